@@ -0,0 +1,536 @@
+#ifndef ACTIVITYMASK_HPP_
+#define ACTIVITYMASK_HPP_
+
+#include "src/iterators/FieldIterator.hpp"
+#include "src/utils/BoundaryId.hpp"
+#include "src/utils/Math.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+namespace Haparanda {
+namespace Grid {
+
+	/**
+	 * Record of which parts of a value array are negligible, so that
+	 * operators can skip them. The array is divided into tiles of
+	 * tileSize^DIMENSIONALITY elements (smaller at the upper boundaries if
+	 * tileSize does not divide elementsPerDim), and a tile is significant if
+	 * the largest absolute value in it exceeds the threshold.
+	 *
+	 * Operators keep the mask of their result up to date while writing it,
+	 * so that it describes the input of the next application. The mask must
+	 * be initialized with update before the first application.
+	 *
+	 * A tile is active if a significant tile is within the reach of the
+	 * operator, i.e. if the result in the tile may be significant, and an
+	 * operator writes zeros in the other tiles instead of computing them. It
+	 * only writes them if the tile is not known to be zero already.
+	 *
+	 * The mask also packs the boundary data sent to the neighbors, so that
+	 * only the significant face tiles are sent: The message starts with one
+	 * flag per face tile, followed by the values of the significant tiles.
+	 * If no tile is significant, the message is empty. Which face tile each
+	 * boundary element belongs to is found when the mask is created, so that
+	 * the threads can pack and unpack the tiles independently.
+	 *
+	 * @tparam DIMENSIONALITY Dimensionality of the value array
+	 */
+	template <std::size_t DIMENSIONALITY>
+	class ActivityMask
+	{
+	public:
+		/**
+		 * Create a mask where all tiles are significant and active.
+		 *
+		 * @param elementsPerDim Number of elements of the array along each dimension
+		 * @param tileSize Number of elements of a tile along each dimension
+		 * @param threshold Largest absolute value considered negligible
+		 */
+		ActivityMask(std::size_t elementsPerDim, std::size_t tileSize, double threshold);
+
+		virtual ~ActivityMask();
+
+		/**
+		 * Decide which tiles are active, i.e. have a significant tile within
+		 * the specified distance along any dimension.
+		 *
+		 * @param reach Number of elements an operator reaches along each dimension
+		 */
+		void computeActive(std::size_t reach);
+
+		/**
+		 * @param dim Dimension of the boundary
+		 * @param extent Width of the boundary data
+		 * @return Max number of elements of a packed message with boundary data along the specified dimension
+		 */
+		std::size_t getMaxPackedCount(std::size_t dim, std::size_t extent) const;
+
+		/**
+		 * @return Total number of tiles
+		 */
+		std::size_t getNumTiles() const;
+
+		/**
+		 * @return The largest absolute value considered negligible
+		 */
+		double getThreshold() const;
+
+		/**
+		 * @return Number of elements of a tile along each dimension
+		 */
+		std::size_t getTileSize() const;
+
+		/**
+		 * @param tile Index of a tile
+		 * @return True if the tile is active (according to the last call to computeActive)
+		 */
+		bool isActive(std::size_t tile) const;
+
+		/**
+		 * @param tile Index of a tile
+		 * @return True if the tile is significant
+		 */
+		bool isSignificant(std::size_t tile) const;
+
+		/**
+		 * @param iterator Iterator over the value array
+		 * @param dim A dimension
+		 * @param first Offset along the dimension from the current element of the iterator
+		 * @param last Offset not below first
+		 * @return True if any tile of the elements between the offsets (inclusive, within the array) is significant
+		 */
+		bool isSignificantAlong(const Iterators::FieldIterator<DIMENSIONALITY>& iterator, std::size_t dim, int first,
+				int last) const;
+
+		/**
+		 * @param boundary A boundary of the value array
+		 * @param width Distance from the boundary
+		 * @return True if any tile within the specified distance from the boundary is significant
+		 */
+		bool isSignificantNear(const BoundaryId& boundary, std::size_t width) const;
+
+		/**
+		 * @param tile Index of a tile
+		 * @return True if all values of the tile are known to be zero
+		 */
+		bool isZero(std::size_t tile) const;
+
+		/**
+		 * Let all tiles within the specified distance from a boundary be
+		 * significant and not known to be zero, e.g. after an operator has
+		 * added values there without keeping track of them.
+		 *
+		 * @param boundary A boundary of the value array
+		 * @param width Distance from the boundary
+		 */
+		void markSignificantNear(const BoundaryId& boundary, std::size_t width);
+
+		/**
+		 * Let each tile be significant if its value in maxima exceeds the
+		 * threshold or it is significant already. Operators call this with
+		 * the largest absolute values they write, per thread.
+		 *
+		 * @param maxima Largest absolute value of each tile
+		 */
+		void mergeMaxima(const std::vector<double>& maxima);
+
+		/**
+		 * @return Number of active tiles
+		 */
+		std::size_t numActiveTiles() const;
+
+		/**
+		 * Copy the significant tiles of the boundary data along the specified
+		 * dimension to a buffer, preceded by one flag per face tile.
+		 *
+		 * @param values The value array
+		 * @param dim Dimension of the boundary
+		 * @param startIndex Index of the first element of the boundary data
+		 * @param extent Width of the boundary data
+		 * @param buffer Array of at least getMaxPackedCount(dim, extent) elements
+		 * @return Number of elements written to the buffer, 0 if no tile is significant
+		 */
+		std::size_t packBoundaryData(const double *values, std::size_t dim, std::size_t startIndex, std::size_t extent,
+				double *buffer) const;
+
+		/**
+		 * Mark all tiles as not significant, before an operator writes a new
+		 * result.
+		 */
+		void resetMaxima();
+
+		/**
+		 * @param tile Index of a tile
+		 * @param zero True if all values of the tile are known to be zero
+		 */
+		void setZero(std::size_t tile, bool zero);
+
+		/**
+		 * @param iterator Iterator over the value array
+		 * @return Index of the tile of the current element of the iterator
+		 */
+		std::size_t tileOf(const Iterators::FieldIterator<DIMENSIONALITY>& iterator) const;
+
+		/**
+		 * @return Number of tiles along each dimension
+		 */
+		std::size_t tilesPerDim() const;
+
+		/**
+		 * Copy the boundary data packed by packBoundaryData into a ghost
+		 * region, with zeros in the tiles which were not sent.
+		 *
+		 * @param buffer Packed boundary data
+		 * @param count Number of elements of the packed boundary data
+		 * @param dim Dimension of the boundary
+		 * @param extent Width of the ghost region
+		 * @param ghostValues Values of the ghost region
+		 */
+		void unpackBoundaryData(const double *buffer, std::size_t count, std::size_t dim, std::size_t extent,
+				double *ghostValues) const;
+
+		/**
+		 * Compute which tiles are significant from the values of the array.
+		 *
+		 * @param values The value array
+		 */
+		void update(const double *values);
+
+	private:
+		std::size_t elementsPerDim;
+		std::size_t tileSize;
+		double threshold;
+		std::size_t numTilesPerDim;
+		std::size_t numTiles;
+		std::vector<char> significant;
+		std::vector<char> active;
+		std::vector<char> zero;
+		/* The points of the face along each dimension (the boundary data of
+		 * extent 1), grouped by face tile and in order within each tile. */
+		std::vector<std::size_t> faceTileStart[DIMENSIONALITY];	// Index of the first point of each face tile, followed by the number of points
+		std::vector<std::size_t> faceLow[DIMENSIONALITY];	// Index of each point in the dimensions below the face dimension
+		std::vector<std::size_t> faceHigh[DIMENSIONALITY];	// Index of each point in the dimensions above it, times the stride of the face dimension
+
+		/**
+		 * @param tile Index of a tile
+		 * @param boundary A boundary of the value array
+		 * @param width Distance from the boundary
+		 * @return True if the tile contains elements within the specified distance from the boundary
+		 */
+		bool isNear(std::size_t tile, const BoundaryId& boundary, std::size_t width) const;
+
+		/**
+		 * Group the points of the face along each dimension by face tile, so
+		 * that the boundary data can be packed and unpacked tile by tile.
+		 */
+		void initializeFaceTiles();
+	};
+
+	template <std::size_t DIMENSIONALITY>
+	ActivityMask<DIMENSIONALITY>::ActivityMask(std::size_t elementsPerDim, std::size_t tileSize, double threshold) {
+		this->elementsPerDim = elementsPerDim;
+		this->tileSize = tileSize;
+		this->threshold = threshold;
+		numTilesPerDim = (elementsPerDim + tileSize - 1) / tileSize;
+		numTiles = 1;
+		for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+			numTiles *= numTilesPerDim;
+		}
+		significant.assign(numTiles, true);
+		active.assign(numTiles, true);
+		zero.assign(numTiles, false);
+		initializeFaceTiles();
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	ActivityMask<DIMENSIONALITY>::~ActivityMask() {
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	void ActivityMask<DIMENSIONALITY>::computeActive(std::size_t reach) {
+		// The operator reaches along one dimension at the time
+		std::size_t tileReach = (reach + tileSize - 1) / tileSize;
+		for (std::size_t t=0; t<numTiles; t++) {
+			active[t] = significant[t];
+			std::size_t stride = 1;
+			for (std::size_t d=0; d<DIMENSIONALITY && !active[t]; d++) {
+				std::size_t coordinate = t / stride % numTilesPerDim;
+				std::size_t lowest = coordinate >= tileReach ? coordinate - tileReach : 0;
+				std::size_t highest = std::min(coordinate + tileReach, numTilesPerDim - 1);
+				for (std::size_t c=lowest; c<=highest && !active[t]; c++) {
+					active[t] = significant[t + (c - coordinate) * stride];
+				}
+				stride *= numTilesPerDim;
+			}
+		}
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	std::size_t ActivityMask<DIMENSIONALITY>::getMaxPackedCount(std::size_t dim, std::size_t extent) const {
+		std::size_t numFaceTiles = 1;
+		std::size_t numElements = extent;
+		for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+			if (d != dim) {
+				numFaceTiles *= numTilesPerDim;
+				numElements *= elementsPerDim;
+			}
+		}
+		return numFaceTiles + numElements;
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	inline std::size_t ActivityMask<DIMENSIONALITY>::getNumTiles() const {
+		return numTiles;
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	inline double ActivityMask<DIMENSIONALITY>::getThreshold() const {
+		return threshold;
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	inline std::size_t ActivityMask<DIMENSIONALITY>::getTileSize() const {
+		return tileSize;
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	inline bool ActivityMask<DIMENSIONALITY>::isActive(std::size_t tile) const {
+		return active[tile];
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	inline bool ActivityMask<DIMENSIONALITY>::isSignificant(std::size_t tile) const {
+		return significant[tile];
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	inline bool ActivityMask<DIMENSIONALITY>::isZero(std::size_t tile) const {
+		return zero[tile];
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	bool ActivityMask<DIMENSIONALITY>::isSignificantAlong(const Iterators::FieldIterator<DIMENSIONALITY>& iterator,
+			std::size_t dim, int first, int last) const {
+		long index = iterator.currentIndex(dim);
+		std::size_t lowest = std::max(index + first, 0L) / tileSize;
+		std::size_t highest = std::min(index + last, static_cast<long>(elementsPerDim) - 1) / tileSize;
+		std::size_t stride = Math::power(numTilesPerDim, dim);
+		// The tile of the current element, with coordinate 0 along dim
+		std::size_t base = tileOf(iterator) - index / tileSize * stride;
+		for (std::size_t c=lowest; c<=highest; c++) {
+			if (significant[base + c * stride]) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	bool ActivityMask<DIMENSIONALITY>::isSignificantNear(const BoundaryId& boundary, std::size_t width) const {
+		for (std::size_t t=0; t<numTiles; t++) {
+			if (significant[t] && isNear(t, boundary, width)) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	void ActivityMask<DIMENSIONALITY>::markSignificantNear(const BoundaryId& boundary, std::size_t width) {
+		for (std::size_t t=0; t<numTiles; t++) {
+			if (isNear(t, boundary, width)) {
+				significant[t] = true;
+				zero[t] = false;
+			}
+		}
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	void ActivityMask<DIMENSIONALITY>::mergeMaxima(const std::vector<double>& maxima) {
+		for (std::size_t t=0; t<numTiles; t++) {
+			significant[t] = significant[t] || maxima[t] > threshold;
+		}
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	std::size_t ActivityMask<DIMENSIONALITY>::numActiveTiles() const {
+		return std::count(active.begin(), active.end(), true);
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	std::size_t ActivityMask<DIMENSIONALITY>::packBoundaryData(const double *values, std::size_t dim, std::size_t startIndex,
+			std::size_t extent, double *buffer) const {
+		const std::vector<std::size_t>& start = faceTileStart[dim];
+		const std::size_t *low = &faceLow[dim][0];
+		const std::size_t *high = &faceHigh[dim][0];
+		const std::size_t numFaceTiles = start.size() - 1;
+		const std::size_t stride = Math::power(elementsPerDim, dim);
+		const double *source = &values[startIndex];
+		// Find the significant face tiles
+#pragma omp parallel for schedule(static)
+		for (std::size_t f=0; f<numFaceTiles; f++) {
+			double maximum = 0;
+			for (std::size_t k=0; k<extent; k++) {
+				for (std::size_t p=start[f]; p<start[f+1]; p++) {
+					maximum = std::max(maximum, std::abs(source[low[p] + k * stride + elementsPerDim * high[p]]));
+				}
+			}
+			buffer[f] = maximum > threshold ? 1 : 0;
+		}
+		std::vector<std::size_t> offset(numFaceTiles);
+		std::size_t count = numFaceTiles;
+		for (std::size_t f=0; f<numFaceTiles; f++) {
+			offset[f] = count;
+			count += 0 != buffer[f] ? (start[f+1] - start[f]) * extent : 0;
+		}
+		if (numFaceTiles == count) {
+			return 0;
+		}
+		// The values of each significant tile, one layer at the time
+#pragma omp parallel for schedule(static)
+		for (std::size_t f=0; f<numFaceTiles; f++) {
+			if (0 == buffer[f]) {
+				continue;
+			}
+			double *to = &buffer[offset[f]];
+			for (std::size_t k=0; k<extent; k++) {
+				for (std::size_t p=start[f]; p<start[f+1]; p++) {
+					*to++ = source[low[p] + k * stride + elementsPerDim * high[p]];
+				}
+			}
+		}
+		return count;
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	void ActivityMask<DIMENSIONALITY>::resetMaxima() {
+		significant.assign(numTiles, false);
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	inline void ActivityMask<DIMENSIONALITY>::setZero(std::size_t tile, bool zero) {
+		this->zero[tile] = zero;
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	inline std::size_t ActivityMask<DIMENSIONALITY>::tileOf(const Iterators::FieldIterator<DIMENSIONALITY>& iterator) const {
+		std::size_t tile = 0;
+		for (std::size_t d=DIMENSIONALITY; d-- > 0; ) {
+			tile = tile * numTilesPerDim + iterator.currentIndex(d) / tileSize;
+		}
+		return tile;
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	inline std::size_t ActivityMask<DIMENSIONALITY>::tilesPerDim() const {
+		return numTilesPerDim;
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	void ActivityMask<DIMENSIONALITY>::unpackBoundaryData(const double *buffer, std::size_t count, std::size_t dim,
+			std::size_t extent, double *ghostValues) const {
+		const std::vector<std::size_t>& start = faceTileStart[dim];
+		const std::size_t *low = &faceLow[dim][0];
+		const std::size_t *high = &faceHigh[dim][0];
+		const std::size_t numFaceTiles = start.size() - 1;
+		const std::size_t stride = Math::power(elementsPerDim, dim);
+		if (0 == count) {
+			std::fill_n(ghostValues, start[numFaceTiles] * extent, 0.0);
+			return;
+		}
+		std::vector<std::size_t> offset(numFaceTiles);
+		std::size_t next = numFaceTiles;
+		for (std::size_t f=0; f<numFaceTiles; f++) {
+			offset[f] = next;
+			next += 0 != buffer[f] ? (start[f+1] - start[f]) * extent : 0;
+		}
+		// The ghost region is laid out like the boundary data
+#pragma omp parallel for schedule(static)
+		for (std::size_t f=0; f<numFaceTiles; f++) {
+			bool isSignificant = 0 != buffer[f];
+			const double *from = &buffer[offset[f]];
+			for (std::size_t k=0; k<extent; k++) {
+				for (std::size_t p=start[f]; p<start[f+1]; p++) {
+					ghostValues[low[p] + k * stride + extent * high[p]] = isSignificant ? *from++ : 0.0;
+				}
+			}
+		}
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	void ActivityMask<DIMENSIONALITY>::update(const double *values) {
+		std::vector<double> maxima(numTiles, 0);
+		std::size_t numElements = Math::power(elementsPerDim, DIMENSIONALITY);
+		for (std::size_t i=0; i<numElements; i++) {
+			std::size_t tile = 0;
+			std::size_t rest = i;
+			std::size_t tileStride = 1;
+			for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+				tile += rest % elementsPerDim / tileSize * tileStride;
+				rest /= elementsPerDim;
+				tileStride *= numTilesPerDim;
+			}
+			maxima[tile] = std::max(maxima[tile], std::abs(values[i]));
+		}
+		resetMaxima();
+		mergeMaxima(maxima);
+	}
+
+
+	/*** Private methods ***/
+	template <std::size_t DIMENSIONALITY>
+	inline bool ActivityMask<DIMENSIONALITY>::isNear(std::size_t tile, const BoundaryId& boundary, std::size_t width) const {
+		std::size_t dim = boundary.getDimension();
+		std::size_t coordinate = tile / Math::power(numTilesPerDim, dim) % numTilesPerDim;
+		if (boundary.isLowerSide()) {
+			return coordinate * tileSize < width;
+		}
+		return (coordinate + 1) * tileSize + width > elementsPerDim;
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	void ActivityMask<DIMENSIONALITY>::initializeFaceTiles() {
+		const std::size_t numPoints = Math::power(elementsPerDim, DIMENSIONALITY-1);
+		const std::size_t numFaceTiles = Math::power(numTilesPerDim, DIMENSIONALITY-1);
+		std::vector<std::size_t> faceTile(numPoints);
+		for (std::size_t dim=0; dim<DIMENSIONALITY; dim++) {
+			const std::size_t stride = Math::power(elementsPerDim, dim);
+			// Count the points of each face tile
+			std::vector<std::size_t>& start = faceTileStart[dim];
+			start.assign(numFaceTiles + 1, 0);
+			for (std::size_t p=0; p<numPoints; p++) {
+				std::size_t tile = 0;
+				std::size_t rest = p;
+				std::size_t tileStride = 1;
+				for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+					if (d != dim) {
+						tile += rest % elementsPerDim / tileSize * tileStride;
+						rest /= elementsPerDim;
+						tileStride *= numTilesPerDim;
+					}
+				}
+				faceTile[p] = tile;
+				start[tile+1]++;
+			}
+			for (std::size_t f=0; f<numFaceTiles; f++) {
+				start[f+1] += start[f];
+			}
+			// Place the points of each tile in order
+			std::vector<std::size_t> next(start.begin(), start.end() - 1);
+			faceLow[dim].resize(numPoints);
+			faceHigh[dim].resize(numPoints);
+			for (std::size_t p=0; p<numPoints; p++) {
+				std::size_t index = next[faceTile[p]]++;
+				faceLow[dim][index] = p % stride;
+				faceHigh[dim][index] = p / stride * stride;
+			}
+		}
+	}
+
+} /* namespace Grid */
+} /* namespace Haparanda */
+
+#endif /* ACTIVITYMASK_HPP_ */
@@ -0,0 +1,607 @@
+#ifndef AGGREGATEDCOMPOSEDBLOCK_HPP_
+#define AGGREGATEDCOMPOSEDBLOCK_HPP_
+
+#include "ComputationalComposedBlock.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace Haparanda {
+namespace Grid {
+
+	/**
+	 * Computational composed block which sends the boundary data destined for
+	 * other nodes in one aggregated message per pair of nodes, instead of one
+	 * message per pair of neighbors. This pays off when many small blocks on
+	 * one node border blocks on another node, so that the number of messages
+	 * rather than the amount of data limits the exchange.
+	 *
+	 * Every process packs its boundary data destined for other nodes into
+	 * send slots in shared memory, and its ghost regions outside boundaries
+	 * to other nodes are also stored in shared memory. The first process on
+	 * each node (the leader) sends one message to each node bordering it,
+	 * described by a data type which gathers the faces directly from the
+	 * send slots, and receives one message from each of them directly into
+	 * the ghost regions of the processes on its node. Data exchanged with
+	 * neighbors on the same node is sent just as in
+	 * ComputationalComposedBlock.
+	 *
+	 * The processes on a node are synchronized by counters in shared memory:
+	 * The leader does not send before all processes have packed their data,
+	 * and does not receive into ghost regions which are still being read.
+	 * A process learns that a ghost region is initialized from a counter set
+	 * by the leader, which progresses the aggregated messages in
+	 * receiveDoneAt and completes them in finishCommunication. Note that the
+	 * processes on a node must therefore call the communication methods
+	 * equally many times.
+	 *
+	 * The nodes are the ones found by CommunicativeBlock (possibly emulated),
+	 * and each of them must consist of processes that can share memory.
+	 *
+	 * @tparam DIMENSIONALITY Dimensionality of the block
+	 * @tparam INDEX Type of the linear indices of the iterators, see ComputationalComposedBlock
+	 */
+	template <std::size_t DIMENSIONALITY, typename INDEX = std::uint32_t>
+	class AggregatedComposedBlock: public ComputationalComposedBlock<DIMENSIONALITY, INDEX>
+	{
+	public:
+		/**
+		 * Create ghost regions, initialize everything MPI related and plan
+		 * the aggregated messages.
+		 *
+		 * @param elementsPerDim Block size in each dimension
+		 * @param extent Width of ghost regions
+		 */
+		AggregatedComposedBlock(std::size_t elementsPerDim, std::size_t extent);
+
+		/**
+		 * Create ghost regions, initialize everything MPI related and plan
+		 * the aggregated messages. Initialize the block with its values.
+		 *
+		 * @param elementsPerDim Block size in each dimension
+		 * @param extent Width of ghost regions
+		 * @param values Array containing values to be stored in this block
+		 */
+		AggregatedComposedBlock(std::size_t elementsPerDim, std::size_t extent, double *values);
+
+		virtual ~AggregatedComposedBlock();
+
+		/**
+		 * @param dim Dimension of the boundary
+		 * @param side 0 for the lower boundary, 1 for the upper boundary
+		 * @return True if the data exchanged with the neighbor at the specified boundary is part of the aggregated messages
+		 */
+		bool isAggregated(std::size_t dim, std::size_t side) const;
+
+		/**
+		 * Wait for the data to be sent to the neighbors on this node, and
+		 * let the leader complete the aggregated messages.
+		 */
+		virtual void finishCommunication();
+
+		/**
+		 * @return Number of aggregated messages sent from the node of this process in each time step
+		 */
+		std::size_t numAggregatedMessages() const;
+
+		/**
+		 * @throws std::runtime_error If no ghost region is being initialized, i.e. if all have been handed out since the communication started
+		 */
+		virtual void receiveDoneAt(BoundaryId *boundary);
+
+	protected:
+		/**
+		 * Start receiving from the neighbors on this node, and let the leader
+		 * start receiving the aggregated messages. Note that nothing is
+		 * started if values is not set!
+		 */
+		virtual void startReceive();
+
+		/**
+		 * Pack the data destined for other nodes, start sending to the
+		 * neighbors on this node and let the leader send the aggregated
+		 * messages. Note that nothing is sent if values is not set!
+		 */
+		virtual void startSend();
+
+	private:
+		/**
+		 * State of a process, read by the other processes on the same node.
+		 * Each state starts at a cache line of its own.
+		 */
+		struct alignas(64) SharedState {
+			std::atomic<long> packedStep;		// Last time step for which the data to other nodes is packed
+			std::atomic<long> consumedStep;		// Last time step for which the ghost regions have been read
+			std::atomic<long> sentStep;			// Leader only: Last time step for which the aggregated messages are sent
+			std::atomic<long> deliveredStep[2*DIMENSIONALITY];	// Last time step for which each ghost region is initialized
+		};
+
+		/**
+		 * A face in an aggregated message.
+		 */
+		struct Face {
+			int receiverRank;	// Rank of the process whose ghost region the face ends up in
+			int ghostIndex;		// 2*dim + side of that ghost region
+			int localRank;		// Rank on this node of the process sending or receiving the face
+			int slot;			// Index of the face among the send slots or ghost regions of that process
+
+			bool operator<(const Face& other) const {
+				return receiverRank < other.receiverRank
+						|| (receiverRank == other.receiverRank && ghostIndex < other.ghostIndex);
+			}
+		};
+
+		MPI_Comm nodeCommunicator;
+		MPI_Win slotWindow;
+		MPI_Win ghostWindow;
+		MPI_Win stateWindow;
+		double *sendSlots;				// Slot 2*dim + side holds the boundary data sent to that neighbor
+		SharedState *state;				// The state of this process
+		SharedState *leaderState;
+		bool leader;					// True if this process is the leader of its node, i.e. has rank 0 on it
+		bool received[DIMENSIONALITY][2];	// True if the boundary has been handed out by receiveDoneAt
+		long step;						// Current time step, i.e. number of calls to startCommunication
+		// Members used by the leader only
+		std::vector<SharedState *> localStates;		// The states of all processes on this node
+		std::vector<int> sendLeaders;				// Leaders of the nodes to which aggregated messages are sent
+		std::vector<MPI_Datatype> sendTypes;		// Faces of each sent message, relative to MPI_BOTTOM
+		std::vector<int> receiveLeaders;			// Leaders of the nodes from which aggregated messages are received
+		std::vector<MPI_Datatype> receiveTypes;		// Ghost regions of each received message, relative to MPI_BOTTOM
+		std::vector<std::vector<Face> > deliveries;	// Ghost regions initialized by each received message
+		std::vector<MPI_Request> aggregateRequests;	// Receives followed by sends
+		std::size_t numAggregatesPending;			// Number of receives not yet completed
+		std::size_t numMessages;					// Number of aggregated messages sent from this node in each time step
+		/* Each face sent or received is described to the leader by the node
+		 * at the other end (-1 if the face is not aggregated), the rank of
+		 * the receiving process and the index of its ghost region. */
+		static const std::size_t FACE_INFO_SIZE = 3;
+
+		/**
+		 * Allocate the shared memory and, on the leader, plan the aggregated
+		 * messages.
+		 */
+		void initializeAggregation();
+
+		/**
+		 * @param stateMemory Memory allocated for a state, at least one cache line larger than the state
+		 * @return Pointer to the first address in stateMemory which is suitably aligned for a state
+		 */
+		static SharedState *alignState(void *stateMemory);
+
+		/**
+		 * Let the leader tell the processes on this node about the completed
+		 * aggregated receives.
+		 *
+		 * @param wait If true, wait for all receives to complete, otherwise only check which have completed
+		 */
+		void deliverAggregates(bool wait);
+
+		/**
+		 * Plan the aggregated messages sent from and received by this node.
+		 * Only done by the leader.
+		 *
+		 * @param allFaceInfo Description of the faces sent and received by each process on this node, FACE_INFO_SIZE integers per face
+		 * @param leaderNodes Node index of each process which is a leader, -1 for the other processes
+		 * @param nodeSize Number of processes on this node
+		 */
+		void planAggregates(const std::vector<int>& allFaceInfo, const std::vector<int>& leaderNodes, int nodeSize);
+
+		/**
+		 * @return True if this process is the leader of its node
+		 */
+		bool isLeader() const;
+
+		/**
+		 * Create a data type which describes the specified faces, at absolute
+		 * addresses.
+		 *
+		 * @param faces Faces in the order they appear in the message
+		 * @param memory Start of the memory of the slots or ghost regions of each process on this node
+		 * @return Committed data type
+		 */
+		MPI_Datatype createAggregateType(const std::vector<Face>& faces, const std::vector<double *>& memory) const;
+	};
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	AggregatedComposedBlock<DIMENSIONALITY, INDEX>::AggregatedComposedBlock(std::size_t elementsPerDim, std::size_t extent)
+	: ComputationalComposedBlock<DIMENSIONALITY, INDEX>(elementsPerDim, extent) {
+		initializeAggregation();
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	AggregatedComposedBlock<DIMENSIONALITY, INDEX>::AggregatedComposedBlock(std::size_t elementsPerDim, std::size_t extent, double *values)
+	: ComputationalComposedBlock<DIMENSIONALITY, INDEX>(elementsPerDim, extent, values) {
+		initializeAggregation();
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	AggregatedComposedBlock<DIMENSIONALITY, INDEX>::~AggregatedComposedBlock() {
+		// The ghost regions do not delete their values: They are freed with the window
+		for (std::size_t i=0; i<sendTypes.size(); i++) {
+			MPI_Type_free(&sendTypes[i]);
+		}
+		for (std::size_t i=0; i<receiveTypes.size(); i++) {
+			MPI_Type_free(&receiveTypes[i]);
+		}
+		state->~SharedState();
+		MPI_Win_free(&stateWindow);
+		MPI_Win_free(&ghostWindow);
+		MPI_Win_free(&slotWindow);
+		MPI_Comm_free(&nodeCommunicator);
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	inline bool AggregatedComposedBlock<DIMENSIONALITY, INDEX>::isAggregated(std::size_t dim, std::size_t side) const {
+		return !this->isOwnNeighbor(dim) && this->onOtherNode[dim][side];
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	void AggregatedComposedBlock<DIMENSIONALITY, INDEX>::finishCommunication() {
+		HAPARANDA_REGION("finish");
+		this->waitForSends();
+		if (NULL == this->values) {
+			return;
+		}
+		this->communicationTimer->start();
+		if (isLeader()) {
+			deliverAggregates(true);
+			MPI_Waitall(aggregateRequests.size(), aggregateRequests.data(), MPI_STATUSES_IGNORE);
+			state->sentStep.store(step, std::memory_order_release);
+		}
+		state->consumedStep.store(step, std::memory_order_release);
+		this->communicationTimer->stop();
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	inline std::size_t AggregatedComposedBlock<DIMENSIONALITY, INDEX>::numAggregatedMessages() const {
+		return numMessages;
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	void AggregatedComposedBlock<DIMENSIONALITY, INDEX>::receiveDoneAt(BoundaryId *boundary) {
+		this->communicationTimer->start();
+		if (this->ownBoundariesDone < 2*this->numOwnNeighborDims) {
+			// Initialized already by startSend
+			boundary->setDimension(this->ownNeighborDims[this->ownBoundariesDone/2]);
+			boundary->setIsLowerSide(0==this->ownBoundariesDone%2);
+			this->ownBoundariesDone++;
+			this->communicationTimer->stop();
+			return;
+		}
+		bool anyPending = false;
+		for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+			anyPending = anyPending || (!this->isOwnNeighbor(d) && (!received[d][0] || !received[d][1]));
+		}
+		if (!anyPending) {
+			// Nothing would ever be done
+			this->communicationTimer->stop();
+			throw std::runtime_error("No ghost region is being initialized");
+		}
+		while (true) {
+			if (isLeader()) {
+				deliverAggregates(false);
+			}
+			// Ghost regions initialized by aggregated messages
+			for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+				for (std::size_t j=0; j<2; j++) {
+					if (!isAggregated(d, j) || received[d][j]
+							|| state->deliveredStep[2*d+j].load(std::memory_order_acquire) < step) {
+						continue;
+					}
+					HAPARANDA_EVENT("received", d, j);
+					received[d][j] = true;
+					boundary->setDimension(d);
+					boundary->setIsLowerSide(0==j);
+					this->communicationTimer->stop();
+					return;
+				}
+			}
+			// Neighbors on this node
+			int index;
+			if (MPI::Request::Testany(2*DIMENSIONALITY, this->receiveRequest, index) && MPI::UNDEFINED != index) {
+				HAPARANDA_EVENT("received", index/2, 1-index%2);
+				boundary->setDimension(index/2);
+				boundary->setIsLowerSide(1==index%2);
+				received[index/2][1-index%2] = true;
+				this->communicationTimer->stop();
+				return;
+			}
+			std::this_thread::yield();
+		}
+	}
+
+
+	/*** Protected methods ***/
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	void AggregatedComposedBlock<DIMENSIONALITY, INDEX>::startReceive() {
+		if (NULL == this->values) {
+			return;
+		}
+		step++;
+		this->ownBoundariesDone = 0;
+		for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+			for (std::size_t j=0; j<2; j++) {
+				received[d][j] = false;
+				// Same numbering as in ComputationalComposedBlock: Odd indices for the lower ghost regions
+				std::size_t index = 2*d + 1 - j;
+				if (this->isOwnNeighbor(d) || isAggregated(d, j)) {
+					this->receiveRequest[index] = MPI::Prequest();
+				} else {
+					this->receiveRequest[index] = this->ghostRegions[d][j]->initializeReceive(
+							this->communicator, this->neighborRank[d][j]);
+					this->receiveRequest[index].Start();
+				}
+			}
+		}
+		if (isLeader()) {
+			// The ghost regions of the previous time step must not be overwritten while they are read
+			for (std::size_t p=0; p<localStates.size(); p++) {
+				while (localStates[p]->consumedStep.load(std::memory_order_acquire) < step-1) {
+					std::this_thread::yield();
+				}
+			}
+			aggregateRequests.resize(receiveLeaders.size() + sendLeaders.size());
+			for (std::size_t i=0; i<receiveLeaders.size(); i++) {
+				MPI_Irecv(MPI_BOTTOM, 1, receiveTypes[i], receiveLeaders[i], 2*DIMENSIONALITY,
+						this->communicator, &aggregateRequests[i]);
+			}
+			numAggregatesPending = receiveLeaders.size();
+		}
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	void AggregatedComposedBlock<DIMENSIONALITY, INDEX>::startSend() {
+		if (NULL == this->values) {
+			return;
+		}
+		this->communicationTimer->start();
+		// The send slots of the previous time step must not be overwritten while they are sent
+		while (leaderState->sentStep.load(std::memory_order_acquire) < step-1) {
+			std::this_thread::yield();
+		}
+		std::size_t faceSize = this->sendCount();
+		for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+			std::size_t stride = Math::power(this->elementsPerDim, d);
+			for (std::size_t j=0; j<2; j++) {
+				if (isAggregated(d, j)) {
+					std::size_t startIndex = 0==j ? 0 : (this->elementsPerDim - this->extent) * stride;
+					this->copyBoundaryData(d, startIndex, &sendSlots[(2*d+j) * faceSize]);
+					this->countSentData(d, j, faceSize, MPI::DOUBLE);
+				}
+			}
+		}
+		state->packedStep.store(step, std::memory_order_release);
+		for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+			if (this->isOwnNeighbor(d)) {
+				this->copyOwnBoundaryData(d);
+			}
+			for (std::size_t j=0; j<2; j++) {
+				if (this->isOwnNeighbor(d) || isAggregated(d, j)) {
+					this->sendRequest[2*d+j] = MPI::Request();
+				} else {
+					int count;
+					MPI::Datatype type;
+					double *data = this->prepareSendData(d, j, &count, &type);
+					this->countSentData(d, j, count, type);
+					this->sendRequest[2*d+j] = this->communicator.Isend(data, count, type,
+							this->neighborRank[d][j], 2*d+j);
+				}
+			}
+		}
+		if (isLeader()) {
+			for (std::size_t p=0; p<localStates.size(); p++) {
+				while (localStates[p]->packedStep.load(std::memory_order_acquire) < step) {
+					std::this_thread::yield();
+				}
+			}
+			std::size_t offset = receiveLeaders.size();
+			for (std::size_t i=0; i<sendLeaders.size(); i++) {
+				MPI_Isend(MPI_BOTTOM, 1, sendTypes[i], sendLeaders[i], 2*DIMENSIONALITY,
+						this->communicator, &aggregateRequests[offset + i]);
+			}
+		}
+		this->communicationTimer->stop();
+	}
+
+
+	/*** Private methods ***/
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	void AggregatedComposedBlock<DIMENSIONALITY, INDEX>::initializeAggregation() {
+		step = 0;
+		numAggregatesPending = 0;
+		// Nothing is being received before the communication starts
+		for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+			received[d][0] = received[d][1] = true;
+		}
+		this->detectNodes();
+		int rank;
+		MPI_Comm_rank(this->communicator, &rank);
+		MPI_Comm_split(this->communicator, this->nodeIndex, rank, &nodeCommunicator);
+		int localRank, nodeSize;
+		MPI_Comm_rank(nodeCommunicator, &localRank);
+		MPI_Comm_size(nodeCommunicator, &nodeSize);
+		leader = 0 == localRank;
+		MPI_Comm sharingCommunicator;
+		MPI_Comm_split_type(nodeCommunicator, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &sharingCommunicator);
+		int sharingSize;
+		MPI_Comm_size(sharingCommunicator, &sharingSize);
+		MPI_Comm_free(&sharingCommunicator);
+		int allShare = sharingSize == nodeSize;
+		MPI_Allreduce(MPI_IN_PLACE, &allShare, 1, MPI_INT, MPI_LAND, this->communicator);
+		if (!allShare) {
+			throw std::runtime_error("AggregatedComposedBlock: The processes of a node cannot share memory");
+		}
+
+		/* Allocate the send slots, the ghost regions and the state of this
+		 * process in shared memory. */
+		std::size_t faceSize = this->sendCount();
+		MPI_Info info;
+		MPI_Info_create(&info);
+		MPI_Info_set(info, "alloc_shared_noncontig", "true");
+		MPI_Win_allocate_shared(2*DIMENSIONALITY * faceSize * sizeof(double), sizeof(double),
+				info, nodeCommunicator, &sendSlots, &slotWindow);
+		double *ghostMemory;
+		MPI_Win_allocate_shared(2*DIMENSIONALITY * faceSize * sizeof(double), sizeof(double),
+				info, nodeCommunicator, &ghostMemory, &ghostWindow);
+		void *stateMemory;
+		MPI_Win_allocate_shared(sizeof(SharedState) + alignof(SharedState), 1, info, nodeCommunicator,
+				&stateMemory, &stateWindow);
+		MPI_Info_free(&info);
+		for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+			for (std::size_t j=0; j<2; j++) {
+				this->ghostRegions[d][j]->setValues(&ghostMemory[(2*d+j) * faceSize]);
+			}
+		}
+		state = new (alignState(stateMemory)) SharedState();
+		state->packedStep.store(0);
+		state->consumedStep.store(0);
+		state->sentStep.store(0);
+		for (std::size_t i=0; i<2*DIMENSIONALITY; i++) {
+			state->deliveredStep[i].store(0);
+		}
+		MPI_Aint size;
+		int displacementUnit;
+		MPI_Win_shared_query(stateWindow, 0, &size, &displacementUnit, &stateMemory);
+		leaderState = alignState(stateMemory);
+
+		/* Tell the leader where the data of this process is sent, and where
+		 * the data to its ghost regions comes from. */
+		std::vector<int> faceInfo(2 * 2*DIMENSIONALITY * FACE_INFO_SIZE, -1);
+		for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+			for (std::size_t j=0; j<2; j++) {
+				if (isAggregated(d, j)) {
+					int *sent = &faceInfo[(2*d+j) * FACE_INFO_SIZE];
+					sent[0] = this->neighborNode[d][j];
+					sent[1] = this->neighborRank[d][j];
+					sent[2] = 2*d + 1-j;
+					int *received = &faceInfo[(2*DIMENSIONALITY + 2*d+j) * FACE_INFO_SIZE];
+					received[0] = this->neighborNode[d][j];
+					received[1] = rank;
+					received[2] = 2*d + j;
+				}
+			}
+		}
+		std::vector<int> allFaceInfo(isLeader() ? nodeSize * faceInfo.size() : 0);
+		MPI_Gather(faceInfo.data(), faceInfo.size(), MPI_INT, allFaceInfo.data(), faceInfo.size(), MPI_INT,
+				0, nodeCommunicator);
+		// The ranks of the leaders of all nodes
+		int leaderNode = isLeader() ? this->nodeIndex : -1;
+		std::vector<int> leaderNodes(this->communicator.Get_size());
+		MPI_Allgather(&leaderNode, 1, MPI_INT, leaderNodes.data(), 1, MPI_INT, this->communicator);
+		if (isLeader()) {
+			planAggregates(allFaceInfo, leaderNodes, nodeSize);
+		}
+		unsigned long messages = sendLeaders.size();
+		MPI_Bcast(&messages, 1, MPI_UNSIGNED_LONG, 0, nodeCommunicator);
+		numMessages = messages;
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	void AggregatedComposedBlock<DIMENSIONALITY, INDEX>::planAggregates(const std::vector<int>& allFaceInfo,
+			const std::vector<int>& leaderNodes, int nodeSize) {
+		std::map<int, int> leaderOf;
+		for (std::size_t r=0; r<leaderNodes.size(); r++) {
+			if (0 <= leaderNodes[r]) {
+				leaderOf[leaderNodes[r]] = r;
+			}
+		}
+
+		/* Collect the faces of each message. Both the sending and the
+		 * receiving leader order them by receiving rank and ghost region, so
+		 * that they agree on the layout of the message. */
+		MPI_Aint size;
+		int displacementUnit;
+		void *stateMemory;
+		std::vector<double *> localSlots(nodeSize);
+		std::vector<double *> localGhosts(nodeSize);
+		localStates.resize(nodeSize);
+		std::map<int, std::vector<Face> > outgoing, incoming;
+		for (int p=0; p<nodeSize; p++) {
+			MPI_Win_shared_query(slotWindow, p, &size, &displacementUnit, &localSlots[p]);
+			MPI_Win_shared_query(ghostWindow, p, &size, &displacementUnit, &localGhosts[p]);
+			MPI_Win_shared_query(stateWindow, p, &size, &displacementUnit, &stateMemory);
+			localStates[p] = alignState(stateMemory);
+			for (std::size_t i=0; i<2 * 2*DIMENSIONALITY; i++) {
+				const int *info = &allFaceInfo[(p * 2 * 2*DIMENSIONALITY + i) * FACE_INFO_SIZE];
+				if (0 > info[0]) {
+					continue;
+				}
+				Face face = {info[1], info[2], p, static_cast<int>(i % (2*DIMENSIONALITY))};
+				if (i < 2*DIMENSIONALITY) {
+					outgoing[info[0]].push_back(face);
+				} else {
+					incoming[info[0]].push_back(face);
+				}
+			}
+		}
+		for (typename std::map<int, std::vector<Face> >::iterator it=outgoing.begin(); it!=outgoing.end(); it++) {
+			std::sort(it->second.begin(), it->second.end());
+			sendLeaders.push_back(leaderOf[it->first]);
+			sendTypes.push_back(createAggregateType(it->second, localSlots));
+		}
+		for (typename std::map<int, std::vector<Face> >::iterator it=incoming.begin(); it!=incoming.end(); it++) {
+			std::sort(it->second.begin(), it->second.end());
+			receiveLeaders.push_back(leaderOf[it->first]);
+			receiveTypes.push_back(createAggregateType(it->second, localGhosts));
+			deliveries.push_back(it->second);
+		}
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	inline typename AggregatedComposedBlock<DIMENSIONALITY, INDEX>::SharedState *
+	AggregatedComposedBlock<DIMENSIONALITY, INDEX>::alignState(void *stateMemory) {
+		std::uintptr_t address = reinterpret_cast<std::uintptr_t>(stateMemory);
+		std::uintptr_t alignment = alignof(SharedState);
+		return reinterpret_cast<SharedState *>((address + alignment - 1) / alignment * alignment);
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	void AggregatedComposedBlock<DIMENSIONALITY, INDEX>::deliverAggregates(bool wait) {
+		while (0 < numAggregatesPending) {
+			int index;
+			int done;
+			if (wait) {
+				MPI_Waitany(receiveLeaders.size(), aggregateRequests.data(), &index, MPI_STATUS_IGNORE);
+			} else {
+				MPI_Testany(receiveLeaders.size(), aggregateRequests.data(), &index, &done, MPI_STATUS_IGNORE);
+				if (!done) {
+					return;
+				}
+			}
+			numAggregatesPending--;
+			const std::vector<Face>& faces = deliveries[index];
+			for (std::size_t i=0; i<faces.size(); i++) {
+				localStates[faces[i].localRank]->deliveredStep[faces[i].slot].store(step, std::memory_order_release);
+			}
+		}
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	inline bool AggregatedComposedBlock<DIMENSIONALITY, INDEX>::isLeader() const {
+		return leader;
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	MPI_Datatype AggregatedComposedBlock<DIMENSIONALITY, INDEX>::createAggregateType(const std::vector<Face>& faces,
+			const std::vector<double *>& memory) const {
+		std::size_t faceSize = this->sendCount();
+		std::vector<int> lengths(faces.size(), faceSize);
+		std::vector<MPI_Aint> addresses(faces.size());
+		for (std::size_t i=0; i<faces.size(); i++) {
+			MPI_Get_address(&memory[faces[i].localRank][faces[i].slot * faceSize], &addresses[i]);
+		}
+		MPI_Datatype type;
+		MPI_Type_create_hindexed(faces.size(), lengths.data(), addresses.data(), MPI_DOUBLE, &type);
+		MPI_Type_commit(&type);
+		return type;
+	}
+
+} /* namespace Grid */
+} /* namespace Haparanda */
+
+#endif /* AGGREGATEDCOMPOSEDBLOCK_HPP_ */
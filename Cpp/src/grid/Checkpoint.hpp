@@ -0,0 +1,402 @@
+#ifndef CHECKPOINT_HPP_
+#define CHECKPOINT_HPP_
+
+#include "CommunicativeBlock.hpp"
+#include "src/utils/Math.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <mpi.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace Haparanda {
+namespace Grid {
+
+	/**
+	 * Checkpoint of the values of the blocks of all processes, in a single
+	 * file. The file starts with a header of HEADER_SIZE bytes describing the
+	 * content (as 64-bit words):
+	 *
+	 * 0. MAGIC, which also reveals if the file was written with another byte order
+	 * 1. VERSION of the format
+	 * 2. HEADER_SIZE
+	 * 3. Dimensionality D
+	 * 4. Number of elements of each block along each dimension
+	 * 5. Time step at which the checkpoint was written
+	 * 6. Size of each value in bytes
+	 * 7. ... 7+D-1. Size of the processor grid along each dimension
+	 *
+	 * The header is followed by the values of the blocks, one block after
+	 * the other, ordered by their coordinates in the processor grid with
+	 * dimension 0 varying fastest. The values of a block are stored as in
+	 * memory. The blocks are written collectively, each process
+	 * describing its block as a subarray of the array of blocks.
+	 *
+	 * Since the header fills whole pages and each block is contiguous, a
+	 * process can map its block into memory directly on restart if the
+	 * decomposition is the same as when the checkpoint was written. If it
+	 * is not, the processes collectively read the parts of the old blocks
+	 * overlapping their new ones, directly into place, which works as long
+	 * as the global grid is the same.
+	 *
+	 * @tparam DIMENSIONALITY Dimensionality of the blocks
+	 */
+	template <std::size_t DIMENSIONALITY>
+	class Checkpoint
+	{
+	public:
+		static const std::uint64_t MAGIC = 0x3154504b43504148ull;	// "HAPCKPT1" in little endian byte order
+		static const std::uint64_t VERSION = 1;
+		static const std::size_t HEADER_SIZE = 4096;
+
+		/**
+		 * Read the header of a checkpoint. This is collective over the
+		 * communicator.
+		 *
+		 * @param fileName Path to the checkpoint file
+		 * @param communicator Communicator containing all processes which will restart from the checkpoint
+		 */
+		Checkpoint(const std::string& fileName, const MPI::Intracomm& communicator);
+
+		/**
+		 * Unmap all memory mapped by map.
+		 */
+		virtual ~Checkpoint();
+
+		/**
+		 * @return Number of elements of each block along each dimension when the checkpoint was written
+		 */
+		std::size_t getElementsPerDim() const;
+
+		/**
+		 * @param dim Specified dimension (See return value.)
+		 * @return Number of processes along the specified dimension when the checkpoint was written
+		 */
+		std::size_t getProcGridSize(std::size_t dim) const;
+
+		/**
+		 * @return The time step at which the checkpoint was written
+		 */
+		std::size_t getStep() const;
+
+		/**
+		 * Map the values of the specified block into memory, without
+		 * reading them. The memory is private to this process, so it can be
+		 * modified, e.g. by letting the block use it as its values. It is
+		 * valid until this checkpoint is deleted.
+		 *
+		 * @param block A block of the same size and position as a block in the checkpoint
+		 * @return The mapped values of the block
+		 */
+		double *map(const CommunicativeBlock<DIMENSIONALITY>& block);
+
+		/**
+		 * @param block A block
+		 * @return True if the block has the same size and position in the same processor grid as a block in the checkpoint, so that it can be mapped
+		 */
+		bool matches(const CommunicativeBlock<DIMENSIONALITY>& block) const;
+
+		/**
+		 * Initialize the values of a block from the checkpoint. If the block
+		 * matches one in the checkpoint, its values are copied from mapped
+		 * memory. Otherwise, the checkpoint is redistributed by collective
+		 * reads, so then all processes must call this method.
+		 *
+		 * @param block A block in a grid of the same global size as the one in the checkpoint
+		 * @param values Array to which the values of the block are written
+		 */
+		void restore(const CommunicativeBlock<DIMENSIONALITY>& block, double *values);
+
+		/**
+		 * Write the values of the blocks of all processes to a checkpoint
+		 * file. This is collective over the communicator of the blocks.
+		 *
+		 * @param fileName Path to the checkpoint file, which is overwritten if it exists
+		 * @param block The block of this process
+		 * @param values Values of the block
+		 * @param step Current time step
+		 */
+		static void write(const std::string& fileName, const CommunicativeBlock<DIMENSIONALITY>& block,
+				const double *values, std::size_t step);
+
+	private:
+		std::string fileName;
+		std::size_t elementsPerDim;
+		std::size_t step;
+		std::size_t procGridSize[DIMENSIONALITY];
+		std::vector<std::pair<void *, std::size_t> > mappings;	// Start and length of each mapped region
+
+		/**
+		 * Create the data type describing the specified box of blocks of an
+		 * array of blocks.
+		 *
+		 * @param numBlocks Number of blocks of the array along each dimension
+		 * @param start Coordinates of the first block of the box
+		 * @param size Number of blocks of the box along each dimension
+		 * @param elementsPerDim Number of elements of each block along each dimension
+		 * @return The committed data type. The caller must free it.
+		 */
+		static MPI::Datatype createBlockBoxType(const int *numBlocks, const int *start, const int *size,
+				std::size_t elementsPerDim);
+
+		/**
+		 * Read the parts of the old blocks overlapping the specified block
+		 * from the checkpoint. The file view consists of one subarray of each
+		 * old block, and the values are read through matching subarrays of
+		 * the new block, so nothing else is read or buffered.
+		 *
+		 * @param block A block in a grid of the same global size as the one in the checkpoint
+		 * @param values Array to which the values of the block are written
+		 */
+		void redistribute(const CommunicativeBlock<DIMENSIONALITY>& block, double *values);
+	};
+
+	template <std::size_t DIMENSIONALITY>
+	const std::uint64_t Checkpoint<DIMENSIONALITY>::MAGIC;
+
+	template <std::size_t DIMENSIONALITY>
+	const std::uint64_t Checkpoint<DIMENSIONALITY>::VERSION;
+
+	template <std::size_t DIMENSIONALITY>
+	const std::size_t Checkpoint<DIMENSIONALITY>::HEADER_SIZE;
+
+	template <std::size_t DIMENSIONALITY>
+	Checkpoint<DIMENSIONALITY>::Checkpoint(const std::string& fileName, const MPI::Intracomm& communicator) {
+		this->fileName = fileName;
+		std::vector<std::uint64_t> header(HEADER_SIZE / sizeof(std::uint64_t), 0);
+		int ok = 1;
+		if (0 == communicator.Get_rank()) {
+			int fd = open(fileName.c_str(), O_RDONLY);
+			ok = -1 != fd && HEADER_SIZE == static_cast<std::size_t>(pread(fd, &header[0], HEADER_SIZE, 0));
+			if (-1 != fd) {
+				close(fd);
+			}
+		}
+		communicator.Bcast(&ok, 1, MPI::INT, 0);
+		if (!ok) {
+			throw std::runtime_error("Cannot read checkpoint " + fileName);
+		}
+		communicator.Bcast(&header[0], header.size(), MPI::UNSIGNED_LONG_LONG, 0);
+		if (MAGIC != header[0] || VERSION != header[1] || HEADER_SIZE != header[2]) {
+			throw std::runtime_error(fileName + " is not a checkpoint of this version and byte order");
+		}
+		if (DIMENSIONALITY != header[3] || sizeof(double) != header[6]) {
+			throw std::runtime_error(fileName + " is a checkpoint of another dimensionality or value type");
+		}
+		elementsPerDim = header[4];
+		step = header[5];
+		for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+			procGridSize[d] = header[7+d];
+		}
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	Checkpoint<DIMENSIONALITY>::~Checkpoint() {
+		for (std::size_t i=0; i<mappings.size(); i++) {
+			munmap(mappings[i].first, mappings[i].second);
+		}
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	inline std::size_t Checkpoint<DIMENSIONALITY>::getElementsPerDim() const {
+		return elementsPerDim;
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	inline std::size_t Checkpoint<DIMENSIONALITY>::getProcGridSize(std::size_t dim) const {
+		return procGridSize[dim];
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	inline std::size_t Checkpoint<DIMENSIONALITY>::getStep() const {
+		return step;
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	double *Checkpoint<DIMENSIONALITY>::map(const CommunicativeBlock<DIMENSIONALITY>& block) {
+		if (!matches(block)) {
+			throw std::runtime_error("The block does not match any block of checkpoint " + fileName);
+		}
+		std::size_t blockIndex = 0;
+		for (std::size_t d=DIMENSIONALITY; d-- > 0; ) {
+			blockIndex = blockIndex * procGridSize[d] + block.procGridCoord(d);
+		}
+		std::size_t blockBytes = Math::power(elementsPerDim, DIMENSIONALITY) * sizeof(double);
+		std::size_t offset = HEADER_SIZE + blockIndex * blockBytes;
+		// The mapping must start at a page boundary
+		std::size_t pageSize = sysconf(_SC_PAGESIZE);
+		std::size_t alignedOffset = offset / pageSize * pageSize;
+		std::size_t length = blockBytes + offset - alignedOffset;
+		int fd = open(fileName.c_str(), O_RDONLY);
+		if (-1 == fd) {
+			throw std::runtime_error("Cannot open checkpoint " + fileName);
+		}
+		void *start = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, alignedOffset);
+		close(fd);
+		if (MAP_FAILED == start) {
+			throw std::runtime_error("Cannot map checkpoint " + fileName);
+		}
+		mappings.push_back(std::make_pair(start, length));
+		return reinterpret_cast<double *>(static_cast<char *>(start) + offset - alignedOffset);
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	bool Checkpoint<DIMENSIONALITY>::matches(const CommunicativeBlock<DIMENSIONALITY>& block) const {
+		if (block.getElementsPerDim() != elementsPerDim) {
+			return false;
+		}
+		for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+			if (static_cast<std::size_t>(block.procGridSize(d)) != procGridSize[d]) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	void Checkpoint<DIMENSIONALITY>::restore(const CommunicativeBlock<DIMENSIONALITY>& block, double *values) {
+		if (!matches(block)) {
+			redistribute(block, values);
+			return;
+		}
+		std::size_t numElements = Math::power(elementsPerDim, DIMENSIONALITY);
+		const double *mapped = map(block);
+		// Let all threads fault in the pages
+#pragma omp parallel for simd schedule(static)
+		for (std::size_t i=0; i<numElements; i++) {
+			values[i] = mapped[i];
+		}
+		munmap(mappings.back().first, mappings.back().second);
+		mappings.pop_back();
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	void Checkpoint<DIMENSIONALITY>::write(const std::string& fileName, const CommunicativeBlock<DIMENSIONALITY>& block,
+			const double *values, std::size_t step) {
+		const MPI::Cartcomm& communicator = block.getCommunicator();
+		int numBlocks[DIMENSIONALITY];
+		int coordinates[DIMENSIONALITY];
+		int size[DIMENSIONALITY];
+		for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+			numBlocks[d] = block.procGridSize(d);
+			coordinates[d] = block.procGridCoord(d);
+			size[d] = 1;
+		}
+		std::size_t numElements = Math::power(block.getElementsPerDim(), DIMENSIONALITY);
+		MPI::File file = MPI::File::Open(communicator, fileName.c_str(), MPI::MODE_CREATE | MPI::MODE_WRONLY, MPI::INFO_NULL);
+		// Cut off what is left of an old file
+		std::size_t totalNumBlocks = 1;
+		for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+			totalNumBlocks *= numBlocks[d];
+		}
+		file.Set_size(HEADER_SIZE + totalNumBlocks * numElements * sizeof(double));
+		if (0 == communicator.Get_rank()) {
+			std::vector<std::uint64_t> header(HEADER_SIZE / sizeof(std::uint64_t), 0);
+			header[0] = MAGIC;
+			header[1] = VERSION;
+			header[2] = HEADER_SIZE;
+			header[3] = DIMENSIONALITY;
+			header[4] = block.getElementsPerDim();
+			header[5] = step;
+			header[6] = sizeof(double);
+			for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+				header[7+d] = numBlocks[d];
+			}
+			file.Write_at(0, &header[0], header.size(), MPI::UNSIGNED_LONG_LONG);
+		}
+		MPI::Datatype fileType = createBlockBoxType(numBlocks, coordinates, size, block.getElementsPerDim());
+		file.Set_view(HEADER_SIZE, MPI::DOUBLE, fileType, "native", MPI::INFO_NULL);
+		file.Write_all(values, numElements, MPI::DOUBLE);
+		file.Close();
+		fileType.Free();
+	}
+
+	/*** Private methods ***/
+	template <std::size_t DIMENSIONALITY>
+	MPI::Datatype Checkpoint<DIMENSIONALITY>::createBlockBoxType(const int *numBlocks, const int *start, const int *size,
+			std::size_t elementsPerDim) {
+		MPI::Datatype blockType = MPI::DOUBLE.Create_contiguous(Math::power(elementsPerDim, DIMENSIONALITY));
+		MPI::Datatype boxType = blockType.Create_subarray(DIMENSIONALITY, numBlocks, size, start, MPI::ORDER_FORTRAN);
+		boxType.Commit();
+		blockType.Free();
+		return boxType;
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	void Checkpoint<DIMENSIONALITY>::redistribute(const CommunicativeBlock<DIMENSIONALITY>& block, double *values) {
+		const std::size_t newElementsPerDim = block.getElementsPerDim();
+		std::size_t firstOldBlock[DIMENSIONALITY];	// Of the box of old blocks overlapping the new block
+		std::size_t boxSize[DIMENSIONALITY];
+		std::size_t firstIndex[DIMENSIONALITY];	// Global index of the first element of the new block
+		std::size_t numBoxBlocks = 1;
+		for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+			if (block.procGridSize(d) * newElementsPerDim != procGridSize[d] * elementsPerDim) {
+				throw std::runtime_error("The grid is not of the same size as in checkpoint " + fileName);
+			}
+			firstIndex[d] = block.procGridCoord(d) * newElementsPerDim;
+			firstOldBlock[d] = firstIndex[d] / elementsPerDim;
+			boxSize[d] = (firstIndex[d] + newElementsPerDim - 1) / elementsPerDim - firstOldBlock[d] + 1;
+			numBoxBlocks *= boxSize[d];
+		}
+		// One piece for each old block in the box, in the order of the blocks in the file
+		std::vector<int> blockLengths(numBoxBlocks, 1);
+		std::vector<MPI::Aint> fileDisplacements(numBoxBlocks);
+		std::vector<MPI::Aint> memoryDisplacements(numBoxBlocks, 0);
+		std::vector<MPI::Datatype> filePieces(numBoxBlocks);
+		std::vector<MPI::Datatype> memoryPieces(numBoxBlocks);
+		const MPI::Aint oldBlockBytes = Math::power(elementsPerDim, DIMENSIONALITY) * sizeof(double);
+		int oldSizes[DIMENSIONALITY];
+		int newSizes[DIMENSIONALITY];
+		std::fill_n(oldSizes, DIMENSIONALITY, elementsPerDim);
+		std::fill_n(newSizes, DIMENSIONALITY, newElementsPerDim);
+		for (std::size_t i=0; i<numBoxBlocks; i++) {
+			std::size_t rest = i;
+			std::size_t blockIndex = 0;
+			std::size_t blockStride = 1;
+			int overlapSizes[DIMENSIONALITY];
+			int oldStarts[DIMENSIONALITY];	// Of the overlap, in the old block
+			int newStarts[DIMENSIONALITY];	// Of the overlap, in the new block
+			for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+				std::size_t oldBlock = firstOldBlock[d] + rest % boxSize[d];
+				rest /= boxSize[d];
+				blockIndex += oldBlock * blockStride;
+				blockStride *= procGridSize[d];
+				std::size_t first = std::max(firstIndex[d], oldBlock * elementsPerDim);
+				std::size_t last = std::min(firstIndex[d] + newElementsPerDim, (oldBlock + 1) * elementsPerDim);
+				overlapSizes[d] = last - first;
+				oldStarts[d] = first - oldBlock * elementsPerDim;
+				newStarts[d] = first - firstIndex[d];
+			}
+			fileDisplacements[i] = blockIndex * oldBlockBytes;
+			filePieces[i] = MPI::DOUBLE.Create_subarray(DIMENSIONALITY, oldSizes, overlapSizes, oldStarts, MPI::ORDER_FORTRAN);
+			memoryPieces[i] = MPI::DOUBLE.Create_subarray(DIMENSIONALITY, newSizes, overlapSizes, newStarts, MPI::ORDER_FORTRAN);
+		}
+		MPI::Datatype fileType = MPI::Datatype::Create_struct(numBoxBlocks, &blockLengths[0], &fileDisplacements[0],
+				&filePieces[0]);
+		MPI::Datatype memoryType = MPI::Datatype::Create_struct(numBoxBlocks, &blockLengths[0], &memoryDisplacements[0],
+				&memoryPieces[0]);
+		fileType.Commit();
+		memoryType.Commit();
+		for (std::size_t i=0; i<numBoxBlocks; i++) {
+			filePieces[i].Free();
+			memoryPieces[i].Free();
+		}
+		MPI::File file = MPI::File::Open(block.getCommunicator(), fileName.c_str(), MPI::MODE_RDONLY, MPI::INFO_NULL);
+		file.Set_view(HEADER_SIZE, MPI::DOUBLE, fileType, "native", MPI::INFO_NULL);
+		file.Read_all(values, 1, memoryType);
+		file.Close();
+		fileType.Free();
+		memoryType.Free();
+	}
+
+} /* namespace Grid */
+} /* namespace Haparanda */
+
+#endif /* CHECKPOINT_HPP_ */
@@ -0,0 +1,221 @@
+#ifndef COLLECTIVECOMPOSEDBLOCK_HPP_
+#define COLLECTIVECOMPOSEDBLOCK_HPP_
+
+#include "ComputationalComposedBlock.hpp"
+
+namespace Haparanda {
+namespace Grid {
+
+	/**
+	 * Computational composed block which exchanges boundary data with all its
+	 * neighbors in one non-blocking neighborhood collective operation
+	 * (MPI_Ineighbor_alltoallw) on the Cartesian communicator, instead of
+	 * one point-to-point message per neighbor. Some MPI implementations
+	 * optimize neighborhood collectives much better than separate messages.
+	 *
+	 * The exchange is done on a distributed graph communicator rather than on
+	 * the Cartesian one: If the processor grid has only one or two processors
+	 * along a dimension, both neighbors along that dimension are the same
+	 * process, and the messages between the two processes are then matched
+	 * in the order of the neighbor lists. The graph lists the sources of each
+	 * dimension in the order upper, lower, so that the boundary data sent to
+	 * the lower neighbor ends up in its upper ghost region and vice versa.
+	 * Dimensions along which the block is its own neighbor are left out of
+	 * the graph: Their ghost regions are copied directly by startSend.
+	 *
+	 * As the data from all neighbors arrive in one operation, receiveDoneAt
+	 * waits for the whole exchange the first time it is called after
+	 * startCommunication for a boundary which is not copied, and then hands
+	 * out the boundaries one by one.
+	 *
+	 * @tparam DIMENSIONALITY Dimensionality of the block
+	 * @tparam INDEX Type of the linear indices of the iterators, see ComputationalComposedBlock
+	 */
+	template <std::size_t DIMENSIONALITY, typename INDEX = std::uint32_t>
+	class CollectiveComposedBlock: public ComputationalComposedBlock<DIMENSIONALITY, INDEX>
+	{
+	public:
+		/**
+		 * Create ghost regions and initialize everything MPI related.
+		 *
+		 * @param elementsPerDim Block size in each dimension
+		 * @param extent Width of ghost regions
+		 */
+		CollectiveComposedBlock(std::size_t elementsPerDim, std::size_t extent);
+
+		/**
+		 * Create ghost regions and initialize everything MPI related.
+		 * Initialize the block with its values.
+		 *
+		 * @param elementsPerDim Block size in each dimension
+		 * @param extent Width of ghost regions
+		 * @param values Array containing values to be stored in this block
+		 */
+		CollectiveComposedBlock(std::size_t elementsPerDim, std::size_t extent, double *values);
+
+		virtual ~CollectiveComposedBlock();
+
+		/**
+		 * Wait for the exchange to finish.
+		 */
+		virtual void finishCommunication();
+
+		virtual void receiveDoneAt(BoundaryId *boundary);
+
+	protected:
+		/**
+		 * Prepare for handing out the boundaries at which data is received.
+		 * (The receives are started together with the sends.)
+		 */
+		virtual void startReceive();
+
+		/**
+		 * Start the exchange with all neighbors. Note that nothing is started
+		 * if values is not set!
+		 */
+		virtual void startSend();
+
+	private:
+		MPI_Comm neighborhood;			// Graph communicator used for the exchange
+		MPI_Request exchangeRequest;
+		// Arguments of the exchange, which must stay untouched until it is completed
+		int sendCounts[2*DIMENSIONALITY];
+		MPI_Aint sendDisplacements[2*DIMENSIONALITY];
+		MPI_Datatype sendTypes[2*DIMENSIONALITY];
+		int receiveCounts[2*DIMENSIONALITY];
+		MPI_Aint receiveDisplacements[2*DIMENSIONALITY];
+		MPI_Datatype receiveTypes[2*DIMENSIONALITY];
+		std::size_t exchangedDims[DIMENSIONALITY];	// The dimensions in the graph, i.e. those along which the block is not its own neighbor
+		std::size_t numExchangedDims;
+		std::size_t boundariesDone;		// Number of boundaries handed out by receiveDoneAt since startReceive
+
+		/**
+		 * Set up the communicator used for the exchange, and initialize
+		 * variables describing the state of the exchange.
+		 */
+		void initialize();
+	};
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	CollectiveComposedBlock<DIMENSIONALITY, INDEX>::CollectiveComposedBlock(std::size_t elementsPerDim, std::size_t extent)
+	: ComputationalComposedBlock<DIMENSIONALITY, INDEX>(elementsPerDim, extent) {
+		initialize();
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	CollectiveComposedBlock<DIMENSIONALITY, INDEX>::CollectiveComposedBlock(std::size_t elementsPerDim, std::size_t extent, double *values)
+	: ComputationalComposedBlock<DIMENSIONALITY, INDEX>(elementsPerDim, extent, values) {
+		initialize();
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	CollectiveComposedBlock<DIMENSIONALITY, INDEX>::~CollectiveComposedBlock() {
+		MPI_Comm_free(&neighborhood);
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	void CollectiveComposedBlock<DIMENSIONALITY, INDEX>::finishCommunication() {
+		HAPARANDA_REGION("finish");
+		this->communicationTimer->start();
+		MPI_Wait(&exchangeRequest, MPI_STATUS_IGNORE);
+		this->communicationTimer->stop();
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	void CollectiveComposedBlock<DIMENSIONALITY, INDEX>::receiveDoneAt(BoundaryId *boundary) {
+		assert(boundariesDone < 2*DIMENSIONALITY);
+		this->communicationTimer->start();
+		std::size_t numOwnBoundaries = 2*this->numOwnNeighborDims;
+		if (boundariesDone < numOwnBoundaries) {
+			// Initialized already by startSend
+			boundary->setDimension(this->ownNeighborDims[boundariesDone/2]);
+		} else {
+			if (numOwnBoundaries == boundariesDone) {
+				MPI_Wait(&exchangeRequest, MPI_STATUS_IGNORE);
+			}
+			// All ghost regions are received at once, but handed out one at the time
+			std::size_t dim = exchangedDims[(boundariesDone - numOwnBoundaries)/2];
+			HAPARANDA_EVENT("received", dim, boundariesDone%2);
+			boundary->setDimension(dim);
+		}
+		boundary->setIsLowerSide(0==boundariesDone%2);
+		boundariesDone++;
+		this->communicationTimer->stop();
+	}
+
+
+	/*** Protected methods ***/
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	void CollectiveComposedBlock<DIMENSIONALITY, INDEX>::startReceive() {
+		boundariesDone = 0;
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	void CollectiveComposedBlock<DIMENSIONALITY, INDEX>::startSend() {
+		if (NULL == this->values) {
+			return;
+		}
+		this->communicationTimer->start();
+		for (std::size_t i=0; i<this->numOwnNeighborDims; i++) {
+			this->copyOwnBoundaryData(this->ownNeighborDims[i]);
+		}
+		if (0 == numExchangedDims) {
+			this->communicationTimer->stop();
+			return;
+		}
+		/* Data is sent to the neighbors in the order lower, upper and received
+		 * in the order upper, lower for each dimension (see initialize). All
+		 * buffers are addressed by absolute addresses (relative to
+		 * MPI_BOTTOM) as they are allocated separately. */
+		std::size_t neighbor = 0;
+		for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+			if (this->isOwnNeighbor(d)) {
+				continue;
+			}
+			for (std::size_t j=0; j<2; j++, neighbor++) {
+				MPI::Datatype sendType;
+				double *sendData = this->prepareSendData(d, j, &sendCounts[neighbor], &sendType);
+				sendTypes[neighbor] = sendType;
+				this->countSentData(d, j, sendCounts[neighbor], sendType);
+				MPI_Get_address(sendData, &sendDisplacements[neighbor]);
+				GhostRegion<DIMENSIONALITY, INDEX> *receiver = this->ghostRegions[d][1-j];
+				receiveCounts[neighbor] = receiver->getNumElements();
+				receiveTypes[neighbor] = MPI_DOUBLE;
+				MPI_Get_address(receiver->getValues(), &receiveDisplacements[neighbor]);
+			}
+		}
+		MPI_Ineighbor_alltoallw(MPI_BOTTOM, sendCounts, sendDisplacements, sendTypes,
+				MPI_BOTTOM, receiveCounts, receiveDisplacements, receiveTypes,
+				neighborhood, &exchangeRequest);
+		this->communicationTimer->stop();
+	}
+
+
+	/*** Private methods ***/
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	void CollectiveComposedBlock<DIMENSIONALITY, INDEX>::initialize() {
+		int sources[2*DIMENSIONALITY];
+		int destinations[2*DIMENSIONALITY];
+		numExchangedDims = 0;
+		for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+			if (this->isOwnNeighbor(d)) {
+				continue;
+			}
+			std::size_t e = numExchangedDims++;
+			exchangedDims[e] = d;
+			for (std::size_t j=0; j<2; j++) {
+				destinations[2*e+j] = this->neighborRank[d][j];
+				sources[2*e+j] = this->neighborRank[d][1-j];
+			}
+		}
+		int numNeighbors = 2*numExchangedDims;
+		MPI_Dist_graph_create_adjacent(this->communicator, numNeighbors, sources, MPI_UNWEIGHTED,
+				numNeighbors, destinations, MPI_UNWEIGHTED, MPI_INFO_NULL, false, &neighborhood);
+		exchangeRequest = MPI_REQUEST_NULL;
+		boundariesDone = 0;
+	}
+
+} /* namespace Grid */
+} /* namespace Haparanda */
+
+#endif /* COLLECTIVECOMPOSEDBLOCK_HPP_ */
@@ -2,15 +2,31 @@
 #define COMMUNICATIVEBLOCK_HPP_
 
 #include "ComputationalBlock.hpp"
+#include "DecompositionPlanner.hpp"
+#include "src/utils/Profiler.hpp"
 #include "src/utils/Timer.hpp"
 
 #include <mpi.h>
+#include <vector>
 
 namespace Haparanda {
 namespace Grid {
 
 	using namespace Utils;
 
+	/**
+	 * Position of a block in a periodic grid of blocks which is not the
+	 * processor grid, e.g. because each process has several blocks.
+	 */
+	template <std::size_t DIMENSIONALITY>
+	struct BlockPlacement
+	{
+		MPI::Cartcomm communicator;				// Contains the processes owning the blocks. Not freed by the block.
+		int gridSize[DIMENSIONALITY];			// Number of blocks along each dimension
+		int coordinates[DIMENSIONALITY];		// Coordinates of the block in the grid
+		int neighborRank[DIMENSIONALITY][2];	// Rank of the process owning each neighbor block
+	};
+
 	/**
 	 * Computational block with ability to communicate boundary data using MPI.
 	 *
@@ -37,6 +53,38 @@ namespace Grid {
 		 */
 		virtual void finishCommunication();
 
+		/**
+		 * @return Number of bytes this process has sent to processes on other nodes
+		 */
+		std::size_t interNodeBytesSent() const;
+
+		/**
+		 * @return Communicator containing the processes owning the blocks
+		 */
+		const MPI::Cartcomm& getCommunicator() const;
+
+		/**
+		 * @return Number of bytes this process has sent to other processes on the same node
+		 */
+		std::size_t intraNodeBytesSent() const;
+
+		/**
+		 * @return Number of faces sent between processes on different nodes in each time step, by all processes together
+		 */
+		std::size_t interNodeFacesPerStep() const;
+
+		/**
+		 * Which processes share node is only detected (collectively) for
+		 * planned decompositions, emulated nodes and blocks which call
+		 * detectNodes. Otherwise, each process is considered a node of its
+		 * own.
+		 *
+		 * @param dim Specified dimension (See return value.)
+		 * @param side 0 for the lower side and 1 for the upper side along the specified dimension
+		 * @return True if the neighbor at the specified side is on another node than this process
+		 */
+		bool isOnOtherNode(std::size_t dim, std::size_t side) const;
+
 		/**
 		 * @param dim Specified dimension (See return value)
 		 * @return Coordinate of the current processor in processor grid along the specified dimension
@@ -58,12 +106,42 @@ namespace Grid {
 		 */
 		virtual void receiveDoneAt(BoundaryId *boundary) = 0;
 
+		/**
+		 * Decide whether the processor grid of blocks created after this call
+		 * is arranged by a DecompositionPlanner, which takes into account which
+		 * processes share node, or by MPI::Compute_dims (the default).
+		 *
+		 * @param planned true to plan the processor grid
+		 */
+		static void setPlannedDecomposition(bool planned);
+
+		/**
+		 * Pretend that the processes are placed on nodes of the specified
+		 * number of consecutive ranks in MPI::COMM_WORLD, instead of detecting
+		 * which processes share memory. Useful for studying the decomposition
+		 * on a single node.
+		 *
+		 * @param processesPerNode Number of processes per node, or 0 to detect the nodes
+		 */
+		static void setEmulatedProcessesPerNode(int processesPerNode);
+
 		/**
 		 * Start sending and receiving data.
 		 */
 		virtual void startCommunication();
 
 	protected:
+		/**
+		 * Create a block which is placed in a grid of blocks instead of the
+		 * processor grid. Nothing collective is done, so the processes may
+		 * create different numbers of blocks. Each process is considered to
+		 * be a node of its own.
+		 *
+		 * @param elementsPerDim Number of elements along each dimension
+		 * @param placement Position of the block. Must be valid until prepareCommunication has been called.
+		 */
+		CommunicativeBlock(std::size_t elementsPerDim, const BlockPlacement<DIMENSIONALITY> *placement);
+
 		Utils::Timer *communicationTimer;
 		int numProcessors[DIMENSIONALITY];
 		int processorCoordinates[DIMENSIONALITY];
@@ -71,6 +149,27 @@ namespace Grid {
 		MPI::Prequest receiveRequest[2*DIMENSIONALITY];
 		MPI::Request sendRequest[2*DIMENSIONALITY];
 		MPI::Cartcomm communicator;
+		int nodeIndex;						// Index of the node of this process
+		int neighborNode[DIMENSIONALITY][2];	// Index of the node of each neighbor
+		bool onOtherNode[DIMENSIONALITY][2];
+
+		/**
+		 * Record that data is sent to the neighbor at the specified side.
+		 *
+		 * @param dim Dimension along which the data is sent
+		 * @param side 0 for the lower and 1 for the upper neighbor
+		 * @param count Number of elements of the specified type sent
+		 * @param type Data type of the elements sent
+		 */
+		void countSentData(std::size_t dim, std::size_t side, int count, const MPI::Datatype& type);
+
+		/**
+		 * Find out which processes share node with this one, if that has not
+		 * been done when the processor grid was set up. Collective over the
+		 * communicator. For blocks which depend on the nodes of their
+		 * neighbors.
+		 */
+		void detectNodes();
 
 		/**
 		 * Create block data types to be sent to other processors.
@@ -97,23 +196,92 @@ namespace Grid {
 		 * Start sending data.
 		 */
 		virtual void startSend() = 0;
+
+		/**
+		 * Wait until the data sent by startSend may be overwritten. This is
+		 * finishCommunication without its profiling region, for the blocks
+		 * which do more to finish and record it in a region of their own.
+		 */
+		void waitForSends();
+
+	private:
+		static bool plannedDecomposition;
+		static int emulatedProcessesPerNode;
+		std::size_t bytesSentBetweenNodes;
+		std::size_t bytesSentWithinNode;
+		std::size_t numInterNodeFaces;
+		const BlockPlacement<DIMENSIONALITY> *placement;	// NULL if the block is placed in the processor grid
+		bool nodesDetected;		// False if each process is considered a node of its own
+
+		/**
+		 * Find out which node this process is on.
+		 *
+		 * @param node Will be set to the index of the node of this process
+		 * @param localRank Will be set to the index of this process on its node
+		 * @return Number of processes on each node, or 0 if it differs between nodes
+		 */
+		int findNode(int *node, int *localRank) const;
+
+		/**
+		 * Decide which neighbors are on other nodes, and count the faces sent
+		 * between nodes in each time step.
+		 *
+		 * @param node Index of the node of this process
+		 */
+		void initializeNodeNeighbors(int node);
+
+		/**
+		 * Consider each process a node of its own, which needs no
+		 * communication, and count the faces sent between processes in each
+		 * time step.
+		 */
+		void initializeOwnNodes();
 	};
 
+	template <std::size_t DIMENSIONALITY>
+	bool CommunicativeBlock<DIMENSIONALITY>::plannedDecomposition = false;
+
+	template <std::size_t DIMENSIONALITY>
+	int CommunicativeBlock<DIMENSIONALITY>::emulatedProcessesPerNode = 0;
+
 	template <std::size_t DIMENSIONALITY>
 	CommunicativeBlock<DIMENSIONALITY>::CommunicativeBlock(std::size_t elementsPerDim)
 	: ComputationalBlock<DIMENSIONALITY>(elementsPerDim) {
 		this->communicationTimer = new Utils::Timer();
+		this->bytesSentBetweenNodes = 0;
+		this->bytesSentWithinNode = 0;
+		this->numInterNodeFaces = 0;
+		this->placement = NULL;
+		this->nodesDetected = false;
 	}
 
 	template <std::size_t DIMENSIONALITY>
 	CommunicativeBlock<DIMENSIONALITY>::CommunicativeBlock(std::size_t elementsPerDim, double *values)
 	: ComputationalBlock<DIMENSIONALITY>(elementsPerDim, values) {
 		this->communicationTimer = new Utils::Timer();
+		this->bytesSentBetweenNodes = 0;
+		this->bytesSentWithinNode = 0;
+		this->numInterNodeFaces = 0;
+		this->placement = NULL;
+		this->nodesDetected = false;
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	CommunicativeBlock<DIMENSIONALITY>::CommunicativeBlock(std::size_t elementsPerDim, const BlockPlacement<DIMENSIONALITY> *placement)
+	: ComputationalBlock<DIMENSIONALITY>(elementsPerDim) {
+		this->communicationTimer = new Utils::Timer();
+		this->bytesSentBetweenNodes = 0;
+		this->bytesSentWithinNode = 0;
+		this->numInterNodeFaces = 0;
+		this->placement = placement;
+		this->nodesDetected = false;
 	}
 
 	template <std::size_t DIMENSIONALITY>
 	CommunicativeBlock<DIMENSIONALITY>::~CommunicativeBlock() {
-		communicator.Free();
+		if (NULL == placement) {
+			communicator.Free();
+		}
 		delete communicationTimer;
 	}
 
@@ -124,9 +292,33 @@ namespace Grid {
 
 	template <std::size_t DIMENSIONALITY>
 	void CommunicativeBlock<DIMENSIONALITY>::finishCommunication() {
-		this->communicationTimer->start();
-		MPI::Request::Waitall(2*DIMENSIONALITY, sendRequest);
-		this->communicationTimer->stop();
+		HAPARANDA_REGION("finish");
+		waitForSends();
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	std::size_t CommunicativeBlock<DIMENSIONALITY>::interNodeBytesSent() const {
+		return bytesSentBetweenNodes;
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	std::size_t CommunicativeBlock<DIMENSIONALITY>::intraNodeBytesSent() const {
+		return bytesSentWithinNode;
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	std::size_t CommunicativeBlock<DIMENSIONALITY>::interNodeFacesPerStep() const {
+		return numInterNodeFaces;
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	bool CommunicativeBlock<DIMENSIONALITY>::isOnOtherNode(std::size_t dim, std::size_t side) const {
+		return onOtherNode[dim][side];
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	inline const MPI::Cartcomm& CommunicativeBlock<DIMENSIONALITY>::getCommunicator() const {
+		return communicator;
 	}
 
 	template <std::size_t DIMENSIONALITY>
@@ -139,6 +331,16 @@ namespace Grid {
 		return numProcessors[dim];
 	}
 
+	template <std::size_t DIMENSIONALITY>
+	void CommunicativeBlock<DIMENSIONALITY>::setPlannedDecomposition(bool planned) {
+		plannedDecomposition = planned;
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	void CommunicativeBlock<DIMENSIONALITY>::setEmulatedProcessesPerNode(int processesPerNode) {
+		emulatedProcessesPerNode = processesPerNode;
+	}
+
 	template <std::size_t DIMENSIONALITY>
 	void CommunicativeBlock<DIMENSIONALITY>::startCommunication() {
 		startReceive();
@@ -147,20 +349,81 @@ namespace Grid {
 
 
 	/*** Protected methods ***/
+	template <std::size_t DIMENSIONALITY>
+	void CommunicativeBlock<DIMENSIONALITY>::countSentData(std::size_t dim, std::size_t side, int count, const MPI::Datatype& type) {
+		std::size_t bytes = count * type.Get_size();
+		if (onOtherNode[dim][side]) {
+			bytesSentBetweenNodes += bytes;
+		} else {
+			bytesSentWithinNode += bytes;
+		}
+	}
+
 	template <std::size_t DIMENSIONALITY>
 	void CommunicativeBlock<DIMENSIONALITY>::initializeProcessorGrid() {
+		if (NULL != placement) {
+			this->communicator = placement->communicator;
+			std::copy(placement->gridSize, placement->gridSize + DIMENSIONALITY, this->numProcessors);
+			std::copy(placement->coordinates, placement->coordinates + DIMENSIONALITY, this->processorCoordinates);
+			nodeIndex = communicator.Get_rank();
+			for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+				for (std::size_t j=0; j<2; j++) {
+					neighborRank[d][j] = placement->neighborRank[d][j];
+					neighborNode[d][j] = neighborRank[d][j];
+					onOtherNode[d][j] = neighborNode[d][j] != nodeIndex;
+				}
+			}
+			return;
+		}
 		bool periodicBV[DIMENSIONALITY];
 		std::fill_n(periodicBV, DIMENSIONALITY, true);
 		std::fill_n(this->numProcessors, DIMENSIONALITY, 0);
 		int totalNumProcessors = MPI::COMM_WORLD.Get_size();
+		// Detecting the nodes is collective, so it is only done when they matter
+		bool detect = plannedDecomposition || 0 < emulatedProcessesPerNode;
+		int node = 0, localRank = 0;
+		int processesPerNode = detect ? findNode(&node, &localRank) : 0;
 		// Set up Cartesian topology
-		MPI::Compute_dims(totalNumProcessors, DIMENSIONALITY, this->numProcessors);
-		this->communicator = MPI::COMM_WORLD.Create_cart(DIMENSIONALITY, this->numProcessors, periodicBV, false);
+		if (plannedDecomposition) {
+			if (0 == processesPerNode) {
+				// Irregular placement: Plan as if each process had a node of its own
+				processesPerNode = 1;
+				node = MPI::COMM_WORLD.Get_rank();
+				localRank = 0;
+			}
+			DecompositionPlanner<DIMENSIONALITY> planner(totalNumProcessors, processesPerNode);
+			for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+				this->numProcessors[d] = planner.getProcessorGridSize(d);
+			}
+			/* Order the processes by their planned rank, so that the
+			 * Cartesian communicator can be created without reordering. */
+			MPI::Intracomm ordered = MPI::COMM_WORLD.Split(0, planner.cartesianRank(node, localRank));
+			this->communicator = ordered.Create_cart(DIMENSIONALITY, this->numProcessors, periodicBV, false);
+			ordered.Free();
+		} else {
+			MPI::Compute_dims(totalNumProcessors, DIMENSIONALITY, this->numProcessors);
+			this->communicator = MPI::COMM_WORLD.Create_cart(DIMENSIONALITY, this->numProcessors, periodicBV, false);
+		}
 		int rank = communicator.Get_rank();
 		communicator.Get_coords(rank, DIMENSIONALITY, this->processorCoordinates);
 		for (std::size_t d=0; d<DIMENSIONALITY; d++) {
 			communicator.Shift(d, 1, neighborRank[d][0], neighborRank[d][1]);
 		}
+		if (detect) {
+			initializeNodeNeighbors(node);
+		} else {
+			initializeOwnNodes();
+		}
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	void CommunicativeBlock<DIMENSIONALITY>::detectNodes() {
+		if (nodesDetected || NULL != placement) {
+			return;
+		}
+		int node, localRank;
+		findNode(&node, &localRank);
+		initializeNodeNeighbors(node);
 	}
 
 	template <std::size_t DIMENSIONALITY>
@@ -169,6 +432,84 @@ namespace Grid {
 		initializeBlockDataTypes();
 	}
 
+	template <std::size_t DIMENSIONALITY>
+	void CommunicativeBlock<DIMENSIONALITY>::waitForSends() {
+		this->communicationTimer->start();
+		MPI::Request::Waitall(2*DIMENSIONALITY, sendRequest);
+		this->communicationTimer->stop();
+	}
+
+
+	/*** Private methods ***/
+	template <std::size_t DIMENSIONALITY>
+	int CommunicativeBlock<DIMENSIONALITY>::findNode(int *node, int *localRank) const {
+		int worldRank = MPI::COMM_WORLD.Get_rank();
+		int processesPerNode;
+		if (0 < emulatedProcessesPerNode) {
+			processesPerNode = emulatedProcessesPerNode;
+			*node = worldRank / processesPerNode;
+			*localRank = worldRank % processesPerNode;
+			// The same on all processes, so no communication is needed
+			return 0 == MPI::COMM_WORLD.Get_size() % processesPerNode ? processesPerNode : 0;
+		} else {
+			MPI_Comm nodeCommunicator, leaderCommunicator;
+			MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, worldRank, MPI_INFO_NULL, &nodeCommunicator);
+			MPI_Comm_size(nodeCommunicator, &processesPerNode);
+			MPI_Comm_rank(nodeCommunicator, localRank);
+			// The nodes are numbered by the ranks of their first processes among all first processes
+			MPI_Comm_split(MPI_COMM_WORLD, 0 == *localRank ? 0 : MPI_UNDEFINED, worldRank, &leaderCommunicator);
+			if (MPI_COMM_NULL != leaderCommunicator) {
+				MPI_Comm_rank(leaderCommunicator, node);
+				MPI_Comm_free(&leaderCommunicator);
+			}
+			MPI_Bcast(node, 1, MPI_INT, 0, nodeCommunicator);
+			MPI_Comm_free(&nodeCommunicator);
+		}
+		int range[2] = {-processesPerNode, processesPerNode};
+		MPI::COMM_WORLD.Allreduce(MPI::IN_PLACE, range, 2, MPI::INT, MPI::MAX);
+		bool regular = -range[0] == range[1] && 0 == MPI::COMM_WORLD.Get_size() % processesPerNode;
+		return regular ? processesPerNode : 0;
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	void CommunicativeBlock<DIMENSIONALITY>::initializeNodeNeighbors(int node) {
+		std::vector<int> nodeOf(communicator.Get_size());
+		communicator.Allgather(&node, 1, MPI::INT, &nodeOf[0], 1, MPI::INT);
+		unsigned long interNodeFaces = 0;
+		nodeIndex = node;
+		for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+			for (std::size_t j=0; j<2; j++) {
+				neighborNode[d][j] = nodeOf[neighborRank[d][j]];
+				onOtherNode[d][j] = neighborNode[d][j] != node;
+				// A process which is its own neighbor sends nothing
+				if (onOtherNode[d][j] && 1 < numProcessors[d]) {
+					interNodeFaces++;
+				}
+			}
+		}
+		communicator.Allreduce(MPI::IN_PLACE, &interNodeFaces, 1, MPI::UNSIGNED_LONG, MPI::SUM);
+		numInterNodeFaces = interNodeFaces;
+		nodesDetected = true;
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	void CommunicativeBlock<DIMENSIONALITY>::initializeOwnNodes() {
+		nodeIndex = communicator.Get_rank();
+		std::size_t faces = 0;
+		for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+			for (std::size_t j=0; j<2; j++) {
+				neighborNode[d][j] = neighborRank[d][j];
+				onOtherNode[d][j] = neighborNode[d][j] != nodeIndex;
+				// A process which is its own neighbor sends nothing
+				if (onOtherNode[d][j] && 1 < numProcessors[d]) {
+					faces++;
+				}
+			}
+		}
+		// All processes of the periodic grid have as many neighbors
+		numInterNodeFaces = faces * communicator.Get_size();
+	}
+
 } /* namespace Grid */
 } /* namespace Haparanda */
 
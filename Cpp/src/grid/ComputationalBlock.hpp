@@ -1,6 +1,7 @@
 #ifndef COMPUTATIONALBLOCK_HPP_
 #define COMPUTATIONALBLOCK_HPP_
 
+#include "ActivityMask.hpp"
 #include "src/iterators/Iterable.hpp"
 
 namespace Haparanda {
@@ -32,11 +33,33 @@ using namespace Iterators;
 
 		virtual ~ComputationalBlock();
 
+		/**
+		 * @return The activity mask of the values of the block, or NULL if all values are considered significant
+		 */
+		ActivityMask<DIMENSIONALITY> *getActivityMask() const;
+
 		/**
 		 * @return The number of elements along each dimension of the block
 		 */
 		std::size_t getElementsPerDim() const;
 
+		/**
+		 * @param boundary Boundary outside which the ghost region is located
+		 * @return True if all values of the ghost region are known to be negligible, so that the operators need not use them
+		 */
+		virtual bool hasZeroGhostRegion(const BoundaryId& boundary) const;
+
+		/**
+		 * Let the operators keep track of which parts of the values of the
+		 * block are negligible, and skip them. The mask describes the values,
+		 * so if value arrays are swapped between blocks, the masks must be
+		 * swapped too. The mask is not deleted by the destructor of this
+		 * class.
+		 *
+		 * @param activityMask Mask of the values of the block, or NULL to consider all values significant
+		 */
+		void setActivityMask(ActivityMask<DIMENSIONALITY> *activityMask);
+
 		/**
 		 * Set the values of the block to the ones stored in the array given as
 		 * argument and start initialization of side regions.
@@ -49,6 +72,7 @@ using namespace Iterators;
 		std::size_t smallestIndex;
 		std::size_t elementsPerDim;
 		double *values = NULL;
+		ActivityMask<DIMENSIONALITY> *activityMask = NULL;
 
 		/**
 		 * @return An array with DIMENSIONALITY elements, all initialized to elementsPerDim
@@ -80,11 +104,26 @@ using namespace Iterators;
 	ComputationalBlock<DIMENSIONALITY>::~ComputationalBlock() {
 	}
 
+	template <std::size_t DIMENSIONALITY>
+	inline ActivityMask<DIMENSIONALITY> *ComputationalBlock<DIMENSIONALITY>::getActivityMask() const {
+		return activityMask;
+	}
+
 	template <std::size_t DIMENSIONALITY>
 	std::size_t ComputationalBlock<DIMENSIONALITY>::getElementsPerDim() const {
 		return elementsPerDim;
 	}
 
+	template <std::size_t DIMENSIONALITY>
+	bool ComputationalBlock<DIMENSIONALITY>::hasZeroGhostRegion(const BoundaryId& /* boundary */) const {
+		return false;
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	inline void ComputationalBlock<DIMENSIONALITY>::setActivityMask(ActivityMask<DIMENSIONALITY> *activityMask) {
+		this->activityMask = activityMask;
+	}
+
 	template <std::size_t DIMENSIONALITY>
 	inline void ComputationalBlock<DIMENSIONALITY>::setValues(double *values) {
 		this->values = values;
@@ -3,9 +3,15 @@
 
 #include "CommunicativeBlock.hpp"
 #include "GhostRegion.hpp"
+#include "HaloCompressor.hpp"
 #include "src/iterators/ComposedFieldBoundaryIterator.hpp"
+#include "src/utils/Profiler.hpp"
 
 #include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <vector>
 
 using namespace Haparanda::Iterators;
 
@@ -20,10 +26,11 @@ namespace Grid {
 	 * consecutive!
 	 *
 	 * @tparam DIMENSIONALITY Dimensionality of the block
+	 * @tparam INDEX Type of the linear indices of the iterators; std::uint64_t for blocks with 2^32 elements or more
 	 * @author Malin Kallen
 	 * @copyright Malin Kallen 2013-2014, 2017-2019
 	 */
-	template <std::size_t DIMENSIONALITY>
+	template <std::size_t DIMENSIONALITY, typename INDEX = std::uint32_t>
 	class ComputationalComposedBlock: public CommunicativeBlock<DIMENSIONALITY>
 	{
 	public:
@@ -51,11 +58,174 @@ namespace Grid {
 
 		virtual FieldIterator<DIMENSIONALITY> *getInnerIterator() const;
 
+		/**
+		 * @param dim Dimension of the boundary
+		 * @param side 0 for the lower boundary, 1 for the upper boundary
+		 * @return The compressor of the boundary data sent to the neighbor at the specified boundary, or NULL if it is not compressed
+		 */
+		const HaloCompressor *getHaloCompressor(std::size_t dim, std::size_t side) const;
+
+		virtual bool hasZeroGhostRegion(const BoundaryId& boundary) const;
+
+		/**
+		 * @param dim Specified dimension (See return value.)
+		 * @return True if the boundary data sent along the specified dimension is packed explicitly, false if it is described by an MPI data type
+		 */
+		bool isPackedExplicitly(std::size_t dim) const;
+
+		/**
+		 * @param dim Specified dimension (See return value.)
+		 * @return True if this block is its own neighbor along the specified dimension, i.e. if there is only one processor along it
+		 */
+		bool isOwnNeighbor(std::size_t dim) const;
+
+		/**
+		 * If the block has an activity mask, only the significant tiles of
+		 * the boundary data are sent to the neighbors, and a ghost region
+		 * whose boundary data has no significant tile is set to zero without
+		 * receiving any values. (See ActivityMask.) The neighbors must use
+		 * the same tile size.
+		 */
 		virtual void receiveDoneAt(BoundaryId *boundary);
 
+		/**
+		 * Choose how the boundary data sent to the neighbors along the
+		 * specified dimension is prepared. If explicit packing is chosen, the
+		 * OpenMP threads copy the data into a contiguous send buffer before it
+		 * is sent. Otherwise the MPI library packs it, guided by a derived
+		 * data type. The data is always received directly into the ghost
+		 * regions. Default is to use the derived data types.
+		 *
+		 * Note that the packing mode must not be changed while there are
+		 * unfinished send requests!
+		 *
+		 * @param dim Dimension for which the packing mode is set
+		 * @param explicitPacking If true, the boundary data is packed explicitly, otherwise the derived data type is used
+		 */
+		void setExplicitPacking(std::size_t dim, bool explicitPacking);
+
+		/**
+		 * Choose whether to compress the boundary data sent to neighbors on
+		 * other nodes (after packing it, and after leaving out negligible
+		 * tiles if there is an activity mask). See isOnOtherNode for which
+		 * neighbors count as such. Each face has a compressor of its own,
+		 * which decides by itself whether compressing pays off on a link of
+		 * the specified bandwidth, and otherwise lets the packed data be sent
+		 * as it is (See HaloCompressor.) Since the data must be contiguous to
+		 * be compressed, compression implies explicit packing along the
+		 * dimensions with such neighbors.
+		 *
+		 * All blocks must make the same choice, and it must not be changed
+		 * during communication.
+		 *
+		 * @param compression If true, the boundary data is compressed
+		 * @param linkBandwidth Bandwidth of the link to the neighbors, in bytes per second, or 0 to always compress
+		 */
+		void setHaloCompression(bool compression, double linkBandwidth = 0);
+
 	protected:
+		/**
+		 * Create ghost regions and initialize everything MPI related for a
+		 * block placed in a grid of blocks instead of the processor grid.
+		 *
+		 * @param elementsPerDim Block size in each dimension
+		 * @param extent Width of ghost regions
+		 * @param placement Position of the block
+		 */
+		ComputationalComposedBlock(std::size_t elementsPerDim, std::size_t extent,
+				const BlockPlacement<DIMENSIONALITY>& placement);
+
+		GhostRegion<DIMENSIONALITY, INDEX> *ghostRegions[DIMENSIONALITY][2];
+		std::size_t extent;  // Size in dimension i of ghost regions located along the boundaries where x_i is constant
+		MPI::Datatype commDataBlockTypes[DIMENSIONALITY];
+		bool explicitPacking[DIMENSIONALITY];
+		double *sendBuffers[DIMENSIONALITY][2];	// Only allocated for explicitly packed dimensions
+		// Boundary data packed by the activity mask. Only allocated if there is a mask.
+		std::vector<double> packedSendBuffers[DIMENSIONALITY][2];
+		std::vector<double> packedReceiveBuffers[DIMENSIONALITY][2];
+		// NULL unless the boundary data exchanged with the neighbor is compressed
+		HaloCompressor *compressors[DIMENSIONALITY][2];
+		std::vector<unsigned char> compressedSendBuffers[DIMENSIONALITY][2];
+		std::vector<unsigned char> compressedReceiveBuffers[DIMENSIONALITY][2];
+		/* Dimensions along which this block is its own neighbor. The ghost
+		 * regions outside the boundaries along them are initialized by copying
+		 * the opposite boundary data directly, without involving MPI. */
+		std::size_t ownNeighborDims[DIMENSIONALITY];
+		std::size_t numOwnNeighborDims;
+		std::size_t ownBoundariesDone;	// Number of boundaries along ownNeighborDims handed out by receiveDoneAt
+
+		/**
+		 * Compress the boundary data which will be sent to the neighbor along
+		 * the specified boundary, if its compressor finds that it pays off.
+		 * Otherwise the packed data is sent as it is.
+		 *
+		 * @param dim Dimension of the boundary
+		 * @param side 0 for the lower boundary, 1 for the upper boundary
+		 * @param data The boundary data, packed into count consecutive values
+		 * @param count Number of values of the data. Will be set to the number of bytes to send.
+		 * @param type Will be set to the data type to send
+		 * @return Pointer to the start of the data to send
+		 */
+		void *compressSendData(std::size_t dim, std::size_t side, double *data, int *count, MPI::Datatype *type);
+
+		/**
+		 * Copy the boundary data along the specified dimension, starting at
+		 * the specified index, to a contiguous array. The work is shared by
+		 * the OpenMP threads.
+		 *
+		 * @param dim Dimension of the boundary
+		 * @param startIndex Index of the first element to copy
+		 * @param destination Array of at least sendCount() elements to which the data is copied
+		 */
+		void copyBoundaryData(std::size_t dim, std::size_t startIndex, double *destination);
+
+		/**
+		 * Initialize the ghost regions along a dimension along which this
+		 * block is its own neighbor, with data from the opposite boundaries.
+		 *
+		 * @param dim Dimension of the ghost regions
+		 */
+		void copyOwnBoundaryData(std::size_t dim);
+
 		virtual void initializeBlockDataTypes();
 
+		/**
+		 * @param dim Dimension of the ghost regions
+		 * @return Max number of values received for a ghost region along the specified dimension
+		 */
+		std::size_t maxReceiveCount(std::size_t dim) const;
+
+		/**
+		 * Get the boundary data which will be sent to the neighbor along the
+		 * specified boundary ready for sending, i.e. pack it if it is to be
+		 * packed explicitly, and find out how it should be sent.
+		 *
+		 * @param dim Dimension of the boundary
+		 * @param side 0 for the lower boundary, 1 for the upper boundary
+		 * @param count Will be set to the number of elements of the data type to send
+		 * @param type Will be set to the data type to send
+		 * @return Pointer to the start of the data to send
+		 */
+		double *prepareSendData(std::size_t dim, std::size_t side, int *count, MPI::Datatype *type);
+
+		/**
+		 * Pack the significant tiles of the boundary data which will be sent
+		 * to the neighbor along the specified boundary, as decided by the
+		 * activity mask. An empty message means that no tile is significant.
+		 *
+		 * @param dim Dimension of the boundary
+		 * @param side 0 for the lower boundary, 1 for the upper boundary
+		 * @param count Will be set to the number of elements to send
+		 * @param type Will be set to the data type to send
+		 * @return Pointer to the start of the data to send
+		 */
+		double *packSendData(std::size_t dim, std::size_t side, int *count, MPI::Datatype *type);
+
+		/**
+		 * @return The number of elements in a ghost region (and in the boundary data sent to each neighbor)
+		 */
+		std::size_t sendCount() const;
+
 		/**
 		 * Note that the requests are only initialized and started if values is
 		 * set!
@@ -64,20 +234,26 @@ namespace Grid {
 
 		/**
 		 * Note that the requests are only initialized and started if values is
-		 * set!
+		 * set! Ghost regions along dimensions along which this block is its
+		 * own neighbor are initialized directly, without any requests.
 		 */
 		virtual void startSend();
 
 	private:
-		GhostRegion<DIMENSIONALITY> *ghostRegions[DIMENSIONALITY][2];
-		std::size_t extent;  // Size in dimension i of ghost regions located along the boundaries where x_i is constant
-		MPI::Datatype commDataBlockTypes[DIMENSIONALITY];
-
 		/**
 		 * Allocate memory for the ghost regions.
 		 */
 		void createGhostRegions();
 
+		/**
+		 * Initialize the member variables that are initialized the same way by
+		 * all constructors, create the ghost regions and prepare for
+		 * communication.
+		 *
+		 * @param extent Width of ghost regions
+		 */
+		void initialize(std::size_t extent);
+
 		/**
 		 * Start initialization of all ghost regions.
 		 *
@@ -85,34 +261,39 @@ namespace Grid {
 		void startSendingGhostData();
 	};
 
-	template <std::size_t DIMENSIONALITY>
-	ComputationalComposedBlock<DIMENSIONALITY>::ComputationalComposedBlock(std::size_t elementsPerDim, std::size_t extent)
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	ComputationalComposedBlock<DIMENSIONALITY, INDEX>::ComputationalComposedBlock(std::size_t elementsPerDim, std::size_t extent)
 	: CommunicativeBlock<DIMENSIONALITY>(elementsPerDim) {
-		this->extent = extent;
-		createGhostRegions();
-		this->prepareCommunication();
+		initialize(extent);
 	}
 
-	template <std::size_t DIMENSIONALITY>
-	ComputationalComposedBlock<DIMENSIONALITY>::ComputationalComposedBlock(std::size_t elementsPerDim, std::size_t extent, double *values)
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	ComputationalComposedBlock<DIMENSIONALITY, INDEX>::ComputationalComposedBlock(std::size_t elementsPerDim, std::size_t extent, double *values)
 	: CommunicativeBlock<DIMENSIONALITY>(elementsPerDim, values) {
-		this->extent = extent;
-		createGhostRegions();
-		this->prepareCommunication();
+		initialize(extent);
 	}
 
-	template <std::size_t DIMENSIONALITY>
-	ComputationalComposedBlock<DIMENSIONALITY>::~ComputationalComposedBlock() {
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	ComputationalComposedBlock<DIMENSIONALITY, INDEX>::ComputationalComposedBlock(std::size_t elementsPerDim, std::size_t extent,
+			const BlockPlacement<DIMENSIONALITY>& placement)
+	: CommunicativeBlock<DIMENSIONALITY>(elementsPerDim, &placement) {
+		initialize(extent);
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	ComputationalComposedBlock<DIMENSIONALITY, INDEX>::~ComputationalComposedBlock() {
 		for (std::size_t i=0; i<DIMENSIONALITY; i++) {
 			for (std::size_t j=0; j<2; j++) {
 				delete ghostRegions[i][j];
+				free(sendBuffers[i][j]);
 			}
 			commDataBlockTypes[i].Free();
 		}
+		setHaloCompression(false);
 	}
 
-	template <std::size_t DIMENSIONALITY>
-	inline BoundaryIterator<DIMENSIONALITY> *ComputationalComposedBlock<DIMENSIONALITY>::getBoundaryIterator() const {
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	inline BoundaryIterator<DIMENSIONALITY> *ComputationalComposedBlock<DIMENSIONALITY, INDEX>::getBoundaryIterator() const {
 		assert(NULL != this->values);
 		std::array<std::size_t, DIMENSIONALITY> sizes = this->getSizeArray();
 		FieldIterator<DIMENSIONALITY> ***ghostIterators
@@ -123,30 +304,163 @@ namespace Grid {
 				ghostIterators[i][j] = ghostRegions[i][j]->getBoundaryIterator();
 			}
 		}
-		return new ComposedFieldBoundaryIterator<DIMENSIONALITY>(
+		return new ComposedFieldBoundaryIterator<DIMENSIONALITY, INDEX>(
 				sizes, &(this->values[this->smallestIndex]), ghostIterators);
 	}
 
-	template <std::size_t DIMENSIONALITY>
-	inline FieldIterator<DIMENSIONALITY> *ComputationalComposedBlock<DIMENSIONALITY>::getInnerIterator() const {
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	inline FieldIterator<DIMENSIONALITY> *ComputationalComposedBlock<DIMENSIONALITY, INDEX>::getInnerIterator() const {
 		assert(NULL != this->values);
 		std::array<std::size_t, DIMENSIONALITY> sizes = this->getSizeArray();
-		return new ValueFieldIterator<DIMENSIONALITY>(sizes, &(this->values[this->smallestIndex]));
+		return new ValueFieldIterator<DIMENSIONALITY, INDEX>(sizes, &(this->values[this->smallestIndex]));
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	inline const HaloCompressor *ComputationalComposedBlock<DIMENSIONALITY, INDEX>::getHaloCompressor(std::size_t dim,
+			std::size_t side) const {
+		return compressors[dim][side];
 	}
 
-	template <std::size_t DIMENSIONALITY>
-	void ComputationalComposedBlock<DIMENSIONALITY>::receiveDoneAt(BoundaryId *boundary) {
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	bool ComputationalComposedBlock<DIMENSIONALITY, INDEX>::hasZeroGhostRegion(const BoundaryId& boundary) const {
+		return ghostRegions[boundary.getDimension()][boundary.isLowerSide() ? 0 : 1]->isZero();
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	bool ComputationalComposedBlock<DIMENSIONALITY, INDEX>::isPackedExplicitly(std::size_t dim) const {
+		return explicitPacking[dim];
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	bool ComputationalComposedBlock<DIMENSIONALITY, INDEX>::isOwnNeighbor(std::size_t dim) const {
+		return 1 == this->numProcessors[dim];
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	void ComputationalComposedBlock<DIMENSIONALITY, INDEX>::receiveDoneAt(BoundaryId *boundary) {
 		this->communicationTimer->start();
-		int index = MPI::Request::Waitany(2*DIMENSIONALITY, this->receiveRequest);
-		boundary->setDimension(index/2);
-		boundary->setIsLowerSide(1==index%2);
+		if (ownBoundariesDone < 2*numOwnNeighborDims) {
+			// Initialized already by startSend
+			boundary->setDimension(ownNeighborDims[ownBoundariesDone/2]);
+			boundary->setIsLowerSide(0==ownBoundariesDone%2);
+			ownBoundariesDone++;
+		} else {
+			MPI::Status status;
+			int index = MPI::Request::Waitany(2*DIMENSIONALITY, this->receiveRequest, status);
+			std::size_t dim = index/2;
+			std::size_t side = 1 - index%2;
+			HAPARANDA_EVENT("received", dim, side);
+			boundary->setDimension(dim);
+			boundary->setIsLowerSide(1==index%2);
+			GhostRegion<DIMENSIONALITY, INDEX> *ghostRegion = ghostRegions[dim][side];
+			double *received = NULL == this->activityMask ? ghostRegion->getValues() : &packedReceiveBuffers[dim][side][0];
+			std::size_t count;
+			if (NULL != compressors[dim][side]) {
+				count = HaloCompressor::decode(&compressedReceiveBuffers[dim][side][0], status.Get_count(MPI::BYTE),
+						received, maxReceiveCount(dim));
+			} else {
+				count = status.Get_count(MPI::DOUBLE);
+			}
+			if (NULL == this->activityMask) {
+				ghostRegion->setZero(false);
+			} else if (0 == count) {
+				ghostRegion->setToZero();
+			} else {
+				this->activityMask->unpackBoundaryData(received, count, dim, extent, ghostRegion->getValues());
+				ghostRegion->setZero(false);
+			}
+		}
 		this->communicationTimer->stop();
 	}
 
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	void ComputationalComposedBlock<DIMENSIONALITY, INDEX>::setExplicitPacking(std::size_t dim, bool explicitPacking) {
+		assert(dim < DIMENSIONALITY);
+		this->explicitPacking[dim] = explicitPacking;
+		for (std::size_t j=0; j<2; j++) {
+			if (explicitPacking && NULL == sendBuffers[dim][j]) {
+				// Align to cache lines (and vector registers) for the packing loops
+				void *buffer = NULL;
+				if (0 != posix_memalign(&buffer, 64, sendCount() * sizeof(double))) {
+					throw std::bad_alloc();
+				}
+				sendBuffers[dim][j] = static_cast<double *>(buffer);
+			}
+		}
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	void ComputationalComposedBlock<DIMENSIONALITY, INDEX>::setHaloCompression(bool compression, double linkBandwidth) {
+		for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+			for (std::size_t j=0; j<2; j++) {
+				delete compressors[d][j];
+				compressors[d][j] = NULL;
+				// A neighbor on another node is on another node also from its side, so both compress
+				if (compression && this->isOnOtherNode(d, j) && !isOwnNeighbor(d)) {
+					compressors[d][j] = new HaloCompressor(linkBandwidth);
+					setExplicitPacking(d, true);
+				}
+			}
+		}
+	}
+
 
 	/*** Protected methods ***/
-	template <std::size_t DIMENSIONALITY>
-	void ComputationalComposedBlock<DIMENSIONALITY>::initializeBlockDataTypes() {
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	void *ComputationalComposedBlock<DIMENSIONALITY, INDEX>::compressSendData(std::size_t dim, std::size_t side,
+			double *data, int *count, MPI::Datatype *type) {
+		std::vector<unsigned char>& buffer = compressedSendBuffers[dim][side];
+		buffer.resize(HaloCompressor::maxMessageSize(*count));
+		std::size_t numBytes = compressors[dim][side]->encode(data, *count, &buffer[0]);
+		*type = MPI::BYTE;
+		if (0 == numBytes) {
+			// The receiver tells the uncompressed data from a compressed message by its size
+			*count *= sizeof(double);
+			return data;
+		}
+		*count = numBytes;
+		return &buffer[0];
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	void ComputationalComposedBlock<DIMENSIONALITY, INDEX>::copyBoundaryData(std::size_t dim, std::size_t startIndex, double *destination) {
+		const std::size_t stride = Math::power(this->elementsPerDim, dim);
+		// The boundary data consists of numChunks chunks of chunkSize consecutive elements
+		const std::size_t chunkSize = this->extent * stride;
+		const std::size_t numChunks = Math::power(this->elementsPerDim, DIMENSIONALITY-1-dim);
+		const std::size_t chunkDistance = stride * this->elementsPerDim;
+		const double *source = &(this->values[startIndex]);
+		if (1 == numChunks) {
+			// Let all threads take part also when the data is contiguous
+#pragma omp parallel for simd schedule(static)
+			for (std::size_t i=0; i<chunkSize; i++) {
+				destination[i] = source[i];
+			}
+			return;
+		}
+#pragma omp parallel for schedule(static)
+		for (std::size_t c=0; c<numChunks; c++) {
+			const double *from = source + c * chunkDistance;
+			double *to = destination + c * chunkSize;
+#pragma omp simd
+			for (std::size_t i=0; i<chunkSize; i++) {
+				to[i] = from[i];
+			}
+		}
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	void ComputationalComposedBlock<DIMENSIONALITY, INDEX>::copyOwnBoundaryData(std::size_t dim) {
+		std::size_t stride = Math::power(this->elementsPerDim, dim);
+		// The lower ghost region is a copy of the upper boundary and vice versa
+		copyBoundaryData(dim, (this->elementsPerDim - this->extent) * stride, ghostRegions[dim][0]->getValues());
+		copyBoundaryData(dim, 0, ghostRegions[dim][1]->getValues());
+		ghostRegions[dim][0]->setZero(false);
+		ghostRegions[dim][1]->setZero(false);
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	void ComputationalComposedBlock<DIMENSIONALITY, INDEX>::initializeBlockDataTypes() {
 		std::size_t stride[DIMENSIONALITY];
 		stride[0] = 1;
 		for (std::size_t d=1; d<DIMENSIONALITY; d++) {
@@ -168,21 +482,87 @@ namespace Grid {
 		}
 	}
 
-	template <std::size_t DIMENSIONALITY>
-	void ComputationalComposedBlock<DIMENSIONALITY>::startReceive() {
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	double *ComputationalComposedBlock<DIMENSIONALITY, INDEX>::prepareSendData(std::size_t dim, std::size_t side, int *count, MPI::Datatype *type) {
+		std::size_t stride = Math::power(this->elementsPerDim, dim);
+		std::size_t startIndex = 0==side ? 0 : (this->elementsPerDim - this->extent) * stride;
+		if (!explicitPacking[dim]) {
+			*count = 1;
+			*type = commDataBlockTypes[dim];
+			return &(this->values[startIndex]);
+		}
+		*count = sendCount();
+		*type = MPI::DOUBLE;
+		if (DIMENSIONALITY-1 == dim) {
+			// The boundary data is already contiguous: No need to copy it
+			return &(this->values[startIndex]);
+		}
+		copyBoundaryData(dim, startIndex, sendBuffers[dim][side]);
+		return sendBuffers[dim][side];
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	inline std::size_t ComputationalComposedBlock<DIMENSIONALITY, INDEX>::maxReceiveCount(std::size_t dim) const {
+		return NULL == this->activityMask ? sendCount() : this->activityMask->getMaxPackedCount(dim, extent);
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	double *ComputationalComposedBlock<DIMENSIONALITY, INDEX>::packSendData(std::size_t dim, std::size_t side, int *count, MPI::Datatype *type) {
+		std::size_t stride = Math::power(this->elementsPerDim, dim);
+		std::size_t startIndex = 0==side ? 0 : (this->elementsPerDim - this->extent) * stride;
+		std::vector<double>& buffer = packedSendBuffers[dim][side];
+		buffer.resize(this->activityMask->getMaxPackedCount(dim, extent));
+		*count = this->activityMask->packBoundaryData(this->values, dim, startIndex, extent, &buffer[0]);
+		*type = MPI::DOUBLE;
+		return &buffer[0];
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	inline std::size_t ComputationalComposedBlock<DIMENSIONALITY, INDEX>::sendCount() const {
+		return Math::power(this->elementsPerDim, DIMENSIONALITY-1) * this->extent;
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	void ComputationalComposedBlock<DIMENSIONALITY, INDEX>::startReceive() {
 		if (NULL != this->values) {
+			ownBoundariesDone = 0;
 			for (size_t i=0; i<DIMENSIONALITY; i++) {
-				this->receiveRequest[2*i+1] = ghostRegions[i][0]->initializeReceive(
-						this->communicator, this->neighborRank[i][0]);
-				this->receiveRequest[2*i] = ghostRegions[i][1]->initializeReceive(
-						this->communicator, this->neighborRank[i][1]);
+				if (isOwnNeighbor(i)) {
+					this->receiveRequest[2*i+1] = MPI::Prequest();
+					this->receiveRequest[2*i] = MPI::Prequest();
+					continue;
+				}
+				if (NULL == this->activityMask && NULL == compressors[i][0] && NULL == compressors[i][1]) {
+					this->receiveRequest[2*i+1] = ghostRegions[i][0]->initializeReceive(
+							this->communicator, this->neighborRank[i][0]);
+					this->receiveRequest[2*i] = ghostRegions[i][1]->initializeReceive(
+							this->communicator, this->neighborRank[i][1]);
+				} else {
+					for (std::size_t j=0; j<2; j++) {
+						int tag = 2*i + (0==j);
+						if (NULL != this->activityMask) {
+							packedReceiveBuffers[i][j].resize(maxReceiveCount(i));
+						}
+						if (NULL != compressors[i][j]) {
+							std::vector<unsigned char>& buffer = compressedReceiveBuffers[i][j];
+							buffer.resize(HaloCompressor::maxMessageSize(maxReceiveCount(i)));
+							this->receiveRequest[2*i+1-j] = this->communicator.Recv_init(&buffer[0], buffer.size(), MPI::BYTE,
+									this->neighborRank[i][j], tag);
+						} else {
+							std::vector<double>& buffer = packedReceiveBuffers[i][j];
+							this->receiveRequest[2*i+1-j] = this->communicator.Recv_init(&buffer[0], buffer.size(), MPI::DOUBLE,
+									this->neighborRank[i][j], tag);
+						}
+					}
+				}
+				this->receiveRequest[2*i+1].Start();
+				this->receiveRequest[2*i].Start();
 			}
-			MPI::Prequest::Startall(2*DIMENSIONALITY, this->receiveRequest);
 		}
 	}
 
-	template <std::size_t DIMENSIONALITY>
-	void ComputationalComposedBlock<DIMENSIONALITY>::startSend() {
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	void ComputationalComposedBlock<DIMENSIONALITY, INDEX>::startSend() {
 		if (NULL != this->values) {
 			startSendingGhostData();
 		}
@@ -190,26 +570,61 @@ namespace Grid {
 
 
 	/*** Private methods ***/
-	template <std::size_t DIMENSIONALITY>
-	inline void ComputationalComposedBlock<DIMENSIONALITY>::createGhostRegions() {
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	inline void ComputationalComposedBlock<DIMENSIONALITY, INDEX>::createGhostRegions() {
 		for (std::size_t i=0; i<DIMENSIONALITY; i++) {
 			for (std::size_t j=0; j<2; j++) {
 				BoundaryId boundary(i, 0==j);
-				ghostRegions[i][j] = new GhostRegion<DIMENSIONALITY>(boundary, this->elementsPerDim, this->extent);
+				ghostRegions[i][j] = new GhostRegion<DIMENSIONALITY, INDEX>(boundary, this->elementsPerDim, this->extent);
+			}
+		}
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	void ComputationalComposedBlock<DIMENSIONALITY, INDEX>::initialize(std::size_t extent) {
+		this->extent = extent;
+		std::fill_n(explicitPacking, DIMENSIONALITY, false);
+		for (std::size_t i=0; i<DIMENSIONALITY; i++) {
+			std::fill_n(sendBuffers[i], 2, static_cast<double *>(NULL));
+			std::fill_n(compressors[i], 2, static_cast<HaloCompressor *>(NULL));
+		}
+		createGhostRegions();
+		this->prepareCommunication();
+		numOwnNeighborDims = 0;
+		for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+			if (isOwnNeighbor(d)) {
+				ownNeighborDims[numOwnNeighborDims++] = d;
 			}
 		}
+		ownBoundariesDone = 0;
 	}
 
-	template <std::size_t DIMENSIONALITY>
-	void ComputationalComposedBlock<DIMENSIONALITY>::startSendingGhostData() {
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	void ComputationalComposedBlock<DIMENSIONALITY, INDEX>::startSendingGhostData() {
+		HAPARANDA_REGION("send");
 		this->communicationTimer->start();
 		for (std::size_t d=0; d<DIMENSIONALITY; d++) {
-			this->sendRequest[2*d] = this->communicator.Isend(this->values, 1,
-					commDataBlockTypes[d], this->neighborRank[d][0], 2*d);
-			std::size_t stride = Math::power(this->elementsPerDim, d);
-			std::size_t startIndex = (this->elementsPerDim - this->extent) * stride;
-			this->sendRequest[2*d+1] = this->communicator.Isend(&(this->values[startIndex]), 1,
-					commDataBlockTypes[d], this->neighborRank[d][1], (2*d)+1);
+			if (isOwnNeighbor(d)) {
+				copyOwnBoundaryData(d);
+				this->sendRequest[2*d] = MPI::Request();
+				this->sendRequest[2*d+1] = MPI::Request();
+				continue;
+			}
+			for (std::size_t j=0; j<2; j++) {
+				int count;
+				MPI::Datatype type;
+				void *data;
+				{
+					HAPARANDA_REGION_AT("pack", d, j);
+					data = NULL == this->activityMask ? prepareSendData(d, j, &count, &type) : packSendData(d, j, &count, &type);
+					if (NULL != compressors[d][j]) {
+						data = compressSendData(d, j, static_cast<double *>(data), &count, &type);
+					}
+				}
+				this->countSentData(d, j, count, type);
+				this->sendRequest[2*d+j] = this->communicator.Isend(data, count, type,
+						this->neighborRank[d][j], 2*d+j);
+			}
 		}
 		this->communicationTimer->stop();
 	}
@@ -17,10 +17,11 @@ namespace Grid {
 	 * consecutive!
 	 *
 	 * @tparam DIMENSIONALITY Dimensionality of the block
+	 * @tparam INDEX Type of the linear indices of the iterators; std::uint64_t for blocks with 2^32 elements or more
 	 * @author Malin Kallen
 	 * @copyright Malin Kallen 2014, 2017
 	 */
-	template <std::size_t DIMENSIONALITY>
+	template <std::size_t DIMENSIONALITY, typename INDEX = std::uint32_t>
 	class ComputationalPureBlock: public ComputationalBlock<DIMENSIONALITY>
 	{
 	public:
@@ -41,28 +42,28 @@ namespace Grid {
 
 	};
 
-	template <std::size_t DIMENSIONALITY>
-	ComputationalPureBlock<DIMENSIONALITY>::ComputationalPureBlock(std::size_t elementsPerDim, double *values)
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	ComputationalPureBlock<DIMENSIONALITY, INDEX>::ComputationalPureBlock(std::size_t elementsPerDim, double *values)
 	: ComputationalBlock<DIMENSIONALITY>(elementsPerDim, values) {
 	}
 
-	template <std::size_t DIMENSIONALITY>
-	ComputationalPureBlock<DIMENSIONALITY>::~ComputationalPureBlock() {
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	ComputationalPureBlock<DIMENSIONALITY, INDEX>::~ComputationalPureBlock() {
 	}
 
-	template <std::size_t DIMENSIONALITY>
-	inline BoundaryIterator<DIMENSIONALITY> *ComputationalPureBlock<DIMENSIONALITY>::getBoundaryIterator() const {
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	inline BoundaryIterator<DIMENSIONALITY> *ComputationalPureBlock<DIMENSIONALITY, INDEX>::getBoundaryIterator() const {
 		assert(NULL != this->values);
 		std::array<std::size_t, DIMENSIONALITY> sizes = this->getSizeArray();
-		return new ValueFieldBoundaryIterator<DIMENSIONALITY>(
+		return new ValueFieldBoundaryIterator<DIMENSIONALITY, INDEX>(
 				sizes, &(this->values[this->smallestIndex]));
 	}
 
-	template <std::size_t DIMENSIONALITY>
-	inline FieldIterator<DIMENSIONALITY> *ComputationalPureBlock<DIMENSIONALITY>::getInnerIterator() const {
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	inline FieldIterator<DIMENSIONALITY> *ComputationalPureBlock<DIMENSIONALITY, INDEX>::getInnerIterator() const {
 		assert(NULL != this->values);
 		std::array<std::size_t, DIMENSIONALITY> sizes = this->getSizeArray();
-		return new ValueFieldIterator<DIMENSIONALITY>(sizes, &(this->values[this->smallestIndex]));
+		return new ValueFieldIterator<DIMENSIONALITY, INDEX>(sizes, &(this->values[this->smallestIndex]));
 	}
 
 } /* namespace Grid */
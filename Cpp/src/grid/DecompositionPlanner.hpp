@@ -0,0 +1,251 @@
+#ifndef DECOMPOSITIONPLANNER_HPP_
+#define DECOMPOSITIONPLANNER_HPP_
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+
+namespace Haparanda {
+namespace Grid {
+
+	/**
+	 * Class which decides how the processes are arranged in a Cartesian,
+	 * periodic processor grid where each process has a block of the same size
+	 * and exchanges faces of the same size with its neighbors along each
+	 * dimension where there is more than one process.
+	 *
+	 * The processes are assumed to be spread evenly over a number of nodes.
+	 * Each node gets a sub grid of the processor grid, and the planner chooses
+	 * both the shape of the processor grid and the shape of the sub grids.
+	 * Among the alternatives, the ones that minimize the number of faces sent
+	 * between nodes in each time step are chosen. Among those, the one with
+	 * the lowest cost is chosen, where the cost of a face increases by a
+	 * constant factor for each dimension after the one it is normal to, as a
+	 * face normal to dimension d consists of chunks of n^d consecutive
+	 * elements (only the faces normal to the last dimension are contiguous).
+	 *
+	 * @tparam DIMENSIONALITY Dimensionality of the processor grid
+	 */
+	template <std::size_t DIMENSIONALITY>
+	class DecompositionPlanner
+	{
+	public:
+		/**
+		 * Relative cost of a face normal to dimension d compared to a face
+		 * normal to dimension d+1.
+		 */
+		static constexpr double STRIDE_COST_RATIO = 1.5;
+
+		/**
+		 * Plan the decomposition.
+		 *
+		 * @param numProcesses Total number of processes
+		 * @param processesPerNode Number of processes on each node. Must divide numProcesses.
+		 */
+		DecompositionPlanner(std::size_t numProcesses, std::size_t processesPerNode);
+
+		/**
+		 * @param dim Specified dimension (See return value.)
+		 * @return Number of processes along the specified dimension of the processor grid
+		 */
+		std::size_t getProcessorGridSize(std::size_t dim) const;
+
+		/**
+		 * @param dim Specified dimension (See return value.)
+		 * @return Number of processes along the specified dimension of the sub grid of each node
+		 */
+		std::size_t getNodeGridSize(std::size_t dim) const;
+
+		/**
+		 * Get the rank in a Cartesian communicator (where the coordinates of
+		 * a process are ordered with the last dimension varying fastest) of a
+		 * process.
+		 *
+		 * @param node Index of the node of the process, < numProcesses/processesPerNode
+		 * @param localRank Index of the process on its node, < processesPerNode
+		 * @return Rank of the process
+		 */
+		std::size_t cartesianRank(std::size_t node, std::size_t localRank) const;
+
+		/**
+		 * @return Number of faces sent between processes on different nodes in each time step
+		 */
+		std::size_t interNodeFaces() const;
+
+		/**
+		 * @return Number of faces sent between different processes on the same node in each time step
+		 */
+		std::size_t intraNodeFaces() const;
+
+		/**
+		 * @return Cost of the communication in each time step, in units of contiguous faces
+		 */
+		double cost() const;
+
+	private:
+		std::size_t numProcesses;
+		std::size_t processesPerNode;
+		std::size_t processorGrid[DIMENSIONALITY];
+		std::size_t nodeGrid[DIMENSIONALITY];
+		std::size_t numInterNodeFaces;
+		std::size_t numIntraNodeFaces;
+		double totalCost;
+
+		/**
+		 * Try all factorizations of remaining processes into the dimensions
+		 * starting at dim, keeping the best alternative found.
+		 *
+		 * @param dim First dimension to decide the processor grid size for
+		 * @param remaining Product of the processor grid sizes of dimensions >= dim
+		 * @param candidate Processor grid sizes of the dimensions < dim
+		 */
+		void searchProcessorGrids(std::size_t dim, std::size_t remaining, std::size_t *candidate);
+
+		/**
+		 * Try all factorizations of the processes of each node into sub grids
+		 * which fit the specified processor grid, keeping the best alternative
+		 * found.
+		 *
+		 * @param dim First dimension to decide the node grid size for
+		 * @param remaining Product of the node grid sizes of dimensions >= dim
+		 * @param grid Processor grid
+		 * @param candidate Node grid sizes of the dimensions < dim
+		 */
+		void searchNodeGrids(std::size_t dim, std::size_t remaining, const std::size_t *grid, std::size_t *candidate);
+
+		/**
+		 * Evaluate the specified alternative, and keep it if it is better than
+		 * the best one found so far.
+		 *
+		 * @param grid Processor grid
+		 * @param subGrid Sub grid of each node
+		 */
+		void evaluate(const std::size_t *grid, const std::size_t *subGrid);
+	};
+
+	template <std::size_t DIMENSIONALITY>
+	constexpr double DecompositionPlanner<DIMENSIONALITY>::STRIDE_COST_RATIO;
+
+	template <std::size_t DIMENSIONALITY>
+	DecompositionPlanner<DIMENSIONALITY>::DecompositionPlanner(std::size_t numProcesses, std::size_t processesPerNode) {
+		assert(0 < processesPerNode && 0 == numProcesses % processesPerNode);
+		this->numProcesses = numProcesses;
+		this->processesPerNode = processesPerNode;
+		numInterNodeFaces = std::numeric_limits<std::size_t>::max();
+		numIntraNodeFaces = 0;
+		totalCost = std::numeric_limits<double>::max();
+		std::size_t candidate[DIMENSIONALITY];
+		searchProcessorGrids(0, numProcesses, candidate);
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	inline std::size_t DecompositionPlanner<DIMENSIONALITY>::getProcessorGridSize(std::size_t dim) const {
+		return processorGrid[dim];
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	inline std::size_t DecompositionPlanner<DIMENSIONALITY>::getNodeGridSize(std::size_t dim) const {
+		return nodeGrid[dim];
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	std::size_t DecompositionPlanner<DIMENSIONALITY>::cartesianRank(std::size_t node, std::size_t localRank) const {
+		std::size_t coordinates[DIMENSIONALITY];
+		// Both the nodes and the processes of a node are ordered with the last dimension varying fastest
+		for (std::size_t d=DIMENSIONALITY; d-- > 0; ) {
+			std::size_t nodesAlongDim = processorGrid[d] / nodeGrid[d];
+			coordinates[d] = (node % nodesAlongDim) * nodeGrid[d] + localRank % nodeGrid[d];
+			node /= nodesAlongDim;
+			localRank /= nodeGrid[d];
+		}
+		std::size_t rank = 0;
+		for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+			rank = rank * processorGrid[d] + coordinates[d];
+		}
+		return rank;
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	inline std::size_t DecompositionPlanner<DIMENSIONALITY>::interNodeFaces() const {
+		return numInterNodeFaces;
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	inline std::size_t DecompositionPlanner<DIMENSIONALITY>::intraNodeFaces() const {
+		return numIntraNodeFaces;
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	inline double DecompositionPlanner<DIMENSIONALITY>::cost() const {
+		return totalCost;
+	}
+
+
+	/*** Private methods ***/
+	template <std::size_t DIMENSIONALITY>
+	void DecompositionPlanner<DIMENSIONALITY>::searchProcessorGrids(std::size_t dim, std::size_t remaining, std::size_t *candidate) {
+		if (DIMENSIONALITY-1 == dim) {
+			candidate[dim] = remaining;
+			std::size_t subGrid[DIMENSIONALITY];
+			searchNodeGrids(0, processesPerNode, candidate, subGrid);
+			return;
+		}
+		for (std::size_t size=1; size<=remaining; size++) {
+			if (0 == remaining % size) {
+				candidate[dim] = size;
+				searchProcessorGrids(dim+1, remaining/size, candidate);
+			}
+		}
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	void DecompositionPlanner<DIMENSIONALITY>::searchNodeGrids(std::size_t dim, std::size_t remaining,
+			const std::size_t *grid, std::size_t *candidate) {
+		if (DIMENSIONALITY == dim) {
+			if (1 == remaining) {
+				evaluate(grid, candidate);
+			}
+			return;
+		}
+		for (std::size_t size=1; size<=remaining && size<=grid[dim]; size++) {
+			if (0 == remaining % size && 0 == grid[dim] % size) {
+				candidate[dim] = size;
+				searchNodeGrids(dim+1, remaining/size, grid, candidate);
+			}
+		}
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	void DecompositionPlanner<DIMENSIONALITY>::evaluate(const std::size_t *grid, const std::size_t *subGrid) {
+		std::size_t interNode = 0;
+		std::size_t intraNode = 0;
+		double alternativeCost = 0;
+		for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+			if (1 == grid[d]) {
+				// The process is its own neighbor: Nothing is sent
+				continue;
+			}
+			/* Each row of subGrid[d] processes along d sends 2 faces per
+			 * process, and 2 of them leave the node unless the row wraps
+			 * around within the node. */
+			std::size_t faces = 2 * numProcesses;
+			std::size_t leaving = grid[d] == subGrid[d] ? 0 : faces / subGrid[d];
+			interNode += leaving;
+			intraNode += faces - leaving;
+			alternativeCost += faces * std::pow(STRIDE_COST_RATIO, DIMENSIONALITY-1-d);
+		}
+		if (interNode < numInterNodeFaces || (interNode == numInterNodeFaces && alternativeCost < totalCost)) {
+			numInterNodeFaces = interNode;
+			numIntraNodeFaces = intraNode;
+			totalCost = alternativeCost;
+			std::copy(grid, grid + DIMENSIONALITY, processorGrid);
+			std::copy(subGrid, subGrid + DIMENSIONALITY, nodeGrid);
+		}
+	}
+
+} /* namespace Grid */
+} /* namespace Haparanda */
+
+#endif /* DECOMPOSITIONPLANNER_HPP_ */
@@ -0,0 +1,631 @@
+#ifndef DOMAIN_HPP_
+#define DOMAIN_HPP_
+
+#include "ComputationalPureBlock.hpp"
+#include "DomainBlock.hpp"
+#include "GridTransfer.hpp"
+#include "LoadBalancer.hpp"
+#include "src/numerics/BlockOperator.hpp"
+
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace Haparanda {
+namespace Grid {
+
+	/**
+	 * A periodic domain divided into a grid of equally sized blocks, where
+	 * each process owns several blocks. The ghost regions of blocks whose
+	 * neighbors belong to the same process are initialized by copying, and
+	 * only boundary data exchanged with other processes is sent by MPI.
+	 *
+	 * Having more blocks than processes (over-decomposition) lets a process
+	 * compute on some blocks while others wait for data: When an operator is
+	 * applied, the inner parts of all blocks are computed while the data is
+	 * in transfer, and after that the boundary regions are computed in the
+	 * order the data arrives, whichever block it belongs to.
+	 *
+	 * The domain keeps two value arrays per block, and swaps them after each
+	 * application of an operator, so that the next application is done on
+	 * the result of the previous one.
+	 *
+	 * The blocks can be moved between processes to even out the load, e.g.
+	 * when the processes run on nodes of different speeds (See balanceLoad.)
+	 *
+	 * Individual blocks can be refined, to resolve local features without
+	 * paying for a fine resolution everywhere (See setLevels.) A block of
+	 * refinement level l has elementsPerDim*2^l elements along each
+	 * dimension, and the levels of neighbor blocks differ by at most 1.
+	 *
+	 * @tparam DIMENSIONALITY Dimensionality of the domain
+	 */
+	template <std::size_t DIMENSIONALITY>
+	class Domain
+	{
+	public:
+		/**
+		 * Divide the domain into blocks and create the blocks of this
+		 * process. The blocks are distributed so that each process gets a box
+		 * of blocksPerProcessDim^DIMENSIONALITY blocks.
+		 *
+		 * @param elementsPerDim Block size in each dimension
+		 * @param extent Width of ghost regions
+		 * @param blocksPerProcessDim Number of blocks of each process along each dimension
+		 */
+		Domain(std::size_t elementsPerDim, std::size_t extent, std::size_t blocksPerProcessDim);
+
+		virtual ~Domain();
+
+		/**
+		 * Apply the operator on all blocks of this process and swap the
+		 * value arrays, so that the result becomes the values of the blocks.
+		 * Refined blocks are computed by the operators of op for their levels
+		 * (See BlockOperator::atLevel.)
+		 *
+		 * @param op Operator to apply
+		 * @throws std::runtime_error If there are refined blocks, and op cannot be refined
+		 */
+		template <std::size_t ORDER_OF_ACCURACY>
+		void apply(const Numerics::BlockOperator<DIMENSIONALITY, ORDER_OF_ACCURACY>& op);
+
+		/**
+		 * Measure the time spent on each block since the last call, and let
+		 * a LoadBalancer decide how to distribute the blocks. If the load is
+		 * predicted to be more uneven than the tolerance allows, move the
+		 * values of the blocks to their new owners and rebuild the blocks and
+		 * the exchange of boundary data. Must be called by all processes, and
+		 * not while the blocks are communicating.
+		 *
+		 * @param tolerance Accepted imbalance, as a fraction of the average time of the processes (e.g. 0.1)
+		 * @return Number of blocks moved to another process
+		 */
+		std::size_t balanceLoad(double tolerance);
+
+		/**
+		 * @return The total time spent on communication by the blocks of this process, in seconds
+		 */
+		double communicationTime() const;
+
+		/**
+		 * Wait for all data sent by the blocks of this process to be sent.
+		 */
+		void finishCommunication();
+
+		/**
+		 * @param id Index of a block
+		 * @param coordinates Will be set to the coordinates of the block in the grid of blocks
+		 */
+		void getBlockCoordinates(std::size_t id, int *coordinates) const;
+
+		/**
+		 * @param id Index of a block
+		 * @return Number of elements of the block along each dimension
+		 */
+		std::size_t getBlockElementsPerDim(std::size_t id) const;
+
+		/**
+		 * @param dim Specified dimension (See return value.)
+		 * @return Number of blocks along the specified dimension
+		 */
+		std::size_t getBlockGridSize(std::size_t dim) const;
+
+		/**
+		 * @param id Index of a block
+		 * @return Refinement level of the block
+		 */
+		std::size_t getLevel(std::size_t id) const;
+
+		/**
+		 * @param index Index among the blocks of this process, < numLocalBlocks()
+		 * @return The block
+		 */
+		DomainBlock<DIMENSIONALITY> *getLocalBlock(std::size_t index) const;
+
+		/**
+		 * @param index Index among the blocks of this process, < numLocalBlocks()
+		 * @return The current values of the block
+		 */
+		double *getLocalValues(std::size_t index) const;
+
+		/**
+		 * @return Number of bytes the blocks of this process have sent to other processes
+		 */
+		std::size_t interProcessBytesSent() const;
+
+		/**
+		 * @return Number of faces sent between blocks of different processes in each time step, by all processes together
+		 */
+		std::size_t interProcessFacesPerStep() const;
+
+		/**
+		 * @return Number of blocks owned by this process
+		 */
+		std::size_t numLocalBlocks() const;
+
+		/**
+		 * @param id Index of a block
+		 * @return Rank of the process owning the block
+		 */
+		int ownerOf(std::size_t id) const;
+
+		/**
+		 * Let apply call balanceLoad periodically.
+		 *
+		 * @param interval Number of applications between the calls, or 0 to never call balanceLoad automatically
+		 * @param tolerance Accepted imbalance (See balanceLoad.)
+		 */
+		void setBalanceInterval(std::size_t interval, double tolerance);
+
+		/**
+		 * Change the refinement levels of the blocks. The values of a block
+		 * whose level changes are interpolated to the new resolution (or
+		 * restricted to it, by injection), from the values of the block only.
+		 * Must be called by all processes with the same levels, and not while
+		 * the blocks are communicating.
+		 *
+		 * @param levels Refinement level of each block. The levels of neighbor blocks must differ by at most 1.
+		 */
+		void setLevels(const std::vector<std::size_t>& levels);
+
+		/**
+		 * Start the exchange of boundary data of all blocks of this process.
+		 */
+		void startCommunication();
+
+	protected:
+		MPI::Cartcomm communicator;
+		std::size_t elementsPerDim;					// Block size in each dimension, at refinement level 0
+		std::size_t extent;
+		std::size_t numBlocks[DIMENSIONALITY];		// Number of blocks along each dimension
+		std::size_t totalNumBlocks;
+		std::vector<int> owner;						// Rank owning each block
+		std::vector<std::size_t> level;				// Refinement level of each block
+		std::vector<DomainBlock<DIMENSIONALITY> *> blocks;	// The blocks of this process, ordered by index
+		std::vector<double *> values;				// Current values of each block of this process
+		std::vector<double *> nextValues;			// Array to which the next result of each block is written
+		std::vector<ComputationalPureBlock<DIMENSIONALITY> *> resultBlocks;
+		std::vector<DomainBlock<DIMENSIONALITY> *> blockById;	// NULL for blocks of other processes
+		LoadBalancer<DIMENSIONALITY> *balancer;
+		std::vector<double> measuredTime;			// Time of each block of this process at the last call to balanceLoad
+		std::size_t numApplications;				// Number of calls to apply since the last call to balanceLoad
+		std::size_t balanceInterval;
+		double balanceTolerance;
+
+		/**
+		 * Create the blocks of this process, according to owner, and connect
+		 * them to their neighbors on this process. The value arrays must be
+		 * allocated.
+		 */
+		void createBlocks();
+
+		/**
+		 * Delete the blocks of this process, but not their value arrays.
+		 */
+		void deleteBlocks();
+
+		/**
+		 * @param coordinates Coordinates of a block in the grid of blocks
+		 * @return Index of the block
+		 */
+		std::size_t idOf(const int *coordinates) const;
+
+		/**
+		 * Send the values of the blocks of this process which get another
+		 * owner to it, receive the values of the blocks this process gets,
+		 * and recreate the blocks. The transfers are in progress while the
+		 * old blocks are deleted.
+		 *
+		 * @param newOwner Rank owning each block after the migration
+		 */
+		void migrateBlocks(const std::vector<int>& newOwner);
+
+		/**
+		 * @param id Index of a block
+		 * @return Number of elements of the block
+		 */
+		std::size_t numPointsOf(std::size_t id) const;
+	};
+
+	template <std::size_t DIMENSIONALITY>
+	Domain<DIMENSIONALITY>::Domain(std::size_t elementsPerDim, std::size_t extent, std::size_t blocksPerProcessDim) {
+		this->elementsPerDim = elementsPerDim;
+		this->extent = extent;
+		int numProcessors[DIMENSIONALITY];
+		std::fill_n(numProcessors, DIMENSIONALITY, 0);
+		MPI::Compute_dims(MPI::COMM_WORLD.Get_size(), DIMENSIONALITY, numProcessors);
+		bool periodicBV[DIMENSIONALITY];
+		std::fill_n(periodicBV, DIMENSIONALITY, true);
+		communicator = MPI::COMM_WORLD.Create_cart(DIMENSIONALITY, numProcessors, periodicBV, false);
+
+		totalNumBlocks = 1;
+		for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+			numBlocks[d] = numProcessors[d] * blocksPerProcessDim;
+			totalNumBlocks *= numBlocks[d];
+		}
+		// The messages are tagged with the receiving block and ghost region
+		int *tagUpperBound;
+		bool found = MPI::COMM_WORLD.Get_attr(MPI::TAG_UB, &tagUpperBound);
+		if (found && totalNumBlocks * 2*DIMENSIONALITY > static_cast<std::size_t>(*tagUpperBound) + 1) {
+			throw std::runtime_error("Domain: Too many blocks to tag the messages uniquely");
+		}
+
+		// Each process gets a box of blocks, placed like the process in the processor grid
+		level.assign(totalNumBlocks, 0);
+		owner.resize(totalNumBlocks);
+		for (std::size_t id=0; id<totalNumBlocks; id++) {
+			int coordinates[DIMENSIONALITY];
+			getBlockCoordinates(id, coordinates);
+			for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+				coordinates[d] /= blocksPerProcessDim;
+			}
+			owner[id] = communicator.Get_cart_rank(coordinates);
+		}
+		int rank = communicator.Get_rank();
+		for (std::size_t id=0; id<totalNumBlocks; id++) {
+			if (rank == owner[id]) {
+				values.push_back(new double[numPointsOf(id)]);
+				nextValues.push_back(new double[numPointsOf(id)]);
+			}
+		}
+		createBlocks();
+		balancer = new LoadBalancer<DIMENSIONALITY>(numBlocks, communicator.Get_size());
+		numApplications = 0;
+		balanceInterval = 0;
+		balanceTolerance = 0;
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	Domain<DIMENSIONALITY>::~Domain() {
+		deleteBlocks();
+		for (std::size_t i=0; i<values.size(); i++) {
+			delete []values[i];
+			delete []nextValues[i];
+		}
+		delete balancer;
+		communicator.Free();
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	template <std::size_t ORDER_OF_ACCURACY>
+	void Domain<DIMENSIONALITY>::apply(const Numerics::BlockOperator<DIMENSIONALITY, ORDER_OF_ACCURACY>& op) {
+		typedef Numerics::BlockOperator<DIMENSIONALITY, ORDER_OF_ACCURACY> Operator;
+		/* Refined blocks need operators scaled for their step lengths. They
+		 * are kept by op, and measured as part of it. */
+		std::vector<const Operator *> blockOperators(blocks.size());
+		for (std::size_t i=0; i<blocks.size(); i++) {
+			blockOperators[i] = op.atLevel(blocks[i]->getLevel());
+		}
+		startCommunication();
+		// Compute the inner parts while the boundary data is in transfer
+		for (std::size_t i=0; i<blocks.size(); i++) {
+			blocks[i]->getComputationTimer()->start();
+			blockOperators[i]->applyInner(*blocks[i], resultBlocks[i]);
+			blocks[i]->getComputationTimer()->stop();
+		}
+		// Compute the boundary regions in the order the data arrives
+		std::vector<std::size_t> boundariesLeft(blocks.size(), 2*DIMENSIONALITY);
+		std::size_t totalBoundariesLeft = blocks.size() * 2*DIMENSIONALITY;
+		while (0 < totalBoundariesLeft) {
+			bool progress = false;
+			for (std::size_t i=0; i<blocks.size(); i++) {
+				BoundaryId boundary;
+				if (0 < boundariesLeft[i] && blocks[i]->testReceiveDoneAt(&boundary)) {
+					blocks[i]->getComputationTimer()->start();
+					blockOperators[i]->applyAtBoundary(*blocks[i], resultBlocks[i], boundary);
+					blocks[i]->getComputationTimer()->stop();
+					boundariesLeft[i]--;
+					totalBoundariesLeft--;
+					progress = true;
+				}
+			}
+			if (!progress) {
+				std::this_thread::yield();
+			}
+		}
+		finishCommunication();
+		for (std::size_t i=0; i<blocks.size(); i++) {
+			std::swap(values[i], nextValues[i]);
+			blocks[i]->setValues(values[i]);
+			resultBlocks[i]->setValues(nextValues[i]);
+		}
+		numApplications++;
+		if (0 < balanceInterval && numApplications >= balanceInterval) {
+			balanceLoad(balanceTolerance);
+		}
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	std::size_t Domain<DIMENSIONALITY>::balanceLoad(double tolerance) {
+		numApplications = 0;
+		// Both the computations and the local handling of the boundary data take time per block
+		std::vector<double> localTime(totalNumBlocks, 0);
+		for (std::size_t i=0; i<blocks.size(); i++) {
+			double time = blocks[i]->computationTime() + blocks[i]->communicationTime();
+			localTime[blocks[i]->getId()] = time - measuredTime[i];
+			measuredTime[i] = time;
+		}
+		std::vector<double> blockTime(totalNumBlocks);
+		communicator.Allreduce(&localTime[0], &blockTime[0], totalNumBlocks, MPI::DOUBLE, MPI::SUM);
+
+		// All processes reach the same decision, since they have the same input
+		std::vector<double> blockSize(totalNumBlocks);
+		for (std::size_t id=0; id<totalNumBlocks; id++) {
+			blockSize[id] = numPointsOf(id);
+		}
+		std::vector<double> work;
+		balancer->estimate(blockTime, blockSize, owner, work);
+		if (balancer->imbalance(work, owner) <= 1 + tolerance) {
+			return 0;
+		}
+		std::vector<int> newOwner;
+		balancer->partition(work, newOwner);
+		if (balancer->imbalance(work, newOwner) >= balancer->imbalance(work, owner)) {
+			return 0;
+		}
+		std::size_t numMoved = 0;
+		for (std::size_t id=0; id<totalNumBlocks; id++) {
+			numMoved += newOwner[id] != owner[id];
+		}
+		migrateBlocks(newOwner);
+		return numMoved;
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	double Domain<DIMENSIONALITY>::communicationTime() const {
+		double time = 0;
+		for (std::size_t i=0; i<blocks.size(); i++) {
+			time += blocks[i]->communicationTime();
+		}
+		return time;
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	void Domain<DIMENSIONALITY>::finishCommunication() {
+		for (std::size_t i=0; i<blocks.size(); i++) {
+			blocks[i]->finishCommunication();
+		}
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	void Domain<DIMENSIONALITY>::getBlockCoordinates(std::size_t id, int *coordinates) const {
+		// Ordered like the ranks of a Cartesian communicator: The last dimension varies fastest
+		for (std::size_t d=DIMENSIONALITY; d-- > 0; ) {
+			coordinates[d] = id % numBlocks[d];
+			id /= numBlocks[d];
+		}
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	inline std::size_t Domain<DIMENSIONALITY>::getBlockElementsPerDim(std::size_t id) const {
+		return elementsPerDim << level[id];
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	inline std::size_t Domain<DIMENSIONALITY>::getBlockGridSize(std::size_t dim) const {
+		return numBlocks[dim];
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	inline std::size_t Domain<DIMENSIONALITY>::getLevel(std::size_t id) const {
+		return level[id];
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	inline DomainBlock<DIMENSIONALITY> *Domain<DIMENSIONALITY>::getLocalBlock(std::size_t index) const {
+		return blocks[index];
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	inline double *Domain<DIMENSIONALITY>::getLocalValues(std::size_t index) const {
+		return values[index];
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	std::size_t Domain<DIMENSIONALITY>::interProcessBytesSent() const {
+		std::size_t bytes = 0;
+		for (std::size_t i=0; i<blocks.size(); i++) {
+			bytes += blocks[i]->interNodeBytesSent();
+		}
+		return bytes;
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	std::size_t Domain<DIMENSIONALITY>::interProcessFacesPerStep() const {
+		std::size_t faces = 0;
+		for (std::size_t id=0; id<totalNumBlocks; id++) {
+			int coordinates[DIMENSIONALITY];
+			getBlockCoordinates(id, coordinates);
+			for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+				int coordinate = coordinates[d];
+				for (int offset=-1; offset<=1; offset+=2) {
+					coordinates[d] = (coordinate + offset + numBlocks[d]) % numBlocks[d];
+					faces += owner[idOf(coordinates)] != owner[id];
+				}
+				coordinates[d] = coordinate;
+			}
+		}
+		return faces;
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	inline std::size_t Domain<DIMENSIONALITY>::numLocalBlocks() const {
+		return blocks.size();
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	inline int Domain<DIMENSIONALITY>::ownerOf(std::size_t id) const {
+		return owner[id];
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	void Domain<DIMENSIONALITY>::setBalanceInterval(std::size_t interval, double tolerance) {
+		balanceInterval = interval;
+		balanceTolerance = tolerance;
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	void Domain<DIMENSIONALITY>::setLevels(const std::vector<std::size_t>& levels) {
+		for (std::size_t id=0; id<totalNumBlocks; id++) {
+			int coordinates[DIMENSIONALITY];
+			getBlockCoordinates(id, coordinates);
+			for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+				int coordinate = coordinates[d];
+				coordinates[d] = (coordinate + 1) % numBlocks[d];
+				std::size_t neighborLevel = levels[idOf(coordinates)];
+				if (levels[id] > neighborLevel + 1 || neighborLevel > levels[id] + 1) {
+					throw std::runtime_error("Domain: The levels of neighbor blocks differ by more than 1");
+				}
+				coordinates[d] = coordinate;
+			}
+		}
+		deleteBlocks();
+		for (std::size_t i=0, id=0; id<totalNumBlocks; id++) {
+			if (communicator.Get_rank() != owner[id]) {
+				continue;
+			}
+			if (levels[id] != level[id]) {
+				std::size_t oldElementsPerDim = getBlockElementsPerDim(id);
+				std::size_t newElementsPerDim = elementsPerDim << levels[id];
+				std::array<double, DIMENSIONALITY> origin;
+				std::array<double, DIMENSIONALITY> spacing;
+				std::array<std::size_t, DIMENSIONALITY> targetSize;
+				origin.fill(0);
+				spacing.fill(static_cast<double>(oldElementsPerDim) / newElementsPerDim);
+				targetSize.fill(newElementsPerDim);
+				double *newValues = new double[Math::power(newElementsPerDim, DIMENSIONALITY)];
+				GridTransfer<DIMENSIONALITY>::resample(values[i], oldElementsPerDim, origin, spacing, targetSize, 0, newValues);
+				delete []values[i];
+				delete []nextValues[i];
+				values[i] = newValues;
+				nextValues[i] = new double[Math::power(newElementsPerDim, DIMENSIONALITY)];
+			}
+			i++;
+		}
+		level = levels;
+		createBlocks();
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	void Domain<DIMENSIONALITY>::startCommunication() {
+		// All blocks must be started before any boundary is computed (See DomainBlock.)
+		for (std::size_t i=0; i<blocks.size(); i++) {
+			blocks[i]->startCommunication();
+		}
+	}
+
+
+	/*** Protected methods ***/
+	template <std::size_t DIMENSIONALITY>
+	void Domain<DIMENSIONALITY>::createBlocks() {
+		int rank = communicator.Get_rank();
+		blockById.assign(totalNumBlocks, NULL);
+		BlockPlacement<DIMENSIONALITY> placement;
+		placement.communicator = communicator;
+		for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+			placement.gridSize[d] = numBlocks[d];
+		}
+		for (std::size_t id=0; id<totalNumBlocks; id++) {
+			if (rank != owner[id]) {
+				continue;
+			}
+			getBlockCoordinates(id, placement.coordinates);
+			std::size_t neighborIds[DIMENSIONALITY][2];
+			std::size_t neighborLevels[DIMENSIONALITY][2];
+			for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+				int neighborCoordinates[DIMENSIONALITY];
+				std::copy(placement.coordinates, placement.coordinates + DIMENSIONALITY, neighborCoordinates);
+				for (std::size_t j=0; j<2; j++) {
+					neighborCoordinates[d] = (placement.coordinates[d] + (0==j ? -1 : 1) + numBlocks[d]) % numBlocks[d];
+					neighborIds[d][j] = idOf(neighborCoordinates);
+					neighborLevels[d][j] = level[neighborIds[d][j]];
+					placement.neighborRank[d][j] = owner[neighborIds[d][j]];
+				}
+			}
+			std::size_t index = blocks.size();
+			DomainBlock<DIMENSIONALITY> *block = new DomainBlock<DIMENSIONALITY>(getBlockElementsPerDim(id), extent, id,
+					level[id], placement, neighborIds, neighborLevels);
+			block->setValues(values[index]);
+			blocks.push_back(block);
+			blockById[id] = block;
+			resultBlocks.push_back(new ComputationalPureBlock<DIMENSIONALITY>(getBlockElementsPerDim(id), nextValues[index]));
+		}
+		for (std::size_t i=0; i<blocks.size(); i++) {
+			for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+				for (std::size_t j=0; j<2; j++) {
+					blocks[i]->setLocalNeighbor(d, j, blockById[blocks[i]->getNeighborId(d, j)]);
+				}
+			}
+		}
+		measuredTime.assign(blocks.size(), 0);
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	void Domain<DIMENSIONALITY>::deleteBlocks() {
+		for (std::size_t i=0; i<blocks.size(); i++) {
+			delete blocks[i];
+			delete resultBlocks[i];
+		}
+		blocks.clear();
+		resultBlocks.clear();
+		blockById.assign(totalNumBlocks, NULL);
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	std::size_t Domain<DIMENSIONALITY>::idOf(const int *coordinates) const {
+		std::size_t id = 0;
+		for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+			id = id * numBlocks[d] + coordinates[d];
+		}
+		return id;
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	void Domain<DIMENSIONALITY>::migrateBlocks(const std::vector<int>& newOwner) {
+		int rank = communicator.Get_rank();
+		std::vector<MPI::Request> requests;
+		std::vector<double *> leaving;
+		std::vector<double *> newValues;
+		std::vector<double *> newNextValues;
+		// The blocks are ordered by index both before and after the migration
+		std::size_t index = 0;
+		for (std::size_t id=0; id<totalNumBlocks; id++) {
+			bool wasOwned = rank == owner[id];
+			bool isOwned = rank == newOwner[id];
+			if (wasOwned && isOwned) {
+				newValues.push_back(values[index]);
+				newNextValues.push_back(nextValues[index]);
+			} else if (wasOwned) {
+				requests.push_back(communicator.Isend(values[index], numPointsOf(id), MPI::DOUBLE, newOwner[id], id));
+				leaving.push_back(values[index]);
+				delete []nextValues[index];
+			} else if (isOwned) {
+				newValues.push_back(new double[numPointsOf(id)]);
+				newNextValues.push_back(new double[numPointsOf(id)]);
+				requests.push_back(communicator.Irecv(newValues.back(), numPointsOf(id), MPI::DOUBLE, owner[id], id));
+			}
+			index += wasOwned;
+		}
+		// The ghost regions are rebuilt and initialized by the next exchange
+		deleteBlocks();
+		owner = newOwner;
+		values = newValues;
+		nextValues = newNextValues;
+		if (!requests.empty()) {
+			MPI::Request::Waitall(requests.size(), &requests[0]);
+		}
+		for (std::size_t i=0; i<leaving.size(); i++) {
+			delete []leaving[i];
+		}
+		createBlocks();
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	inline std::size_t Domain<DIMENSIONALITY>::numPointsOf(std::size_t id) const {
+		return Math::power(getBlockElementsPerDim(id), DIMENSIONALITY);
+	}
+
+} /* namespace Grid */
+} /* namespace Haparanda */
+
+#endif /* DOMAIN_HPP_ */
@@ -0,0 +1,368 @@
+#ifndef DOMAINBLOCK_HPP_
+#define DOMAINBLOCK_HPP_
+
+#include "ComputationalComposedBlock.hpp"
+#include "GridTransfer.hpp"
+
+#include <thread>
+
+namespace Haparanda {
+namespace Grid {
+
+	/**
+	 * Computational composed block which is one of several blocks of a
+	 * process in a Domain. The ghost regions outside boundaries to blocks of
+	 * the same process are initialized by copying the boundary data of those
+	 * blocks directly, and MPI is only used for boundaries to blocks of other
+	 * processes. The messages are tagged with the receiving block and ghost
+	 * region, so that several pairs of blocks can communicate between the
+	 * same pair of processes.
+	 *
+	 * The blocks of a domain may have different refinement levels, where a
+	 * block of level l has 2^l times as many elements along each dimension
+	 * as a block of level 0 (and covers the same part of the domain). A block
+	 * whose neighbor has another level resamples its boundary data to the
+	 * resolution of the neighbor before sending it (see GridTransfer), so
+	 * that every block receives data it can use as it is.
+	 *
+	 * Note that startCommunication must be called for all blocks of the
+	 * process before receiveDoneAt is called for any of them, since the
+	 * neighbors on the same process initialize the ghost regions in
+	 * startCommunication. (Domain takes care of this.)
+	 *
+	 * @tparam DIMENSIONALITY Dimensionality of the block
+	 */
+	template <std::size_t DIMENSIONALITY>
+	class DomainBlock: public ComputationalComposedBlock<DIMENSIONALITY>
+	{
+	public:
+		/**
+		 * Create ghost regions and initialize everything MPI related.
+		 *
+		 * @param elementsPerDim Block size in each dimension
+		 * @param extent Width of ghost regions
+		 * @param id Index of the block in the domain
+		 * @param level Refinement level of the block
+		 * @param placement Position of the block in the grid of blocks
+		 * @param neighborIds Index of the neighbor block at each side
+		 * @param neighborLevels Refinement level of the neighbor block at each side, which may differ from level by at most 1
+		 */
+		DomainBlock(std::size_t elementsPerDim, std::size_t extent, std::size_t id, std::size_t level,
+				const BlockPlacement<DIMENSIONALITY>& placement, const std::size_t neighborIds[DIMENSIONALITY][2],
+				const std::size_t neighborLevels[DIMENSIONALITY][2]);
+
+		virtual ~DomainBlock();
+
+		/**
+		 * @return The total time spent on computations on this block, in seconds (as measured by the Domain)
+		 */
+		double computationTime() const;
+
+		/**
+		 * @return Timer measuring the computations on this block
+		 */
+		Utils::Timer *getComputationTimer() const;
+
+		/**
+		 * @return Index of this block in the domain
+		 */
+		std::size_t getId() const;
+
+		/**
+		 * @return Refinement level of this block
+		 */
+		std::size_t getLevel() const;
+
+		/**
+		 * @param dim Dimension of the boundary
+		 * @param side 0 for the lower boundary, 1 for the upper boundary
+		 * @return Index of the neighbor block at the specified boundary
+		 */
+		std::size_t getNeighborId(std::size_t dim, std::size_t side) const;
+
+		virtual void receiveDoneAt(BoundaryId *boundary);
+
+		/**
+		 * Tell this block that the neighbor at the specified boundary belongs
+		 * to the same process.
+		 *
+		 * @param dim Dimension of the boundary
+		 * @param side 0 for the lower boundary, 1 for the upper boundary
+		 * @param neighbor The neighbor block, or NULL if it belongs to another process
+		 */
+		void setLocalNeighbor(std::size_t dim, std::size_t side, DomainBlock<DIMENSIONALITY> *neighbor);
+
+		/**
+		 * Like receiveDoneAt, but return immediately if no boundary which has
+		 * not been handed out yet is ready.
+		 *
+		 * @param boundary Will be set to the boundary at which a side region is initialized, if any
+		 * @return True if boundary was set
+		 */
+		bool testReceiveDoneAt(BoundaryId *boundary);
+
+	protected:
+		/**
+		 * Start receiving from the neighbors of other processes. Note that
+		 * nothing is started if values is not set!
+		 */
+		virtual void startReceive();
+
+		/**
+		 * Initialize the ghost regions of the neighbors of this process and
+		 * start sending to the neighbors of other processes. Note that
+		 * nothing is done if values is not set!
+		 */
+		virtual void startSend();
+
+	private:
+		std::size_t id;
+		std::size_t level;
+		std::size_t neighborIds[DIMENSIONALITY][2];
+		std::size_t neighborLevels[DIMENSIONALITY][2];
+		double *resampledData[DIMENSIONALITY][2];	// Boundary data resampled for a neighbor of another process and level, otherwise NULL
+		DomainBlock<DIMENSIONALITY> *localNeighbors[DIMENSIONALITY][2];	// NULL if the neighbor belongs to another process
+		long readyStep[DIMENSIONALITY][2];	// Last time step for which the ghost region is initialized by a local neighbor
+		bool received[DIMENSIONALITY][2];	// True if the boundary has been handed out by receiveDoneAt
+		long step;							// Current time step, i.e. number of calls to startCommunication
+		Utils::Timer *computationTimer;
+
+		/**
+		 * Resample the boundary data sent to the neighbor at the specified
+		 * boundary to the resolution of that neighbor.
+		 *
+		 * @param dim Dimension of the boundary
+		 * @param side 0 for the lower boundary, 1 for the upper boundary
+		 * @param destination Array of the size of the ghost region of the neighbor
+		 */
+		void resampleBoundaryData(std::size_t dim, std::size_t side, double *destination) const;
+
+		/**
+		 * @param dim Dimension of the boundary
+		 * @param side 0 for the lower boundary, 1 for the upper boundary
+		 * @return Number of elements of the ghost region of the neighbor at the specified boundary
+		 */
+		std::size_t neighborGhostSize(std::size_t dim, std::size_t side) const;
+
+		/**
+		 * @return Tag of the messages to the specified ghost region of the specified block
+		 */
+		int tag(std::size_t blockId, std::size_t dim, std::size_t side) const;
+	};
+
+	template <std::size_t DIMENSIONALITY>
+	DomainBlock<DIMENSIONALITY>::DomainBlock(std::size_t elementsPerDim, std::size_t extent, std::size_t id, std::size_t level,
+			const BlockPlacement<DIMENSIONALITY>& placement, const std::size_t neighborIds[DIMENSIONALITY][2],
+			const std::size_t neighborLevels[DIMENSIONALITY][2])
+	: ComputationalComposedBlock<DIMENSIONALITY>(elementsPerDim, extent, placement) {
+		this->id = id;
+		this->level = level;
+		this->step = 0;
+		this->computationTimer = new Utils::Timer();
+		for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+			for (std::size_t j=0; j<2; j++) {
+				this->neighborIds[d][j] = neighborIds[d][j];
+				this->neighborLevels[d][j] = neighborLevels[d][j];
+				resampledData[d][j] = NULL;
+				localNeighbors[d][j] = NULL;
+				readyStep[d][j] = 0;
+				received[d][j] = false;
+			}
+		}
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	DomainBlock<DIMENSIONALITY>::~DomainBlock() {
+		for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+			for (std::size_t j=0; j<2; j++) {
+				delete []resampledData[d][j];
+			}
+		}
+		delete computationTimer;
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	double DomainBlock<DIMENSIONALITY>::computationTime() const {
+		return computationTimer->totalElapsedTime();
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	inline Utils::Timer *DomainBlock<DIMENSIONALITY>::getComputationTimer() const {
+		return computationTimer;
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	inline std::size_t DomainBlock<DIMENSIONALITY>::getId() const {
+		return id;
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	inline std::size_t DomainBlock<DIMENSIONALITY>::getLevel() const {
+		return level;
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	inline std::size_t DomainBlock<DIMENSIONALITY>::getNeighborId(std::size_t dim, std::size_t side) const {
+		return neighborIds[dim][side];
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	void DomainBlock<DIMENSIONALITY>::receiveDoneAt(BoundaryId *boundary) {
+		while (!testReceiveDoneAt(boundary)) {
+			std::this_thread::yield();
+		}
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	void DomainBlock<DIMENSIONALITY>::setLocalNeighbor(std::size_t dim, std::size_t side, DomainBlock<DIMENSIONALITY> *neighbor) {
+		localNeighbors[dim][side] = neighbor;
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	bool DomainBlock<DIMENSIONALITY>::testReceiveDoneAt(BoundaryId *boundary) {
+		this->communicationTimer->start();
+		bool done = false;
+		if (this->ownBoundariesDone < 2*this->numOwnNeighborDims) {
+			// Initialized already by startSend
+			boundary->setDimension(this->ownNeighborDims[this->ownBoundariesDone/2]);
+			boundary->setIsLowerSide(0==this->ownBoundariesDone%2);
+			this->ownBoundariesDone++;
+			done = true;
+		}
+		// Neighbors of this process
+		for (std::size_t d=0; d<DIMENSIONALITY && !done; d++) {
+			for (std::size_t j=0; j<2 && !done; j++) {
+				if (NULL != localNeighbors[d][j] && !this->isOwnNeighbor(d) && !received[d][j] && readyStep[d][j] >= step) {
+					HAPARANDA_EVENT("received", d, j);
+					received[d][j] = true;
+					boundary->setDimension(d);
+					boundary->setIsLowerSide(0==j);
+					done = true;
+				}
+			}
+		}
+		// Neighbors of other processes
+		int index;
+		if (!done && MPI::Request::Testany(2*DIMENSIONALITY, this->receiveRequest, index) && MPI::UNDEFINED != index) {
+			HAPARANDA_EVENT("received", index/2, 1-index%2);
+			boundary->setDimension(index/2);
+			boundary->setIsLowerSide(1==index%2);
+			received[index/2][1-index%2] = true;
+			done = true;
+		}
+		this->communicationTimer->stop();
+		return done;
+	}
+
+
+	/*** Protected methods ***/
+	template <std::size_t DIMENSIONALITY>
+	void DomainBlock<DIMENSIONALITY>::startReceive() {
+		if (NULL == this->values) {
+			return;
+		}
+		step++;
+		this->ownBoundariesDone = 0;
+		for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+			for (std::size_t j=0; j<2; j++) {
+				received[d][j] = false;
+				// Same numbering as in ComputationalComposedBlock: Odd indices for the lower ghost regions
+				std::size_t index = 2*d + 1 - j;
+				if (this->isOwnNeighbor(d) || NULL != localNeighbors[d][j]) {
+					this->receiveRequest[index] = MPI::Prequest();
+				} else {
+					GhostRegion<DIMENSIONALITY> *ghostRegion = this->ghostRegions[d][j];
+					this->receiveRequest[index] = this->communicator.Recv_init(ghostRegion->getValues(),
+							ghostRegion->getNumElements(), MPI::DOUBLE, this->neighborRank[d][j], tag(id, d, j));
+					this->receiveRequest[index].Start();
+				}
+			}
+		}
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	void DomainBlock<DIMENSIONALITY>::startSend() {
+		if (NULL == this->values) {
+			return;
+		}
+		this->communicationTimer->start();
+		for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+			if (this->isOwnNeighbor(d)) {
+				this->copyOwnBoundaryData(d);
+				this->sendRequest[2*d] = MPI::Request();
+				this->sendRequest[2*d+1] = MPI::Request();
+				continue;
+			}
+			std::size_t stride = Math::power(this->elementsPerDim, d);
+			for (std::size_t j=0; j<2; j++) {
+				DomainBlock<DIMENSIONALITY> *neighbor = localNeighbors[d][j];
+				if (level != neighborLevels[d][j]) {
+					if (NULL != neighbor) {
+						resampleBoundaryData(d, j, neighbor->ghostRegions[d][1-j]->getValues());
+						neighbor->readyStep[d][1-j] = step;
+						this->sendRequest[2*d+j] = MPI::Request();
+						continue;
+					}
+					std::size_t count = neighborGhostSize(d, j);
+					if (NULL == resampledData[d][j]) {
+						resampledData[d][j] = new double[count];
+					}
+					resampleBoundaryData(d, j, resampledData[d][j]);
+					this->countSentData(d, j, count, MPI::DOUBLE);
+					this->sendRequest[2*d+j] = this->communicator.Isend(resampledData[d][j], count, MPI::DOUBLE,
+							this->neighborRank[d][j], tag(neighborIds[d][j], d, 1-j));
+				} else if (NULL != neighbor) {
+					// The boundary data ends up in the opposite ghost region of the neighbor
+					std::size_t startIndex = 0==j ? 0 : (this->elementsPerDim - this->extent) * stride;
+					this->copyBoundaryData(d, startIndex, neighbor->ghostRegions[d][1-j]->getValues());
+					neighbor->readyStep[d][1-j] = step;
+					this->sendRequest[2*d+j] = MPI::Request();
+				} else {
+					int count;
+					MPI::Datatype type;
+					double *data = this->prepareSendData(d, j, &count, &type);
+					this->countSentData(d, j, count, type);
+					this->sendRequest[2*d+j] = this->communicator.Isend(data, count, type,
+							this->neighborRank[d][j], tag(neighborIds[d][j], d, 1-j));
+				}
+			}
+		}
+		this->communicationTimer->stop();
+	}
+
+
+	/*** Private methods ***/
+	template <std::size_t DIMENSIONALITY>
+	void DomainBlock<DIMENSIONALITY>::resampleBoundaryData(std::size_t dim, std::size_t side, double *destination) const {
+		// Number of elements of the neighbor per element of this block, along each dimension
+		double ratio = std::ldexp(1.0, static_cast<int>(neighborLevels[dim][side]) - static_cast<int>(level));
+		std::array<double, DIMENSIONALITY> origin;
+		std::array<double, DIMENSIONALITY> spacing;
+		std::array<std::size_t, DIMENSIONALITY> targetSize;
+		origin.fill(0);
+		spacing.fill(1/ratio);
+		targetSize.fill(this->elementsPerDim * ratio);
+		targetSize[dim] = this->extent;
+		if (1 == side) {
+			// The lower ghost region of the upper neighbor ends where this block ends
+			origin[dim] = this->elementsPerDim - this->extent/ratio;
+		}
+		GridTransfer<DIMENSIONALITY>::resample(this->values, this->elementsPerDim, origin, spacing, targetSize, dim, destination);
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	std::size_t DomainBlock<DIMENSIONALITY>::neighborGhostSize(std::size_t dim, std::size_t side) const {
+		std::size_t neighborElementsPerDim = std::ldexp(static_cast<double>(this->elementsPerDim),
+				static_cast<int>(neighborLevels[dim][side]) - static_cast<int>(level));
+		return Math::power(neighborElementsPerDim, DIMENSIONALITY-1) * this->extent;
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	inline int DomainBlock<DIMENSIONALITY>::tag(std::size_t blockId, std::size_t dim, std::size_t side) const {
+		return blockId * 2*DIMENSIONALITY + 2*dim + side;
+	}
+
+} /* namespace Grid */
+} /* namespace Haparanda */
+
+#endif /* DOMAINBLOCK_HPP_ */
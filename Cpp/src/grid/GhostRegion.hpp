@@ -6,6 +6,8 @@
 #include "src/iterators/ValueFieldBoundaryIterator.hpp"
 #include "src/utils/Math.hpp"
 
+#include <algorithm>
+#include <cstdint>
 #include <mpi.h>
 
 using namespace Haparanda::Iterators;
@@ -17,10 +19,11 @@ namespace Grid {
 	 * A class representing ghost regions of a computational block.
 	 *
 	 * @tparam DIMENSIONALITY Dimensionality of the block
+	 * @tparam INDEX Type of the linear indices of the iterators, see FieldSteppingStrategy
 	 * @author Malin Kallen
 	 * @copyright Malin Kallen 2017, 2019
 	 */
-	template <std::size_t DIMENSIONALITY>
+	template <std::size_t DIMENSIONALITY, typename INDEX = std::uint32_t>
 	class GhostRegion: public Iterable<DIMENSIONALITY>
 	{
 	public:
@@ -40,6 +43,27 @@ namespace Grid {
 
 		virtual FieldIterator<DIMENSIONALITY> *getInnerIterator() const;
 
+		/**
+		 * @return The total number of elements in the ghost region
+		 */
+		std::size_t getNumElements() const;
+
+		/**
+		 * @return Pointer to the first element of the ghost region
+		 */
+		double *getValues() const;
+
+		/**
+		 * Let the ghost region store its values in the array given as
+		 * argument, e.g. memory allocated by MPI. The array must be large
+		 * enough to hold getNumElements() values. It is not deleted by the
+		 * destructor of this class, but the array previously used is deleted
+		 * if the ghost region owned it.
+		 *
+		 * @param values Array in which the ghost values will be stored
+		 */
+		void setValues(double *values);
+
 		/**
 		 * Initialize a receive from the process with the specified rank in the
 		 * communicator given as argument. The values will be stored in this
@@ -54,11 +78,29 @@ namespace Grid {
 		 */
 		MPI::Request initializeReceive(MPI::Comm& communicator, int rank) const;
 
+		/**
+		 * @return True if all values of the ghost region are known to be zero
+		 */
+		bool isZero() const;
+
+		/**
+		 * Set all values of the ghost region to zero, unless they are known
+		 * to be zero already.
+		 */
+		void setToZero();
+
+		/**
+		 * @param zero True if all values of the ghost region are known to be zero
+		 */
+		void setZero(bool zero);
+
 	private:
 		BoundaryId boundary;		// Boundary along which the ghost region is located
 		std::size_t width;			// Size along boundary.dimension
 		std::size_t elementsPerDim;	// Size along the other dimensions
 		double *values;
+		bool ownsValues;			// True if values is to be deleted by the destructor
+		bool zero;					// True if all values are known to be zero
 
 		/**
 		 * This constructor is for testing purposes.
@@ -94,57 +136,96 @@ namespace Grid {
 	};
 
 
-	template <std::size_t DIMENSIONALITY>
-	GhostRegion<DIMENSIONALITY>:: GhostRegion(BoundaryId& boundary, std::size_t size, std::size_t width) {
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	GhostRegion<DIMENSIONALITY, INDEX>:: GhostRegion(BoundaryId& boundary, std::size_t size, std::size_t width) {
 		std::size_t totalSize = Math::power(size, DIMENSIONALITY-1) * width;
 		double *values = new double[totalSize];
 		initializeMemberVariables(boundary, size, width, values);
 	}
 
-	template <std::size_t DIMENSIONALITY>
-	GhostRegion<DIMENSIONALITY>:: ~GhostRegion() {
-		if (NULL != this->values) {
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	GhostRegion<DIMENSIONALITY, INDEX>:: ~GhostRegion() {
+		if (ownsValues && NULL != this->values) {
 			delete []this->values;
 		}
 	}
 
-	template <std::size_t DIMENSIONALITY>
-	inline BoundaryIterator<DIMENSIONALITY> *GhostRegion<DIMENSIONALITY>::getBoundaryIterator() const {
-		return new ValueFieldBoundaryIterator<DIMENSIONALITY>(getSizeArray(), values);
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	inline BoundaryIterator<DIMENSIONALITY> *GhostRegion<DIMENSIONALITY, INDEX>::getBoundaryIterator() const {
+		return new ValueFieldBoundaryIterator<DIMENSIONALITY, INDEX>(getSizeArray(), values);
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	inline FieldIterator<DIMENSIONALITY> *GhostRegion<DIMENSIONALITY, INDEX>::getInnerIterator() const {
+		return new ValueFieldIterator<DIMENSIONALITY, INDEX>(getSizeArray(), values);
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	inline std::size_t GhostRegion<DIMENSIONALITY, INDEX>::getNumElements() const {
+		return Math::power(this->elementsPerDim, DIMENSIONALITY-1) * this->width;
 	}
 
-	template <std::size_t DIMENSIONALITY>
-	inline FieldIterator<DIMENSIONALITY> *GhostRegion<DIMENSIONALITY>::getInnerIterator() const {
-		return new ValueFieldIterator<DIMENSIONALITY>(getSizeArray(), values);
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	inline double *GhostRegion<DIMENSIONALITY, INDEX>::getValues() const {
+		return this->values;
 	}
 
-	template <std::size_t DIMENSIONALITY>
-	MPI::Request GhostRegion<DIMENSIONALITY>::initializeReceive(MPI::Comm& communicator, int rank) const {
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	void GhostRegion<DIMENSIONALITY, INDEX>::setValues(double *values) {
+		if (ownsValues && NULL != this->values) {
+			delete []this->values;
+		}
+		this->values = values;
+		ownsValues = false;
+		zero = false;
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	MPI::Request GhostRegion<DIMENSIONALITY, INDEX>::initializeReceive(MPI::Comm& communicator, int rank) const {
 		int tag = 2 * this->boundary.getDimension() + this->boundary.isLowerSide();
-		std::size_t totalSize = Math::power(this->elementsPerDim, DIMENSIONALITY-1) * this->width;
-		return communicator.Recv_init(this->values, totalSize, MPI::DOUBLE, rank, tag);
+		return communicator.Recv_init(this->values, getNumElements(), MPI::DOUBLE, rank, tag);
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	inline bool GhostRegion<DIMENSIONALITY, INDEX>::isZero() const {
+		return zero;
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	void GhostRegion<DIMENSIONALITY, INDEX>::setToZero() {
+		if (!zero) {
+			std::fill_n(this->values, getNumElements(), 0.0);
+			zero = true;
+		}
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	inline void GhostRegion<DIMENSIONALITY, INDEX>::setZero(bool zero) {
+		this->zero = zero;
 	}
 
 
-	template <std::size_t DIMENSIONALITY>
-	GhostRegion<DIMENSIONALITY>:: GhostRegion(BoundaryId& boundary, std::size_t size, std::size_t width, double *values) {
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	GhostRegion<DIMENSIONALITY, INDEX>:: GhostRegion(BoundaryId& boundary, std::size_t size, std::size_t width, double *values) {
 		initializeMemberVariables(boundary, size, width, values);
 	}
 
-	template <std::size_t DIMENSIONALITY>
-	std::array<std::size_t, DIMENSIONALITY> GhostRegion<DIMENSIONALITY>::getSizeArray() const {
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	std::array<std::size_t, DIMENSIONALITY> GhostRegion<DIMENSIONALITY, INDEX>::getSizeArray() const {
 		std::array<std::size_t, DIMENSIONALITY> sizes;
 		sizes.fill(elementsPerDim);
 		sizes[boundary.getDimension()] = width;
 		return sizes;
 	}
 
-	template <std::size_t DIMENSIONALITY>
-	void GhostRegion<DIMENSIONALITY>::initializeMemberVariables(BoundaryId boundary, std::size_t elementsPerDim, std::size_t width, double *values) {
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	void GhostRegion<DIMENSIONALITY, INDEX>::initializeMemberVariables(BoundaryId boundary, std::size_t elementsPerDim, std::size_t width, double *values) {
 		this->boundary = boundary;
 		this->elementsPerDim = elementsPerDim;
 		this->width = width;
 		this->values = values;
+		this->ownsValues = true;
+		this->zero = false;
 	}
 
 } /* namespace Grid */
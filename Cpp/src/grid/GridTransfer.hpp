@@ -0,0 +1,157 @@
+#ifndef GRIDTRANSFER_HPP_
+#define GRIDTRANSFER_HPP_
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+namespace Haparanda {
+namespace Grid {
+
+	/**
+	 * Transfer of values between grids of different resolution, by
+	 * tensor-product Lagrange interpolation. The interpolation is done along
+	 * one dimension at the time, and each target point only uses the
+	 * INTERPOLATION_POINTS source points closest to it along that dimension,
+	 * so the cost is proportional to the size of the target, not of the
+	 * source.
+	 *
+	 * A target point which coincides with a source point gets exactly the
+	 * value of that point, i.e. restriction to every other point is
+	 * injection, while prolongation is interpolation of order
+	 * INTERPOLATION_POINTS. Close to the edges of the source, the
+	 * interpolation stencil is shifted inwards (one-sided), so points
+	 * slightly outside the source are extrapolated.
+	 *
+	 * All boxes are stored with dimension 0 varying fastest, like the values
+	 * of a block.
+	 *
+	 * @tparam DIMENSIONALITY Dimensionality of the grids
+	 */
+	template <std::size_t DIMENSIONALITY>
+	class GridTransfer
+	{
+	public:
+		static const std::size_t INTERPOLATION_POINTS = 8;
+
+		/**
+		 * Evaluate the values of a box at a grid of target points. Target
+		 * point t (along dimension d) is at index origin[d] + t*spacing[d] of
+		 * the source.
+		 *
+		 * @param source Values of a box of sourceSize^DIMENSIONALITY points
+		 * @param sourceSize Number of source points along each dimension
+		 * @param origin Position of the first target point, in source index units
+		 * @param spacing Distance between the target points, in source index units
+		 * @param targetSize Number of target points along each dimension
+		 * @param firstDim The dimension to interpolate along first. Choose the one along which the target is smallest relative to the source, to do as little work as possible.
+		 * @param target Will be set to the values at the target points
+		 */
+		static void resample(const double *source, std::size_t sourceSize, const std::array<double, DIMENSIONALITY>& origin,
+				const std::array<double, DIMENSIONALITY>& spacing, const std::array<std::size_t, DIMENSIONALITY>& targetSize,
+				std::size_t firstDim, double *target);
+
+	private:
+		/**
+		 * Interpolate along one dimension of a box.
+		 *
+		 * @param source Values of the box
+		 * @param sizes Size of the box along each dimension. The size along dim is set to newSize.
+		 * @param dim Dimension to interpolate along
+		 * @param origin Position of the first new point along dim, in source index units
+		 * @param spacing Distance between the new points along dim, in source index units
+		 * @param newSize Number of new points along dim
+		 * @param target Will be set to the values of the resulting box
+		 */
+		static void interpolateAlong(const double *source, std::array<std::size_t, DIMENSIONALITY>& sizes, std::size_t dim,
+				double origin, double spacing, std::size_t newSize, double *target);
+	};
+
+	template <std::size_t DIMENSIONALITY>
+	const std::size_t GridTransfer<DIMENSIONALITY>::INTERPOLATION_POINTS;
+
+	template <std::size_t DIMENSIONALITY>
+	void GridTransfer<DIMENSIONALITY>::resample(const double *source, std::size_t sourceSize,
+			const std::array<double, DIMENSIONALITY>& origin, const std::array<double, DIMENSIONALITY>& spacing,
+			const std::array<std::size_t, DIMENSIONALITY>& targetSize, std::size_t firstDim, double *target) {
+		std::array<std::size_t, DIMENSIONALITY> sizes;
+		sizes.fill(sourceSize);
+		std::vector<double> buffers[2];
+		const double *from = source;
+		for (std::size_t i=0; i<DIMENSIONALITY; i++) {
+			// firstDim, and then the others in ascending order
+			std::size_t d = 0==i ? firstDim : (i <= firstDim ? i-1 : i);
+			std::size_t newNumPoints = 1;
+			for (std::size_t e=0; e<DIMENSIONALITY; e++) {
+				newNumPoints *= e==d ? targetSize[e] : sizes[e];
+			}
+			double *to = target;
+			if (DIMENSIONALITY-1 != i) {
+				buffers[i%2].resize(newNumPoints);
+				to = &buffers[i%2][0];
+			}
+			interpolateAlong(from, sizes, d, origin[d], spacing[d], targetSize[d], to);
+			from = to;
+		}
+	}
+
+
+	/*** Private methods ***/
+	template <std::size_t DIMENSIONALITY>
+	void GridTransfer<DIMENSIONALITY>::interpolateAlong(const double *source, std::array<std::size_t, DIMENSIONALITY>& sizes,
+			std::size_t dim, double origin, double spacing, std::size_t newSize, double *target) {
+		const std::size_t oldSize = sizes[dim];
+		const std::size_t numPoints = std::min(INTERPOLATION_POINTS, oldSize);
+		// Lagrange weights and first source point of each new point
+		std::vector<double> weights(newSize * numPoints);
+		std::vector<std::size_t> first(newSize);
+		for (std::size_t t=0; t<newSize; t++) {
+			double x = origin + t*spacing;
+			long start = static_cast<long>(std::floor(x)) - static_cast<long>(numPoints/2) + 1;
+			start = std::max(0L, std::min(start, static_cast<long>(oldSize - numPoints)));
+			first[t] = start;
+			for (std::size_t m=0; m<numPoints; m++) {
+				double weight = 1;
+				for (std::size_t k=0; k<numPoints; k++) {
+					if (k != m) {
+						weight *= (x - (start + static_cast<double>(k))) / (static_cast<double>(m) - k);
+					}
+				}
+				weights[t*numPoints + m] = weight;
+			}
+		}
+		std::size_t stride = 1;
+		for (std::size_t d=0; d<dim; d++) {
+			stride *= sizes[d];
+		}
+		std::size_t numOuter = 1;
+		for (std::size_t d=dim+1; d<DIMENSIONALITY; d++) {
+			numOuter *= sizes[d];
+		}
+#pragma omp parallel for schedule(static)
+		for (std::size_t o=0; o<numOuter; o++) {
+			const double *from = source + o * oldSize * stride;
+			double *to = target + o * newSize * stride;
+			for (std::size_t t=0; t<newSize; t++) {
+				const double *w = &weights[t*numPoints];
+				const double *line = from + first[t] * stride;
+				double *result = to + t * stride;
+#pragma omp simd
+				for (std::size_t i=0; i<stride; i++) {
+					double value = 0;
+					for (std::size_t m=0; m<numPoints; m++) {
+						value += w[m] * line[m*stride + i];
+					}
+					result[i] = value;
+				}
+			}
+		}
+		sizes[dim] = newSize;
+	}
+
+} /* namespace Grid */
+} /* namespace Haparanda */
+
+#endif /* GRIDTRANSFER_HPP_ */
@@ -0,0 +1,241 @@
+#ifndef HALOCOMPRESSOR_HPP_
+#define HALOCOMPRESSOR_HPP_
+
+#include "src/utils/Timer.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+namespace Haparanda {
+namespace Grid {
+
+	/**
+	 * Lossless compression of the boundary data sent to the neighbors. Each
+	 * value is XOR:ed with the previous one, which for smooth data clears the
+	 * sign, the exponent and the leading part of the mantissa, and only the
+	 * bytes after the leading zero bytes are stored. The number of leading
+	 * zero bytes is stored in a 4-bit code per value.
+	 *
+	 * A compressed message consists of the number of values (64 bits), the
+	 * codes of all values and then the remaining bytes of each value, padded
+	 * with a zero byte if needed so that its size is not a multiple of the
+	 * size of a double. Uncompressed values are sent as they are, so a
+	 * message is compressed if and only if its size is not such a multiple.
+	 *
+	 * Compression only pays off if the time it saves on the link is larger
+	 * than the time needed to compress and decompress. The compressor
+	 * measures the compression ratio and its own throughput and stops
+	 * compressing when it does not pay off. It then compresses every
+	 * PROBE_INTERVAL:th message anyway, to notice when the data changes.
+	 */
+	class HaloCompressor
+	{
+	public:
+		// Number of messages between measurements while compression is off
+		static const std::size_t PROBE_INTERVAL = 16;
+
+		/**
+		 * @param linkBandwidth Bandwidth of the link to the neighbors, in bytes per second, or 0 to always compress
+		 */
+		HaloCompressor(double linkBandwidth);
+
+		virtual ~HaloCompressor();
+
+		/**
+		 * Decode a message created by encode, or the uncompressed values.
+		 *
+		 * @param message The message
+		 * @param numBytes Number of bytes of the message
+		 * @param values Array to which the values are written
+		 * @param maxValues Max number of values which fit in values
+		 * @return Number of values written
+		 */
+		static std::size_t decode(const unsigned char *message, std::size_t numBytes, double *values, std::size_t maxValues);
+
+		/**
+		 * Compress values into a message if compression is expected to pay
+		 * off. Otherwise, the values are to be sent as they are.
+		 *
+		 * @param values Values to encode
+		 * @param numValues Number of values
+		 * @param message Array of at least maxMessageSize(numValues) bytes to which the message is written
+		 * @return Number of bytes of the message, or 0 if the values are not compressed
+		 */
+		std::size_t encode(const double *values, std::size_t numValues, unsigned char *message);
+
+		/**
+		 * @return The average number of bytes of the uncompressed values per byte of the compressed messages
+		 */
+		double getCompressionRatio() const;
+
+		/**
+		 * @return True if the next message is to be compressed
+		 */
+		bool isCompressing() const;
+
+		/**
+		 * @param numValues Number of values of a message
+		 * @return Max number of bytes of a compressed message with the specified number of values
+		 */
+		static std::size_t maxMessageSize(std::size_t numValues);
+
+	private:
+		double linkBandwidth;
+		Utils::Timer *timer;
+		// Moving averages over the compressed messages, weighing the last one by 1/2
+		double savedFraction;	// Fraction of the bytes saved by compression
+		double timePerByte;		// Time to compress a byte of values
+		double rawBytes;		// Total bytes of the values compressed
+		double compressedBytes;	// Total bytes of the compressed messages
+		bool compressing;
+		std::size_t messagesSinceProbe;
+
+		/**
+		 * Write the compressed values to a message, including the padding.
+		 *
+		 * @return Number of bytes of the message
+		 */
+		static std::size_t compress(const double *values, std::size_t numValues, unsigned char *message);
+
+		/**
+		 * Add the measurements of a compressed message and decide whether to
+		 * compress the following messages.
+		 *
+		 * @param numRawBytes Number of bytes of the values
+		 * @param numCompressedBytes Number of bytes of the compressed message
+		 * @param time Time spent on compressing
+		 */
+		void updateDecision(std::size_t numRawBytes, std::size_t numCompressedBytes, double time);
+	};
+
+	inline HaloCompressor::HaloCompressor(double linkBandwidth) {
+		this->linkBandwidth = linkBandwidth;
+		timer = new Utils::Timer();
+		savedFraction = 0;
+		timePerByte = 0;
+		rawBytes = 0;
+		compressedBytes = 0;
+		compressing = true;
+		messagesSinceProbe = 0;
+	}
+
+	inline HaloCompressor::~HaloCompressor() {
+		delete timer;
+	}
+
+	inline std::size_t HaloCompressor::decode(const unsigned char *message, std::size_t numBytes, double *values,
+			std::size_t maxValues) {
+		if (0 == numBytes % sizeof(double)) {
+			std::size_t numValues = numBytes / sizeof(double);
+			if (numValues > maxValues) {
+				throw std::runtime_error("Halo message larger than the ghost region");
+			}
+			std::memcpy(values, message, numBytes);
+			return numValues;
+		}
+		std::uint64_t numValues;
+		if (numBytes < sizeof(numValues)) {
+			throw std::runtime_error("Corrupt halo message");
+		}
+		std::memcpy(&numValues, message, sizeof(numValues));
+		if (numValues > maxValues) {
+			throw std::runtime_error("Halo message larger than the ghost region");
+		}
+		const unsigned char *codes = message + sizeof(numValues);
+		const unsigned char *bytes = codes + (numValues+1)/2;
+		std::uint64_t previous = 0;
+		for (std::size_t i=0; i<numValues; i++) {
+			unsigned char numLeadingZeroBytes = (codes[i/2] >> (4 * (i%2))) & 0xF;
+			std::uint64_t difference = 0;
+			for (std::size_t b=0; b<sizeof(double)-numLeadingZeroBytes; b++) {
+				difference |= std::uint64_t(*bytes++) << (8*b);
+			}
+			previous ^= difference;
+			std::memcpy(&values[i], &previous, sizeof(double));
+		}
+		std::size_t padding = numBytes - (bytes - message);
+		if (1 < padding || (1 == padding && 0 != *bytes)) {
+			throw std::runtime_error("Corrupt halo message");
+		}
+		return numValues;
+	}
+
+	inline std::size_t HaloCompressor::encode(const double *values, std::size_t numValues, unsigned char *message) {
+		bool probe = !compressing && PROBE_INTERVAL <= ++messagesSinceProbe;
+		if (compressing || probe) {
+			timer->start(true);
+			std::size_t numBytes = compress(values, numValues, message);
+			double time = timer->stop();
+			messagesSinceProbe = 0;
+			updateDecision(numValues * sizeof(double), numBytes, time);
+			if (numBytes < numValues * sizeof(double)) {
+				return numBytes;
+			}
+		}
+		return 0;
+	}
+
+	inline double HaloCompressor::getCompressionRatio() const {
+		return 0 < compressedBytes ? rawBytes / compressedBytes : 1.0;
+	}
+
+	inline bool HaloCompressor::isCompressing() const {
+		return compressing;
+	}
+
+	inline std::size_t HaloCompressor::maxMessageSize(std::size_t numValues) {
+		return sizeof(std::uint64_t) + (numValues+1)/2 + numValues * sizeof(double) + 1;
+	}
+
+
+	/*** Private methods ***/
+	inline std::size_t HaloCompressor::compress(const double *values, std::size_t numValues, unsigned char *message) {
+		std::uint64_t count = numValues;
+		std::memcpy(message, &count, sizeof(count));
+		unsigned char *codes = message + sizeof(count);
+		std::memset(codes, 0, (numValues+1)/2);
+		unsigned char *bytes = codes + (numValues+1)/2;
+		std::uint64_t previous = 0;
+		for (std::size_t i=0; i<numValues; i++) {
+			std::uint64_t current;
+			std::memcpy(&current, &values[i], sizeof(double));
+			std::uint64_t difference = current ^ previous;
+			previous = current;
+			unsigned char numLeadingZeroBytes = 0;
+			while (numLeadingZeroBytes < sizeof(double)
+					&& 0 == ((difference >> (8 * (sizeof(double) - 1 - numLeadingZeroBytes))) & 0xFF)) {
+				numLeadingZeroBytes++;
+			}
+			codes[i/2] |= numLeadingZeroBytes << (4 * (i%2));
+			for (std::size_t b=0; b<sizeof(double)-numLeadingZeroBytes; b++) {
+				*bytes++ = (difference >> (8*b)) & 0xFF;
+			}
+		}
+		if (0 == (bytes - message) % sizeof(double)) {
+			*bytes++ = 0;
+		}
+		return bytes - message;
+	}
+
+	inline void HaloCompressor::updateDecision(std::size_t numRawBytes, std::size_t numCompressedBytes, double time) {
+		if (0 == numRawBytes) {
+			return;
+		}
+		rawBytes += numRawBytes;
+		compressedBytes += numCompressedBytes;
+		bool first = rawBytes == numRawBytes;
+		double fraction = 1 - double(numCompressedBytes) / numRawBytes;
+		savedFraction = first ? fraction : (savedFraction + fraction) / 2;
+		timePerByte = first ? time / numRawBytes : (timePerByte + time / numRawBytes) / 2;
+		if (0 < linkBandwidth) {
+			// Time saved on the link, vs. time to compress and (about as long) decompress
+			compressing = savedFraction / linkBandwidth > 2 * timePerByte;
+		}
+	}
+
+} /* namespace Grid */
+} /* namespace Haparanda */
+
+#endif /* HALOCOMPRESSOR_HPP_ */
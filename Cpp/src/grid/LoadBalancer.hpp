@@ -0,0 +1,244 @@
+#ifndef LOADBALANCER_HPP_
+#define LOADBALANCER_HPP_
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+namespace Haparanda {
+namespace Grid {
+
+	/**
+	 * Partitioner of a grid of blocks among processes of different speeds.
+	 * The blocks are ordered along a space-filling curve (Morton order), and
+	 * each process gets a contiguous part of the curve. The parts are sized
+	 * so that every process is predicted to need the same time for its
+	 * blocks, which keeps the blocks of a process close to each other while
+	 * evening out the load.
+	 *
+	 * The work of the blocks and the speeds of the processes are estimated
+	 * from the time measured for each block. All blocks are assumed to have
+	 * the same amount of work per point, so a process which needs more time
+	 * per point than another is considered slower. The estimated work of a
+	 * block is its time times the speed of its process, which lets blocks
+	 * which need more time than others of the same size (e.g. because they
+	 * exchange more data with other processes) weigh more.
+	 *
+	 * @tparam DIMENSIONALITY Dimensionality of the grid of blocks
+	 */
+	template <std::size_t DIMENSIONALITY>
+	class LoadBalancer
+	{
+	public:
+		/**
+		 * @param numBlocks Number of blocks along each dimension, in a grid where the last dimension varies fastest
+		 * @param numProcesses Number of processes among which the blocks are distributed
+		 */
+		LoadBalancer(const std::size_t *numBlocks, int numProcesses);
+
+		/**
+		 * Estimate the work of each block and the speed of each process
+		 * from the time spent on each block. The speed of a process which
+		 * owns no blocks is not changed, and a process whose blocks took no
+		 * measurable time is assumed to have the average speed.
+		 *
+		 * @param blockTime Time spent on each block, by the process owning it
+		 * @param blockSize Number of points of each block
+		 * @param owner Rank owning each block
+		 * @param work Will be set to the estimated work of each block
+		 */
+		void estimate(const std::vector<double>& blockTime, const std::vector<double>& blockSize,
+				const std::vector<int>& owner, std::vector<double>& work);
+
+		/**
+		 * @return Indices of the blocks, in the order in which they appear along the space-filling curve
+		 */
+		const std::vector<std::size_t>& getCurve() const;
+
+		/**
+		 * @param rank Rank of a process
+		 * @return Current estimate of the speed of the process (points per second)
+		 */
+		double getSpeed(int rank) const;
+
+		/**
+		 * @param work Work of each block
+		 * @param owner Rank owning each block
+		 * @return Predicted time of the slowest process divided by the average predicted time
+		 */
+		double imbalance(const std::vector<double>& work, const std::vector<int>& owner) const;
+
+		/**
+		 * Divide the space-filling curve into one contiguous part per
+		 * process, such that the work of each part is proportional to the
+		 * speed of the process. Every process gets at least one block if
+		 * there are enough blocks.
+		 *
+		 * @param work Work of each block
+		 * @param owner Will be set to the rank owning each block
+		 */
+		void partition(const std::vector<double>& work, std::vector<int>& owner) const;
+
+		/**
+		 * Set the speed of a process, e.g. when it is known in advance.
+		 *
+		 * @param rank Rank of a process
+		 * @param speed Speed of the process (points per second), > 0
+		 */
+		void setSpeed(int rank, double speed);
+
+	private:
+		int numProcesses;
+		std::vector<std::size_t> curve;		// Block indices along the curve
+		std::vector<double> speed;			// Estimated speed of each process
+
+		/**
+		 * Order the blocks by interleaving the bits of their coordinates.
+		 */
+		void createCurve(const std::size_t *numBlocks);
+	};
+
+	template <std::size_t DIMENSIONALITY>
+	LoadBalancer<DIMENSIONALITY>::LoadBalancer(const std::size_t *numBlocks, int numProcesses) {
+		this->numProcesses = numProcesses;
+		speed.assign(numProcesses, 1.0);
+		createCurve(numBlocks);
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	void LoadBalancer<DIMENSIONALITY>::estimate(const std::vector<double>& blockTime, const std::vector<double>& blockSize,
+			const std::vector<int>& owner, std::vector<double>& work) {
+		std::vector<double> processTime(numProcesses, 0);
+		std::vector<double> processSize(numProcesses, 0);
+		std::vector<std::size_t> processBlocks(numProcesses, 0);
+		for (std::size_t id=0; id<blockTime.size(); id++) {
+			processTime[owner[id]] += blockTime[id];
+			processSize[owner[id]] += blockSize[id];
+			processBlocks[owner[id]]++;
+		}
+		double measuredSpeed = 0;
+		int numMeasured = 0;
+		for (int rank=0; rank<numProcesses; rank++) {
+			if (0 < processBlocks[rank] && 0 < processTime[rank]) {
+				speed[rank] = processSize[rank] / processTime[rank];
+				measuredSpeed += speed[rank];
+				numMeasured++;
+			}
+		}
+		// Processes with blocks but no measured time are assumed to be average
+		for (int rank=0; rank<numProcesses; rank++) {
+			if (0 < processBlocks[rank] && 0 == processTime[rank] && 0 < numMeasured) {
+				speed[rank] = measuredSpeed / numMeasured;
+			}
+		}
+		work.resize(blockTime.size());
+		for (std::size_t id=0; id<blockTime.size(); id++) {
+			// A block without measurements weighs as much as its points
+			work[id] = 0 < processTime[owner[id]] ? blockTime[id] * speed[owner[id]] : blockSize[id];
+		}
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	inline const std::vector<std::size_t>& LoadBalancer<DIMENSIONALITY>::getCurve() const {
+		return curve;
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	inline double LoadBalancer<DIMENSIONALITY>::getSpeed(int rank) const {
+		return speed[rank];
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	double LoadBalancer<DIMENSIONALITY>::imbalance(const std::vector<double>& work, const std::vector<int>& owner) const {
+		std::vector<double> processWork(numProcesses, 0);
+		for (std::size_t id=0; id<work.size(); id++) {
+			processWork[owner[id]] += work[id];
+		}
+		double maxTime = 0;
+		double totalTime = 0;
+		for (int rank=0; rank<numProcesses; rank++) {
+			double time = processWork[rank] / speed[rank];
+			maxTime = std::max(maxTime, time);
+			totalTime += time;
+		}
+		return 0 < totalTime ? maxTime * numProcesses / totalTime : 1.0;
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	void LoadBalancer<DIMENSIONALITY>::partition(const std::vector<double>& work, std::vector<int>& owner) const {
+		double totalWork = 0;
+		for (std::size_t id=0; id<work.size(); id++) {
+			totalWork += work[id];
+		}
+		double totalSpeed = 0;
+		for (int rank=0; rank<numProcesses; rank++) {
+			totalSpeed += speed[rank];
+		}
+		owner.resize(curve.size());
+		int rank = 0;
+		double workDone = 0;		// Work of the blocks before the current one along the curve
+		double speedDone = speed[0];	// Speed of the processes up to and including rank
+		std::size_t blocksOfRank = 0;
+		for (std::size_t i=0; i<curve.size(); i++) {
+			std::size_t blocksLeft = curve.size() - i;
+			std::size_t ranksLeft = numProcesses - rank - 1;
+			double blockWork = work[curve[i]];
+			// Move on when the middle of the block is past the end of the part of rank
+			bool pastEnd = workDone + blockWork/2 > totalWork * speedDone / totalSpeed;
+			if (0 < blocksOfRank && 0 < ranksLeft && (pastEnd || blocksLeft <= ranksLeft)) {
+				rank++;
+				speedDone += speed[rank];
+				blocksOfRank = 0;
+			}
+			owner[curve[i]] = rank;
+			blocksOfRank++;
+			workDone += blockWork;
+		}
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	inline void LoadBalancer<DIMENSIONALITY>::setSpeed(int rank, double speed) {
+		this->speed[rank] = speed;
+	}
+
+
+	/*** Private methods ***/
+	template <std::size_t DIMENSIONALITY>
+	void LoadBalancer<DIMENSIONALITY>::createCurve(const std::size_t *numBlocks) {
+		std::size_t totalNumBlocks = 1;
+		std::size_t maxNumBlocks = 1;
+		for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+			totalNumBlocks *= numBlocks[d];
+			maxNumBlocks = std::max(maxNumBlocks, numBlocks[d]);
+		}
+		std::size_t numBits = 0;
+		while ((std::size_t(1) << numBits) < maxNumBlocks) {
+			numBits++;
+		}
+		std::vector<std::pair<unsigned long long, std::size_t> > keys(totalNumBlocks);
+		for (std::size_t id=0; id<totalNumBlocks; id++) {
+			std::size_t coordinates[DIMENSIONALITY];
+			std::size_t rest = id;
+			for (std::size_t d=DIMENSIONALITY; d-- > 0; ) {
+				coordinates[d] = rest % numBlocks[d];
+				rest /= numBlocks[d];
+			}
+			unsigned long long key = 0;
+			for (std::size_t b=numBits; b-- > 0; ) {
+				for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+					key = (key << 1) | ((coordinates[d] >> b) & 1);
+				}
+			}
+			keys[id] = std::make_pair(key, id);
+		}
+		std::sort(keys.begin(), keys.end());
+		curve.resize(totalNumBlocks);
+		for (std::size_t i=0; i<totalNumBlocks; i++) {
+			curve[i] = keys[i].second;
+		}
+	}
+
+} /* namespace Grid */
+} /* namespace Haparanda */
+
+#endif /* LOADBALANCER_HPP_ */
@@ -0,0 +1,380 @@
+#ifndef MAPPEDBLOCK_HPP_
+#define MAPPEDBLOCK_HPP_
+
+#include "ComputationalPureBlock.hpp"
+#include "src/utils/Math.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <errno.h>
+#include <fcntl.h>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+namespace Haparanda {
+namespace Grid {
+
+	template <std::size_t DIMENSIONALITY>
+	class MappedBlockIterator;
+
+	/**
+	 * Computational block without ghost regions, whose values are stored in
+	 * a memory-mapped file, so that the block may be larger than the memory.
+	 *
+	 * The values are streamed in slabs, i.e. the values with the same index
+	 * along the last (slowest) dimension. When an inner iterator of the
+	 * block enters a slab, a background thread asks the kernel to read the
+	 * following windowSlabs slabs (madvise), and to write back and drop the
+	 * slab windowSlabs slabs behind (sync_file_range, posix_fadvise). Each
+	 * thread traversing the block thereby keeps about 2*windowSlabs slabs
+	 * resident, and the reading and writing overlaps the computations. The
+	 * window must cover the extent of the operators applied on the block.
+	 *
+	 * As such blocks are typically huge, the iterators use 64-bit indices.
+	 *
+	 * Apply operators with BlockOperator::applyInner, and let the result be
+	 * written to a second mapped block. Since the values are the file, they
+	 * cannot be replaced with setValues; swap the blocks instead.
+	 *
+	 * @tparam DIMENSIONALITY Dimensionality of the block
+	 */
+	template <std::size_t DIMENSIONALITY>
+	class MappedBlock: public ComputationalPureBlock<DIMENSIONALITY, std::uint64_t>
+	{
+	public:
+		/**
+		 * Map the specified file, which is created (with zero values) if it
+		 * does not exist.
+		 *
+		 * @param elementsPerDim Number of elements along each dimension
+		 * @param fileName Path to the file
+		 * @param windowSlabs Number of slabs to read ahead of the iterators, > 0
+		 */
+		MappedBlock(std::size_t elementsPerDim, const std::string& fileName, std::size_t windowSlabs);
+
+		/**
+		 * Stop the background thread and unmap the file. Values not written
+		 * back yet are written by the kernel later; call sync to wait for
+		 * them.
+		 */
+		virtual ~MappedBlock();
+
+		virtual FieldIterator<DIMENSIONALITY> *getInnerIterator() const;
+
+		/**
+		 * @return Number of slabs the background thread has asked the kernel to read
+		 */
+		std::size_t getNumPrefetched() const;
+
+		/**
+		 * @return Number of slabs the background thread has dropped from the memory
+		 */
+		std::size_t getNumReleased() const;
+
+		/**
+		 * @return The values of the block, i.e. the mapping of the file
+		 */
+		double *getValues() const;
+
+		/**
+		 * Not supported, since the values are stored in the file.
+		 *
+		 * @throws std::runtime_error Always
+		 */
+		virtual void setValues(double *values);
+
+		/**
+		 * Wait until the queued advice is given and all values are written
+		 * to the file.
+		 */
+		void sync();
+
+	private:
+		friend class MappedBlockIterator<DIMENSIONALITY>;
+
+		struct Advice {
+			std::size_t firstSlab;
+			std::size_t endSlab;	// One past the last slab
+			bool prefetch;			// Read the slabs if true, otherwise write back and drop them
+		};
+
+		std::size_t windowSlabs;
+		std::size_t numSlabs;
+		std::size_t slabBytes;
+		std::size_t fileBytes;
+		int fd;
+		std::size_t numPrefetched;
+		std::size_t numReleased;
+		bool advising;				// True while the background thread gives advice
+		bool stopping;
+		std::deque<Advice> advice;
+		mutable std::mutex mutex;
+		std::condition_variable adviceQueued;
+		std::condition_variable adviceGiven;
+		std::thread thread;
+
+		/**
+		 * Queue advice to the background thread for an iterator which has
+		 * entered the specified slab.
+		 *
+		 * @param slab Index of the slab along the last dimension
+		 * @param first True if the iterator starts at the slab, false if it comes from the previous one
+		 */
+		void enterSlab(std::size_t slab, bool first);
+
+		/**
+		 * Give the queued advice to the kernel until stopped.
+		 */
+		void run();
+	};
+
+	/**
+	 * Iterator of the inner region of a MappedBlock, telling the block when
+	 * it enters a new slab.
+	 *
+	 * @tparam DIMENSIONALITY Dimensionality of the block
+	 */
+	template <std::size_t DIMENSIONALITY>
+	class MappedBlockIterator: public ValueFieldIterator<DIMENSIONALITY, std::uint64_t>
+	{
+	public:
+		/**
+		 * @param block The block to iterate through
+		 */
+		MappedBlockIterator(MappedBlock<DIMENSIONALITY> *block);
+
+		virtual ~MappedBlockIterator();
+
+		virtual void advance(std::size_t steps);
+
+		virtual void first();
+
+		virtual void next();
+
+	private:
+		MappedBlock<DIMENSIONALITY> *block;
+		std::size_t slabSize;		// Number of elements per slab
+		std::size_t slab;			// Current slab
+		std::size_t stepsInSlab;	// Number of steps left until the next slab
+
+		/**
+		 * Find the slab of the current element and tell the block about it.
+		 */
+		void locate();
+	};
+
+	template <std::size_t DIMENSIONALITY>
+	MappedBlock<DIMENSIONALITY>::MappedBlock(std::size_t elementsPerDim, const std::string& fileName, std::size_t windowSlabs)
+	: ComputationalPureBlock<DIMENSIONALITY, std::uint64_t>(elementsPerDim, NULL) {
+		if (0 == windowSlabs) {
+			throw std::runtime_error("The window of a mapped block must have at least one slab");
+		}
+		this->windowSlabs = windowSlabs;
+		numSlabs = elementsPerDim;
+		slabBytes = Math::power(elementsPerDim, DIMENSIONALITY-1) * sizeof(double);
+		fileBytes = numSlabs * slabBytes;
+		fd = open(fileName.c_str(), O_RDWR | O_CREAT, 0644);
+		if (-1 == fd) {
+			throw std::runtime_error("Cannot open " + fileName + ": " + std::strerror(errno));
+		}
+		struct stat status;
+		if (0 != fstat(fd, &status) || (0 != status.st_size && fileBytes != std::size_t(status.st_size))) {
+			close(fd);
+			throw std::runtime_error(fileName + " does not have the size of the block");
+		}
+		// Sparse until the values are written
+		void *mapping = MAP_FAILED;
+		if (0 == ftruncate(fd, fileBytes)) {
+			mapping = mmap(NULL, fileBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_NORESERVE, fd, 0);
+		}
+		if (MAP_FAILED == mapping) {
+			close(fd);
+			throw std::runtime_error("Cannot map " + fileName + ": " + std::strerror(errno));
+		}
+		this->values = static_cast<double *>(mapping);
+		numPrefetched = 0;
+		numReleased = 0;
+		advising = false;
+		stopping = false;
+		thread = std::thread(&MappedBlock::run, this);
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	MappedBlock<DIMENSIONALITY>::~MappedBlock() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		adviceQueued.notify_one();
+		thread.join();
+		munmap(this->values, fileBytes);
+		close(fd);
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	FieldIterator<DIMENSIONALITY> *MappedBlock<DIMENSIONALITY>::getInnerIterator() const {
+		// The iterator advises the block, which is not part of its state
+		return new MappedBlockIterator<DIMENSIONALITY>(const_cast<MappedBlock *>(this));
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	std::size_t MappedBlock<DIMENSIONALITY>::getNumPrefetched() const {
+		std::lock_guard<std::mutex> lock(mutex);
+		return numPrefetched;
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	std::size_t MappedBlock<DIMENSIONALITY>::getNumReleased() const {
+		std::lock_guard<std::mutex> lock(mutex);
+		return numReleased;
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	inline double *MappedBlock<DIMENSIONALITY>::getValues() const {
+		return this->values;
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	void MappedBlock<DIMENSIONALITY>::setValues(double * /* values */) {
+		throw std::runtime_error("The values of a mapped block cannot be replaced");
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	void MappedBlock<DIMENSIONALITY>::sync() {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			adviceGiven.wait(lock, [this]{ return advice.empty() && !advising; });
+		}
+		if (0 != msync(this->values, fileBytes, MS_SYNC)) {
+			throw std::runtime_error(std::string("Cannot write the values of a mapped block: ") + std::strerror(errno));
+		}
+	}
+
+
+	/*** Private methods ***/
+	template <std::size_t DIMENSIONALITY>
+	void MappedBlock<DIMENSIONALITY>::enterSlab(std::size_t slab, bool first) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (first) {
+				Advice ahead = {slab, std::min(slab + windowSlabs + 1, numSlabs), true};
+				advice.push_back(ahead);
+			} else if (slab + windowSlabs < numSlabs) {
+				Advice ahead = {slab + windowSlabs, slab + windowSlabs + 1, true};
+				advice.push_back(ahead);
+			}
+			if (!first && slab > windowSlabs) {
+				Advice behind = {slab - windowSlabs - 1, slab - windowSlabs, false};
+				advice.push_back(behind);
+			}
+		}
+		adviceQueued.notify_one();
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	void MappedBlock<DIMENSIONALITY>::run() {
+		std::size_t pageSize = sysconf(_SC_PAGESIZE);
+		char *start = reinterpret_cast<char *>(this->values);
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true) {
+			adviceQueued.wait(lock, [this]{ return !advice.empty() || stopping; });
+			if (stopping) {
+				return;
+			}
+			Advice current = advice.front();
+			advice.pop_front();
+			advising = true;
+			lock.unlock();
+			std::size_t begin = current.firstSlab * slabBytes;
+			std::size_t end = current.endSlab * slabBytes;
+			if (current.prefetch) {
+				// Include the pages partly in the slabs
+				begin = begin / pageSize * pageSize;
+				madvise(start + begin, end - begin, MADV_WILLNEED);
+			} else {
+				// Leave the pages partly in the neighboring slabs
+				begin = (begin + pageSize - 1) / pageSize * pageSize;
+				end = end / pageSize * pageSize;
+				if (begin < end) {
+					madvise(start + begin, end - begin, MADV_DONTNEED);
+#ifdef SYNC_FILE_RANGE_WRITE
+					sync_file_range(fd, begin, end - begin, SYNC_FILE_RANGE_WRITE);
+#endif
+					// Only drops the pages which are written back already
+					posix_fadvise(fd, begin, end - begin, POSIX_FADV_DONTNEED);
+				}
+			}
+			lock.lock();
+			if (current.prefetch) {
+				numPrefetched += current.endSlab - current.firstSlab;
+			} else {
+				numReleased += current.endSlab - current.firstSlab;
+			}
+			advising = false;
+			adviceGiven.notify_all();
+		}
+	}
+
+
+	template <std::size_t DIMENSIONALITY>
+	MappedBlockIterator<DIMENSIONALITY>::MappedBlockIterator(MappedBlock<DIMENSIONALITY> *block)
+	: ValueFieldIterator<DIMENSIONALITY, std::uint64_t>(block->getSizeArray(), block->getValues()) {
+		this->block = block;
+		slabSize = Math::power(block->getElementsPerDim(), DIMENSIONALITY-1);
+		locate();
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	MappedBlockIterator<DIMENSIONALITY>::~MappedBlockIterator() {
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	void MappedBlockIterator<DIMENSIONALITY>::advance(std::size_t steps) {
+		ValueFieldIterator<DIMENSIONALITY, std::uint64_t>::advance(steps);
+		locate();
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	void MappedBlockIterator<DIMENSIONALITY>::first() {
+		ValueFieldIterator<DIMENSIONALITY, std::uint64_t>::first();
+		locate();
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	inline void MappedBlockIterator<DIMENSIONALITY>::next() {
+		ValueFieldIterator<DIMENSIONALITY, std::uint64_t>::next();
+		if (0 == --stepsInSlab && this->isInField()) {
+			stepsInSlab = slabSize;
+			block->enterSlab(++slab, false);
+		}
+	}
+
+
+	/*** Private methods ***/
+	template <std::size_t DIMENSIONALITY>
+	void MappedBlockIterator<DIMENSIONALITY>::locate() {
+		if (!this->isInField()) {
+			return;
+		}
+		std::size_t indexInSlab = 0;
+		std::size_t stride = 1;
+		for (std::size_t d=0; d+1<DIMENSIONALITY; d++) {
+			indexInSlab += this->currentIndex(d) * stride;
+			stride *= this->size(d);
+		}
+		slab = this->currentIndex(DIMENSIONALITY-1);
+		stepsInSlab = slabSize - indexInSlab;
+		block->enterSlab(slab, true);
+	}
+
+} /* namespace Grid */
+} /* namespace Haparanda */
+
+#endif /* MAPPEDBLOCK_HPP_ */
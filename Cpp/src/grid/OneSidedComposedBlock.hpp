@@ -0,0 +1,272 @@
+#ifndef ONESIDEDCOMPOSEDBLOCK_HPP_
+#define ONESIDEDCOMPOSEDBLOCK_HPP_
+
+#include "ComputationalComposedBlock.hpp"
+
+#include <cstdint>
+#include <stdexcept>
+
+namespace Haparanda {
+namespace Grid {
+
+	/**
+	 * Computational composed block which exchanges boundary data by one-sided
+	 * communication: Each ghost region is stored in memory allocated for an
+	 * MPI window (which the MPI library can register for RDMA), and the
+	 * neighbors put their boundary data directly into it. This avoids the
+	 * message matching on the receiving side, and on networks with good RDMA
+	 * support also the copies through eager buffers.
+	 *
+	 * The accesses are synchronized by post-start-complete-wait epochs, where
+	 * the group of each window consists of the only neighbor that accesses it.
+	 * The epoch of each ghost region is finished separately, so that
+	 * receiveDoneAt can return as soon as any of them is initialized. The
+	 * access epochs of all windows the process puts data into are open at
+	 * the same time, so that the puts proceed concurrently. Along dimensions
+	 * where the block is its own neighbor, the ghost regions are copied
+	 * directly by startSend instead, and no windows are created.
+	 *
+	 * @tparam DIMENSIONALITY Dimensionality of the block
+	 * @tparam INDEX Type of the linear indices of the iterators, see ComputationalComposedBlock
+	 */
+	template <std::size_t DIMENSIONALITY, typename INDEX = std::uint32_t>
+	class OneSidedComposedBlock: public ComputationalComposedBlock<DIMENSIONALITY, INDEX>
+	{
+	public:
+		/**
+		 * Create ghost regions and initialize everything MPI related,
+		 * including the windows exposing the ghost regions.
+		 *
+		 * @param elementsPerDim Block size in each dimension
+		 * @param extent Width of ghost regions
+		 */
+		OneSidedComposedBlock(std::size_t elementsPerDim, std::size_t extent);
+
+		/**
+		 * Create ghost regions and initialize everything MPI related,
+		 * including the windows exposing the ghost regions. Initialize the
+		 * block with its values.
+		 *
+		 * @param elementsPerDim Block size in each dimension
+		 * @param extent Width of ghost regions
+		 * @param values Array containing values to be stored in this block
+		 */
+		OneSidedComposedBlock(std::size_t elementsPerDim, std::size_t extent, double *values);
+
+		virtual ~OneSidedComposedBlock();
+
+		/**
+		 * Wait for the epochs of all ghost regions which have not been handed
+		 * out by receiveDoneAt to finish.
+		 */
+		virtual void finishCommunication();
+
+		/**
+		 * @throws std::runtime_error If no ghost region is being initialized, i.e. if all have been handed out since the communication started
+		 */
+		virtual void receiveDoneAt(BoundaryId *boundary);
+
+	protected:
+		/**
+		 * Expose each ghost region to the neighbor that initializes it. Note
+		 * that nothing is exposed if values is not set!
+		 */
+		virtual void startReceive();
+
+		/**
+		 * Put the boundary data into the ghost regions of the neighbors. Note
+		 * that nothing is sent if values is not set!
+		 */
+		virtual void startSend();
+
+	private:
+		/* ghostWindows[d][j] exposes ghostRegions[d][j] on every process. It
+		 * is accessed by the neighbor at side j, and the data is put into it
+		 * by the neighbor at side 1-j of the accessing process. The windows
+		 * and groups are null along dimensions where the block is its own
+		 * neighbor. */
+		MPI_Win ghostWindows[DIMENSIONALITY][2];
+		MPI_Group exposureGroups[DIMENSIONALITY][2];	// The neighbor that puts data into ghostRegions[d][j]
+		MPI_Group accessGroups[DIMENSIONALITY][2];		// The neighbor whose ghostWindows[d][j] this process puts data into
+		bool exposed[DIMENSIONALITY][2];				// True if the epoch of ghostRegions[d][j] is not finished
+
+		/**
+		 * Create the windows and the groups used for synchronizing the
+		 * accesses to them.
+		 */
+		void initializeWindows();
+	};
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	OneSidedComposedBlock<DIMENSIONALITY, INDEX>::OneSidedComposedBlock(std::size_t elementsPerDim, std::size_t extent)
+	: ComputationalComposedBlock<DIMENSIONALITY, INDEX>(elementsPerDim, extent) {
+		initializeWindows();
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	OneSidedComposedBlock<DIMENSIONALITY, INDEX>::OneSidedComposedBlock(std::size_t elementsPerDim, std::size_t extent, double *values)
+	: ComputationalComposedBlock<DIMENSIONALITY, INDEX>(elementsPerDim, extent, values) {
+		initializeWindows();
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	OneSidedComposedBlock<DIMENSIONALITY, INDEX>::~OneSidedComposedBlock() {
+		// The ghost regions do not delete their values: They are freed with the windows
+		for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+			if (this->isOwnNeighbor(d)) {
+				continue;
+			}
+			for (std::size_t j=0; j<2; j++) {
+				MPI_Win_free(&ghostWindows[d][j]);
+				MPI_Group_free(&exposureGroups[d][j]);
+				MPI_Group_free(&accessGroups[d][j]);
+			}
+		}
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	void OneSidedComposedBlock<DIMENSIONALITY, INDEX>::finishCommunication() {
+		HAPARANDA_REGION("finish");
+		this->communicationTimer->start();
+		for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+			for (std::size_t j=0; j<2; j++) {
+				if (exposed[d][j]) {
+					MPI_Win_wait(ghostWindows[d][j]);
+					exposed[d][j] = false;
+				}
+			}
+		}
+		this->communicationTimer->stop();
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	void OneSidedComposedBlock<DIMENSIONALITY, INDEX>::receiveDoneAt(BoundaryId *boundary) {
+		if (this->ownBoundariesDone < 2*this->numOwnNeighborDims) {
+			// Initialized already by startSend
+			boundary->setDimension(this->ownNeighborDims[this->ownBoundariesDone/2]);
+			boundary->setIsLowerSide(0==this->ownBoundariesDone%2);
+			this->ownBoundariesDone++;
+			return;
+		}
+		bool anyExposed = false;
+		for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+			anyExposed = anyExposed || exposed[d][0] || exposed[d][1];
+		}
+		if (!anyExposed) {
+			// Nothing would ever be done
+			throw std::runtime_error("No ghost region is being initialized");
+		}
+		this->communicationTimer->start();
+		while (true) {
+			for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+				for (std::size_t j=0; j<2; j++) {
+					if (!exposed[d][j]) {
+						continue;
+					}
+					int done;
+					MPI_Win_test(ghostWindows[d][j], &done);
+					if (done) {
+						HAPARANDA_EVENT("received", d, j);
+						exposed[d][j] = false;
+						boundary->setDimension(d);
+						boundary->setIsLowerSide(0==j);
+						this->communicationTimer->stop();
+						return;
+					}
+				}
+			}
+		}
+	}
+
+
+	/*** Protected methods ***/
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	void OneSidedComposedBlock<DIMENSIONALITY, INDEX>::startReceive() {
+		if (NULL == this->values) {
+			return;
+		}
+		this->ownBoundariesDone = 0;
+		for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+			if (this->isOwnNeighbor(d)) {
+				continue;
+			}
+			for (std::size_t j=0; j<2; j++) {
+				MPI_Win_post(exposureGroups[d][j], MPI_MODE_NOSTORE, ghostWindows[d][j]);
+				exposed[d][j] = true;
+			}
+		}
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	void OneSidedComposedBlock<DIMENSIONALITY, INDEX>::startSend() {
+		if (NULL == this->values) {
+			return;
+		}
+		this->communicationTimer->start();
+		// Each window is accessed once, so all access epochs can be open at once
+		for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+			if (this->isOwnNeighbor(d)) {
+				continue;
+			}
+			for (std::size_t j=0; j<2; j++) {
+				MPI_Win_start(accessGroups[d][j], 0, ghostWindows[d][j]);
+			}
+		}
+		for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+			if (this->isOwnNeighbor(d)) {
+				this->copyOwnBoundaryData(d);
+				continue;
+			}
+			for (std::size_t j=0; j<2; j++) {
+				// The boundary at side j ends up in the opposite ghost region of the neighbor
+				int count;
+				MPI::Datatype type;
+				double *data = this->prepareSendData(d, j, &count, &type);
+				this->countSentData(d, j, count, type);
+				MPI_Put(data, count, type, this->neighborRank[d][j], 0,
+						this->ghostRegions[d][1-j]->getNumElements(), MPI_DOUBLE, ghostWindows[d][1-j]);
+			}
+		}
+		for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+			if (this->isOwnNeighbor(d)) {
+				continue;
+			}
+			for (std::size_t j=0; j<2; j++) {
+				MPI_Win_complete(ghostWindows[d][j]);
+			}
+		}
+		this->communicationTimer->stop();
+	}
+
+
+	/*** Private methods ***/
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	void OneSidedComposedBlock<DIMENSIONALITY, INDEX>::initializeWindows() {
+		MPI_Group processGroup;
+		MPI_Comm_group(this->communicator, &processGroup);
+		for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+			for (std::size_t j=0; j<2; j++) {
+				exposed[d][j] = false;
+				if (this->isOwnNeighbor(d)) {
+					// The ghost region keeps its own memory
+					ghostWindows[d][j] = MPI_WIN_NULL;
+					exposureGroups[d][j] = MPI_GROUP_NULL;
+					accessGroups[d][j] = MPI_GROUP_NULL;
+					continue;
+				}
+				GhostRegion<DIMENSIONALITY, INDEX> *ghostRegion = this->ghostRegions[d][j];
+				double *windowMemory;
+				MPI_Win_allocate(ghostRegion->getNumElements() * sizeof(double), sizeof(double),
+						MPI_INFO_NULL, this->communicator, &windowMemory, &ghostWindows[d][j]);
+				ghostRegion->setValues(windowMemory);
+				MPI_Group_incl(processGroup, 1, &this->neighborRank[d][j], &exposureGroups[d][j]);
+				MPI_Group_incl(processGroup, 1, &this->neighborRank[d][1-j], &accessGroups[d][j]);
+			}
+		}
+		MPI_Group_free(&processGroup);
+	}
+
+} /* namespace Grid */
+} /* namespace Haparanda */
+
+#endif /* ONESIDEDCOMPOSEDBLOCK_HPP_ */
@@ -0,0 +1,431 @@
+#ifndef SHAREDMEMORYCOMPOSEDBLOCK_HPP_
+#define SHAREDMEMORYCOMPOSEDBLOCK_HPP_
+
+#include "ComputationalComposedBlock.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <stdexcept>
+#include <thread>
+
+namespace Haparanda {
+namespace Grid {
+
+	/**
+	 * Computational composed block which reads the boundary data of neighbors
+	 * on the same node directly from their value arrays instead of receiving
+	 * copies of it into the ghost regions. The value arrays of all processes
+	 * on a node are allocated in an MPI shared memory window for this
+	 * purpose. Boundary data is exchanged with neighbors on other nodes by
+	 * messages, just as in ComputationalComposedBlock. Along dimensions where
+	 * the block is its own neighbor, the ghost regions are copied directly by
+	 * startSend, also just as in ComputationalComposedBlock.
+	 *
+	 * The processes are synchronized by two counters per process, stored in
+	 * shared memory: One telling for which time step the values are ready to
+	 * be read by the neighbors, and one telling for which time step the
+	 * process has finished reading the values of its neighbors.
+	 * startCommunication waits for the neighbors on the same node to get
+	 * their values ready (which they normally are close to, as they have
+	 * just waited for each other in finishCommunication), so that iterators
+	 * can be created before receiveDoneAt is called. finishCommunication
+	 * waits for them to finish reading. As a consequence, the same rules
+	 * apply as for the message based exchange: The values must not be
+	 * modified between startCommunication and finishCommunication.
+	 *
+	 * Note that the values of this block must be stored in one of the arrays
+	 * returned by getValueArray!
+	 *
+	 * @tparam DIMENSIONALITY Dimensionality of the block
+	 * @tparam INDEX Type of the linear indices of the iterators, see ComputationalComposedBlock
+	 */
+	template <std::size_t DIMENSIONALITY, typename INDEX = std::uint32_t>
+	class SharedMemoryComposedBlock: public ComputationalComposedBlock<DIMENSIONALITY, INDEX>
+	{
+	public:
+		/**
+		 * Create ghost regions, allocate the value arrays in shared memory
+		 * and initialize everything MPI related. Memory is shared with all
+		 * processes on the same node.
+		 *
+		 * @param elementsPerDim Block size in each dimension
+		 * @param extent Width of ghost regions
+		 * @param numValueArrays Number of value arrays to allocate (e.g. 2 if the input and output of a stencil application are swapped after each time step)
+		 */
+		SharedMemoryComposedBlock(std::size_t elementsPerDim, std::size_t extent, std::size_t numValueArrays);
+
+		/**
+		 * Create ghost regions, allocate the value arrays in shared memory
+		 * and initialize everything MPI related. Memory is shared with the
+		 * processes which are both in the specified communicator and on the
+		 * same node. (This makes it possible to emulate several nodes on one
+		 * node.)
+		 *
+		 * @param elementsPerDim Block size in each dimension
+		 * @param extent Width of ghost regions
+		 * @param numValueArrays Number of value arrays to allocate
+		 * @param sharingCandidates Communicator containing the processes which may share memory with this one
+		 */
+		SharedMemoryComposedBlock(std::size_t elementsPerDim, std::size_t extent, std::size_t numValueArrays,
+				MPI_Comm sharingCandidates);
+
+		/**
+		 * Note that the value arrays are freed!
+		 */
+		virtual ~SharedMemoryComposedBlock();
+
+		/**
+		 * Wait for the data to be sent to the neighbors on other nodes, and
+		 * for the neighbors on this node to finish reading the values.
+		 */
+		virtual void finishCommunication();
+
+		virtual BoundaryIterator<DIMENSIONALITY> *getBoundaryIterator() const;
+
+		/**
+		 * @param index Index of the array, < the number of value arrays specified to the constructor
+		 * @return Value array in shared memory, large enough to hold all values of the block
+		 */
+		double *getValueArray(std::size_t index) const;
+
+		/**
+		 * @param dim Dimension of the boundary
+		 * @param side 0 for the lower boundary, 1 for the upper boundary
+		 * @return True if the neighbor at the specified boundary is another process on the same node as this process
+		 */
+		bool sharesMemoryWith(std::size_t dim, std::size_t side) const;
+
+		/**
+		 * @throws std::runtime_error If no ghost region is being initialized, i.e. if all have been handed out since the communication started
+		 */
+		virtual void receiveDoneAt(BoundaryId *boundary);
+
+	protected:
+		/**
+		 * Start receiving from the neighbors on other nodes. Note that nothing
+		 * is started if values is not set!
+		 */
+		virtual void startReceive();
+
+		/**
+		 * Tell the neighbors on this node that the values are ready to be
+		 * read, start sending to the neighbors on other nodes and wait for
+		 * the values of the neighbors on this node to get ready. Note that
+		 * nothing is done if values is not set!
+		 */
+		virtual void startSend();
+
+	private:
+		/**
+		 * State of a process, read by the neighbors on the same node. Each
+		 * state occupies a cache line of its own.
+		 */
+		struct alignas(64) SharedState {
+			std::atomic<long> readyStep;		// Last time step for which the values may be read
+			std::atomic<long> finishedStep;		// Last time step for which the neighbor values have been read
+			std::atomic<long> valueOffset;		// Index of the first value in the value arrays
+		};
+
+		MPI_Comm nodeCommunicator;		// The processes sharing memory with this one
+		MPI_Win valueWindow;
+		MPI_Win stateWindow;
+		std::size_t numValueArrays;
+		std::size_t numPoints;			// Number of elements in each value array
+		double *valueArrays;			// The value arrays of this process
+		SharedState *state;				// The state of this process
+		SharedState *neighborStates[DIMENSIONALITY][2];		// NULL if the neighbor is on another node or this process
+		double *neighborValueArrays[DIMENSIONALITY][2];		// The value arrays of the neighbors on this node
+		double *neighborValues[DIMENSIONALITY][2];			// Current values of the neighbors on this node (set by startSend)
+		bool received[DIMENSIONALITY][2];	// True if the boundary has been handed out by receiveDoneAt
+		long step;						// Current time step, i.e. number of calls to startCommunication
+
+		/**
+		 * Allocate the shared memory and find out which neighbors it is
+		 * shared with.
+		 *
+		 * @param numValueArrays Number of value arrays to allocate
+		 * @param sharingCandidates Communicator containing the processes which may share memory with this one
+		 */
+		void initializeSharedMemory(std::size_t numValueArrays, MPI_Comm sharingCandidates);
+
+		/**
+		 * @param stateMemory Memory allocated for a state, large enough to hold two states
+		 * @return Pointer to the first address in stateMemory which is suitably aligned for a state
+		 */
+		static SharedState *alignState(void *stateMemory);
+
+		/**
+		 * @return Index of the receive request for data to the specified ghost region
+		 */
+		std::size_t receiveIndex(std::size_t dim, std::size_t side) const;
+	};
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	SharedMemoryComposedBlock<DIMENSIONALITY, INDEX>::SharedMemoryComposedBlock(
+			std::size_t elementsPerDim, std::size_t extent, std::size_t numValueArrays)
+	: ComputationalComposedBlock<DIMENSIONALITY, INDEX>(elementsPerDim, extent) {
+		initializeSharedMemory(numValueArrays, MPI_COMM_WORLD);
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	SharedMemoryComposedBlock<DIMENSIONALITY, INDEX>::SharedMemoryComposedBlock(std::size_t elementsPerDim,
+			std::size_t extent, std::size_t numValueArrays, MPI_Comm sharingCandidates)
+	: ComputationalComposedBlock<DIMENSIONALITY, INDEX>(elementsPerDim, extent) {
+		initializeSharedMemory(numValueArrays, sharingCandidates);
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	SharedMemoryComposedBlock<DIMENSIONALITY, INDEX>::~SharedMemoryComposedBlock() {
+		state->~SharedState();
+		MPI_Win_free(&stateWindow);
+		MPI_Win_free(&valueWindow);
+		MPI_Comm_free(&nodeCommunicator);
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	void SharedMemoryComposedBlock<DIMENSIONALITY, INDEX>::finishCommunication() {
+		HAPARANDA_REGION("finish");
+		this->waitForSends();
+		if (NULL == this->values) {
+			return;
+		}
+		this->communicationTimer->start();
+		state->finishedStep.store(step, std::memory_order_release);
+		for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+			for (std::size_t j=0; j<2; j++) {
+				SharedState *neighborState = neighborStates[d][j];
+				if (NULL != neighborState) {
+					while (neighborState->finishedStep.load(std::memory_order_acquire) < step) {
+						std::this_thread::yield();
+					}
+				}
+			}
+		}
+		this->communicationTimer->stop();
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	BoundaryIterator<DIMENSIONALITY> *SharedMemoryComposedBlock<DIMENSIONALITY, INDEX>::getBoundaryIterator() const {
+		assert(NULL != this->values);
+		std::array<std::size_t, DIMENSIONALITY> sizes = this->getSizeArray();
+		FieldIterator<DIMENSIONALITY> ***sideIterators
+		= new FieldIterator<DIMENSIONALITY>**[DIMENSIONALITY];
+		for (std::size_t i=0; i<DIMENSIONALITY; i++) {
+			sideIterators[i] = new FieldIterator<DIMENSIONALITY>*[2];
+			for (std::size_t j=0; j<2; j++) {
+				if (sharesMemoryWith(i, j)) {
+					/* The side iterator iterates over the opposite boundary of
+					 * the whole neighbor block, so the size of the composed
+					 * iterator includes the whole neighbor blocks. */
+					sideIterators[i][j] = new ValueFieldBoundaryIterator<DIMENSIONALITY, INDEX>(sizes, neighborValues[i][j]);
+				} else {
+					sideIterators[i][j] = this->ghostRegions[i][j]->getBoundaryIterator();
+				}
+			}
+		}
+		return new ComposedFieldBoundaryIterator<DIMENSIONALITY, INDEX>(
+				sizes, &(this->values[this->smallestIndex]), sideIterators);
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	inline double *SharedMemoryComposedBlock<DIMENSIONALITY, INDEX>::getValueArray(std::size_t index) const {
+		assert(index < numValueArrays);
+		return &valueArrays[index * numPoints];
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	inline bool SharedMemoryComposedBlock<DIMENSIONALITY, INDEX>::sharesMemoryWith(std::size_t dim, std::size_t side) const {
+		return NULL != neighborStates[dim][side];
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	void SharedMemoryComposedBlock<DIMENSIONALITY, INDEX>::receiveDoneAt(BoundaryId *boundary) {
+		bool anyPending = false;
+		for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+			anyPending = anyPending || !received[d][0] || !received[d][1];
+		}
+		if (!anyPending) {
+			// Nothing would ever be done
+			throw std::runtime_error("No ghost region is being initialized");
+		}
+		this->communicationTimer->start();
+		if (this->ownBoundariesDone < 2*this->numOwnNeighborDims) {
+			// Initialized already by startSend
+			std::size_t dim = this->ownNeighborDims[this->ownBoundariesDone/2];
+			std::size_t side = this->ownBoundariesDone%2;
+			received[dim][side] = true;
+			boundary->setDimension(dim);
+			boundary->setIsLowerSide(0==side);
+			this->ownBoundariesDone++;
+			this->communicationTimer->stop();
+			return;
+		}
+		while (true) {
+			// Neighbors on this node (Their values are ready after startSend.)
+			for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+				for (std::size_t j=0; j<2; j++) {
+					if (!sharesMemoryWith(d, j) || received[d][j]) {
+						continue;
+					}
+					HAPARANDA_EVENT("received", d, j);
+					received[d][j] = true;
+					boundary->setDimension(d);
+					boundary->setIsLowerSide(0==j);
+					this->communicationTimer->stop();
+					return;
+				}
+			}
+			// Neighbors on other nodes
+			int index;
+			if (MPI::Request::Testany(2*DIMENSIONALITY, this->receiveRequest, index) && MPI::UNDEFINED != index) {
+				HAPARANDA_EVENT("received", index/2, 1-index%2);
+				boundary->setDimension(index/2);
+				boundary->setIsLowerSide(1==index%2);
+				received[index/2][1-index%2] = true;
+				this->communicationTimer->stop();
+				return;
+			}
+			std::this_thread::yield();
+		}
+	}
+
+
+	/*** Protected methods ***/
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	void SharedMemoryComposedBlock<DIMENSIONALITY, INDEX>::startReceive() {
+		if (NULL == this->values) {
+			return;
+		}
+		step++;
+		this->ownBoundariesDone = 0;
+		for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+			for (std::size_t j=0; j<2; j++) {
+				received[d][j] = false;
+				std::size_t index = receiveIndex(d, j);
+				if (this->isOwnNeighbor(d) || sharesMemoryWith(d, j)) {
+					this->receiveRequest[index] = MPI::Prequest();
+				} else {
+					this->receiveRequest[index] = this->ghostRegions[d][j]->initializeReceive(
+							this->communicator, this->neighborRank[d][j]);
+					this->receiveRequest[index].Start();
+				}
+			}
+		}
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	void SharedMemoryComposedBlock<DIMENSIONALITY, INDEX>::startSend() {
+		if (NULL == this->values) {
+			return;
+		}
+		this->communicationTimer->start();
+		long offset = this->values - valueArrays;
+		assert(0 <= offset && offset < static_cast<long>(numValueArrays * numPoints));
+		state->valueOffset.store(offset, std::memory_order_relaxed);
+		state->readyStep.store(step, std::memory_order_release);
+		for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+			if (this->isOwnNeighbor(d)) {
+				this->copyOwnBoundaryData(d);
+			}
+			for (std::size_t j=0; j<2; j++) {
+				if (this->isOwnNeighbor(d) || sharesMemoryWith(d, j)) {
+					this->sendRequest[2*d+j] = MPI::Request();
+				} else {
+					int count;
+					MPI::Datatype type;
+					double *data = this->prepareSendData(d, j, &count, &type);
+					this->countSentData(d, j, count, type);
+					this->sendRequest[2*d+j] = this->communicator.Isend(data, count, type,
+							this->neighborRank[d][j], 2*d+j);
+				}
+			}
+		}
+		for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+			for (std::size_t j=0; j<2; j++) {
+				SharedState *neighborState = neighborStates[d][j];
+				if (NULL != neighborState) {
+					while (neighborState->readyStep.load(std::memory_order_acquire) < step) {
+						std::this_thread::yield();
+					}
+					neighborValues[d][j] = &neighborValueArrays[d][j][neighborState->valueOffset.load(std::memory_order_relaxed)];
+				}
+			}
+		}
+		this->communicationTimer->stop();
+	}
+
+
+	/*** Private methods ***/
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	void SharedMemoryComposedBlock<DIMENSIONALITY, INDEX>::initializeSharedMemory(std::size_t numValueArrays, MPI_Comm sharingCandidates) {
+		this->numValueArrays = numValueArrays;
+		this->numPoints = Math::power(this->elementsPerDim, DIMENSIONALITY);
+		this->step = 0;
+		// Nothing is being received before the communication starts
+		for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+			received[d][0] = received[d][1] = true;
+		}
+		MPI_Comm_split_type(sharingCandidates, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &nodeCommunicator);
+
+		/* Let the memory of each process be allocated close to it, and let
+		 * each state have a cache line of its own. */
+		MPI_Info info;
+		MPI_Info_create(&info);
+		MPI_Info_set(info, "alloc_shared_noncontig", "true");
+		MPI_Win_allocate_shared(numValueArrays * numPoints * sizeof(double), sizeof(double),
+				info, nodeCommunicator, &valueArrays, &valueWindow);
+		// The window memory is not necessarily aligned to cache lines
+		void *stateMemory;
+		MPI_Win_allocate_shared(2 * sizeof(SharedState), 1, info, nodeCommunicator, &stateMemory, &stateWindow);
+		MPI_Info_free(&info);
+		state = new (alignState(stateMemory)) SharedState();
+		state->readyStep.store(0);
+		state->finishedStep.store(0);
+		state->valueOffset.store(0);
+
+		// Find the neighbors on this node
+		MPI_Group processGroup;
+		MPI_Group nodeGroup;
+		MPI_Comm_group(this->communicator, &processGroup);
+		MPI_Comm_group(nodeCommunicator, &nodeGroup);
+		for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+			for (std::size_t j=0; j<2; j++) {
+				int nodeRank;
+				MPI_Group_translate_ranks(processGroup, 1, &this->neighborRank[d][j], nodeGroup, &nodeRank);
+				neighborStates[d][j] = NULL;
+				neighborValueArrays[d][j] = NULL;
+				neighborValues[d][j] = NULL;
+				if (MPI_UNDEFINED != nodeRank && !this->isOwnNeighbor(d)) {
+					MPI_Aint size;
+					int displacementUnit;
+					void *stateMemory;
+					MPI_Win_shared_query(stateWindow, nodeRank, &size, &displacementUnit, &stateMemory);
+					neighborStates[d][j] = alignState(stateMemory);
+					MPI_Win_shared_query(valueWindow, nodeRank, &size, &displacementUnit, &neighborValueArrays[d][j]);
+				}
+			}
+		}
+		MPI_Group_free(&processGroup);
+		MPI_Group_free(&nodeGroup);
+		// The states must be initialized before any neighbor reads them
+		MPI_Barrier(nodeCommunicator);
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	inline typename SharedMemoryComposedBlock<DIMENSIONALITY, INDEX>::SharedState *
+	SharedMemoryComposedBlock<DIMENSIONALITY, INDEX>::alignState(void *stateMemory) {
+		std::uintptr_t address = reinterpret_cast<std::uintptr_t>(stateMemory);
+		std::uintptr_t alignment = alignof(SharedState);
+		return reinterpret_cast<SharedState *>((address + alignment - 1) / alignment * alignment);
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	inline std::size_t SharedMemoryComposedBlock<DIMENSIONALITY, INDEX>::receiveIndex(std::size_t dim, std::size_t side) const {
+		// Same numbering as in ComputationalComposedBlock: Odd indices for the lower ghost regions
+		return 2*dim + 1 - side;
+	}
+
+} /* namespace Grid */
+} /* namespace Haparanda */
+
+#endif /* SHAREDMEMORYCOMPOSEDBLOCK_HPP_ */
@@ -14,11 +14,12 @@ namespace Iterators {
 	 * to be stepped through by the iterator.
 	 *
 	 * @tparam DIMENSIONALITY The dimensionality of the block whose boundary will be stepped along by this stepper
+	 * @tparam INDEX Type of the linear indices, see FieldSteppingStrategy
 	 * @author Malin Kallen
 	 * @copyright Malin Kallen 2013-2014, 2016
 	 */
-	template <std::size_t DIMENSIONALITY>
-	class BoundaryStepper: public FieldSteppingStrategy<DIMENSIONALITY>
+	template <std::size_t DIMENSIONALITY, typename INDEX = std::uint32_t>
+	class BoundaryStepper: public FieldSteppingStrategy<DIMENSIONALITY, INDEX>
 	{
 	public:
 		/**
@@ -60,17 +61,17 @@ namespace Iterators {
 		void setIndexLimits();
 	};
 
-	template <std::size_t DIMENSIONALITY>
-	BoundaryStepper<DIMENSIONALITY>::BoundaryStepper(const std::array<std::size_t, DIMENSIONALITY>& sizes)
-	: FieldSteppingStrategy<DIMENSIONALITY>(sizes) {
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	BoundaryStepper<DIMENSIONALITY, INDEX>::BoundaryStepper(const std::array<std::size_t, DIMENSIONALITY>& sizes)
+	: FieldSteppingStrategy<DIMENSIONALITY, INDEX>(sizes) {
 	}
 
-	template <std::size_t DIMENSIONALITY>
-	BoundaryStepper<DIMENSIONALITY>::~BoundaryStepper() {
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	BoundaryStepper<DIMENSIONALITY, INDEX>::~BoundaryStepper() {
 	}
 
-	template <std::size_t DIMENSIONALITY>
-	inline void BoundaryStepper<DIMENSIONALITY>::next() {
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	inline void BoundaryStepper<DIMENSIONALITY, INDEX>::next() {
 		assert(this->isInField());
 		const std::size_t stride = this->stride[boundary.getDimension()];
 		if ((this->index+1) % stride != 0) {
@@ -82,8 +83,8 @@ namespace Iterators {
 		}
 	}
 
-	template <std::size_t DIMENSIONALITY>
-	inline void BoundaryStepper<DIMENSIONALITY>::setBoundaryToIterate(const BoundaryId& boundary) {
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	inline void BoundaryStepper<DIMENSIONALITY, INDEX>::setBoundaryToIterate(const BoundaryId& boundary) {
 		assert(DIMENSIONALITY > boundary.getDimension());
 		this->boundary = boundary;
 		setIndexLimits();
@@ -92,8 +93,8 @@ namespace Iterators {
 
 
 	/*** Private methods ***/
-	template <std::size_t DIMENSIONALITY>
-	inline void BoundaryStepper<DIMENSIONALITY>::setIndexLimits() {
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	inline void BoundaryStepper<DIMENSIONALITY, INDEX>::setIndexLimits() {
 		const std::size_t boundarySize = 0 == this->totalSize ? 0 : this->totalSize/this->size[boundary.getDimension()];
 		size_t threadId = OMP_THREAD_ID;
 		size_t numThreads = OMP_NUM_THREADS;
@@ -12,10 +12,11 @@ namespace Iterators {
 	 * A class representing an iterator over the boundary of a composed field.
 	 *
 	 * @tparam ORDER Order/dimensionality of the field
+	 * @tparam INDEX Type of the linear indices of the iterator over the main region, see FieldSteppingStrategy
 	 * @author Malin Kallen
 	 * @copyright Malin Kallen 2014, 2016, 2017
 	 */
-	template <std::size_t ORDER>
+	template <std::size_t ORDER, typename INDEX = std::uint32_t>
 	class ComposedFieldBoundaryIterator : public ComposedFieldIterator<ORDER>, public BoundaryIterator<ORDER>
 	{
 	public:
@@ -42,30 +43,30 @@ namespace Iterators {
 		virtual FieldIterator<ORDER> *currentSideIterator() const;
 	};
 
-	template <std::size_t ORDER>
-	ComposedFieldBoundaryIterator<ORDER>::ComposedFieldBoundaryIterator(
+	template <std::size_t ORDER, typename INDEX>
+	ComposedFieldBoundaryIterator<ORDER, INDEX>::ComposedFieldBoundaryIterator(
 			const std::array<std::size_t, ORDER>& sizes, double *data, FieldIterator<ORDER> ***sideIterators) {
 		this->initialize(sizes, data, sideIterators);
 	}
 
-	template <std::size_t ORDER>
-	ComposedFieldBoundaryIterator<ORDER>::~ComposedFieldBoundaryIterator() {
+	template <std::size_t ORDER, typename INDEX>
+	ComposedFieldBoundaryIterator<ORDER, INDEX>::~ComposedFieldBoundaryIterator() {
 	}
 
-	template <std::size_t ORDER>
-	inline void ComposedFieldBoundaryIterator<ORDER>::first() {
+	template <std::size_t ORDER, typename INDEX>
+	inline void ComposedFieldBoundaryIterator<ORDER, INDEX>::first() {
 		this->mainIterator->first();
 		currentSideIterator()->first();
 	}
 
-	template <std::size_t ORDER>
-	inline void ComposedFieldBoundaryIterator<ORDER>::next() {
+	template <std::size_t ORDER, typename INDEX>
+	inline void ComposedFieldBoundaryIterator<ORDER, INDEX>::next() {
 		this->mainIterator->next();
 		currentSideIterator()->next();
 	}
 
-	template <std::size_t ORDER>
-	void ComposedFieldBoundaryIterator<ORDER>::setBoundaryToIterate(const BoundaryId& boundary) {
+	template <std::size_t ORDER, typename INDEX>
+	void ComposedFieldBoundaryIterator<ORDER, INDEX>::setBoundaryToIterate(const BoundaryId& boundary) {
 		this->currentBoundary = boundary;
 		dynamic_cast<BoundaryIterator<ORDER>&>(*this->mainIterator).setBoundaryToIterate(this->currentBoundary);
 		BoundaryId *oppositeBoundary = this->currentBoundary.oppositeSide();
@@ -76,13 +77,13 @@ namespace Iterators {
 
 
 	/*** Protected methods ***/
-	template <std::size_t ORDER>
-	void ComposedFieldBoundaryIterator<ORDER>::createMainIterator(const std::array<std::size_t, ORDER>& sizes, double *data) {
-		this->mainIterator = new ValueFieldBoundaryIterator<ORDER>(sizes, data);
+	template <std::size_t ORDER, typename INDEX>
+	void ComposedFieldBoundaryIterator<ORDER, INDEX>::createMainIterator(const std::array<std::size_t, ORDER>& sizes, double *data) {
+		this->mainIterator = new ValueFieldBoundaryIterator<ORDER, INDEX>(sizes, data);
 	}
 
-	template <std::size_t ORDER>
-	inline FieldIterator<ORDER> *ComposedFieldBoundaryIterator<ORDER>::currentSideIterator() const {
+	template <std::size_t ORDER, typename INDEX>
+	inline FieldIterator<ORDER> *ComposedFieldBoundaryIterator<ORDER, INDEX>::currentSideIterator() const {
 		std::size_t currentDimension = this->currentBoundary.getDimension();
 		std::size_t currentSide = this->currentBoundary.isLowerSide() ? 0 : 1;
 		return this->sideIterators[currentDimension][currentSide];
@@ -21,6 +21,14 @@ namespace Iterators {
 	public:
 		virtual ~FieldIterator();
 
+		/**
+		 * Advance the iterator the specified number of steps, or past its
+		 * last element if it has fewer steps left.
+		 *
+		 * @param steps Number of steps to take
+		 */
+		virtual void advance(std::size_t steps);
+
 		/**
 		 * @param dimension Specifies which index should be retrieved, see description of the return value
 		 * @return The <code>dimension</code>:th coordinate of the index of the element currently pointed at by the iterator
@@ -85,6 +93,13 @@ namespace Iterators {
 	FieldIterator<ORDER>::~FieldIterator() {
 	}
 
+	template <std::size_t ORDER>
+	void FieldIterator<ORDER>::advance(std::size_t steps) {
+		for (std::size_t s=0; s<steps && isInField(); s++) {
+			next();
+		}
+	}
+
 } /* namespace Iterators */
 } /* namespace Haparanda */
 
@@ -5,6 +5,9 @@
 
 #include <array>
 #include <cassert>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
 
 #ifdef _OPENMP
 #include <omp.h>
@@ -22,17 +25,18 @@ using namespace Haparanda::Utils;
 namespace Haparanda {
 namespace Iterators {
 	template <std::size_t ORDER> class FieldIterator;
-	template <std::size_t ORDER> class PureFieldIterator;
+	template <std::size_t ORDER, typename INDEX> class PureFieldIterator;
 
 	/**
 	 * Strategy that defines how an iterator is stepped through a field (or
 	 * tensor) of the specified order.
 	 *
 	 * @tparam ORDER Order of the field which is stepped through.
+	 * @tparam INDEX Unsigned type of the linear indices and strides. The default 32-bit indices are divided faster, but std::uint64_t is needed for fields with 2^32 elements or more.
 	 * @author Malin Kallen
 	 * @copyright Malin Kallen 2013-2014, 2016-2017
 	 */
-	template <std::size_t ORDER>
+	template <std::size_t ORDER, typename INDEX = std::uint32_t>
 	class FieldSteppingStrategy
 	{
 	public:
@@ -91,72 +95,88 @@ namespace Iterators {
 		 */
 		virtual void next() = 0;
 
+		/**
+		 * Advance the iterator the specified number of steps, or past its
+		 * last element if it has fewer steps left.
+		 *
+		 * @param steps Number of steps to take
+		 */
+		virtual void advance(std::size_t steps);
+
 		std::size_t minIndex, maxIndex, index;
-		std::array<uint32_t, ORDER+1> stride;
-		std::array<uint32_t, ORDER> size;
+		std::array<INDEX, ORDER+1> stride;
+		std::array<INDEX, ORDER> size;
 		std::size_t totalSize;
 
-		std::array<MagicNumber, ORDER+1> magicStrideNumbers;
-		std::array<MagicNumber, ORDER> magicSizeNumbers;
+		// Magic numbers of the same width as the indices
+		typedef typename std::conditional<sizeof(INDEX) <= sizeof(std::uint32_t), MagicNumber, MagicNumber64>::type Magic;
+		std::array<Magic, ORDER+1> magicStrideNumbers;
+		std::array<Magic, ORDER> magicSizeNumbers;
 
 		friend class FieldIterator<ORDER>;
-		friend class PureFieldIterator<ORDER>;
+		friend class PureFieldIterator<ORDER, INDEX>;
 	};
 
-	template <std::size_t ORDER>
-	FieldSteppingStrategy<ORDER>::FieldSteppingStrategy(const std::array<std::size_t, ORDER>& sizes) {
+	template <std::size_t ORDER, typename INDEX>
+	FieldSteppingStrategy<ORDER, INDEX>::FieldSteppingStrategy(const std::array<std::size_t, ORDER>& sizes) {
+		static_assert(std::is_unsigned<INDEX>::value && sizeof(INDEX) <= sizeof(std::uint64_t), "Unsupported index type");
 		totalSize = 1;
 		stride[0] = 1;
-		magicStrideNumbers[0] = MagicNumber::getMagicNumbers(stride[0]);
+		magicStrideNumbers[0] = Magic::getMagicNumbers(stride[0]);
 		for (std::size_t i=0; i<ORDER; i++) {
-			assert(sizes[i] <= 4294967295); // as it must fit in an uint32!
+			// All strides, including the total size, must fit in INDEX
+			if (0 != sizes[i] && stride[i] > std::numeric_limits<INDEX>::max() / sizes[i]) {
+				throw std::runtime_error("Field too large for its index type; use 64-bit indices");
+			}
 			size[i] = sizes[i];
 			totalSize *= this->size[i];
-			magicSizeNumbers[i] = MagicNumber::getMagicNumbers(size[i]);
+			magicSizeNumbers[i] = Magic::getMagicNumbers(size[i]);
 			stride[i+1] = stride[i] * size[i];
-			magicStrideNumbers[i+1] = MagicNumber::getMagicNumbers(stride[i+1]);
+			magicStrideNumbers[i+1] = Magic::getMagicNumbers(stride[i+1]);
 		}
 	}
 
-	template <std::size_t ORDER>
-	FieldSteppingStrategy<ORDER>::~FieldSteppingStrategy() {
+	template <std::size_t ORDER, typename INDEX>
+	FieldSteppingStrategy<ORDER, INDEX>::~FieldSteppingStrategy() {
 	}
 
 
-	template <std::size_t ORDER>
-	inline std::size_t FieldSteppingStrategy<ORDER>::currentIndex(std::size_t dimension) const {
+	template <std::size_t ORDER, typename INDEX>
+	inline std::size_t FieldSteppingStrategy<ORDER, INDEX>::currentIndex(std::size_t dimension) const {
 		assert(isInField());
 		// indexAlongDimension = index/stride[dimension]
-		uint64_t indexAlongDimension =
-		(((index * magicStrideNumbers[dimension].M) >> 32) +
-			index * magicStrideNumbers[dimension].a) >>
-				magicStrideNumbers[dimension].s;
+		uint64_t indexAlongDimension = magicStrideNumbers[dimension].divide(index);
 		// n = indexAlongDimension / size[dimension]
-		uint64_t n = (((indexAlongDimension * magicSizeNumbers[dimension].M) >> 32) +
-				indexAlongDimension * magicSizeNumbers[dimension].a) >>
-				magicSizeNumbers[dimension].s;
+		uint64_t n = magicSizeNumbers[dimension].divide(indexAlongDimension);
 		// return indexAlongDimension % size[dimension]
 		return indexAlongDimension - size[dimension] * n;
 	}
 
-	template <std::size_t ORDER>
-	inline bool FieldSteppingStrategy<ORDER>::isInField() const {
+	template <std::size_t ORDER, typename INDEX>
+	inline bool FieldSteppingStrategy<ORDER, INDEX>::isInField() const {
 		return index>=minIndex && index<=maxIndex;
 	}
 
-	template <std::size_t ORDER>
-	inline void FieldSteppingStrategy<ORDER>::first() {
+	template <std::size_t ORDER, typename INDEX>
+	void FieldSteppingStrategy<ORDER, INDEX>::advance(std::size_t steps) {
+		for (std::size_t s=0; s<steps && isInField(); s++) {
+			next();
+		}
+	}
+
+	template <std::size_t ORDER, typename INDEX>
+	inline void FieldSteppingStrategy<ORDER, INDEX>::first() {
 		index = minIndex;
 	}
 
-	template <std::size_t ORDER>
-	inline std::size_t FieldSteppingStrategy<ORDER>::linearNeighborIndex(std::size_t dimension, int offset) const {
+	template <std::size_t ORDER, typename INDEX>
+	inline std::size_t FieldSteppingStrategy<ORDER, INDEX>::linearNeighborIndex(std::size_t dimension, int offset) const {
 		assert(neighborInField(dimension, offset));
-		return index + offset * (int)stride[dimension];
+		return index + offset * static_cast<typename std::make_signed<INDEX>::type>(stride[dimension]);
 	}
 
-	template <std::size_t ORDER>
-	inline bool FieldSteppingStrategy<ORDER>::neighborInField(std::size_t dimension, int offset) const {
+	template <std::size_t ORDER, typename INDEX>
+	inline bool FieldSteppingStrategy<ORDER, INDEX>::neighborInField(std::size_t dimension, int offset) const {
 		const long neighborIndexInDimension = offset + currentIndex(dimension);
 		return neighborIndexInDimension >= 0
 				&& neighborIndexInDimension < static_cast<long>(size[dimension]);
@@ -11,10 +11,11 @@ namespace Iterators {
 	 * with dimensionality information included, e.g. a field or a tensor.
 	 *
 	 * @tparam ORDER Order/dimensionality of the data structure
+	 * @tparam INDEX Type of the linear indices, see FieldSteppingStrategy
 	 * @author Malin Kallen
 	 * @copyright Malin Kallen 2014, 2016, 2017
 	 */
-	template <std::size_t ORDER>
+	template <std::size_t ORDER, typename INDEX = std::uint32_t>
 	class PureFieldIterator : virtual public FieldIterator<ORDER>
 	{
 	public:
@@ -31,6 +32,8 @@ namespace Iterators {
 		 */
 		virtual ~PureFieldIterator();
 
+		virtual void advance(std::size_t steps);
+
 		virtual std::size_t currentIndex(std::size_t dimension) const;
 
 		virtual double currentNeighbor(std::size_t dimension, int offset) const;
@@ -50,7 +53,7 @@ namespace Iterators {
 		virtual std::size_t size(std::size_t dimension) const;
 
 	protected:
-		FieldSteppingStrategy<ORDER> *stepper;
+		FieldSteppingStrategy<ORDER, INDEX> *stepper;
 		ValueType *getter;
 
 		/**
@@ -78,14 +81,14 @@ namespace Iterators {
 		void initialize(const std::array<std::size_t, ORDER>& sizes, double *data);
 	};
 
-	template <std::size_t ORDER>
-	PureFieldIterator<ORDER>::PureFieldIterator() {
+	template <std::size_t ORDER, typename INDEX>
+	PureFieldIterator<ORDER, INDEX>::PureFieldIterator() {
 		stepper = NULL;
 		getter = NULL;
 	}
 
-	template <std::size_t ORDER>
-	PureFieldIterator<ORDER>::~PureFieldIterator() {
+	template <std::size_t ORDER, typename INDEX>
+	PureFieldIterator<ORDER, INDEX>::~PureFieldIterator() {
 		if (NULL != stepper) {
 			delete stepper;
 		}
@@ -94,62 +97,67 @@ namespace Iterators {
 		}
 	}
 
-	template <std::size_t ORDER>
-	inline std::size_t PureFieldIterator<ORDER>::currentIndex(std::size_t dimension) const {
+	template <std::size_t ORDER, typename INDEX>
+	inline void PureFieldIterator<ORDER, INDEX>::advance(std::size_t steps) {
+		this->stepper->advance(steps);
+	}
+
+	template <std::size_t ORDER, typename INDEX>
+	inline std::size_t PureFieldIterator<ORDER, INDEX>::currentIndex(std::size_t dimension) const {
 		assert(this->stepper->isInField());
 		return this->stepper->currentIndex(dimension);
 	}
 
-	template <std::size_t ORDER>
-	inline double PureFieldIterator<ORDER>::currentNeighbor(std::size_t dimension, int offset) const {
+	template <std::size_t ORDER, typename INDEX>
+	inline double PureFieldIterator<ORDER, INDEX>::currentNeighbor(std::size_t dimension, int offset) const {
 		assert(this->stepper->neighborInField(dimension, offset));
 		std::size_t neighborIndex = this->stepper->linearNeighborIndex(dimension, offset);
 		return this->getter->getValue(neighborIndex);
 	}
 
-	template <std::size_t ORDER>
-	inline double PureFieldIterator<ORDER>::currentValue() const {
+	template <std::size_t ORDER, typename INDEX>
+	inline double PureFieldIterator<ORDER, INDEX>::currentValue() const {
 		assert(this->stepper->isInField());
 		return this->getter->getValue(this->stepper->index);
 	}
 
-	template <std::size_t ORDER>
-	inline void PureFieldIterator<ORDER>::first() {
+	template <std::size_t ORDER, typename INDEX>
+	inline void PureFieldIterator<ORDER, INDEX>::first() {
 		this->stepper->first();
 	}
 
-	template <std::size_t ORDER>
-	inline bool PureFieldIterator<ORDER>::isInField() const {
+	template <std::size_t ORDER, typename INDEX>
+	inline bool PureFieldIterator<ORDER, INDEX>::isInField() const {
 		return this->stepper->isInField();
 	}
 
-	template <std::size_t ORDER>
-	inline void PureFieldIterator<ORDER>::next() {
+	template <std::size_t ORDER, typename INDEX>
+	inline void PureFieldIterator<ORDER, INDEX>::next() {
 		this->stepper->next();
 	}
 
-	template<std::size_t ORDER>
-	inline void PureFieldIterator<ORDER>::setCurrentValue(double newValue) {
+	template<std::size_t ORDER, typename INDEX>
+	inline void PureFieldIterator<ORDER, INDEX>::setCurrentValue(double newValue) {
 		assert(this->stepper->isInField());
 		this->getter->setValue(this->stepper->index, newValue);
 	}
 
-	template<std::size_t ORDER>
-	inline void PureFieldIterator<ORDER>::setCurrentNeighbor(std::size_t dimension, int offset, double newValue) {
+	template<std::size_t ORDER, typename INDEX>
+	inline void PureFieldIterator<ORDER, INDEX>::setCurrentNeighbor(std::size_t dimension, int offset, double newValue) {
 		assert(this->stepper->neighborInField(dimension, offset));
 		std::size_t neighborIndex = this->stepper->linearNeighborIndex(dimension, offset);
 		this->getter->setValue(neighborIndex, newValue);
 	}
 
-	template<std::size_t ORDER>
-	inline std::size_t PureFieldIterator<ORDER>::size(std::size_t dimension) const {
+	template<std::size_t ORDER, typename INDEX>
+	inline std::size_t PureFieldIterator<ORDER, INDEX>::size(std::size_t dimension) const {
 		return this->stepper->size[dimension];
 	}
 
 
 	/** Protected methods ***/
-	template<std::size_t ORDER>
-	inline void PureFieldIterator<ORDER>::initialize(const std::array<std::size_t, ORDER>& sizes, double *data) {
+	template<std::size_t ORDER, typename INDEX>
+	inline void PureFieldIterator<ORDER, INDEX>::initialize(const std::array<std::size_t, ORDER>& sizes, double *data) {
 		createStepper(sizes);
 		createGetter(data);
 	}
@@ -13,12 +13,13 @@ namespace Iterators {
 	 * dimensionality.
 	 *
 	 * @tparam ORDER Order/dimensionality of the data structure
+	 * @tparam INDEX Type of the linear indices, see FieldSteppingStrategy
 	 * @author Malin Kallen
 	 * @copyright Malin Kallen 2014, 2016, 2017
 	 */
-	template <std::size_t ORDER>
+	template <std::size_t ORDER, typename INDEX = std::uint32_t>
 	class ValueFieldBoundaryIterator
-			: public PureFieldIterator<ORDER>,
+			: public PureFieldIterator<ORDER, INDEX>,
 			  public BoundaryIterator<ORDER>
 	{
 	public:
@@ -54,32 +55,32 @@ namespace Iterators {
 		virtual void createStepper(const std::array<std::size_t, ORDER>& sizes);
 	};
 
-	template <std::size_t ORDER>
-	ValueFieldBoundaryIterator<ORDER>::ValueFieldBoundaryIterator(
+	template <std::size_t ORDER, typename INDEX>
+	ValueFieldBoundaryIterator<ORDER, INDEX>::ValueFieldBoundaryIterator(
 				const std::array<std::size_t, ORDER>& sizes, double *values) {
 		this->initialize(sizes, values);
 	}
 
-	template <std::size_t ORDER>
-	ValueFieldBoundaryIterator<ORDER>::~ValueFieldBoundaryIterator() {
+	template <std::size_t ORDER, typename INDEX>
+	ValueFieldBoundaryIterator<ORDER, INDEX>::~ValueFieldBoundaryIterator() {
 	}
 
 
 	/*** Protected methods ***/
-	template <std::size_t ORDER>
-	inline void ValueFieldBoundaryIterator<ORDER>::createGetter(double *values) {
+	template <std::size_t ORDER, typename INDEX>
+	inline void ValueFieldBoundaryIterator<ORDER, INDEX>::createGetter(double *values) {
 		this->getter = new ValueArray(values);
 	}
 
-	template <std::size_t ORDER>
-	inline void ValueFieldBoundaryIterator<ORDER>::createStepper(const std::array<std::size_t, ORDER>& sizes) {
-		this->stepper = new BoundaryStepper<ORDER>(sizes);
+	template <std::size_t ORDER, typename INDEX>
+	inline void ValueFieldBoundaryIterator<ORDER, INDEX>::createStepper(const std::array<std::size_t, ORDER>& sizes) {
+		this->stepper = new BoundaryStepper<ORDER, INDEX>(sizes);
 	}
 
-	template <std::size_t ORDER>
-	void ValueFieldBoundaryIterator<ORDER>::setBoundaryToIterate(const BoundaryId& boundary) {
+	template <std::size_t ORDER, typename INDEX>
+	void ValueFieldBoundaryIterator<ORDER, INDEX>::setBoundaryToIterate(const BoundaryId& boundary) {
 		this->currentBoundary = boundary;
-		(static_cast<BoundaryStepper<ORDER> &>(*this->stepper))
+		(static_cast<BoundaryStepper<ORDER, INDEX> &>(*this->stepper))
 				.setBoundaryToIterate(this->currentBoundary);
 		this->first();
 	}
@@ -14,11 +14,12 @@ namespace Iterators {
 	 * tensor.
 	 *
 	 * @tparam ORDER Order/dimensionality of the field
+	 * @tparam INDEX Type of the linear indices, see FieldSteppingStrategy
 	 * @author Malin Kallen
 	 * @copyright Malin Kallen 2014, 2016, 2017
 	 */
-	template <std::size_t ORDER>
-	class ValueFieldIterator: public PureFieldIterator<ORDER>
+	template <std::size_t ORDER, typename INDEX = std::uint32_t>
+	class ValueFieldIterator: public PureFieldIterator<ORDER, INDEX>
 	{
 	public:
 		/**
@@ -49,24 +50,24 @@ namespace Iterators {
 		virtual void createStepper(const std::array<std::size_t, ORDER>& sizes);
 	};
 
-	template <std::size_t ORDER>
-	ValueFieldIterator<ORDER>::ValueFieldIterator(
+	template <std::size_t ORDER, typename INDEX>
+	ValueFieldIterator<ORDER, INDEX>::ValueFieldIterator(
 				const std::array<std::size_t, ORDER>& sizes, double *values) {
 		this->initialize(sizes, values);
 	}
 
-	template <std::size_t ORDER>
-	ValueFieldIterator<ORDER>::~ValueFieldIterator() {
+	template <std::size_t ORDER, typename INDEX>
+	ValueFieldIterator<ORDER, INDEX>::~ValueFieldIterator() {
 	}
 
-	template <std::size_t ORDER>
-	inline void ValueFieldIterator<ORDER>::createGetter(double *values) {
+	template <std::size_t ORDER, typename INDEX>
+	inline void ValueFieldIterator<ORDER, INDEX>::createGetter(double *values) {
 		this->getter = new ValueArray(values);
 	}
 
-	template <std::size_t ORDER>
-	inline void ValueFieldIterator<ORDER>::createStepper(const std::array<std::size_t, ORDER>& sizes) {
-		this->stepper = new WholeFieldStepper<ORDER>(sizes);
+	template <std::size_t ORDER, typename INDEX>
+	inline void ValueFieldIterator<ORDER, INDEX>::createStepper(const std::array<std::size_t, ORDER>& sizes) {
+		this->stepper = new WholeFieldStepper<ORDER, INDEX>(sizes);
 	}
 
 } /* namespace Iterators */
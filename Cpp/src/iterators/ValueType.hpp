@@ -35,7 +35,7 @@ namespace Iterators {
 		virtual void setValue(std::size_t index, double newValue) = 0;
 
 		template<std::size_t ORDER> friend class FieldIterator;
-		template<std::size_t ORDER> friend class PureFieldIterator;
+		template<std::size_t ORDER, typename INDEX> friend class PureFieldIterator;
 	};
 
 	ValueType::~ValueType() {
@@ -11,11 +11,12 @@ namespace Iterators {
 	 * from 0 to total size - 1.
 	 *
 	 * @tparam ORDER Order of the field which this stepper steps through
+	 * @tparam INDEX Type of the linear indices, see FieldSteppingStrategy
 	 * @author Malin Kallen
 	 * @copyright Malin Kallen 2013-2014, 2016
 	 */
-	template <std::size_t ORDER>
-	class WholeFieldStepper: public FieldSteppingStrategy<ORDER>
+	template <std::size_t ORDER, typename INDEX = std::uint32_t>
+	class WholeFieldStepper: public FieldSteppingStrategy<ORDER, INDEX>
 	{
 	public:
 
@@ -49,6 +50,14 @@ namespace Iterators {
 		 */
 		virtual void next();
 
+		/**
+		 * Advance the iterator the specified number of steps at once, or
+		 * past its last element if it has fewer steps left.
+		 *
+		 * @param steps Number of steps to take
+		 */
+		virtual void advance(std::size_t steps);
+
 	private:
 		friend class WholeFieldStepperTest;
 		friend class WholeFieldStepperDeathTest;
@@ -59,32 +68,42 @@ namespace Iterators {
 		void setIndexLimits();
 	};
 
-	template <std::size_t ORDER>
-	WholeFieldStepper<ORDER>::WholeFieldStepper(const std::array<std::size_t, ORDER>& sizes)
-	: FieldSteppingStrategy<ORDER>(sizes) {
+	template <std::size_t ORDER, typename INDEX>
+	WholeFieldStepper<ORDER, INDEX>::WholeFieldStepper(const std::array<std::size_t, ORDER>& sizes)
+	: FieldSteppingStrategy<ORDER, INDEX>(sizes) {
 		setIndexLimits();
 		this->first();
 	}
 
-	template <std::size_t ORDER>
-	WholeFieldStepper<ORDER>::~WholeFieldStepper() {
+	template <std::size_t ORDER, typename INDEX>
+	WholeFieldStepper<ORDER, INDEX>::~WholeFieldStepper() {
 	}
 
-	template <std::size_t ORDER>
-	inline void WholeFieldStepper<ORDER>::next() {
+	template <std::size_t ORDER, typename INDEX>
+	inline void WholeFieldStepper<ORDER, INDEX>::next() {
 		assert(this->isInField());
 		this->index++;
 	}
 
-	template <std::size_t ORDER>
-	inline void WholeFieldStepper<ORDER>::setIndexLimits() {
-		int chunk = this->totalSize / OMP_NUM_THREADS;
-		int offset = this->totalSize % OMP_NUM_THREADS;
-		if (OMP_THREAD_ID < offset) {
+	template <std::size_t ORDER, typename INDEX>
+	inline void WholeFieldStepper<ORDER, INDEX>::advance(std::size_t steps) {
+		if (this->isInField()) {
+			this->index = steps > this->maxIndex - this->index ? this->maxIndex + 1 : this->index + steps;
+		}
+	}
+
+	template <std::size_t ORDER, typename INDEX>
+	inline void WholeFieldStepper<ORDER, INDEX>::setIndexLimits() {
+		// Not int, as the field may have 2^31 elements or more with 64-bit indices
+		std::size_t threadId = OMP_THREAD_ID;
+		std::size_t numThreads = OMP_NUM_THREADS;
+		std::size_t chunk = this->totalSize / numThreads;
+		std::size_t offset = this->totalSize % numThreads;
+		if (threadId < offset) {
 			chunk++;
-			this->minIndex = chunk * OMP_THREAD_ID;
+			this->minIndex = chunk * threadId;
 		} else {
-			this->minIndex = chunk * OMP_THREAD_ID + offset;
+			this->minIndex = chunk * threadId + offset;
 		}
 		this->maxIndex = this->minIndex + chunk-1;
 	}
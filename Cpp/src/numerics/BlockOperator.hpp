@@ -2,6 +2,11 @@
 #define BLOCKOPERATOR_HPP_
 
 #include "src/grid/ComputationalComposedBlock.hpp"
+#include "src/utils/PerformanceCounters.hpp"
+#include "src/utils/Profiler.hpp"
+
+#include <stdexcept>
+#include <vector>
 
 namespace Haparanda {
 namespace Numerics {
@@ -33,16 +38,108 @@ namespace Numerics {
 		 */
 		void apply(CommunicativeBlock& input, ComputationalBlock *result) const;
 
+		/**
+		 * Apply the operator close to the specified boundary only. The ghost
+		 * region outside it must be initialized.
+		 *
+		 * @param input Block representing the data on which the operator will be applied
+		 * @param result Block to which the result will be written
+		 * @param boundary Boundary along which the operator will be applied
+		 */
+		void applyAtBoundary(const ComputationalBlock& input, ComputationalBlock *result, const BoundaryId& boundary) const;
+
+		/**
+		 * Apply the operator in the inner part of the block only, i.e. where
+		 * no ghost regions are needed.
+		 *
+		 * @param input Block representing the data on which the operator will be applied
+		 * @param result Block to which the result will be written
+		 */
+		void applyInner(const ComputationalBlock& input, ComputationalBlock *result) const;
+
 		/**
 		* @return The total time spent on actual computations by this stencil, in seconds
 		*/
 		double computationTime() const;
 
+		/**
+		 * @return The time each thread has spent in the parallel regions of the computations, in seconds, indexed by thread number
+		 */
+		const std::vector<double>& threadComputationTimes() const;
+
+		/**
+		 * Count hardware events of the threads in the parallel regions of the
+		 * computations, per phase (interior or boundary).
+		 *
+		 * @param counters Counters to accumulate the events in, or NULL to stop counting. Not deleted by the operator.
+		 */
+		void setPerformanceCounters(Utils::PerformanceCounters *counters);
+
+		/**
+		 * Create an operator like this one, for blocks whose step lengths are
+		 * 2^-level times those this operator is created for, e.g. for refined
+		 * blocks of a domain. The caller is responsible for deleting it.
+		 *
+		 * @param level Number of times the step lengths are halved
+		 * @return The new operator, or NULL if this operator cannot be refined
+		 */
+		virtual BlockOperator *refined(std::size_t level) const;
+
+		/**
+		 * Get an operator for refined blocks (See refined.) It is created the
+		 * first time a level is asked for, and then reused until this operator
+		 * is deleted. Its computations are measured as computations of this
+		 * operator, i.e. they are included in the times and events of this
+		 * operator.
+		 *
+		 * @param level Number of times the step lengths are halved
+		 * @return The operator for the level, this operator if the level is 0. Not to be deleted by the caller.
+		 * @throws std::runtime_error If this operator cannot be refined
+		 */
+		const BlockOperator *atLevel(std::size_t level) const;
+
 	protected:
 
 		// Timer for the computations
 		Haparanda::Utils::Timer *computationTimer;
 
+		// Time spent by each thread in the parallel regions of the computations
+		std::vector<double> *threadTimes;
+
+		// Events counted in the parallel regions of the computations, NULL if they are not counted
+		Utils::PerformanceCounters *counters;
+
+		// Operator whose timer, thread times and counters the computations are measured by: this one unless returned by atLevel
+		const BlockOperator *measurer;
+
+		// Operators returned by atLevel, indexed by level. NULL for levels not asked for.
+		mutable std::vector<BlockOperator *> levelOperators;
+
+		/**
+		 * Add time spent by the calling thread in a parallel region of the
+		 * computations.
+		 *
+		 * @param time Time spent, in seconds
+		 */
+		void addThreadTime(double time) const;
+
+		/**
+		 * Read the performance counters of the calling thread, at the start
+		 * of a phase in a parallel region of the computations.
+		 *
+		 * @return The reading, to be passed to stopCounting
+		 */
+		Utils::PerformanceCounters::Reading startCounting() const;
+
+		/**
+		 * Add the events of the calling thread since startCounting to the
+		 * performance counters, if there are any.
+		 *
+		 * @param phase The phase the calling thread has been running
+		 * @param start Reading returned by startCounting
+		 */
+		void stopCounting(Utils::PerformanceCounters::Phase phase, const Utils::PerformanceCounters::Reading& start) const;
+
 		/**
 		 * Apply the operator close to the boundary represented by the last
 		 * argument, that is where receiving of ghost data outside that boundary
@@ -77,33 +174,61 @@ namespace Numerics {
 	template<std::size_t DIMENSIONALITY, std::size_t ORDER_OF_ACCURACY>
 	BlockOperator<DIMENSIONALITY, ORDER_OF_ACCURACY>::BlockOperator() {
 		computationTimer   = new Utils::Timer();
+		threadTimes = new std::vector<double>(OMP_MAX_NUM_THREADS, 0.0);
+		counters = NULL;
+		measurer = this;
 	}
 
 	template<std::size_t DIMENSIONALITY, std::size_t ORDER_OF_ACCURACY>
 	BlockOperator<DIMENSIONALITY, ORDER_OF_ACCURACY>::~BlockOperator() {
 		delete computationTimer;
+		delete threadTimes;
+		for (std::size_t l=0; l<levelOperators.size(); l++) {
+			delete levelOperators[l];
+		}
 	}
 
 	template<std::size_t DIMENSIONALITY, std::size_t ORDER_OF_ACCURACY>
 	void BlockOperator<DIMENSIONALITY, ORDER_OF_ACCURACY>::apply(CommunicativeBlock& input, ComputationalBlock *result) const {
 		// Compute the inner parts.
-		computationTimer->start();
-		applyInInnerRegion(input, result);
-		computationTimer->stop();
+		{
+			HAPARANDA_REGION("interior");
+			measurer->computationTimer->start();
+			applyInInnerRegion(input, result);
+			measurer->computationTimer->stop();
+		}
 
 		// Compute boundary parts
 		applyInBoundaryRegions(input, result);
 	}
 
+	template<std::size_t DIMENSIONALITY, std::size_t ORDER_OF_ACCURACY>
+	void BlockOperator<DIMENSIONALITY, ORDER_OF_ACCURACY>::applyAtBoundary(const ComputationalBlock& input,
+			ComputationalBlock *result, const BoundaryId& boundary) const {
+		measurer->computationTimer->start();
+		applyInBoundaryRegion(input, result, boundary);
+		measurer->computationTimer->stop();
+	}
+
+	template<std::size_t DIMENSIONALITY, std::size_t ORDER_OF_ACCURACY>
+	void BlockOperator<DIMENSIONALITY, ORDER_OF_ACCURACY>::applyInner(const ComputationalBlock& input, ComputationalBlock *result) const {
+		measurer->computationTimer->start();
+		applyInInnerRegion(input, result);
+		measurer->computationTimer->stop();
+	}
+
 	template<std::size_t DIMENSIONALITY, std::size_t ORDER_OF_ACCURACY>
 	void BlockOperator<DIMENSIONALITY, ORDER_OF_ACCURACY>::applyInBoundaryRegions(CommunicativeBlock& input, ComputationalBlock *result) const {
 		BoundaryId boundary;
 		for (std::size_t d = 0; d < 2 * DIMENSIONALITY; d++) {
 			// Find a ghost region that is initialized
+			HAPARANDA_REGION_START(waitStart);
 			input.receiveDoneAt(&boundary);
-			this->computationTimer->start();
+			HAPARANDA_REGION_ADD("wait", boundary.getDimension(), boundary.isLowerSide() ? 0 : 1, waitStart);
+			HAPARANDA_REGION_AT("boundary", boundary.getDimension(), boundary.isLowerSide() ? 0 : 1);
+			measurer->computationTimer->start();
 			applyInBoundaryRegion(input, result, boundary);
-			this->computationTimer->stop();
+			measurer->computationTimer->stop();
 		}
 	}
 
@@ -112,6 +237,67 @@ namespace Numerics {
 		return computationTimer->totalElapsedTime();
 	}
 
+	template<std::size_t DIMENSIONALITY, std::size_t ORDER_OF_ACCURACY>
+	const std::vector<double>& BlockOperator<DIMENSIONALITY, ORDER_OF_ACCURACY>::threadComputationTimes() const {
+		return *threadTimes;
+	}
+
+	template<std::size_t DIMENSIONALITY, std::size_t ORDER_OF_ACCURACY>
+	void BlockOperator<DIMENSIONALITY, ORDER_OF_ACCURACY>::setPerformanceCounters(Utils::PerformanceCounters *counters) {
+		this->counters = counters;
+	}
+
+	template<std::size_t DIMENSIONALITY, std::size_t ORDER_OF_ACCURACY>
+	BlockOperator<DIMENSIONALITY, ORDER_OF_ACCURACY> *BlockOperator<DIMENSIONALITY, ORDER_OF_ACCURACY>::refined(std::size_t /* level */) const {
+		return NULL;
+	}
+
+	template<std::size_t DIMENSIONALITY, std::size_t ORDER_OF_ACCURACY>
+	const BlockOperator<DIMENSIONALITY, ORDER_OF_ACCURACY> *BlockOperator<DIMENSIONALITY, ORDER_OF_ACCURACY>::atLevel(std::size_t level) const {
+		if (0 == level) {
+			return this;
+		}
+		if (levelOperators.size() <= level) {
+			levelOperators.resize(level + 1, NULL);
+		}
+		if (NULL == levelOperators[level]) {
+			BlockOperator *levelOperator = refined(level);
+			if (NULL == levelOperator) {
+				throw std::runtime_error("BlockOperator: The operator cannot be refined");
+			}
+			levelOperator->measurer = measurer;
+			levelOperators[level] = levelOperator;
+		}
+		return levelOperators[level];
+	}
+
+
+	/*** Protected methods ***/
+	template<std::size_t DIMENSIONALITY, std::size_t ORDER_OF_ACCURACY>
+	inline void BlockOperator<DIMENSIONALITY, ORDER_OF_ACCURACY>::addThreadTime(double time) const {
+		// Threads started after the construction have no slot
+		std::size_t thread = OMP_THREAD_ID;
+		if (thread < measurer->threadTimes->size()) {
+			(*measurer->threadTimes)[thread] += time;
+		}
+	}
+
+	template<std::size_t DIMENSIONALITY, std::size_t ORDER_OF_ACCURACY>
+	inline Utils::PerformanceCounters::Reading BlockOperator<DIMENSIONALITY, ORDER_OF_ACCURACY>::startCounting() const {
+		if (NULL == measurer->counters) {
+			return Utils::PerformanceCounters::Reading();
+		}
+		return Utils::PerformanceCounters::read();
+	}
+
+	template<std::size_t DIMENSIONALITY, std::size_t ORDER_OF_ACCURACY>
+	inline void BlockOperator<DIMENSIONALITY, ORDER_OF_ACCURACY>::stopCounting(Utils::PerformanceCounters::Phase phase,
+			const Utils::PerformanceCounters::Reading& start) const {
+		if (NULL != measurer->counters) {
+			measurer->counters->add(phase, start);
+		}
+	}
+
 } /* namespace Numerics */
 } /* namespace Haparanda */
 
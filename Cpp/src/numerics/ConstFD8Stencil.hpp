@@ -26,6 +26,8 @@
 
 #include "MultuncialStencil.hpp"
 
+#include <cmath>
+
 namespace Haparanda {
 namespace Numerics {
 
@@ -49,10 +51,17 @@ namespace Numerics {
 
 		virtual ~ConstFD8Stencil();
 
+		/**
+		 * @param level Number of times the step lengths are halved
+		 * @return A stencil whose weights are scaled for 2^-level times the step lengths of this stencil
+		 */
+		virtual ConstFD8Stencil *refined(std::size_t level) const;
+
 	protected:
 		virtual double getWeight(const Iterators::FieldIterator<DIMENSIONALITY>& iterator, std::size_t dim, int weightIndex) const;
 
 	private:
+		std::array<double, DIMENSIONALITY> stepLength;
 		double weights[DIMENSIONALITY][ORDER_OF_ACCURACY+1];
 
 		/**
@@ -66,6 +75,7 @@ namespace Numerics {
 
 	template<std::size_t DIMENSIONALITY>
 	ConstFD8Stencil<DIMENSIONALITY>::ConstFD8Stencil(const std::array<double, DIMENSIONALITY>& stepLength) {
+		this->stepLength = stepLength;
 		initializeWeights(stepLength);
 	}
 
@@ -73,6 +83,15 @@ namespace Numerics {
 	ConstFD8Stencil<DIMENSIONALITY>::~ConstFD8Stencil() {
 	}
 
+	template<std::size_t DIMENSIONALITY>
+	ConstFD8Stencil<DIMENSIONALITY> *ConstFD8Stencil<DIMENSIONALITY>::refined(std::size_t level) const {
+		std::array<double, DIMENSIONALITY> refinedStepLength;
+		for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+			refinedStepLength[d] = std::ldexp(stepLength[d], -static_cast<int>(level));
+		}
+		return new ConstFD8Stencil<DIMENSIONALITY>(refinedStepLength);
+	}
+
 
 	/*** Protected methods ***/
 	template<std::size_t DIMENSIONALITY>
@@ -3,12 +3,26 @@
 
 #include "BlockOperator.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
 namespace Haparanda {
 namespace Numerics {
 
 	/**
 	 * Class representing a multuncial stencil.
 	 *
+	 * If the input block has an activity mask, the stencil is only computed
+	 * in tiles with a significant tile within its reach, and zeros are
+	 * written in the others (unless they are zero already). The inner region
+	 * is traversed one row of a tile at the time, so that the tile is only
+	 * looked up once per row, and rows of tiles which are zero already are
+	 * skipped. If the ghost region is known to be zero, the boundary region
+	 * is skipped where the input is negligible close to the boundary. If the
+	 * result block has an activity mask, it is updated to describe the
+	 * result. Input and result masks must have the same tile size.
+	 *
 	 * @tparam DIMENSIONALITY Dimensionality of the stencil
 	 * @tparam ORDER_OF_ACCURACY Order of accuracy of the stencil, i.e. the extent * 2
 	 * @author Malin Kallen, Magnus Grandin
@@ -51,8 +65,18 @@ namespace Numerics {
 	/*** Protected methods ***/
 	template<std::size_t DIMENSIONALITY, std::size_t ORDER_OF_ACCURACY>
 	void MultuncialStencil<DIMENSIONALITY, ORDER_OF_ACCURACY>::applyInBoundaryRegion(const ComputationalBlock& input, ComputationalBlock *result, const BoundaryId& boundary) const {
+		Grid::ActivityMask<DIMENSIONALITY> *inputMask = input.getActivityMask();
+		bool skipNegligible = input.hasZeroGhostRegion(boundary) && NULL != inputMask;
+		if (skipNegligible && !inputMask->isSignificantNear(boundary, EXTENT)) {
+			// Everything this would add is negligible
+			return;
+		}
 #pragma omp parallel
 		{
+			HAPARANDA_REGION("kernel");
+			Utils::Timer threadTimer;
+			threadTimer.start();
+			Utils::PerformanceCounters::Reading counterStart = this->startCounting();
 			BoundaryIterator *inputIterator = input.getBoundaryIterator();
 			inputIterator->setBoundaryToIterate(boundary);
 			BoundaryIterator *resultIterator = result->getBoundaryIterator();
@@ -62,6 +86,13 @@ namespace Numerics {
 			int dir = boundary.isLowerSide() ? 1 : -1;
 			int maxDistanceFromBoundary = dir * EXTENT;
 			while (inputIterator->isInField()) {
+				if (skipNegligible && !inputMask->isSignificantAlong(*inputIterator, dim,
+						std::min(0, maxDistanceFromBoundary - dir), std::max(0, maxDistanceFromBoundary - dir))) {
+					// Only negligible values within reach of the ghost region here
+					inputIterator->next();
+					resultIterator->next();
+					continue;
+				}
 				for (int distanceFromBoundary=0; distanceFromBoundary!=maxDistanceFromBoundary; distanceFromBoundary+=dir) {
 					/* Apply left part of stencil if being on the lower boundary
 					   and the right part of the stencil if being on the upper one. */
@@ -79,45 +110,104 @@ namespace Numerics {
 			assert(!resultIterator->isInField());
 			delete inputIterator;
 			delete resultIterator;
+			this->stopCounting(Utils::PerformanceCounters::BOUNDARY, counterStart);
+			this->addThreadTime(threadTimer.stop());
 		} // pragma omp parallel
+		if (NULL != result->getActivityMask()) {
+			result->getActivityMask()->markSignificantNear(boundary, EXTENT);
+		}
 	}
 
 	template<std::size_t DIMENSIONALITY, std::size_t ORDER_OF_ACCURACY>
 	void MultuncialStencil<DIMENSIONALITY, ORDER_OF_ACCURACY>::applyInInnerRegion(const ComputationalBlock& input, ComputationalBlock *result) const {
 		std::size_t sizePerDim = input.getElementsPerDim();
+		Grid::ActivityMask<DIMENSIONALITY> *inputMask = input.getActivityMask();
+		Grid::ActivityMask<DIMENSIONALITY> *resultMask = result->getActivityMask();
+		if (NULL != inputMask) {
+			inputMask->computeActive(EXTENT);
+		}
+		std::vector<double> resultMaxima(NULL == resultMask ? 0 : resultMask->getNumTiles(), 0.0);
 #pragma omp parallel
 		{
+			HAPARANDA_REGION("kernel");
+			Utils::Timer threadTimer;
+			threadTimer.start();
+			Utils::PerformanceCounters::Reading counterStart = this->startCounting();
 			FieldIterator *inputIterator = input.getInnerIterator();
 			FieldIterator *resultIterator = result->getInnerIterator();
+			std::vector<double> threadMaxima(resultMaxima.size(), 0.0);
+			// The tiles are looked up in the input mask, or else in the result mask
+			Grid::ActivityMask<DIMENSIONALITY> *mask = NULL != inputMask ? inputMask : resultMask;
 
 			while(inputIterator->isInField()) {
-				// Apply the stencil in each dimension
-				double resultValue = 0;
-				for (std::size_t d=0; d<DIMENSIONALITY; d++) {
-					std::size_t indexAlongD = inputIterator->currentIndex(d);
-					// Left part of stencil
-					if (indexAlongD >= EXTENT) {
-						for (std::size_t i=0; i<EXTENT; i++) {
-							resultValue += getWeight(*inputIterator, d, i) * inputIterator->currentNeighbor(d, -EXTENT+i);
+				// The rest of the row, or of the row of the current tile
+				std::size_t indexAlong0 = inputIterator->currentIndex(0);
+				std::size_t rowLength = sizePerDim - indexAlong0;
+				std::size_t tile = 0;
+				if (NULL != mask) {
+					tile = mask->tileOf(*inputIterator);
+					rowLength = std::min(rowLength, mask->getTileSize() - indexAlong0 % mask->getTileSize());
+				}
+				if (NULL != inputMask && !inputMask->isActive(tile)) {
+					// Nothing significant within reach
+					if (NULL == resultMask || !resultMask->isZero(tile)) {
+						for (std::size_t p=0; p<rowLength && resultIterator->isInField(); p++) {
+							resultIterator->setCurrentValue(0);
+							resultIterator->next();
 						}
+					} else {
+						resultIterator->advance(rowLength);
 					}
-					// Center weight
-					resultValue += getWeight(*inputIterator, d, EXTENT) * inputIterator->currentValue();
-					// Right part of stencil
-					if (indexAlongD+EXTENT < sizePerDim) {
-						for (std::size_t i=1; i<=EXTENT; i++) {
-							resultValue += getWeight(*inputIterator, d, EXTENT+i) * inputIterator->currentNeighbor(d, i);
+					inputIterator->advance(rowLength);
+					continue;
+				}
+				for (std::size_t p=0; p<rowLength && inputIterator->isInField(); p++) {
+					// Apply the stencil in each dimension
+					double resultValue = 0;
+					for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+						std::size_t indexAlongD = inputIterator->currentIndex(d);
+						// Left part of stencil
+						if (indexAlongD >= EXTENT) {
+							for (std::size_t i=0; i<EXTENT; i++) {
+								resultValue += getWeight(*inputIterator, d, i) * inputIterator->currentNeighbor(d, -EXTENT+i);
+							}
+						}
+						// Center weight
+						resultValue += getWeight(*inputIterator, d, EXTENT) * inputIterator->currentValue();
+						// Right part of stencil
+						if (indexAlongD+EXTENT < sizePerDim) {
+							for (std::size_t i=1; i<=EXTENT; i++) {
+								resultValue += getWeight(*inputIterator, d, EXTENT+i) * inputIterator->currentNeighbor(d, i);
+							}
 						}
 					}
+					resultIterator->setCurrentValue(resultValue);
+					if (NULL != resultMask) {
+						threadMaxima[tile] = std::max(threadMaxima[tile], std::abs(resultValue));
+					}
+					inputIterator->next();
+					resultIterator->next();
 				}
-				resultIterator->setCurrentValue(resultValue);
-				inputIterator->next();
-				resultIterator->next();
 			}
 			assert(!resultIterator->isInField());
 			delete inputIterator;
 			delete resultIterator;
+			if (NULL != resultMask) {
+#pragma omp critical
+				for (std::size_t t=0; t<resultMaxima.size(); t++) {
+					resultMaxima[t] = std::max(resultMaxima[t], threadMaxima[t]);
+				}
+			}
+			this->stopCounting(Utils::PerformanceCounters::INTERIOR, counterStart);
+			this->addThreadTime(threadTimer.stop());
 		} // pragma omp parallel
+		if (NULL != resultMask) {
+			resultMask->resetMaxima();
+			resultMask->mergeMaxima(resultMaxima);
+			for (std::size_t t=0; t<resultMaxima.size(); t++) {
+				resultMask->setZero(t, NULL != inputMask && !inputMask->isActive(t));
+			}
+		}
 	}
 
 } /* namespace Numerics */
@@ -0,0 +1,406 @@
+#ifndef EVENTTRACE_HPP_
+#define EVENTTRACE_HPP_
+
+#include <algorithm>
+#include <cstdint>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <mpi.h>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace Haparanda {
+namespace Utils {
+
+	/**
+	 * Timeline of the events of all threads of all processes, exported in
+	 * the Chrome trace format, which chrome://tracing and Perfetto display.
+	 * The regions timed by the Profiler (when built with HAPARANDA_PROFILE)
+	 * are recorded as events while the trace is enabled.
+	 *
+	 * Each thread records its events in a ring buffer of its own, so no
+	 * locks or atomic operations are needed while recording. When a buffer
+	 * is full, the oldest events are overwritten.
+	 */
+	class EventTrace
+	{
+	public:
+		/**
+		 * Start recording, discarding any events recorded before. No thread
+		 * may be recording events during the call.
+		 *
+		 * @param capacity Maximum number of events kept per thread
+		 */
+		static void enable(std::size_t capacity);
+
+		/**
+		 * Stop recording. The recorded events are kept.
+		 */
+		static void disable();
+
+		/**
+		 * @return True if events are being recorded
+		 */
+		static bool isEnabled();
+
+		/**
+		 * Discard the recorded events. No thread may be recording events.
+		 */
+		static void clear();
+
+		/**
+		 * @return Current time in nanoseconds, from an arbitrary starting point
+		 */
+		static std::uint64_t now();
+
+		/**
+		 * Record an event of the calling thread which has ended, if the
+		 * trace is enabled.
+		 *
+		 * @param name Name of the event. Must be a string literal, or otherwise outlive the trace.
+		 * @param dim Dimension of the boundary the event belongs to, or -1
+		 * @param side 0 for the lower boundary, 1 for the upper boundary, or -1
+		 * @param start Time at which the event started, as returned by now
+		 * @param end Time at which the event ended, as returned by now
+		 */
+		static void record(const char *name, int dim, int side, std::uint64_t start, std::uint64_t end);
+
+		/**
+		 * Record an instantaneous event of the calling thread, if the trace
+		 * is enabled.
+		 *
+		 * @param name Name of the event. Must be a string literal, or otherwise outlive the trace.
+		 * @param dim Dimension of the boundary the event belongs to, or -1
+		 * @param side 0 for the lower boundary, 1 for the upper boundary, or -1
+		 */
+		static void mark(const char *name, int dim = -1, int side = -1);
+
+		/**
+		 * @return The number of events kept by the calling process
+		 */
+		static std::size_t numEvents();
+
+		/**
+		 * @return The number of events of the calling process which have been overwritten
+		 */
+		static std::size_t numOverwritten();
+
+		/**
+		 * Write the events of all processes of the communicator to a file in
+		 * the Chrome trace format, with one track per thread, grouped by
+		 * rank. The clocks of the processes are aligned to that of rank 0 by
+		 * exchanging time stamps, so the timelines of processes on different
+		 * nodes can be compared. Collective over the communicator.
+		 *
+		 * @param communicator Communicator of the processes whose events are exported
+		 * @param fileName Path to the file, written by rank 0
+		 * @return Estimated offset of the clock of rank 0 from that of the calling process, in nanoseconds
+		 */
+		static std::int64_t exportChromeTrace(const MPI::Intracomm& communicator, const std::string& fileName);
+
+	private:
+		struct Event
+		{
+			const char *name;
+			int dim;
+			int side;
+			std::uint64_t start;
+			std::uint64_t end;		// Equal to start for instantaneous events
+		};
+
+		struct ThreadTrace
+		{
+			int ompThread;				// OpenMP thread number at the first event
+			std::vector<Event> events;	// Ring buffer
+			std::uint64_t numRecorded;	// Total number of events recorded, including overwritten ones
+
+			ThreadTrace(std::size_t capacity);
+		};
+
+		static const int ALIGNMENT_ROUNDS = 20;	// Time stamp exchanges per process when aligning the clocks
+
+		/**
+		 * @return True while recording, shared by all threads
+		 */
+		static bool& enabled();
+
+		/**
+		 * @return Number of events kept per thread
+		 */
+		static std::size_t& capacity();
+
+		/**
+		 * @return The trace of the calling thread, created at the first call
+		 */
+		static ThreadTrace& threadTrace();
+
+		/**
+		 * @return The traces of all threads which have recorded events
+		 */
+		static std::vector<ThreadTrace *>& traces();
+
+		/**
+		 * @return Lock protecting the list of traces
+		 */
+		static std::mutex& tracesMutex();
+
+		/**
+		 * Estimate the offset of the clock of rank 0 from that of the calling
+		 * process, from the time stamp exchange with the smallest round trip
+		 * time. Collective over the communicator.
+		 *
+		 * @return The offset in nanoseconds, 0 on rank 0
+		 */
+		static std::int64_t clockOffset(const MPI::Intracomm& communicator);
+
+		/**
+		 * Append the events of the calling process as comma separated trace
+		 * events.
+		 */
+		static void writeEvents(std::ostream& out, int rank, std::int64_t offset, std::int64_t origin);
+	};
+
+	inline void EventTrace::enable(std::size_t capacity) {
+		if (0 == capacity) {
+			throw std::runtime_error("The trace must hold at least one event per thread");
+		}
+		EventTrace::capacity() = capacity;
+		clear();
+		enabled() = true;
+	}
+
+	inline void EventTrace::disable() {
+		enabled() = false;
+	}
+
+	inline bool EventTrace::isEnabled() {
+		return enabled();
+	}
+
+	inline void EventTrace::clear() {
+		std::lock_guard<std::mutex> lock(tracesMutex());
+		std::vector<ThreadTrace *>& all = traces();
+		for (std::size_t i=0; i<all.size(); i++) {
+			all[i]->events.resize(capacity());
+			all[i]->numRecorded = 0;
+		}
+	}
+
+	inline std::uint64_t EventTrace::now() {
+		struct timespec time;
+		clock_gettime(CLOCK_MONOTONIC, &time);
+		return std::uint64_t(time.tv_sec) * 1000000000 + time.tv_nsec;
+	}
+
+	inline void EventTrace::record(const char *name, int dim, int side, std::uint64_t start, std::uint64_t end) {
+		if (!enabled()) {
+			return;
+		}
+		ThreadTrace& trace = threadTrace();
+		Event& event = trace.events[trace.numRecorded % trace.events.size()];
+		event.name = name;
+		event.dim = dim;
+		event.side = side;
+		event.start = start;
+		event.end = end;
+		trace.numRecorded++;
+	}
+
+	inline void EventTrace::mark(const char *name, int dim, int side) {
+		std::uint64_t time = now();
+		record(name, dim, side, time, time);
+	}
+
+	inline std::size_t EventTrace::numEvents() {
+		std::lock_guard<std::mutex> lock(tracesMutex());
+		std::vector<ThreadTrace *>& all = traces();
+		std::size_t count = 0;
+		for (std::size_t i=0; i<all.size(); i++) {
+			count += std::min<std::uint64_t>(all[i]->numRecorded, all[i]->events.size());
+		}
+		return count;
+	}
+
+	inline std::size_t EventTrace::numOverwritten() {
+		std::lock_guard<std::mutex> lock(tracesMutex());
+		std::vector<ThreadTrace *>& all = traces();
+		std::size_t count = 0;
+		for (std::size_t i=0; i<all.size(); i++) {
+			if (all[i]->numRecorded > all[i]->events.size()) {
+				count += all[i]->numRecorded - all[i]->events.size();
+			}
+		}
+		return count;
+	}
+
+	inline std::int64_t EventTrace::exportChromeTrace(const MPI::Intracomm& communicator, const std::string& fileName) {
+		std::int64_t offset = clockOffset(communicator);
+		// Time stamps are written relative to the earliest event of any process
+		long long localOrigin = std::numeric_limits<long long>::max();
+		{
+			std::lock_guard<std::mutex> lock(tracesMutex());
+			std::vector<ThreadTrace *>& all = traces();
+			for (std::size_t i=0; i<all.size(); i++) {
+				std::size_t kept = std::min<std::uint64_t>(all[i]->numRecorded, all[i]->events.size());
+				std::size_t first = all[i]->numRecorded - kept;
+				if (0 < kept) {
+					long long start = all[i]->events[first % all[i]->events.size()].start + offset;
+					localOrigin = std::min(localOrigin, start);
+				}
+			}
+		}
+		long long origin;
+		communicator.Allreduce(&localOrigin, &origin, 1, MPI::LONG_LONG, MPI::MIN);
+
+		int rank = communicator.Get_rank();
+		std::ostringstream events;
+		writeEvents(events, rank, offset, origin);
+		std::string localEvents = events.str();
+		int localLength = localEvents.size();
+		int nProcesses = communicator.Get_size();
+		std::vector<int> lengths(nProcesses);
+		communicator.Gather(&localLength, 1, MPI::INT, &lengths[0], 1, MPI::INT, 0);
+		std::vector<int> displacements(nProcesses, 0);
+		for (int p=1; p<nProcesses; p++) {
+			displacements[p] = displacements[p-1] + lengths[p-1];
+		}
+		std::vector<char> allEvents(0 == rank ? displacements.back() + lengths.back() + 1 : 1);
+		communicator.Gatherv(localEvents.c_str(), localLength, MPI::CHAR,
+				&allEvents[0], &lengths[0], &displacements[0], MPI::CHAR, 0);
+		if (0 == rank) {
+			std::ofstream file(fileName.c_str());
+			if (!file) {
+				throw std::runtime_error("Could not open the trace file " + fileName);
+			}
+			file << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+			bool first = true;
+			for (int p=0; p<nProcesses; p++) {
+				if (0 < lengths[p]) {
+					// Each process starts its events with a separator
+					file.write(&allEvents[displacements[p]] + (first ? 1 : 0), lengths[p] - (first ? 1 : 0));
+					first = false;
+				}
+			}
+			file << "]}" << std::endl;
+		}
+		return offset;
+	}
+
+
+	/*** Private methods ***/
+	inline EventTrace::ThreadTrace::ThreadTrace(std::size_t capacity)
+	: events(capacity), numRecorded(0) {
+#ifdef _OPENMP
+		ompThread = omp_get_thread_num();
+#else
+		ompThread = 0;
+#endif
+	}
+
+	inline bool& EventTrace::enabled() {
+		static bool enabled = false;
+		return enabled;
+	}
+
+	inline std::size_t& EventTrace::capacity() {
+		static std::size_t capacity = 1;
+		return capacity;
+	}
+
+	inline EventTrace::ThreadTrace& EventTrace::threadTrace() {
+		// Kept in the list after the thread has exited, to be exported
+		static thread_local ThreadTrace *trace = NULL;
+		if (NULL == trace) {
+			std::lock_guard<std::mutex> lock(tracesMutex());
+			trace = new ThreadTrace(capacity());
+			traces().push_back(trace);
+		}
+		return *trace;
+	}
+
+	inline std::vector<EventTrace::ThreadTrace *>& EventTrace::traces() {
+		static std::vector<ThreadTrace *> all;
+		return all;
+	}
+
+	inline std::mutex& EventTrace::tracesMutex() {
+		static std::mutex mutex;
+		return mutex;
+	}
+
+	inline std::int64_t EventTrace::clockOffset(const MPI::Intracomm& communicator) {
+		int rank = communicator.Get_rank();
+		std::int64_t offset = 0;
+		// Rank 0 answers each of the other processes in turn with its current time
+		for (int p=1; p<communicator.Get_size(); p++) {
+			if (0 == rank) {
+				for (int i=0; i<ALIGNMENT_ROUNDS; i++) {
+					long long request;
+					communicator.Recv(&request, 1, MPI::LONG_LONG, p, 0);
+					long long time = now();
+					communicator.Send(&time, 1, MPI::LONG_LONG, p, 0);
+				}
+			} else if (p == rank) {
+				std::uint64_t bestRoundTrip = std::numeric_limits<std::uint64_t>::max();
+				for (int i=0; i<ALIGNMENT_ROUNDS; i++) {
+					long long request = 0;
+					long long remoteTime;
+					std::uint64_t sent = now();
+					communicator.Send(&request, 1, MPI::LONG_LONG, 0, 0);
+					communicator.Recv(&remoteTime, 1, MPI::LONG_LONG, 0, 0);
+					std::uint64_t received = now();
+					// The remote time is assumed to be read half way through the round trip
+					if (received - sent < bestRoundTrip) {
+						bestRoundTrip = received - sent;
+						offset = remoteTime - std::int64_t(sent + (received - sent) / 2);
+					}
+				}
+			}
+		}
+		return offset;
+	}
+
+	inline void EventTrace::writeEvents(std::ostream& out, int rank, std::int64_t offset, std::int64_t origin) {
+		std::lock_guard<std::mutex> lock(tracesMutex());
+		std::vector<ThreadTrace *>& all = traces();
+		out << std::fixed << std::setprecision(3);
+		out << ",{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << rank
+				<< ",\"args\":{\"name\":\"rank " << rank << "\"}}";
+		for (std::size_t t=0; t<all.size(); t++) {
+			const ThreadTrace& trace = *all[t];
+			out << ",{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << rank << ",\"tid\":" << t
+					<< ",\"args\":{\"name\":\"thread " << t << " (OpenMP thread " << trace.ompThread << ")\"}}";
+			std::size_t kept = std::min<std::uint64_t>(trace.numRecorded, trace.events.size());
+			for (std::uint64_t i=trace.numRecorded-kept; i<trace.numRecorded; i++) {
+				const Event& event = trace.events[i % trace.events.size()];
+				// Microseconds, as the format requires
+				double start = (std::int64_t(event.start) + offset - origin) * 1e-3;
+				out << ",{\"name\":\"" << event.name;
+				if (event.dim >= 0) {
+					out << "[" << event.dim << "]";
+				}
+				if (event.side >= 0) {
+					out << "[" << (0 == event.side ? "lower" : "upper") << "]";
+				}
+				out << "\",\"pid\":" << rank << ",\"tid\":" << t << ",\"ts\":" << start;
+				if (event.end == event.start) {
+					out << ",\"ph\":\"i\",\"s\":\"t\"}";
+				} else {
+					out << ",\"ph\":\"X\",\"dur\":" << (event.end - event.start) * 1e-3 << "}";
+				}
+			}
+		}
+	}
+
+} /* namespace Utils */
+} /* namespace Haparanda */
+
+#endif /* EVENTTRACE_HPP_ */
@@ -26,6 +26,44 @@ namespace Utils {
 		 * @param divisor Divisor for which the magic numbers described above will be computed
 		 */
 		static MagicNumber getMagicNumbers(unsigned divisor);
+
+		/**
+		 * @param x Dividend, < 2^32
+		 * @return x / divisor, where divisor is the one the magic numbers are computed for
+		 */
+		uint64_t divide(uint64_t x) const {
+			return (((x * M) >> 32) + x * a) >> s;
+		}
+	};
+
+	/**
+	 * Magic numbers for division of 64-bit integers, computed in the same
+	 * way as MagicNumber but with 64-bit words. The multiplication needs
+	 * 128 bits, which makes the division slower than with MagicNumber.
+	 */
+	struct MagicNumber64 {
+		uint64_t M;		// Magic number,
+		int a;			// "add" indicator,
+		int s;			// and shift amount.
+
+		/**
+		 * Compute a magic number result r such that x/divisor can be written
+		 * (((x * r.M) / 2^64) + x * r.a) / 2^s
+		 * where / denotes integer division
+		 * for any positive 64 bit integer x and divisor
+		 *
+		 * @param divisor Divisor for which the magic numbers described above will be computed
+		 */
+		static MagicNumber64 getMagicNumbers(uint64_t divisor);
+
+		/**
+		 * @param x Dividend
+		 * @return x / divisor, where divisor is the one the magic numbers are computed for
+		 */
+		uint64_t divide(uint64_t x) const {
+			typedef unsigned __int128 uint128_t;
+			return ((uint128_t(x) * M >> 64) + uint128_t(x) * a) >> s;
+		}
 	};
 
 
@@ -75,6 +113,52 @@ namespace Utils {
 		return magic;		// (magu.a was set above).
 	}
 
+	inline MagicNumber64 MagicNumber64::getMagicNumbers(uint64_t divisor){
+		// Must have 1 <= d <= 2**64-1.
+		int p;
+		uint64_t nc, delta, q1, r1, q2, r2;
+		struct MagicNumber64 magic;
+
+		magic.a = 0;					// Initialize "add" indicator.
+		if (0 == divisor) {
+			// Same approximation as in MagicNumber
+			magic.M = std::numeric_limits<uint64_t>::max();
+			magic.s = 0;
+		} else {
+			const uint64_t TWO_POW_63 = 0x8000000000000000ull;
+			nc = -1 - (-divisor)%divisor;   // Unsigned arithmetic here.
+			p = 63;						 // Init. p.
+			q1 = TWO_POW_63/nc;			 // Init. q1 = 2**p/nc.
+			r1 = TWO_POW_63 - q1*nc;		// Init. r1 = rem(2**p, nc).
+			q2 = (TWO_POW_63-1)/divisor;	// Init. q2 = (2**p - 1)/d.
+			r2 = (TWO_POW_63-1) - q2*divisor;   // Init. r2 = rem(2**p - 1, d).
+			do {
+				p = p + 1;
+				if (r1 >= nc - r1) {
+					q1 = 2*q1 + 1;
+					r1 = 2*r1 - nc;
+				} else {
+					q1 = 2*q1;
+					r1 = 2*r1;}
+				if (r2 + 1 >= divisor - r2) {
+					if (q2 >= TWO_POW_63-1) magic.a = 1;
+					q2 = 2*q2 + 1;
+					r2 = 2*r2 + 1 - divisor;
+				} else {
+					if (q2 >= TWO_POW_63) magic.a = 1;
+					q2 = 2*q2;
+					r2 = 2*r2 + 1;
+				}
+				delta = divisor - 1 - r2;
+			} while (p < 128 &&
+				(q1 < delta || (q1 == delta && r1 == 0)));
+
+			magic.M = q2 + 1;	// Magic number
+			magic.s = p - 64;	// and shift amount to return
+		}
+		return magic;		// (magic.a was set above).
+	}
+
 } /* namespace Utils */
 } /* namespace Haparanda */
 
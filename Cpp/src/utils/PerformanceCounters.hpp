@@ -0,0 +1,255 @@
+#ifndef PERFORMANCECOUNTERS_HPP_
+#define PERFORMANCECOUNTERS_HPP_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace Haparanda {
+namespace Utils {
+
+	/**
+	 * Event counts of the threads running the phases of a computation, read
+	 * by perf_event_open. Each thread opens its own counters, counting only
+	 * itself, the first time it reads them, and accumulates into a slot of
+	 * its own, so no synchronization is needed.
+	 *
+	 * The hardware counters are often unavailable, e.g. in containers,
+	 * virtual machines or with a restrictive perf_event_paranoid. The CPU
+	 * time of the thread is then still counted, by the task clock software
+	 * event or, if perf events are not available at all, by the thread CPU
+	 * time clock. Counters which cannot be opened read 0, and isAvailable
+	 * tells which ones were opened. There is no generic event for floating
+	 * point operations, so their number is better derived from the
+	 * algorithm.
+	 */
+	class PerformanceCounters
+	{
+	public:
+		enum Counter {
+			CYCLES,			// CPU cycles
+			INSTRUCTIONS,	// Retired instructions
+			CACHE_MISSES,	// Last level cache misses
+			CPU_TIME,		// CPU time of the thread, in nanoseconds
+			NUM_COUNTERS
+		};
+
+		enum Phase {
+			INTERIOR,		// Where no ghost regions are needed
+			BOUNDARY,		// Close to the boundaries
+			NUM_PHASES
+		};
+
+		/**
+		 * Counts of the calling thread at one point in time.
+		 */
+		struct Reading
+		{
+			std::uint64_t values[NUM_COUNTERS];
+		};
+
+		/**
+		 * Open the counters of the calling thread, to find out which ones are
+		 * available.
+		 *
+		 * @param numThreads Number of threads which may accumulate counts, i.e. the maximum OpenMP thread number + 1
+		 */
+		PerformanceCounters(std::size_t numThreads);
+
+		virtual ~PerformanceCounters();
+
+		/**
+		 * @param counter A counter
+		 * @return True if the counter could be opened on the calling thread of the constructor
+		 */
+		bool isAvailable(Counter counter) const;
+
+		/**
+		 * @return True if any hardware counter is available
+		 */
+		bool hasHardwareCounters() const;
+
+		/**
+		 * @return The current counts of the calling thread
+		 */
+		static Reading read();
+
+		/**
+		 * Add the counts of the calling thread since a reading to a phase.
+		 *
+		 * @param phase The phase which the calling thread has been running
+		 * @param start Reading at the start of the phase
+		 */
+		void add(Phase phase, const Reading& start);
+
+		/**
+		 * @param phase A phase
+		 * @param counter A counter
+		 * @return The count accumulated by all threads in the phase
+		 */
+		std::uint64_t total(Phase phase, Counter counter) const;
+
+		/**
+		 * @param counter A counter
+		 * @return Name of the counter, e.g. for reports
+		 */
+		static const char *name(Counter counter);
+
+		/**
+		 * Discard the accumulated counts.
+		 */
+		void reset();
+
+	private:
+		/**
+		 * Perf event file descriptors of one thread, closed when it exits.
+		 */
+		struct ThreadCounters
+		{
+			int fileDescriptors[NUM_COUNTERS];	// -1 if the counter could not be opened
+
+			ThreadCounters();
+
+			~ThreadCounters();
+		};
+
+		std::vector<Reading> *counts;	// Accumulated counts per phase and thread, indexed by NUM_PHASES * thread + phase
+		bool available[NUM_COUNTERS];
+
+		/**
+		 * @return The counters of the calling thread, opened at the first call
+		 */
+		static ThreadCounters& threadCounters();
+
+		/**
+		 * Open a counter of the calling thread.
+		 *
+		 * @return The file descriptor, or -1 if the counter is not available
+		 */
+		static int open(std::uint32_t type, std::uint64_t config);
+	};
+
+	inline PerformanceCounters::PerformanceCounters(std::size_t numThreads) {
+		Reading zero;
+		std::fill_n(zero.values, NUM_COUNTERS, 0);
+		counts = new std::vector<Reading>(NUM_PHASES * numThreads, zero);
+		ThreadCounters& own = threadCounters();
+		for (int c=0; c<NUM_COUNTERS; c++) {
+			available[c] = -1 != own.fileDescriptors[c];
+		}
+		// Falls back to the thread CPU time clock
+		available[CPU_TIME] = true;
+	}
+
+	inline PerformanceCounters::~PerformanceCounters() {
+		delete counts;
+	}
+
+	inline bool PerformanceCounters::isAvailable(Counter counter) const {
+		return available[counter];
+	}
+
+	inline bool PerformanceCounters::hasHardwareCounters() const {
+		return available[CYCLES] || available[INSTRUCTIONS] || available[CACHE_MISSES];
+	}
+
+	inline PerformanceCounters::Reading PerformanceCounters::read() {
+		ThreadCounters& counters = threadCounters();
+		Reading reading;
+		for (int c=0; c<NUM_COUNTERS; c++) {
+			std::uint64_t value = 0;
+			if (-1 == counters.fileDescriptors[c] || ssize_t(sizeof(value)) != ::read(counters.fileDescriptors[c], &value, sizeof(value))) {
+				value = 0;
+			}
+			reading.values[c] = value;
+		}
+		if (-1 == counters.fileDescriptors[CPU_TIME]) {
+			struct timespec time;
+			clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+			reading.values[CPU_TIME] = std::uint64_t(time.tv_sec) * 1000000000 + time.tv_nsec;
+		}
+		return reading;
+	}
+
+	inline void PerformanceCounters::add(Phase phase, const Reading& start) {
+		Reading end = read();
+#ifdef _OPENMP
+		std::size_t thread = omp_get_thread_num();
+#else
+		std::size_t thread = 0;
+#endif
+		// Threads beyond the expected number have no slot
+		if (NUM_PHASES * thread < counts->size()) {
+			Reading& sum = (*counts)[NUM_PHASES * thread + phase];
+			for (int c=0; c<NUM_COUNTERS; c++) {
+				sum.values[c] += end.values[c] - start.values[c];
+			}
+		}
+	}
+
+	inline std::uint64_t PerformanceCounters::total(Phase phase, Counter counter) const {
+		std::uint64_t sum = 0;
+		for (std::size_t i=phase; i<counts->size(); i+=NUM_PHASES) {
+			sum += (*counts)[i].values[counter];
+		}
+		return sum;
+	}
+
+	inline const char *PerformanceCounters::name(Counter counter) {
+		static const char *names[NUM_COUNTERS] = {"cycles", "instructions", "cacheMisses", "cpuTime"};
+		return names[counter];
+	}
+
+	inline void PerformanceCounters::reset() {
+		for (std::size_t i=0; i<counts->size(); i++) {
+			std::fill_n((*counts)[i].values, NUM_COUNTERS, 0);
+		}
+	}
+
+
+	/*** Private methods ***/
+	inline PerformanceCounters::ThreadCounters::ThreadCounters() {
+		fileDescriptors[CYCLES] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+		fileDescriptors[INSTRUCTIONS] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+		fileDescriptors[CACHE_MISSES] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+		fileDescriptors[CPU_TIME] = open(PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK);
+	}
+
+	inline PerformanceCounters::ThreadCounters::~ThreadCounters() {
+		for (int c=0; c<NUM_COUNTERS; c++) {
+			if (-1 != fileDescriptors[c]) {
+				close(fileDescriptors[c]);
+			}
+		}
+	}
+
+	inline PerformanceCounters::ThreadCounters& PerformanceCounters::threadCounters() {
+		static thread_local ThreadCounters counters;
+		return counters;
+	}
+
+	inline int PerformanceCounters::open(std::uint32_t type, std::uint64_t config) {
+		struct perf_event_attr attributes;
+		std::memset(&attributes, 0, sizeof(attributes));
+		attributes.size = sizeof(attributes);
+		attributes.type = type;
+		attributes.config = config;
+		attributes.exclude_kernel = 1;
+		attributes.exclude_hv = 1;
+		// The calling thread only, on any CPU
+		long fileDescriptor = syscall(__NR_perf_event_open, &attributes, 0, -1, -1, 0);
+		return fileDescriptor < 0 ? -1 : int(fileDescriptor);
+	}
+
+} /* namespace Utils */
+} /* namespace Haparanda */
+
+#endif /* PERFORMANCECOUNTERS_HPP_ */
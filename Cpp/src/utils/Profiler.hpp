@@ -0,0 +1,367 @@
+#ifndef PROFILER_HPP_
+#define PROFILER_HPP_
+
+#include "EventTrace.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/*
+ * Instrumentation macros. They expand to nothing unless HAPARANDA_PROFILE is
+ * defined (make PROFILE=1), so the instrumented code pays nothing by default.
+ *
+ * HAPARANDA_REGION(name) times the rest of the enclosing scope as a region
+ * nested in the current region of the calling thread, and
+ * HAPARANDA_REGION_AT(name, dim, side) does the same for a region belonging
+ * to a boundary, e.g. boundary[d][side]. HAPARANDA_REGION_START(start) and
+ * HAPARANDA_REGION_ADD(name, dim, side, start) record a region whose
+ * boundary is known only at its end, e.g. waiting for any ghost region.
+ * While the EventTrace is enabled, the regions are also recorded as events,
+ * and HAPARANDA_EVENT(name, dim, side) records an instantaneous event.
+ */
+#ifdef HAPARANDA_PROFILE
+#define HAPARANDA_PROFILE_CONCAT_(a, b) a##b
+#define HAPARANDA_PROFILE_CONCAT(a, b) HAPARANDA_PROFILE_CONCAT_(a, b)
+#define HAPARANDA_REGION(name) \
+	Haparanda::Utils::ProfiledRegion HAPARANDA_PROFILE_CONCAT(profiledRegion, __LINE__)(name)
+#define HAPARANDA_REGION_AT(name, dim, side) \
+	Haparanda::Utils::ProfiledRegion HAPARANDA_PROFILE_CONCAT(profiledRegion, __LINE__)(name, dim, side)
+#define HAPARANDA_REGION_START(start) std::uint64_t start = Haparanda::Utils::Profiler::now()
+#define HAPARANDA_REGION_ADD(name, dim, side, start) Haparanda::Utils::Profiler::add(name, dim, side, start)
+#define HAPARANDA_EVENT(name, dim, side) Haparanda::Utils::EventTrace::mark(name, dim, side)
+#else
+#define HAPARANDA_REGION(name)
+#define HAPARANDA_REGION_AT(name, dim, side)
+#define HAPARANDA_REGION_START(start)
+#define HAPARANDA_REGION_ADD(name, dim, side, start)
+#define HAPARANDA_EVENT(name, dim, side)
+#endif
+
+namespace Haparanda {
+namespace Utils {
+
+	/**
+	 * Hierarchical timing of named regions. Each thread records the regions
+	 * it enters in a tree of its own, so nothing is shared between the
+	 * threads while timing, and no atomic operations are needed. The only
+	 * synchronization is a lock taken once per thread, at its first region.
+	 * The time is read by clock_gettime(CLOCK_MONOTONIC), which is served by
+	 * the vDSO (from the TSC where available) without a system call. While
+	 * the EventTrace is enabled, each region is also recorded as an event.
+	 *
+	 * Region names must be string literals, or otherwise outlive the
+	 * profiler, since only pointers to them are stored.
+	 */
+	class Profiler
+	{
+	public:
+		/**
+		 * Accumulated time of a region, with the regions nested in it.
+		 */
+		struct Region
+		{
+			const char *name;
+			int dim;						// Dimension of the boundary, or -1
+			int side;						// Side of the boundary, or -1
+			std::uint64_t nanoseconds;		// Total time spent in the region
+			std::uint64_t calls;			// Number of times the region was entered
+			Region *parent;
+			std::vector<Region *> children;
+
+			Region(const char *name, int dim, int side, Region *parent);
+
+			~Region();
+
+			/**
+			 * @return The child with the specified name and boundary, created if it does not exist
+			 */
+			Region *child(const char *name, int dim, int side);
+
+			/**
+			 * @return The child with the specified name and boundary, or NULL if there is none
+			 */
+			const Region *find(const char *name, int dim = -1, int side = -1) const;
+		};
+
+		/**
+		 * @return Current time in nanoseconds, from an arbitrary starting point
+		 */
+		static std::uint64_t now();
+
+		/**
+		 * Enter a region nested in the current region of the calling thread.
+		 *
+		 * @param name Name of the region
+		 * @param dim Dimension of the boundary the region belongs to, or -1
+		 * @param side 0 for the lower boundary, 1 for the upper boundary, or -1
+		 * @return The region entered, to be passed to leave
+		 */
+		static Region *enter(const char *name, int dim = -1, int side = -1);
+
+		/**
+		 * Leave the current region of the calling thread.
+		 *
+		 * @param region The region, as returned by enter
+		 * @param start Time at which the region was entered, as returned by now
+		 */
+		static void leave(Region *region, std::uint64_t start);
+
+		/**
+		 * Record a region nested in the current region of the calling thread,
+		 * which has already ended.
+		 *
+		 * @param name Name of the region
+		 * @param dim Dimension of the boundary the region belongs to, or -1
+		 * @param side 0 for the lower boundary, 1 for the upper boundary, or -1
+		 * @param start Time at which the region started, as returned by now
+		 */
+		static void add(const char *name, int dim, int side, std::uint64_t start);
+
+		/**
+		 * @return The number of threads which have entered a region
+		 */
+		static std::size_t numThreads();
+
+		/**
+		 * @return The root of the regions of the calling thread. Its children are the outermost regions.
+		 */
+		static const Region& ownRegions();
+
+		/**
+		 * @param thread Index of the thread, in the order the threads entered their first region
+		 * @return The root of the regions of the thread. Its children are the outermost regions.
+		 */
+		static const Region& threadRegions(std::size_t thread);
+
+		/**
+		 * Write the accumulated time and the number of calls of each region
+		 * of each thread, indented by nesting level.
+		 *
+		 * @param out Stream to which the report is written
+		 */
+		static void report(std::ostream& out);
+
+		/**
+		 * Discard the recorded regions. No thread may be inside a region.
+		 */
+		static void reset();
+
+	private:
+		struct ThreadProfile
+		{
+			int ompThread;		// OpenMP thread number at the first region
+			Region root;
+			Region *current;
+
+			ThreadProfile();
+		};
+
+		/**
+		 * @return The profile of the calling thread, created at the first call
+		 */
+		static ThreadProfile& threadProfile();
+
+		/**
+		 * @return The profiles of all threads which have entered a region
+		 */
+		static std::vector<ThreadProfile *>& profiles();
+
+		/**
+		 * @return Lock protecting the list of profiles
+		 */
+		static std::mutex& profilesMutex();
+
+		/**
+		 * Write the regions nested in a region, recursively.
+		 */
+		static void reportChildren(std::ostream& out, const Region& region, int level);
+	};
+
+	/**
+	 * Scope guard timing a region from its construction to its destruction.
+	 * Normally used through the HAPARANDA_REGION macros.
+	 */
+	class ProfiledRegion
+	{
+	public:
+		/**
+		 * @param name Name of the region
+		 * @param dim Dimension of the boundary the region belongs to, or -1
+		 * @param side 0 for the lower boundary, 1 for the upper boundary, or -1
+		 */
+		ProfiledRegion(const char *name, int dim = -1, int side = -1);
+
+		~ProfiledRegion();
+
+	private:
+		Profiler::Region *region;
+		std::uint64_t start;
+	};
+
+	inline Profiler::Region::Region(const char *name, int dim, int side, Region *parent)
+	: name(name), dim(dim), side(side), nanoseconds(0), calls(0), parent(parent) {
+	}
+
+	inline Profiler::Region::~Region() {
+		for (std::size_t i=0; i<children.size(); i++) {
+			delete children[i];
+		}
+	}
+
+	inline Profiler::Region *Profiler::Region::child(const char *name, int dim, int side) {
+		for (std::size_t i=0; i<children.size(); i++) {
+			Region *candidate = children[i];
+			// Comparing the pointers first, since the names are mostly the same literals
+			if (candidate->dim == dim && candidate->side == side
+					&& (candidate->name == name || 0 == std::strcmp(candidate->name, name))) {
+				return candidate;
+			}
+		}
+		children.push_back(new Region(name, dim, side, this));
+		return children.back();
+	}
+
+	inline const Profiler::Region *Profiler::Region::find(const char *name, int dim, int side) const {
+		for (std::size_t i=0; i<children.size(); i++) {
+			if (children[i]->dim == dim && children[i]->side == side && 0 == std::strcmp(children[i]->name, name)) {
+				return children[i];
+			}
+		}
+		return NULL;
+	}
+
+	inline std::uint64_t Profiler::now() {
+		return EventTrace::now();
+	}
+
+	inline Profiler::Region *Profiler::enter(const char *name, int dim, int side) {
+		ThreadProfile& profile = threadProfile();
+		profile.current = profile.current->child(name, dim, side);
+		return profile.current;
+	}
+
+	inline void Profiler::leave(Region *region, std::uint64_t start) {
+		std::uint64_t end = now();
+		region->nanoseconds += end - start;
+		region->calls++;
+		threadProfile().current = region->parent;
+		EventTrace::record(region->name, region->dim, region->side, start, end);
+	}
+
+	inline void Profiler::add(const char *name, int dim, int side, std::uint64_t start) {
+		std::uint64_t end = now();
+		Region *region = threadProfile().current->child(name, dim, side);
+		region->nanoseconds += end - start;
+		region->calls++;
+		EventTrace::record(region->name, region->dim, region->side, start, end);
+	}
+
+	inline std::size_t Profiler::numThreads() {
+		std::lock_guard<std::mutex> lock(profilesMutex());
+		return profiles().size();
+	}
+
+	inline const Profiler::Region& Profiler::ownRegions() {
+		return threadProfile().root;
+	}
+
+	inline const Profiler::Region& Profiler::threadRegions(std::size_t thread) {
+		std::lock_guard<std::mutex> lock(profilesMutex());
+		return profiles().at(thread)->root;
+	}
+
+	inline void Profiler::report(std::ostream& out) {
+		std::lock_guard<std::mutex> lock(profilesMutex());
+		std::vector<ThreadProfile *>& all = profiles();
+		std::ios::fmtflags flags = out.flags();
+		for (std::size_t i=0; i<all.size(); i++) {
+			out << "thread " << i << " (OpenMP thread " << all[i]->ompThread << ")" << std::endl;
+			reportChildren(out, all[i]->root, 1);
+		}
+		out.flags(flags);
+	}
+
+	inline void Profiler::reset() {
+		std::lock_guard<std::mutex> lock(profilesMutex());
+		std::vector<ThreadProfile *>& all = profiles();
+		for (std::size_t i=0; i<all.size(); i++) {
+			for (std::size_t j=0; j<all[i]->root.children.size(); j++) {
+				delete all[i]->root.children[j];
+			}
+			all[i]->root.children.clear();
+			all[i]->current = &all[i]->root;
+		}
+	}
+
+
+	/*** Private methods ***/
+	inline Profiler::ThreadProfile::ThreadProfile()
+	: root("", -1, -1, NULL), current(&root) {
+#ifdef _OPENMP
+		ompThread = omp_get_thread_num();
+#else
+		ompThread = 0;
+#endif
+	}
+
+	inline Profiler::ThreadProfile& Profiler::threadProfile() {
+		// Kept in the list after the thread has exited, to be reported
+		static thread_local ThreadProfile *profile = NULL;
+		if (NULL == profile) {
+			profile = new ThreadProfile();
+			std::lock_guard<std::mutex> lock(profilesMutex());
+			profiles().push_back(profile);
+		}
+		return *profile;
+	}
+
+	inline std::vector<Profiler::ThreadProfile *>& Profiler::profiles() {
+		static std::vector<ThreadProfile *> all;
+		return all;
+	}
+
+	inline std::mutex& Profiler::profilesMutex() {
+		static std::mutex mutex;
+		return mutex;
+	}
+
+	inline void Profiler::reportChildren(std::ostream& out, const Region& region, int level) {
+		for (std::size_t i=0; i<region.children.size(); i++) {
+			const Region& child = *region.children[i];
+			std::ostringstream name;
+			name << std::string(2*level, ' ') << child.name;
+			if (child.dim >= 0) {
+				name << "[" << child.dim << "]";
+			}
+			if (child.side >= 0) {
+				name << "[" << (0 == child.side ? "lower" : "upper") << "]";
+			}
+			out << std::left << std::setw(40) << name.str() << std::right
+					<< std::setw(14) << std::fixed << std::setprecision(6) << child.nanoseconds * 1e-9 << " s"
+					<< std::setw(12) << child.calls << " calls" << std::endl;
+			reportChildren(out, child, level + 1);
+		}
+	}
+
+	inline ProfiledRegion::ProfiledRegion(const char *name, int dim, int side) {
+		region = Profiler::enter(name, dim, side);
+		start = Profiler::now();
+	}
+
+	inline ProfiledRegion::~ProfiledRegion() {
+		Profiler::leave(region, start);
+	}
+
+} /* namespace Utils */
+} /* namespace Haparanda */
+
+#endif /* PROFILER_HPP_ */
@@ -0,0 +1,189 @@
+#ifndef ROOFLINE_HPP_
+#define ROOFLINE_HPP_
+
+#include "Timer.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+namespace Haparanda {
+namespace Utils {
+
+	/**
+	 * Roofline model of the calling process: the performance attainable by
+	 * a kernel of a given arithmetic intensity is bounded by the peak
+	 * floating point performance and by the memory bandwidth times the
+	 * intensity. Both are measured by probes run by the current OpenMP
+	 * threads, so they reflect the same thread count and affinity as the
+	 * kernels, and the same instruction set as the kernels are compiled for.
+	 */
+	class Roofline
+	{
+	public:
+		static const std::size_t DEFAULT_TRIAD_ELEMENTS = std::size_t(1) << 23;	// 64 MiB per array
+		static const std::size_t DEFAULT_FMA_ITERATIONS = 10000000;
+
+		/**
+		 * @param bandwidth Memory bandwidth, in bytes per second
+		 * @param peakFlops Peak floating point performance, in operations per second
+		 */
+		Roofline(double bandwidth, double peakFlops);
+
+		virtual ~Roofline();
+
+		/**
+		 * Measure the roofline by the STREAM triad and the FMA probe.
+		 *
+		 * @param triadElements Number of elements of each triad array. Should be well beyond the size of the caches.
+		 * @param fmaIterations Number of iterations per thread of the FMA probe
+		 * @return The measured roofline
+		 */
+		static Roofline measure(std::size_t triadElements = DEFAULT_TRIAD_ELEMENTS,
+				std::size_t fmaIterations = DEFAULT_FMA_ITERATIONS);
+
+		/**
+		 * Measure the memory bandwidth by the STREAM triad a[i] = b[i] + s * c[i],
+		 * counting 24 bytes per element like STREAM does (i.e. not the write
+		 * allocation of a). The best of a few repetitions is used.
+		 *
+		 * @param elements Number of elements of each array
+		 * @return The bandwidth, in bytes per second
+		 */
+		static double measureTriadBandwidth(std::size_t elements);
+
+		/**
+		 * Measure the peak floating point performance by independent chains
+		 * of multiply-adds on each thread, enough of them to hide the latency
+		 * of the operations.
+		 *
+		 * @param iterations Number of iterations per thread
+		 * @return The performance, in floating point operations per second
+		 */
+		static double measurePeakFlops(std::size_t iterations);
+
+		/**
+		 * @return The memory bandwidth, in bytes per second
+		 */
+		double getBandwidth() const;
+
+		/**
+		 * @return The peak floating point performance, in operations per second
+		 */
+		double getPeakFlops() const;
+
+		/**
+		 * @param intensity Arithmetic intensity, in floating point operations per byte moved to or from memory
+		 * @return The attainable floating point performance, in operations per second
+		 */
+		double attainableFlops(double intensity) const;
+
+		/**
+		 * @return The arithmetic intensity at which the kernels stop being bound by the memory bandwidth
+		 */
+		double ridgePoint() const;
+
+	private:
+		static const int TRIAD_REPETITIONS = 5;
+		static const int FMA_CHAINS = 16;	// Independent chains per thread
+
+		double bandwidth;
+		double peakFlops;
+	};
+
+	inline Roofline::Roofline(double bandwidth, double peakFlops) {
+		if (bandwidth <= 0 || peakFlops <= 0) {
+			throw std::runtime_error("The bandwidth and the peak performance must be positive");
+		}
+		this->bandwidth = bandwidth;
+		this->peakFlops = peakFlops;
+	}
+
+	inline Roofline::~Roofline() {
+	}
+
+	inline Roofline Roofline::measure(std::size_t triadElements, std::size_t fmaIterations) {
+		return Roofline(measureTriadBandwidth(triadElements), measurePeakFlops(fmaIterations));
+	}
+
+	inline double Roofline::measureTriadBandwidth(std::size_t elements) {
+		std::vector<double> a(elements);
+		std::vector<double> b(elements);
+		std::vector<double> c(elements);
+		long n = elements;
+		// Touched first by the threads which will use them
+#pragma omp parallel for schedule(static)
+		for (long i=0; i<n; i++) {
+			a[i] = 0;
+			b[i] = 1;
+			c[i] = 2;
+		}
+		const double scalar = 3;
+		double bestTime = std::numeric_limits<double>::max();
+		Timer timer;
+		for (int r=0; r<TRIAD_REPETITIONS; r++) {
+			timer.start(true);
+#pragma omp parallel for schedule(static)
+			for (long i=0; i<n; i++) {
+				a[i] = b[i] + scalar * c[i];
+			}
+			bestTime = std::min(bestTime, timer.stop());
+		}
+		if (a[n/2] != 7) {
+			throw std::runtime_error("The triad computed wrong values");
+		}
+		return 3.0 * sizeof(double) * elements / bestTime;
+	}
+
+	inline double Roofline::measurePeakFlops(std::size_t iterations) {
+		double checksum = 0;
+		long totalIterations = 0;
+		Timer timer;
+		timer.start();
+#pragma omp parallel reduction(+:checksum, totalIterations)
+		{
+			double chains[FMA_CHAINS];
+			for (int j=0; j<FMA_CHAINS; j++) {
+				chains[j] = j;
+			}
+			// Converges to 1, so the values neither overflow nor become denormal
+			const double factor = 0.999999;
+			const double term = 0.000001;
+			for (std::size_t i=0; i<iterations; i++) {
+				for (int j=0; j<FMA_CHAINS; j++) {
+					chains[j] = chains[j] * factor + term;
+				}
+			}
+			for (int j=0; j<FMA_CHAINS; j++) {
+				checksum += chains[j];
+			}
+			totalIterations += iterations;
+		}
+		double time = timer.stop();
+		if (checksum <= 0) {
+			throw std::runtime_error("The FMA probe computed wrong values");
+		}
+		return 2.0 * FMA_CHAINS * totalIterations / time;
+	}
+
+	inline double Roofline::getBandwidth() const {
+		return bandwidth;
+	}
+
+	inline double Roofline::getPeakFlops() const {
+		return peakFlops;
+	}
+
+	inline double Roofline::attainableFlops(double intensity) const {
+		return std::min(peakFlops, intensity * bandwidth);
+	}
+
+	inline double Roofline::ridgePoint() const {
+		return peakFlops / bandwidth;
+	}
+
+} /* namespace Utils */
+} /* namespace Haparanda */
+
+#endif /* ROOFLINE_HPP_ */
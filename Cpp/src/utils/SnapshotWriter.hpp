@@ -0,0 +1,386 @@
+#ifndef SNAPSHOTWRITER_HPP_
+#define SNAPSHOTWRITER_HPP_
+
+#include "src/utils/Timer.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <errno.h>
+#include <fcntl.h>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace Haparanda {
+namespace Utils {
+
+	/**
+	 * Writer of snapshots of value arrays, which lets the caller continue
+	 * while the snapshots are written. A snapshot is copied into a staging
+	 * buffer by the calling thread (and its OpenMP threads), and written to
+	 * disk by a background thread, with large writes bypassing the page
+	 * cache (O_DIRECT) where the file system supports it.
+	 *
+	 * The staging buffers are allocated lazily, and all of them together
+	 * never exceed the memory budget. A budget of two snapshots lets one be
+	 * written while the next one is copied. When the budget is exhausted,
+	 * write either waits for a buffer to be written (backpressure), or drops
+	 * the snapshot if dropping is allowed.
+	 *
+	 * A snapshot file starts with a header of HEADER_SIZE bytes with MAGIC,
+	 * the step and the number of values (as 64-bit words), followed by the
+	 * values.
+	 */
+	class SnapshotWriter
+	{
+	public:
+		static const std::uint64_t MAGIC = 0x31504e5350414148ull;	// "HAAPSNP1" in little endian byte order
+		static const std::size_t HEADER_SIZE = 4096;	// Also the alignment of the writes
+		static const std::size_t WRITE_SIZE = 8 << 20;	// Max number of bytes per write call
+
+		/**
+		 * Start the background thread.
+		 *
+		 * @param memoryBudget Max number of bytes of all staging buffers together
+		 * @param dropWhenFull If true, snapshots are dropped when the budget is exhausted, otherwise write waits
+		 */
+		SnapshotWriter(std::size_t memoryBudget, bool dropWhenFull = false);
+
+		/**
+		 * Write the remaining snapshots and stop the background thread.
+		 */
+		virtual ~SnapshotWriter();
+
+		/**
+		 * Wait until all snapshots are written.
+		 */
+		void flush();
+
+		/**
+		 * @return Number of bytes written to the snapshot files
+		 */
+		std::size_t getBytesWritten() const;
+
+		/**
+		 * @return Number of snapshots dropped since the budget was exhausted
+		 */
+		std::size_t getNumDropped() const;
+
+		/**
+		 * @return Number of snapshots written
+		 */
+		std::size_t getNumWritten() const;
+
+		/**
+		 * @return Total time the callers of write have waited for buffers, in seconds
+		 */
+		double getStallTime() const;
+
+		/**
+		 * @return Total time the background thread has spent writing, in seconds
+		 */
+		double getWriteTime() const;
+
+		/**
+		 * @param numValues Number of values of a snapshot
+		 * @return Number of bytes of the staging buffer of a snapshot of the specified size
+		 */
+		static std::size_t stagingSize(std::size_t numValues);
+
+		/**
+		 * Copy the values into a staging buffer, and let the background
+		 * thread write them to a file.
+		 *
+		 * @param values Values to write
+		 * @param numValues Number of values
+		 * @param fileName Path to the snapshot file, which is overwritten if it exists
+		 * @param step Time step of the snapshot
+		 * @return False if the snapshot was dropped, true otherwise
+		 */
+		bool write(const double *values, std::size_t numValues, const std::string& fileName, std::size_t step);
+
+	private:
+		struct Snapshot {
+			char *buffer;
+			std::size_t size;		// Number of bytes of the buffer
+			std::size_t numBytes;	// Number of bytes to write
+			std::string fileName;
+		};
+
+		std::size_t memoryBudget;
+		bool dropWhenFull;
+		std::size_t allocated;				// Number of bytes of all staging buffers
+		std::vector<Snapshot> freeBuffers;	// Staging buffers which are not in use
+		std::deque<Snapshot> queue;			// Snapshots waiting to be written
+		bool writing;						// True while the background thread writes a snapshot
+		bool stopping;
+		std::string error;					// Error of the background thread, reported by the next call
+		std::size_t bytesWritten;
+		std::size_t numDropped;
+		std::size_t numWritten;
+		Timer stallTimer;
+		double writeTime;
+		mutable std::mutex mutex;
+		std::condition_variable queued;		// Signaled when a snapshot is queued or the writer is stopping
+		std::condition_variable done;		// Signaled when a snapshot is written
+		std::thread thread;
+
+		/**
+		 * Get a staging buffer of at least the specified size, waiting for
+		 * one or allocating it if needed. The mutex must be held.
+		 *
+		 * @param lock Lock of the mutex
+		 * @param size Number of bytes needed
+		 * @param snapshot Will be set to the buffer
+		 * @return False if the snapshot is to be dropped
+		 */
+		bool acquireBuffer(std::unique_lock<std::mutex>& lock, std::size_t size, Snapshot *snapshot);
+
+		/**
+		 * Throw the error of the background thread, if any. The mutex must
+		 * be held.
+		 */
+		void checkError();
+
+		/**
+		 * Write the snapshots in the queue until stopped.
+		 */
+		void run();
+
+		/**
+		 * Write a snapshot to its file.
+		 *
+		 * @param snapshot The snapshot
+		 */
+		static void writeFile(const Snapshot& snapshot);
+	};
+
+	inline SnapshotWriter::SnapshotWriter(std::size_t memoryBudget, bool dropWhenFull) {
+		this->memoryBudget = memoryBudget;
+		this->dropWhenFull = dropWhenFull;
+		allocated = 0;
+		writing = false;
+		stopping = false;
+		bytesWritten = 0;
+		numDropped = 0;
+		numWritten = 0;
+		writeTime = 0;
+		thread = std::thread(&SnapshotWriter::run, this);
+	}
+
+	inline SnapshotWriter::~SnapshotWriter() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		queued.notify_one();
+		thread.join();
+		for (std::size_t i=0; i<freeBuffers.size(); i++) {
+			free(freeBuffers[i].buffer);
+		}
+	}
+
+	inline void SnapshotWriter::flush() {
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [this]{ return queue.empty() && !writing; });
+		checkError();
+	}
+
+	inline std::size_t SnapshotWriter::getBytesWritten() const {
+		std::lock_guard<std::mutex> lock(mutex);
+		return bytesWritten;
+	}
+
+	inline std::size_t SnapshotWriter::getNumDropped() const {
+		std::lock_guard<std::mutex> lock(mutex);
+		return numDropped;
+	}
+
+	inline std::size_t SnapshotWriter::getNumWritten() const {
+		std::lock_guard<std::mutex> lock(mutex);
+		return numWritten;
+	}
+
+	inline double SnapshotWriter::getStallTime() const {
+		std::lock_guard<std::mutex> lock(mutex);
+		return stallTimer.totalElapsedTime();
+	}
+
+	inline double SnapshotWriter::getWriteTime() const {
+		std::lock_guard<std::mutex> lock(mutex);
+		return writeTime;
+	}
+
+	inline std::size_t SnapshotWriter::stagingSize(std::size_t numValues) {
+		std::size_t numBytes = HEADER_SIZE + numValues * sizeof(double);
+		return (numBytes + HEADER_SIZE - 1) / HEADER_SIZE * HEADER_SIZE;
+	}
+
+	inline bool SnapshotWriter::write(const double *values, std::size_t numValues, const std::string& fileName,
+			std::size_t step) {
+		Snapshot snapshot;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			checkError();
+			if (!acquireBuffer(lock, stagingSize(numValues), &snapshot)) {
+				numDropped++;
+				return false;
+			}
+		}
+		// Copy outside the lock, so that the background thread can go on
+		std::uint64_t header[] = {MAGIC, step, numValues};
+		std::memset(snapshot.buffer, 0, HEADER_SIZE);
+		std::memcpy(snapshot.buffer, header, sizeof(header));
+		double *data = reinterpret_cast<double *>(snapshot.buffer + HEADER_SIZE);
+#pragma omp parallel for simd schedule(static)
+		for (std::size_t i=0; i<numValues; i++) {
+			data[i] = values[i];
+		}
+		snapshot.numBytes = HEADER_SIZE + numValues * sizeof(double);
+		snapshot.fileName = fileName;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			queue.push_back(snapshot);
+		}
+		queued.notify_one();
+		return true;
+	}
+
+
+	/*** Private methods ***/
+	inline bool SnapshotWriter::acquireBuffer(std::unique_lock<std::mutex>& lock, std::size_t size, Snapshot *snapshot) {
+		if (size > memoryBudget) {
+			throw std::runtime_error("A snapshot does not fit in the memory budget of the snapshot writer");
+		}
+		bool stalled = false;
+		while (true) {
+			// Reuse a large enough free buffer
+			for (std::size_t i=0; i<freeBuffers.size(); i++) {
+				if (freeBuffers[i].size >= size) {
+					*snapshot = freeBuffers[i];
+					freeBuffers.erase(freeBuffers.begin() + i);
+					if (stalled) {
+						stallTimer.stop();
+					}
+					return true;
+				}
+			}
+			// Free smaller buffers until a new one fits
+			while (allocated + size > memoryBudget && !freeBuffers.empty()) {
+				allocated -= freeBuffers.back().size;
+				free(freeBuffers.back().buffer);
+				freeBuffers.pop_back();
+			}
+			if (allocated + size <= memoryBudget) {
+				void *buffer = NULL;
+				if (0 != posix_memalign(&buffer, HEADER_SIZE, size)) {
+					throw std::bad_alloc();
+				}
+				snapshot->buffer = static_cast<char *>(buffer);
+				snapshot->size = size;
+				allocated += size;
+				if (stalled) {
+					stallTimer.stop();
+				}
+				return true;
+			}
+			if (dropWhenFull) {
+				return false;
+			}
+			if (!stalled) {
+				stallTimer.start();
+				stalled = true;
+			}
+			done.wait(lock);
+			checkError();
+		}
+	}
+
+	inline void SnapshotWriter::checkError() {
+		if (!error.empty()) {
+			std::string message = error;
+			error.clear();
+			throw std::runtime_error(message);
+		}
+	}
+
+	inline void SnapshotWriter::run() {
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true) {
+			queued.wait(lock, [this]{ return !queue.empty() || stopping; });
+			if (queue.empty()) {
+				return;
+			}
+			Snapshot snapshot = queue.front();
+			queue.pop_front();
+			writing = true;
+			lock.unlock();
+			std::string message;
+			Timer timer;
+			timer.start();
+			try {
+				writeFile(snapshot);
+			} catch (std::runtime_error& e) {
+				message = e.what();
+			}
+			double time = timer.stop();
+			lock.lock();
+			writeTime += time;
+			writing = false;
+			if (message.empty()) {
+				numWritten++;
+				bytesWritten += snapshot.numBytes;
+			} else {
+				error = message;
+			}
+			freeBuffers.push_back(snapshot);
+			lock.unlock();
+			done.notify_all();
+			lock.lock();
+		}
+	}
+
+	inline void SnapshotWriter::writeFile(const Snapshot& snapshot) {
+		int fd = -1;
+#ifdef O_DIRECT
+		fd = open(snapshot.fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+#endif
+		if (-1 == fd) {
+			// E.g. tmpfs does not support O_DIRECT
+			fd = open(snapshot.fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		}
+		if (-1 == fd) {
+			throw std::runtime_error("Cannot open snapshot " + snapshot.fileName + ": " + std::strerror(errno));
+		}
+		// The whole buffer is written, to keep the writes aligned, and the file is then cut
+		std::size_t numBytes = std::min(snapshot.size, (snapshot.numBytes + HEADER_SIZE - 1) / HEADER_SIZE * HEADER_SIZE);
+		std::size_t offset = 0;
+		// A copy, as std::min takes references, which the constant has no definition to bind to
+		const std::size_t writeSize = WRITE_SIZE;
+		while (offset < numBytes) {
+			ssize_t written = pwrite(fd, snapshot.buffer + offset, std::min(writeSize, numBytes - offset), offset);
+			if (0 > written) {
+				close(fd);
+				throw std::runtime_error("Cannot write snapshot " + snapshot.fileName + ": " + std::strerror(errno));
+			}
+			offset += written;
+		}
+		bool ok = 0 == ftruncate(fd, snapshot.numBytes);
+		ok = 0 == close(fd) && ok;
+		if (!ok) {
+			throw std::runtime_error("Cannot write snapshot " + snapshot.fileName + ": " + std::strerror(errno));
+		}
+	}
+
+} /* namespace Utils */
+} /* namespace Haparanda */
+
+#endif /* SNAPSHOTWRITER_HPP_ */
@@ -0,0 +1,154 @@
+#ifndef STATISTICS_HPP_
+#define STATISTICS_HPP_
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+namespace Haparanda {
+namespace Utils {
+
+	/**
+	 * Summary statistics of a series of samples, e.g. the times of the
+	 * steps of a benchmark.
+	 */
+	class Statistics
+	{
+	public:
+		Statistics();
+
+		virtual ~Statistics();
+
+		/**
+		 * @param sample The sample to add
+		 */
+		void add(double sample);
+
+		/**
+		 * @return The number of samples
+		 */
+		std::size_t count() const;
+
+		/**
+		 * @return The largest sample
+		 */
+		double max() const;
+
+		/**
+		 * @return The arithmetic mean of the samples
+		 */
+		double mean() const;
+
+		/**
+		 * @return The median of the samples
+		 */
+		double median() const;
+
+		/**
+		 * @return The smallest sample
+		 */
+		double min() const;
+
+		/**
+		 * Get a percentile of the samples, interpolating linearly between the
+		 * closest samples.
+		 *
+		 * @param percent Percentage of the samples which are <= the result, 0 to 100
+		 * @return The percentile
+		 */
+		double percentile(double percent) const;
+
+		/**
+		 * @return The sample standard deviation, or 0 if there are fewer than two samples
+		 */
+		double standardDeviation() const;
+
+	private:
+		mutable std::vector<double> samples;
+		mutable bool sorted;	// True if the samples are in ascending order
+
+		/**
+		 * Sort the samples if needed.
+		 *
+		 * @throws std::runtime_error If there are no samples
+		 */
+		void sort() const;
+	};
+
+	inline Statistics::Statistics() {
+		sorted = true;
+	}
+
+	inline Statistics::~Statistics() {
+	}
+
+	inline void Statistics::add(double sample) {
+		sorted = sorted && (samples.empty() || samples.back() <= sample);
+		samples.push_back(sample);
+	}
+
+	inline std::size_t Statistics::count() const {
+		return samples.size();
+	}
+
+	inline double Statistics::max() const {
+		sort();
+		return samples.back();
+	}
+
+	inline double Statistics::mean() const {
+		sort();
+		double sum = 0;
+		for (std::size_t i=0; i<samples.size(); i++) {
+			sum += samples[i];
+		}
+		return sum / samples.size();
+	}
+
+	inline double Statistics::median() const {
+		return percentile(50);
+	}
+
+	inline double Statistics::min() const {
+		sort();
+		return samples.front();
+	}
+
+	inline double Statistics::percentile(double percent) const {
+		sort();
+		double position = std::min(std::max(percent, 0.0), 100.0) / 100 * (samples.size() - 1);
+		std::size_t below = std::floor(position);
+		std::size_t above = std::min(below + 1, samples.size() - 1);
+		double weight = position - below;
+		return (1 - weight) * samples[below] + weight * samples[above];
+	}
+
+	inline double Statistics::standardDeviation() const {
+		if (samples.size() < 2) {
+			return 0;
+		}
+		double average = mean();
+		double sum = 0;
+		for (std::size_t i=0; i<samples.size(); i++) {
+			sum += (samples[i] - average) * (samples[i] - average);
+		}
+		return std::sqrt(sum / (samples.size() - 1));
+	}
+
+
+	/*** Private methods ***/
+	inline void Statistics::sort() const {
+		if (samples.empty()) {
+			throw std::runtime_error("No samples");
+		}
+		if (!sorted) {
+			std::sort(samples.begin(), samples.end());
+			sorted = true;
+		}
+	}
+
+} /* namespace Utils */
+} /* namespace Haparanda */
+
+#endif /* STATISTICS_HPP_ */
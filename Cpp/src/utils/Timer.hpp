@@ -37,7 +37,7 @@ namespace Haparanda
 		// Default constructor with no name, not started upon creation.
 		Timer();
 
-		// Returns current wall-clock time in seconds.*/
+		// Returns current monotonic wall-clock time in seconds.*/
 		double getWallTime() const;
 
 		// Start the timer
@@ -67,9 +67,9 @@ namespace Haparanda
 	//==============================================================================
 	double Timer::getWallTime() const
 	{
-		struct timeval tv;
-		gettimeofday(&tv, NULL);
-		return tv.tv_sec + 1.0e-6*tv.tv_usec;
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return ts.tv_sec + 1.0e-9*ts.tv_nsec;
 	}
 
 	// Inline definitions of start and stop functions
@@ -0,0 +1,231 @@
+#ifndef TUNINGCACHE_HPP_
+#define TUNINGCACHE_HPP_
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+namespace Haparanda {
+namespace Utils {
+
+	/**
+	 * File of the configurations found fastest by autotuning, so that later
+	 * runs of the same problem on the same kind of host can start with them
+	 * directly. The file has one line per problem, with tab separated fields:
+	 * the key (host signature, dimensionality, size, order of accuracy,
+	 * number of processes, number of threads, and the options which limit
+	 * the candidates or affect their speed: decomposition, emulated
+	 * processes per node, link bandwidth of the halo compression and whether
+	 * checkpoints or snapshots are used), followed by the
+	 * configuration (exchange mode, bit mask of the explicitly packed
+	 * dimensions, blocks per process and dimension, number of threads and
+	 * time per application).
+	 */
+	class TuningCache
+	{
+	public:
+		/**
+		 * Problem which a configuration is tuned for.
+		 */
+		struct Key
+		{
+			std::string host;		// See hostSignature
+			std::size_t dimensionality;
+			std::size_t size;		// Points per dimension of the block of each process
+			std::size_t order;		// Order of accuracy of the stencil
+			int processes;
+			int threads;			// Number of threads available to each process
+			std::string decomposition;	// How the processes are arranged in the processor grid
+			int processesPerNode;	// Emulated processes per node, 0 if the nodes are detected
+			double linkBandwidth;	// Bandwidth the boundary data is compressed for, negative if it is not compressed
+			bool checkpoints;		// True if checkpoints or snapshots are read or written
+		};
+
+		/**
+		 * Tuned configuration of a problem.
+		 */
+		struct Configuration
+		{
+			std::string exchange;			// How the boundary data is exchanged
+			unsigned int packedDimensions;	// Bit d is set if the boundary data is packed explicitly along dimension d
+			std::size_t blocksPerProcessDim;	// Blocks per process along each dimension, 0 if there is no domain
+			int threads;					// Number of threads used
+			double seconds;					// Time per application measured when tuning
+		};
+
+		/**
+		 * Read the cache file, if it exists.
+		 *
+		 * @param fileName Path to the cache file
+		 * @throws std::runtime_error If the file exists but is malformed
+		 */
+		TuningCache(const std::string& fileName);
+
+		virtual ~TuningCache();
+
+		/**
+		 * @param key A problem
+		 * @param configuration Set to the configuration tuned for the problem, if there is one
+		 * @return True if there is a configuration for the problem
+		 */
+		bool find(const Key& key, Configuration *configuration) const;
+
+		/**
+		 * Add the configuration of a problem, replacing any previous one, and
+		 * rewrite the cache file.
+		 *
+		 * @param key The problem
+		 * @param configuration The configuration tuned for it
+		 * @throws std::runtime_error If the file cannot be written
+		 */
+		void store(const Key& key, const Configuration& configuration);
+
+		/**
+		 * @return The number of problems with a configuration
+		 */
+		std::size_t size() const;
+
+		/**
+		 * @return A signature of the calling host, which tuned configurations are only reused on: its name, CPU model and number of hardware threads
+		 */
+		static std::string hostSignature();
+
+	private:
+		static const int NUM_KEY_FIELDS = 10;
+
+		std::string fileName;
+		std::map<std::string, std::string> entries;	// Configuration fields by key fields, as in the file
+
+		/**
+		 * @return The key fields of a line
+		 */
+		static std::string format(const Key& key);
+
+		/**
+		 * @return The configuration fields of a line
+		 */
+		static std::string format(const Configuration& configuration);
+	};
+
+	inline TuningCache::TuningCache(const std::string& fileName) {
+		this->fileName = fileName;
+		std::ifstream file(fileName.c_str());
+		std::string line;
+		for (std::size_t lineNumber=1; std::getline(file, line); lineNumber++) {
+			if (line.empty() || '#' == line[0]) {
+				continue;
+			}
+			std::size_t split = 0;
+			for (int f=0; f<NUM_KEY_FIELDS && std::string::npos != split; f++) {
+				split = line.find('\t', split + (0 < f ? 1 : 0));
+			}
+			if (std::string::npos == split) {
+				std::ostringstream message;
+				message << "Malformed line " << lineNumber << " in the tuning cache " << fileName;
+				throw std::runtime_error(message.str());
+			}
+			entries[line.substr(0, split)] = line.substr(split + 1);
+		}
+	}
+
+	inline TuningCache::~TuningCache() {
+	}
+
+	inline bool TuningCache::find(const Key& key, Configuration *configuration) const {
+		std::map<std::string, std::string>::const_iterator entry = entries.find(format(key));
+		if (entries.end() == entry) {
+			return false;
+		}
+		std::istringstream fields(entry->second);
+		std::string field;
+		std::getline(fields, configuration->exchange, '\t');
+		std::getline(fields, field, '\t');
+		configuration->packedDimensions = std::strtoul(field.c_str(), NULL, 10);
+		std::getline(fields, field, '\t');
+		configuration->blocksPerProcessDim = std::strtoul(field.c_str(), NULL, 10);
+		std::getline(fields, field, '\t');
+		configuration->threads = std::atoi(field.c_str());
+		std::getline(fields, field, '\t');
+		configuration->seconds = std::atof(field.c_str());
+		return true;
+	}
+
+	inline void TuningCache::store(const Key& key, const Configuration& configuration) {
+		entries[format(key)] = format(configuration);
+		// Replace the file at once, so that concurrent readers never see a partial one
+		std::string temporaryName = fileName + ".tmp";
+		{
+			std::ofstream file(temporaryName.c_str());
+			file << "# host\tdimensionality\tsize\torder\tprocesses\tthreads"
+					<< "\tdecomposition\tprocessesPerNode\tlinkBandwidth\tcheckpoints"
+					<< "\texchange\tpackedDimensions\tblocksPerProcessDim\ttunedThreads\tseconds" << std::endl;
+			for (std::map<std::string, std::string>::const_iterator e=entries.begin(); e!=entries.end(); e++) {
+				file << e->first << "\t" << e->second << std::endl;
+			}
+			if (!file) {
+				throw std::runtime_error("Could not write the tuning cache " + temporaryName);
+			}
+		}
+		if (0 != std::rename(temporaryName.c_str(), fileName.c_str())) {
+			throw std::runtime_error("Could not replace the tuning cache " + fileName);
+		}
+	}
+
+	inline std::size_t TuningCache::size() const {
+		return entries.size();
+	}
+
+	inline std::string TuningCache::hostSignature() {
+		char hostName[256] = "";
+		gethostname(hostName, sizeof(hostName) - 1);
+		std::string model = "unknown";
+		std::ifstream cpuInfo("/proc/cpuinfo");
+		std::string line;
+		while (std::getline(cpuInfo, line)) {
+			if (0 == line.compare(0, 10, "model name")) {
+				std::size_t colon = line.find(':');
+				if (std::string::npos != colon) {
+					model = line.substr(line.find_first_not_of(' ', colon + 1));
+				}
+				break;
+			}
+		}
+		std::ostringstream signature;
+		signature << hostName << "/" << model << "/" << std::thread::hardware_concurrency();
+		// Tabs separate the fields of the file
+		std::string result = signature.str();
+		for (std::size_t i=0; i<result.size(); i++) {
+			if ('\t' == result[i]) {
+				result[i] = ' ';
+			}
+		}
+		return result;
+	}
+
+
+	/*** Private methods ***/
+	inline std::string TuningCache::format(const Key& key) {
+		std::ostringstream fields;
+		fields << key.host << "\t" << key.dimensionality << "\t" << key.size << "\t" << key.order
+				<< "\t" << key.processes << "\t" << key.threads << "\t" << key.decomposition
+				<< "\t" << key.processesPerNode << "\t" << key.linkBandwidth << "\t" << key.checkpoints;
+		return fields.str();
+	}
+
+	inline std::string TuningCache::format(const Configuration& configuration) {
+		std::ostringstream fields;
+		fields << configuration.exchange << "\t" << configuration.packedDimensions << "\t"
+				<< configuration.blocksPerProcessDim << "\t" << configuration.threads << "\t" << configuration.seconds;
+		return fields.str();
+	}
+
+} /* namespace Utils */
+} /* namespace Haparanda */
+
+#endif /* TUNINGCACHE_HPP_ */
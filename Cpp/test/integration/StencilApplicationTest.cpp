@@ -9,6 +9,7 @@
 #include <cmath>
 #include <fstream>
 #include <time.h>
+#include <vector>
 
 #define PI 3.14159265358979323846
 #define DIM 3
@@ -17,6 +18,8 @@
 // Max error after two applications
 #define EXPECTED_ACCURACY2 0.15
 // These accuracies should be enough at least for DIM<=7
+// Number of elements of the tiles of the activity masks along each dimension
+#define TILE_SIZE 2
 
 using namespace Haparanda::Grid;
 using namespace Haparanda::Numerics;
@@ -91,18 +94,55 @@ protected:
 		applyStencil();
 		initializeExpected2ndDer();
 		checkValues(EXPECTED_ACCURACY1);
-		// Swap value arrays
-		double *tmp = resultValues;
-		resultValues = inputValues;
-		inputValues = tmp;
-		inputBlock->setValues(inputValues);
-		resultBlock->setValues(resultValues);
+		swapValues();
 		// Verify that the stencil can be applied repeatedly
 		applyStencil();
 		initializeExpected4thDer();
 		checkValues(EXPECTED_ACCURACY2);
 	}
 
+	/**
+	 * Let the input block compress the boundary data it sends, whether it
+	 * pays off or not.
+	 */
+	void enableHaloCompression() {
+		static_cast<ComputationalComposedBlock<DIM> *>(inputBlock)->setHaloCompression(true);
+	}
+
+	/**
+	 * Apply the stencil twice on input which is zero except close to the
+	 * origin, first without and then with activity masks, and verify that
+	 * the results are the same although the masks let the stencil skip part
+	 * of the block.
+	 */
+	void testMaskedStencilApplication() {
+		std::vector<double> expected[2];
+		initializeLocalizedInput();
+		for (std::size_t k=0; k<2; k++) {
+			applyStencil();
+			expected[k].assign(resultValues, resultValues + elementsPerBlock);
+			swapValues();
+		}
+
+		ActivityMask<DIM> inputMask(pointsPerBlock, TILE_SIZE, 0);
+		ActivityMask<DIM> resultMask(pointsPerBlock, TILE_SIZE, 0);
+		ActivityMask<DIM> *masks[2] = {&inputMask, &resultMask};
+		initializeLocalizedInput();
+		inputMask.update(inputValues);
+		for (std::size_t k=0; k<2; k++) {
+			inputBlock->setActivityMask(masks[k%2]);
+			resultBlock->setActivityMask(masks[(k+1)%2]);
+			applyStencil();
+			if (0 == k) {
+				EXPECT_LT(inputMask.numActiveTiles(), inputMask.getNumTiles());
+			}
+			for (std::size_t i=0; i<elementsPerBlock; i++) {
+				expect_equal(expected[k][i], resultValues[i]);
+			}
+			swapValues();
+		}
+	}
+
 private:
 	std::size_t pointsPerBlock;		// Number of elements in each dimension
 	std::size_t elementsPerBlock;	// Total number of elements
@@ -124,6 +164,17 @@ private:
 		inputBlock->finishCommunication();
 	}
 
+	/**
+	 * Let the input and result blocks swap value arrays.
+	 */
+	void swapValues() {
+		double *tmp = resultValues;
+		resultValues = inputValues;
+		inputValues = tmp;
+		inputBlock->setValues(inputValues);
+		resultBlock->setValues(resultValues);
+	}
+
 	/**
 	 * Verify that each value in resultValues differ from the corresponding
 	 * value in expectedValues with at most the specified error.
@@ -196,6 +247,23 @@ private:
 			inputValues[i] = inputValue;
 		}
 	}
+
+	/**
+	 * Initialize inputBlock with a sinus function within two elements from
+	 * the origin (along each dimension), and zeros elsewhere.
+	 */
+	void initializeLocalizedInput() {
+		for (std::size_t i=0; i<elementsPerBlock; i++) {
+			double inputValue = 1;
+			for (std::size_t d=0; d<DIM; d++) {
+				std::size_t stride = Haparanda::Math::power(pointsPerBlock, d);
+				std::size_t indexAlongD = (i/stride)%pointsPerBlock;
+				double x_i = smallestCoordinate[d] + indexAlongD * stepLength[d];
+				inputValue *= x_i < 2*stepLength[d] ? sin(2*PI*x_i) + 2 : 0;
+			}
+			inputValues[i] = inputValue;
+		}
+	}
 };
 
 
@@ -210,4 +278,22 @@ TEST_F(StencilApplicationTest, TestApplyStencil) {
 	testStencilApplication();
 }
 
+/**
+ * Apply the stencil with activity masks on input which is zero in most of the
+ * domain, and verify that the result is the same as without masks.
+ */
+TEST_F(StencilApplicationTest, TestApplyStencilWithActivityMasks) {
+	testMaskedStencilApplication();
+}
+
+/**
+ * Apply the stencil with compressed boundary data, without and with activity
+ * masks, and verify that the result is the same as without compression.
+ */
+TEST_F(StencilApplicationTest, TestApplyStencilWithHaloCompression) {
+	enableHaloCompression();
+	testStencilApplication();
+	testMaskedStencilApplication();
+}
+
 #endif /* STENCILAPPLICATION_HPP_ */
@@ -0,0 +1,161 @@
+#ifndef CHECKPOINTPARTEST_HPP_
+#define CHECKPOINTPARTEST_HPP_
+
+#include "src/grid/Checkpoint.hpp"
+#include "src/grid/ComputationalComposedBlock.hpp"
+#include "src/utils/Math.hpp"
+#include "test/HaparandaTest.hpp"
+
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <vector>
+
+#define DIM 2
+
+namespace Haparanda {
+namespace Grid {
+	/**
+	 * Test of writing a checkpoint and restarting from it.
+	 */
+	class CheckpointParTest : public HaparandaTest
+	{
+	public:
+		virtual void SetUp() {
+			block = new ComputationalComposedBlock<DIM>(elementsPerDim, extent);
+			values.resize(Haparanda::Math::power(elementsPerDim, DIM));
+		}
+
+		virtual void TearDown() {
+			MPI::COMM_WORLD.Barrier();
+			if (0 == MPI::COMM_WORLD.Get_rank()) {
+				std::remove(fileName);
+			}
+			delete block;
+		}
+
+	protected:
+		const char *fileName = "CheckpointParTest.chk";
+		const std::size_t elementsPerDim = 12;
+		const std::size_t extent = 4;
+		ComputationalComposedBlock<DIM> *block;
+		std::vector<double> values;
+
+		/**
+		 * @param index Global index of an element along each dimension
+		 * @return A value identifying the element
+		 */
+		static double valueAt(const std::size_t *index) {
+			return index[0] + 1000.0 * index[1];
+		}
+
+		/**
+		 * Set each value to the value identifying the element, given the
+		 * position of the block in the processor grid.
+		 *
+		 * @param values Values of the block
+		 */
+		void initialize(std::vector<double>& values) const {
+			for (std::size_t i=0; i<values.size(); i++) {
+				std::size_t index[DIM] = {block->procGridCoord(0) * elementsPerDim + i % elementsPerDim,
+						block->procGridCoord(1) * elementsPerDim + i / elementsPerDim};
+				values[i] = valueAt(index);
+			}
+		}
+
+		/**
+		 * Verify that the values identify the elements of the block.
+		 *
+		 * @param values Values of the block
+		 */
+		void checkValues(const double *values) const {
+			std::vector<double> expected(this->values.size());
+			initialize(expected);
+			for (std::size_t i=0; i<expected.size(); i++) {
+				expect_equal(expected[i], values[i]);
+			}
+		}
+
+		/**
+		 * Let process 0 write a checkpoint of the global grid of this test
+		 * decomposed into 3x3 blocks, as a program of another number of
+		 * processes would.
+		 */
+		void writeForeignCheckpoint() const {
+			if (0 == MPI::COMM_WORLD.Get_rank()) {
+				const std::size_t numOldBlocks[DIM] = {3, 3};
+				const std::size_t oldElementsPerDim = block->procGridSize(0) * elementsPerDim / numOldBlocks[0];
+				std::vector<std::uint64_t> header(Checkpoint<DIM>::HEADER_SIZE / sizeof(std::uint64_t), 0);
+				std::uint64_t fields[] = {Checkpoint<DIM>::MAGIC, Checkpoint<DIM>::VERSION, Checkpoint<DIM>::HEADER_SIZE,
+						DIM, oldElementsPerDim, 7, sizeof(double), numOldBlocks[0], numOldBlocks[1]};
+				std::copy(fields, fields + sizeof(fields)/sizeof(fields[0]), header.begin());
+				std::vector<double> data;
+				for (std::size_t b1=0; b1<numOldBlocks[1]; b1++) {
+					for (std::size_t b0=0; b0<numOldBlocks[0]; b0++) {
+						for (std::size_t i=0; i<oldElementsPerDim*oldElementsPerDim; i++) {
+							std::size_t index[DIM] = {b0 * oldElementsPerDim + i % oldElementsPerDim,
+									b1 * oldElementsPerDim + i / oldElementsPerDim};
+							data.push_back(valueAt(index));
+						}
+					}
+				}
+				int fd = open(fileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+				ASSERT_NE(-1, fd);
+				ASSERT_EQ(ssize_t(Checkpoint<DIM>::HEADER_SIZE), write(fd, &header[0], Checkpoint<DIM>::HEADER_SIZE));
+				ASSERT_EQ(ssize_t(data.size() * sizeof(double)), write(fd, &data[0], data.size() * sizeof(double)));
+				close(fd);
+			}
+			MPI::COMM_WORLD.Barrier();
+		}
+	};
+
+	/**
+	 * Test that a checkpoint can be restarted from with the same
+	 * decomposition, both by copying and mapping the values.
+	 */
+	TEST_F(CheckpointParTest, TestWriteAndRestore) {
+		initialize(values);
+		Checkpoint<DIM>::write(fileName, *block, &values[0], 42);
+		Checkpoint<DIM> checkpoint(fileName, MPI::COMM_WORLD);
+		expect_equal(std::size_t(42), checkpoint.getStep());
+		expect_equal(elementsPerDim, checkpoint.getElementsPerDim());
+		EXPECT_TRUE(checkpoint.matches(*block));
+		std::vector<double> restored(values.size(), -1.0);
+		checkpoint.restore(*block, &restored[0]);
+		checkValues(&restored[0]);
+		double *mapped = checkpoint.map(*block);
+		checkValues(mapped);
+		// The mapping is private
+		mapped[0] = -1;
+		checkpoint.restore(*block, &restored[0]);
+		checkValues(&restored[0]);
+	}
+
+	/**
+	 * Test that a checkpoint written with another decomposition is
+	 * redistributed.
+	 */
+	TEST_F(CheckpointParTest, TestRedistribute) {
+		// 3x3 blocks of the same global grid
+		if (0 != block->procGridSize(0) * elementsPerDim % 3 || block->procGridSize(0) != block->procGridSize(1)) {
+			return;
+		}
+		writeForeignCheckpoint();
+		Checkpoint<DIM> checkpoint(fileName, MPI::COMM_WORLD);
+		expect_equal(std::size_t(7), checkpoint.getStep());
+		EXPECT_FALSE(checkpoint.matches(*block));
+		checkpoint.restore(*block, &values[0]);
+		checkValues(&values[0]);
+	}
+
+	/**
+	 * Test that a file which is not a checkpoint is rejected.
+	 */
+	TEST_F(CheckpointParTest, TestInvalidFile) {
+		EXPECT_THROW(Checkpoint<DIM>("CheckpointParTest.missing", MPI::COMM_WORLD), std::runtime_error);
+	}
+
+}	/* namespace Grid */
+}	/* namespace Haparanda */
+
+#endif /* CHECKPOINTPARTEST_HPP_ */
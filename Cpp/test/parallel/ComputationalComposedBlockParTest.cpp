@@ -1,10 +1,15 @@
 #ifndef COMPUTATIONALCOMPOSEDBLOCKPARTEST_HPP_
 #define COMPUTATIONALCOMPOSEDBLOCKPARTEST_HPP_
 
+#include "src/grid/AggregatedComposedBlock.hpp"
+#include "src/grid/CollectiveComposedBlock.hpp"
 #include "src/grid/ComputationalComposedBlock.hpp"
+#include "src/grid/OneSidedComposedBlock.hpp"
+#include "src/grid/SharedMemoryComposedBlock.hpp"
 #include "src/utils/Math.hpp"
 #include "test/HaparandaTest.hpp"
 
+#include <limits>
 #include <math.h>
 #include <stdexcept>
 
@@ -22,7 +27,17 @@ namespace Grid {
 	{
 	public:
 		virtual void SetUp () {
-			block = new ComputationalComposedBlock<DIM>(elementsPerDim, extent);
+			setUpBlock(new ComputationalComposedBlock<DIM>(elementsPerDim, extent));
+		}
+
+		/**
+		 * Let the test use the block given as argument, and initialize it
+		 * with values that identify its position in the processor grid.
+		 *
+		 * @param newBlock Block to test. It will be deleted by TearDown.
+		 */
+		void setUpBlock(CommunicativeBlock<DIM> *newBlock) {
+			block = newBlock;
 
 			for (int d=0; d<DIM; d++) {
 				numProcs[d] = block->procGridSize(d);
@@ -56,12 +71,220 @@ namespace Grid {
 
 
 	protected:
+		/**
+		 * Replace the block created by SetUp with the one given as argument.
+		 *
+		 * @param newBlock Block to test. It will be deleted by TearDown.
+		 */
+		void replaceBlock(CommunicativeBlock<DIM> *newBlock) {
+			delete []values;
+			delete block;
+			setUpBlock(newBlock);
+		}
+
+		/**
+		 * Replace the block created by SetUp with the one given as argument,
+		 * and verify that the ghost regions of it are initialized correctly,
+		 * both without and with explicit packing of the boundary data.
+		 *
+		 * @param newBlock Block to test. It will be deleted by TearDown.
+		 */
+		void testCommunicationOf(ComputationalComposedBlock<DIM> *newBlock) {
+			replaceBlock(newBlock);
+			testCommunication();
+			for (int d=0; d<DIM; d++) {
+				newBlock->setExplicitPacking(d, true);
+			}
+			testCommunication();
+		}
+
+		/**
+		 * Verify that the ghost regions are initialized correctly when the
+		 * boundary data is exchanged by a neighborhood collective operation.
+		 */
+		void testCommunicationCollective() {
+			testCommunicationOf(new CollectiveComposedBlock<DIM>(elementsPerDim, extent));
+		}
+
+		/**
+		 * Verify that the ghost regions are initialized correctly when the
+		 * boundary data sent between nodes is aggregated. Nodes consisting of
+		 * pairs of processes are emulated, so that there are messages to
+		 * aggregate if there are more than two processes.
+		 */
+		void testCommunicationAggregated() {
+			CommunicativeBlock<DIM>::setEmulatedProcessesPerNode(2);
+			AggregatedComposedBlock<DIM> *newBlock = new AggregatedComposedBlock<DIM>(elementsPerDim, extent);
+			CommunicativeBlock<DIM>::setEmulatedProcessesPerNode(0);
+			testCommunicationOf(newBlock);
+			testCommunication();
+		}
+
+		/**
+		 * Verify that the ghost regions are initialized correctly when the
+		 * boundary data is put into them by one-sided communication.
+		 */
+		void testCommunicationOneSided() {
+			testCommunicationOf(new OneSidedComposedBlock<DIM>(elementsPerDim, extent));
+		}
+
+		/**
+		 * Verify that the values outside the boundaries are correct when the
+		 * neighbors on the same node read them directly from each other's
+		 * value arrays. Nodes consisting of pairs of processes are emulated,
+		 * so that data is also exchanged by messages if there are more than
+		 * two processes.
+		 */
+		void testCommunicationSharedMemory() {
+			int rank = MPI::COMM_WORLD.Get_rank();
+			MPI_Comm emulatedNode;
+			MPI_Comm_split(MPI_COMM_WORLD, rank/2, rank, &emulatedNode);
+			SharedMemoryComposedBlock<DIM> *sharedBlock
+			= new SharedMemoryComposedBlock<DIM>(elementsPerDim, extent, 1, emulatedNode);
+			MPI_Comm_free(&emulatedNode);
+			replaceBlock(sharedBlock);
+			double *sharedValues = sharedBlock->getValueArray(0);
+			std::copy(values, values + numElements, sharedValues);
+			sharedBlock->setValues(sharedValues);
+			testCommunication();
+			testCommunication();
+		}
+
+		/**
+		 * Let the boundary data be packed explicitly along every dimension and
+		 * verify that the ghost regions are initialized correctly.
+		 */
+		void testCommunicationExplicitPacking() {
+			for (int d=0; d<DIM; d++) {
+				static_cast<ComputationalComposedBlock<DIM> *>(block)->setExplicitPacking(d, true);
+			}
+			testCommunication();
+		}
+
+		/**
+		 * Verify that the ghost regions are initialized correctly when the
+		 * processor grid is planned for nodes of two processes each, and that
+		 * the data sent between the nodes matches the prediction.
+		 */
+		void testCommunicationPlanned() {
+			CommunicativeBlock<DIM>::setPlannedDecomposition(true);
+			CommunicativeBlock<DIM>::setEmulatedProcessesPerNode(2);
+			replaceBlock(new ComputationalComposedBlock<DIM>(elementsPerDim, extent));
+			CommunicativeBlock<DIM>::setPlannedDecomposition(false);
+			CommunicativeBlock<DIM>::setEmulatedProcessesPerNode(0);
+
+			int numProcesses = MPI::COMM_WORLD.Get_size();
+			DecompositionPlanner<DIM> planner(numProcesses, 0 == numProcesses % 2 ? 2 : 1);
+			for (int d=0; d<DIM; d++) {
+				expect_equal(planner.getProcessorGridSize(d), std::size_t(block->procGridSize(d)));
+			}
+			expect_equal(planner.interNodeFaces(), block->interNodeFacesPerStep());
+
+			testCommunication();
+			unsigned long bytesSent = block->interNodeBytesSent();
+			MPI::COMM_WORLD.Allreduce(MPI::IN_PLACE, &bytesSent, 1, MPI::UNSIGNED_LONG, MPI::SUM);
+			std::size_t faceBytes = Haparanda::Math::power(elementsPerDim, DIM-1) * extent * sizeof(double);
+			expect_equal(planner.interNodeFaces() * faceBytes, std::size_t(bytesSent));
+		}
+
+		/**
+		 * Verify that the ghost regions get the same values as without
+		 * compression when the boundary data is compressed, and when the
+		 * compressor falls back to sending it uncompressed because
+		 * compression does not pay off.
+		 */
+		void testCommunicationHaloCompression() {
+			ComputationalComposedBlock<DIM> *composedBlock = static_cast<ComputationalComposedBlock<DIM> *>(block);
+			int numMessages = 0;
+			for (int d=0; d<DIM; d++) {
+				numMessages += 1 < numProcs[d] ? 2 : 0;
+			}
+			// Uncompressed messages consist of the values only
+			std::size_t sendCount = Haparanda::Math::power(elementsPerDim, DIM-1) * extent;
+			std::size_t rawBytes = numMessages * sendCount * sizeof(double);
+			// Large values which only differ in their last bytes, so that compression pays off
+			valueOffset = 1099511627776.0;
+			for (std::size_t i=0; i<numElements; i++) {
+				values[i] += valueOffset;
+			}
+			composedBlock->setHaloCompression(true);
+			testCommunication();
+			std::size_t bytesBefore = block->interNodeBytesSent() + block->intraNodeBytesSent();
+			testCommunication();
+			std::size_t bytesSent = block->interNodeBytesSent() + block->intraNodeBytesSent() - bytesBefore;
+			// Without detected nodes, each neighbor which is not the process itself is on another node
+			for (int d=0; d<DIM; d++) {
+				for (int j=0; j<2; j++) {
+					const HaloCompressor *compressor = composedBlock->getHaloCompressor(d, j);
+					if (1 < numProcs[d]) {
+						EXPECT_TRUE(compressor->isCompressing());
+					} else {
+						EXPECT_TRUE(NULL == compressor);
+					}
+				}
+			}
+			if (0 < numMessages) {
+				EXPECT_LT(bytesSent, rawBytes);
+			}
+
+			// On an infinitely fast link, compression stops after the first message
+			composedBlock->setHaloCompression(true, std::numeric_limits<double>::max());
+			testCommunication();
+			bytesBefore = block->interNodeBytesSent() + block->intraNodeBytesSent();
+			testCommunication();
+			bytesSent = block->interNodeBytesSent() + block->intraNodeBytesSent() - bytesBefore;
+			for (int d=0; d<DIM; d++) {
+				for (int j=0; j<2; j++) {
+					if (1 < numProcs[d]) {
+						EXPECT_FALSE(composedBlock->getHaloCompressor(d, j)->isCompressing());
+					}
+				}
+			}
+			expect_equal(rawBytes, bytesSent);
+		}
+
+		/**
+		 * Let only the elements on the upper boundary along dimension 0 be
+		 * significant, and verify that the ghost regions are initialized
+		 * correctly when only the significant tiles are sent. The boundary
+		 * data sent to the lower neighbor along dimension 0 has no significant
+		 * tile, so the message is empty and the ghost region is zero. The
+		 * other messages consist of one flag per face tile and the elements
+		 * of the significant tiles.
+		 */
+		void testCommunicationActivityMask() {
+			for (std::size_t i=0; i<numElements; i++) {
+				if (elementsPerDim-1 != i % elementsPerDim) {
+					values[i] = 0;
+				}
+			}
+			const std::size_t tileSize = 2;
+			ActivityMask<DIM> mask(elementsPerDim, tileSize, 0.5);
+			mask.update(values);
+			block->setActivityMask(&mask);
+			std::size_t bytesBefore = block->interNodeBytesSent() + block->intraNodeBytesSent();
+			testCommunication(true);
+			std::size_t bytesSent = block->interNodeBytesSent() + block->intraNodeBytesSent() - bytesBefore;
+			block->setActivityMask(NULL);
+
+			// Along dimension 0, only the message to the upper neighbor has a significant tile
+			std::size_t faceTiles = mask.tilesPerDim();
+			std::size_t expectedCount = 1 < numProcs[0] ? faceTiles + elementsPerDim * extent : 0;
+			// Along dimension 1, only the last tile of each face is significant
+			if (1 < numProcs[1]) {
+				expectedCount += 2 * (faceTiles + (elementsPerDim - tileSize) * extent);
+			}
+			expect_equal(expectedCount * sizeof(double), bytesSent);
+		}
+
 		/**
 		 * Verify that when ghostRegionInitialized returns, the ghost region on the
 		 * side specified by the (output) argument is initialized with values from
 		 * the boundary of the neighboring block in that direction.
+		 *
+		 * @param onlyUpperX If true, the elements which are not on the upper boundary along dimension 0 are expected to be zero
 		 */
-		void testCommunication() {
+		void testCommunication(bool onlyUpperX = false) {
 			block->startCommunication();
 
 			BoundaryId boundary;
@@ -96,10 +319,20 @@ namespace Grid {
 					expectedValue += strides[boundary.getDimension()] * (elementsPerDim - 1);
 				}
 
+				// A message with only negligible data leaves the ghost region zero
+				if (onlyUpperX && 0 == boundary.getDimension() && 1 < numProcs[0]) {
+					EXPECT_EQ(!boundary.isLowerSide(), block->hasZeroGhostRegion(boundary));
+				}
+
 				// Verify ghost region values
 				while(bdIterator->isInField()) {
 					double actualValue = bdIterator->currentNeighbor(boundary.getDimension(), offset);
-					expect_equal(expectedValue, actualValue);
+					std::size_t neighborIndex = expectedValue - neighborCartRank * numElements;
+					if (onlyUpperX && elementsPerDim-1 != neighborIndex % elementsPerDim) {
+						expect_equal(0.0, actualValue);
+					} else {
+						expect_equal(expectedValue + valueOffset, actualValue);
+					}
 					int stride = strides[boundary.getDimension()];
 					if (((int)expectedValue + 1) % stride == 0) {
 						int strideNextDim = strides[boundary.getDimension()+1];
@@ -125,6 +358,7 @@ namespace Grid {
 		// Distance between element on boundary along <array index>
 		std::size_t strides[DIM+1];
 		double *values;
+		double valueOffset = 0;	// Added to all values
 
 	};
 
@@ -137,6 +371,70 @@ namespace Grid {
 		testCommunication();
 	}
 
+	/**
+	 * Test that ghost regions are initialized correctly with data from
+	 * neighbor nodes when a neighborhood collective operation is used.
+	 */
+	TEST_F(ComputationalComposedBlockParTest, TestCommunicationCollective) {
+		testCommunicationCollective();
+	}
+
+	/**
+	 * Test that ghost regions are initialized correctly with data from
+	 * neighbor nodes when the data sent between nodes is aggregated.
+	 */
+	TEST_F(ComputationalComposedBlockParTest, TestCommunicationAggregated) {
+		testCommunicationAggregated();
+	}
+
+	/**
+	 * Test that ghost regions are initialized correctly with data from
+	 * neighbor nodes when one-sided communication is used.
+	 */
+	TEST_F(ComputationalComposedBlockParTest, TestCommunicationOneSided) {
+		testCommunicationOneSided();
+	}
+
+	/**
+	 * Test that the values of neighbors are correct when neighbors on the
+	 * same node share memory.
+	 */
+	TEST_F(ComputationalComposedBlockParTest, TestCommunicationSharedMemory) {
+		testCommunicationSharedMemory();
+	}
+
+	/**
+	 * Test that ghost regions are initialized correctly with data from
+	 * neighbor nodes when the processor grid is planned.
+	 */
+	TEST_F(ComputationalComposedBlockParTest, TestCommunicationPlanned) {
+		testCommunicationPlanned();
+	}
+
+	/**
+	 * Test that ghost regions are initialized correctly with data from
+	 * neighbor nodes when the boundary data is compressed.
+	 */
+	TEST_F(ComputationalComposedBlockParTest, TestCommunicationHaloCompression) {
+		testCommunicationHaloCompression();
+	}
+
+	/**
+	 * Test that ghost regions are initialized correctly with data from
+	 * neighbor nodes when only the significant tiles are sent.
+	 */
+	TEST_F(ComputationalComposedBlockParTest, TestCommunicationActivityMask) {
+		testCommunicationActivityMask();
+	}
+
+	/**
+	 * Test that ghost regions are initialized correctly with data from
+	 * neighbor nodes when the boundary data is packed explicitly.
+	 */
+	TEST_F(ComputationalComposedBlockParTest, TestCommunicationExplicitPacking) {
+		testCommunicationExplicitPacking();
+	}
+
 }	/* namespace Grid */
 }	/* namespace Haparanda */
 
@@ -0,0 +1,295 @@
+#ifndef DOMAINPARTEST_HPP_
+#define DOMAINPARTEST_HPP_
+
+#include "src/grid/Domain.hpp"
+#include "src/numerics/ConstFD8Stencil.hpp"
+#include "src/utils/Math.hpp"
+#include "test/HaparandaTest.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <thread>
+
+#define DIM 2
+#define PI 3.14159265358979323846
+// Max error after one application (See StencilApplicationTest.)
+#define EXPECTED_ACCURACY 0.002
+// Max error of the values of a refined block, interpolated from 12 points per unit
+#define EXPECTED_INTERPOLATION_ACCURACY 1e-3
+// Max error after one application at a boundary between refinement levels. The ghost
+// regions are interpolated to 8:th order, which gives 6:th order after differentiation,
+// and the error grows with the aspect ratio of the elements (e.g. with 3 processes).
+#define EXPECTED_REFINED_ACCURACY 0.2
+
+namespace Haparanda {
+namespace Grid {
+	/**
+	 * Test of a domain with several blocks per process.
+	 */
+	class DomainParTest : public HaparandaTest
+	{
+	public:
+		virtual void SetUp() {
+			domain = new Domain<DIM>(elementsPerDim, extent, blocksPerProcessDim);
+		}
+
+		virtual void TearDown() {
+			delete domain;
+		}
+
+	protected:
+		const std::size_t elementsPerDim = 12;
+		const std::size_t extent = ORDER_OF_ACCURACY/2;
+		const std::size_t blocksPerProcessDim = 2;
+		const std::size_t numElements = Haparanda::Math::power(elementsPerDim, DIM);
+		Domain<DIM> *domain;
+
+		/**
+		 * Let each value identify its block and position, and verify that
+		 * every ghost region of every block of this process is initialized
+		 * with the opposite boundary of the neighbor block, exactly once.
+		 */
+		void testCommunication() {
+			for (std::size_t i=0; i<domain->numLocalBlocks(); i++) {
+				double *values = domain->getLocalValues(i);
+				std::size_t id = domain->getLocalBlock(i)->getId();
+				for (std::size_t k=0; k<numElements; k++) {
+					values[k] = id * numElements + k;
+				}
+			}
+			domain->startCommunication();
+			for (std::size_t i=0; i<domain->numLocalBlocks(); i++) {
+				DomainBlock<DIM> *block = domain->getLocalBlock(i);
+				BoundaryIterator<DIM> *iterator = block->getBoundaryIterator();
+				bool boundaryDone[DIM][2] = {};
+				for (std::size_t b=0; b<2*DIM; b++) {
+					BoundaryId boundary;
+					block->receiveDoneAt(&boundary);
+					std::size_t dim = boundary.getDimension();
+					std::size_t side = boundary.isLowerSide() ? 0 : 1;
+					EXPECT_FALSE(boundaryDone[dim][side]);
+					boundaryDone[dim][side] = true;
+
+					// The element just outside the boundary is on the opposite boundary of the neighbor
+					std::size_t neighborId = block->getNeighborId(dim, side);
+					int offset = 0==side ? -1 : 1;
+					iterator->setBoundaryToIterate(boundary);
+					while (iterator->isInField()) {
+						std::size_t neighborIndex = 0;
+						for (std::size_t d=DIM; d-- > 0; ) {
+							std::size_t indexAlongD = d==dim ? (0==side ? elementsPerDim-1 : 0) : iterator->currentIndex(d);
+							neighborIndex = neighborIndex * elementsPerDim + indexAlongD;
+						}
+						double expected = neighborId * numElements + neighborIndex;
+						expect_equal(expected, iterator->currentNeighbor(dim, offset));
+						iterator->next();
+					}
+				}
+				delete iterator;
+			}
+			domain->finishCommunication();
+		}
+
+		/**
+		 * Initialize the domain with
+		 * @f$sin(2*pi*x0)+...+sin(2*pi*x{d-1})@f$, apply the Laplacian and
+		 * verify that the result is close to the second derivative.
+		 *
+		 * @param accuracy Accepted error
+		 */
+		void testStencilApplication(double accuracy = EXPECTED_ACCURACY) {
+			initializeSinus();
+			Numerics::ConstFD8Stencil<DIM> stencil(stepLength());
+			// The stencil measures the computations on all blocks, also the refined ones
+			double blockTime = 0;
+			for (std::size_t i=0; i<domain->numLocalBlocks(); i++) {
+				blockTime -= domain->getLocalBlock(i)->computationTime();
+			}
+			domain->apply(stencil);
+			for (std::size_t i=0; i<domain->numLocalBlocks(); i++) {
+				blockTime += domain->getLocalBlock(i)->computationTime();
+			}
+			EXPECT_LE(stencil.computationTime(), blockTime);
+			EXPECT_GT(stencil.computationTime(), 0.5 * blockTime);
+			EXPECT_EQ(stencil.atLevel(1), stencil.atLevel(1));
+			for (std::size_t i=0; i<domain->numLocalBlocks(); i++) {
+				double *values = domain->getLocalValues(i);
+				std::size_t numElements = numBlockElements(i);
+				for (std::size_t k=0; k<numElements; k++) {
+					double expected = 0;
+					for (std::size_t d=0; d<DIM; d++) {
+						expected -= 4*PI*PI*sin(2*PI*coordinate(i, k, d));
+					}
+					expect_near(expected, values[k], accuracy);
+				}
+			}
+		}
+
+		/**
+		 * Initialize the domain with a sinus function, refine every other
+		 * block (in a checkerboard pattern, so that all boundaries between
+		 * blocks are boundaries between levels) and verify that the values
+		 * of the refined blocks are interpolated.
+		 */
+		void testRefinement() {
+			initializeSinus();
+			std::size_t totalNumBlocks = 1;
+			for (std::size_t d=0; d<DIM; d++) {
+				totalNumBlocks *= domain->getBlockGridSize(d);
+			}
+			std::vector<std::size_t> levels(totalNumBlocks);
+			for (std::size_t id=0; id<totalNumBlocks; id++) {
+				int coordinates[DIM];
+				domain->getBlockCoordinates(id, coordinates);
+				std::size_t sum = 0;
+				for (std::size_t d=0; d<DIM; d++) {
+					sum += coordinates[d];
+				}
+				levels[id] = sum % 2;
+			}
+			domain->setLevels(levels);
+			for (std::size_t i=0; i<domain->numLocalBlocks(); i++) {
+				std::size_t id = domain->getLocalBlock(i)->getId();
+				expect_equal(levels[id], domain->getLevel(id));
+				expect_equal(elementsPerDim << levels[id], domain->getBlockElementsPerDim(id));
+				double *values = domain->getLocalValues(i);
+				std::size_t numElements = numBlockElements(i);
+				for (std::size_t k=0; k<numElements; k++) {
+					double expected = 0;
+					for (std::size_t d=0; d<DIM; d++) {
+						expected += sin(2*PI*coordinate(i, k, d));
+					}
+					expect_near(expected, values[k], EXPECTED_INTERPOLATION_ACCURACY);
+				}
+			}
+		}
+
+		/**
+		 * Make the blocks of process 0 seem slow, balance the load, and
+		 * verify that process 0 has given away blocks (if there are other
+		 * processes) and that every block has exactly one owner.
+		 */
+		void testLoadBalancing() {
+			int rank = MPI::COMM_WORLD.Get_rank();
+			int numProcesses = MPI::COMM_WORLD.Get_size();
+			std::size_t blocksBefore = domain->numLocalBlocks();
+			for (std::size_t i=0; i<domain->numLocalBlocks(); i++) {
+				Utils::Timer *timer = domain->getLocalBlock(i)->getComputationTimer();
+				timer->start();
+				std::this_thread::sleep_for(std::chrono::milliseconds(0 == rank ? 20 : 5));
+				timer->stop();
+			}
+			std::size_t numMoved = domain->balanceLoad(0.1);
+			if (1 == numProcesses) {
+				expect_equal(std::size_t(0), numMoved);
+			} else {
+				EXPECT_LT(std::size_t(0), numMoved);
+				if (0 == rank) {
+					EXPECT_LT(domain->numLocalBlocks(), blocksBefore);
+				}
+			}
+			for (std::size_t i=0; i<domain->numLocalBlocks(); i++) {
+				expect_equal(rank, domain->ownerOf(domain->getLocalBlock(i)->getId()));
+			}
+			unsigned long localBlocks = domain->numLocalBlocks();
+			unsigned long totalBlocks;
+			MPI::COMM_WORLD.Allreduce(&localBlocks, &totalBlocks, 1, MPI::UNSIGNED_LONG, MPI::SUM);
+			std::size_t expectedTotal = 1;
+			for (std::size_t d=0; d<DIM; d++) {
+				expectedTotal *= domain->getBlockGridSize(d);
+			}
+			expect_equal(expectedTotal, std::size_t(totalBlocks));
+		}
+
+	private:
+		/**
+		 * @return Coordinate along dim of element k of local block i
+		 */
+		double coordinate(std::size_t i, std::size_t k, std::size_t dim) const {
+			std::size_t id = domain->getLocalBlock(i)->getId();
+			int blockCoordinates[DIM];
+			domain->getBlockCoordinates(id, blockCoordinates);
+			std::size_t blockElementsPerDim = domain->getBlockElementsPerDim(id);
+			std::size_t indexAlongDim = k / Haparanda::Math::power(blockElementsPerDim, dim) % blockElementsPerDim;
+			return (blockCoordinates[dim] * elementsPerDim + indexAlongDim * double(elementsPerDim) / blockElementsPerDim)
+					* stepLength()[dim];
+		}
+
+		/**
+		 * Initialize the domain with @f$sin(2*pi*x0)+...+sin(2*pi*x{d-1})@f$.
+		 */
+		void initializeSinus() {
+			for (std::size_t i=0; i<domain->numLocalBlocks(); i++) {
+				double *values = domain->getLocalValues(i);
+				std::size_t numElements = numBlockElements(i);
+				for (std::size_t k=0; k<numElements; k++) {
+					values[k] = 0;
+					for (std::size_t d=0; d<DIM; d++) {
+						values[k] += sin(2*PI*coordinate(i, k, d));
+					}
+				}
+			}
+		}
+
+		/**
+		 * @return Step lengths at refinement level 0
+		 */
+		std::array<double, DIM> stepLength() const {
+			std::array<double, DIM> stepLength;
+			for (std::size_t d=0; d<DIM; d++) {
+				stepLength[d] = 1.0 / (elementsPerDim * domain->getBlockGridSize(d));
+			}
+			return stepLength;
+		}
+
+		/**
+		 * @return Number of elements of local block i
+		 */
+		std::size_t numBlockElements(std::size_t i) const {
+			return Haparanda::Math::power(domain->getBlockElementsPerDim(domain->getLocalBlock(i)->getId()), DIM);
+		}
+	};
+
+	/**
+	 * Test that the ghost regions of all blocks are initialized correctly,
+	 * both from blocks of this process and of other processes.
+	 */
+	TEST_F(DomainParTest, TestCommunication) {
+		testCommunication();
+		testCommunication();
+	}
+
+	/**
+	 * Test that an operator applied on the domain approximates the Laplacian
+	 * across the block boundaries.
+	 */
+	TEST_F(DomainParTest, TestStencilApplication) {
+		testStencilApplication();
+	}
+
+	/**
+	 * Test that blocks are moved away from a slow process, and that the
+	 * blocks still communicate and compute correctly after the move.
+	 */
+	TEST_F(DomainParTest, TestLoadBalancing) {
+		testLoadBalancing();
+		testCommunication();
+		testStencilApplication();
+	}
+
+	/**
+	 * Test that the values of refined blocks are interpolated, and that an
+	 * operator approximates the Laplacian across boundaries between blocks
+	 * of different refinement levels.
+	 */
+	TEST_F(DomainParTest, TestRefinement) {
+		testRefinement();
+		testStencilApplication(EXPECTED_REFINED_ACCURACY);
+		testLoadBalancing();
+		testStencilApplication(EXPECTED_REFINED_ACCURACY);
+	}
+
+}	/* namespace Grid */
+}	/* namespace Haparanda */
+
+#endif /* DOMAINPARTEST_HPP_ */
@@ -0,0 +1,98 @@
+#ifndef EVENTTRACEPARTEST_HPP_
+#define EVENTTRACEPARTEST_HPP_
+
+#include "src/utils/EventTrace.hpp"
+#include "test/HaparandaTest.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+namespace Haparanda {
+namespace Utils {
+	/**
+	 * Test of recording events and exporting them from all processes.
+	 */
+	class EventTraceParTest : public HaparandaTest
+	{
+	public:
+		virtual void TearDown() {
+			EventTrace::disable();
+			MPI::COMM_WORLD.Barrier();
+			if (0 == MPI::COMM_WORLD.Get_rank()) {
+				std::remove(fileName);
+			}
+		}
+
+	protected:
+		const char *fileName = "EventTraceParTest.json";
+
+		/**
+		 * @return The number of occurrences of the pattern in the text
+		 */
+		static std::size_t count(const std::string& text, const std::string& pattern) {
+			std::size_t occurrences = 0;
+			for (std::size_t i=text.find(pattern); std::string::npos != i; i=text.find(pattern, i+1)) {
+				occurrences++;
+			}
+			return occurrences;
+		}
+	};
+
+	TEST_F(EventTraceParTest, TestRingBuffer) {
+		EventTrace::mark("disabled");
+		expect_equal(std::size_t(0), EventTrace::numEvents());
+		EventTrace::enable(4);
+		for (int i=0; i<5; i++) {
+			std::uint64_t start = EventTrace::now();
+			EventTrace::record("interior", -1, -1, start, start + 1000);
+		}
+		EventTrace::mark("received", 1, 0);
+		expect_equal(std::size_t(4), EventTrace::numEvents());
+		expect_equal(std::size_t(2), EventTrace::numOverwritten());
+		EventTrace::clear();
+		expect_equal(std::size_t(0), EventTrace::numEvents());
+	}
+
+	TEST_F(EventTraceParTest, TestExport) {
+		EventTrace::enable(16);
+		std::uint64_t start = EventTrace::now();
+		EventTrace::record("boundary", 0, 1, start, start + 2000);
+		EventTrace::mark("received", 0, 1);
+		std::int64_t offset = EventTrace::exportChromeTrace(MPI::COMM_WORLD, fileName);
+		int nProcesses = MPI::COMM_WORLD.Get_size();
+		if (0 == MPI::COMM_WORLD.Get_rank()) {
+			expect_equal(0, int(offset));
+		} else {
+			// All processes of the test share the clock
+			EXPECT_GT(1000000, std::llabs(offset));
+		}
+		if (0 != MPI::COMM_WORLD.Get_rank()) {
+			return;
+		}
+		std::ifstream file(fileName);
+		std::stringstream contents;
+		contents << file.rdbuf();
+		std::string trace = contents.str();
+		EXPECT_EQ(0u, trace.find("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[{"));
+		EXPECT_NE(std::string::npos, trace.find("}]}"));
+		expect_equal(std::size_t(nProcesses), count(trace, "\"boundary[0][upper]\""));
+		expect_equal(std::size_t(nProcesses), count(trace, "\"ph\":\"X\",\"dur\":2.000"));
+		expect_equal(std::size_t(nProcesses), count(trace, "\"received[0][upper]\""));
+		expect_equal(std::size_t(nProcesses), count(trace, "\"process_name\""));
+		for (int p=0; p<nProcesses; p++) {
+			std::ostringstream name;
+			name << "\"rank " << p << "\"";
+			expect_equal(std::size_t(1), count(trace, name.str()));
+		}
+		// The earliest event is the origin of the timeline
+		EXPECT_NE(std::string::npos, trace.find("\"ts\":0.000"));
+		EXPECT_EQ(std::string::npos, trace.find("\"ts\":-"));
+	}
+
+} /* namespace Utils */
+} /* namespace Haparanda */
+
+#endif /* EVENTTRACEPARTEST_HPP_ */
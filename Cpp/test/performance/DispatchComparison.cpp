@@ -0,0 +1,488 @@
+#include "src/grid/ComputationalComposedBlock.hpp"
+#include "src/grid/ComputationalPureBlock.hpp"
+#include "src/numerics/ConstFD8Stencil.hpp"
+#include "src/utils/Math.hpp"
+#include "src/utils/Timer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+/*
+ * This file is built twice: against this tree, whose operators dispatch to
+ * the kernels by virtual functions, and with HAPARANDA_CRTP defined and the
+ * include path pointing at CppStatic, whose operators use CRTP. It must
+ * therefore only use the parts of the interface that the trees share.
+ */
+#ifdef HAPARANDA_CRTP
+#define VARIANT "crtp"
+#else
+#define VARIANT "virtual"
+#endif
+
+#define EXTENT (ORDER_OF_ACCURACY/2)
+#define TOLERANCE 1e-12		// Maximum deviation from the raw kernel, relative to the magnitude of the terms
+#define CHECKSUM_TOLERANCE 1e-10	// Maximum difference between the checksums of the variants, relative to their magnitude
+
+namespace Haparanda {
+
+	using namespace Grid;
+	using namespace Numerics;
+	using namespace Utils;
+
+	/**
+	 * Result of one variant on one problem.
+	 */
+	struct DispatchResult
+	{
+		double seconds;			// Best time of one application
+		double checksum;		// Sum of the result values
+		double magnitude;		// Sum of the absolute values of the results
+		double deviation;		// Maximum deviation from the raw kernel, relative to the magnitude of the terms
+	};
+
+	/**
+	 * Application of the 8:th order constant stencil on a periodic block,
+	 * once by the operator of the tree this file is built against and once
+	 * by a kernel which indexes the values directly. Both are applied the
+	 * specified number of times on the same input, which is a fixed function
+	 * of the index of each point, so that the results of different builds
+	 * can be compared.
+	 *
+	 * The application runs on one process, which is then its own neighbor
+	 * in all dimensions. The trees exchange the boundary data differently
+	 * (by copying or by messages to the process itself), so only the
+	 * application of the operator is timed: the exchange is started before
+	 * the timing, and the time the operator spends waiting for the ghost
+	 * regions is subtracted.
+	 *
+	 * @tparam DIMENSIONALITY Dimensionality of the block
+	 */
+	template <std::size_t DIMENSIONALITY>
+	class DispatchComparison
+	{
+	public:
+		/**
+		 * @param elementsPerDim Number of points in each dimension of the block
+		 */
+		DispatchComparison(std::size_t elementsPerDim);
+
+		virtual ~DispatchComparison();
+
+		/**
+		 * Apply the operator of the tree.
+		 *
+		 * @param nApplications Number of applications, of which the best one is reported
+		 * @return The result
+		 */
+		DispatchResult runOperator(int nApplications);
+
+		/**
+		 * Apply the raw kernel.
+		 *
+		 * @param nApplications Number of applications, of which the best one is reported
+		 * @return The result
+		 */
+		DispatchResult runRaw(int nApplications);
+
+	private:
+		std::size_t elementsPerDim;
+		std::size_t numPoints;
+		double weights[ORDER_OF_ACCURACY+1];
+		double *inputValues;
+		double *operatorValues;
+		double *rawValues;
+
+		/**
+		 * Apply the stencil by direct indexing: one row along dimension 0 at a
+		 * time, with the neighbors in the other dimensions found by their
+		 * offsets from the row.
+		 */
+		void applyRaw();
+
+		/**
+		 * Sum the results, and compare them to those of the raw kernel.
+		 *
+		 * @param values The results
+		 * @param seconds Best time of one application
+		 */
+		DispatchResult summarize(const double *values, double seconds) const;
+	};
+
+	template <std::size_t DIMENSIONALITY>
+	DispatchComparison<DIMENSIONALITY>::DispatchComparison(std::size_t elementsPerDim) {
+		if (elementsPerDim < EXTENT) {
+			throw std::runtime_error("The block must be at least as large as the extent of the stencil");
+		}
+		this->elementsPerDim = elementsPerDim;
+		numPoints = Math::power(elementsPerDim, DIMENSIONALITY);
+		inputValues = new double[numPoints];
+		operatorValues = new double[numPoints];
+		rawValues = new double[numPoints];
+		long n = numPoints;
+#pragma omp parallel for schedule(static)
+		for (long i=0; i<n; i++) {
+			// A fixed pseudo-random number in [0 1) (SplitMix64)
+			std::uint64_t z = std::uint64_t(i) + 0x9e3779b97f4a7c15ULL;
+			z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+			z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+			z = z ^ (z >> 31);
+			inputValues[i] = (z >> 11) * (1.0 / (std::uint64_t(1) << 53));
+			operatorValues[i] = 0;
+			rawValues[i] = 0;
+		}
+		double hSquared = 1.0 / (elementsPerDim * elementsPerDim);
+		weights[0] = -1.0/(560.0*hSquared);
+		weights[1] = 8.0/(315.0*hSquared);
+		weights[2] = -1.0/(5.0*hSquared);
+		weights[3] = 8.0/(5.0*hSquared);
+		weights[4] = -205.0/(72.0*hSquared);
+		weights[5] = weights[3];
+		weights[6] = weights[2];
+		weights[7] = weights[1];
+		weights[8] = weights[0];
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	DispatchComparison<DIMENSIONALITY>::~DispatchComparison() {
+		delete []inputValues;
+		delete []operatorValues;
+		delete []rawValues;
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	DispatchResult DispatchComparison<DIMENSIONALITY>::runOperator(int nApplications) {
+		// One unit per block, like the stencil application
+		std::array<double, DIMENSIONALITY> stepLength;
+		stepLength.fill(1.0/elementsPerDim);
+		ConstFD8Stencil<DIMENSIONALITY> stencil(stepLength);
+		ComputationalComposedBlock<DIMENSIONALITY> inputBlock(elementsPerDim, EXTENT);
+		inputBlock.setValues(inputValues);
+		ComputationalPureBlock<DIMENSIONALITY> resultBlock(elementsPerDim, operatorValues);
+		double best = std::numeric_limits<double>::max();
+		Timer timer;
+		// The first application warms up the caches and is not timed
+		for (int a=-1; a<nApplications; a++) {
+			inputBlock.startCommunication();
+			double communicationTime = inputBlock.communicationTime();
+			timer.start(true);
+			stencil.apply(inputBlock, &resultBlock);
+			timer.stop();
+			communicationTime = inputBlock.communicationTime() - communicationTime;
+			inputBlock.finishCommunication();
+			if (a >= 0) {
+				best = std::min(best, timer.totalElapsedTime() - communicationTime);
+			}
+		}
+		return summarize(operatorValues, best);
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	DispatchResult DispatchComparison<DIMENSIONALITY>::runRaw(int nApplications) {
+		double best = std::numeric_limits<double>::max();
+		Timer timer;
+		for (int a=-1; a<nApplications; a++) {
+			timer.start(true);
+			applyRaw();
+			timer.stop();
+			if (a >= 0) {
+				best = std::min(best, timer.totalElapsedTime());
+			}
+		}
+		return summarize(rawValues, best);
+	}
+
+
+	/*** Private methods ***/
+	template <std::size_t DIMENSIONALITY>
+	void DispatchComparison<DIMENSIONALITY>::applyRaw() {
+		const long n = elementsPerDim;
+		const long rows = numPoints / elementsPerDim;
+#pragma omp parallel for schedule(static)
+		for (long row=0; row<rows; row++) {
+			const double *neighbors[DIMENSIONALITY][ORDER_OF_ACCURACY+1];
+			const double *own = inputValues + row * n;
+			long stride = n;
+			long rest = row;
+			for (std::size_t d=1; d<DIMENSIONALITY; d++) {
+				long coordinate = rest % n;
+				rest /= n;
+				for (int k=0; k<=ORDER_OF_ACCURACY; k++) {
+					long neighbor = coordinate + k - EXTENT;
+					neighbor += neighbor < 0 ? n : (neighbor >= n ? -n : 0);
+					neighbors[d][k] = own + (neighbor - coordinate) * stride;
+				}
+				stride *= n;
+			}
+			double *result = rawValues + row * n;
+			for (long x=0; x<n; x++) {
+				double sum = 0;
+				for (int k=0; k<=ORDER_OF_ACCURACY; k++) {
+					long neighbor = x + k - EXTENT;
+					neighbor += neighbor < 0 ? n : (neighbor >= n ? -n : 0);
+					sum += weights[k] * own[neighbor];
+				}
+				for (std::size_t d=1; d<DIMENSIONALITY; d++) {
+					for (int k=0; k<=ORDER_OF_ACCURACY; k++) {
+						sum += weights[k] * neighbors[d][k][x];
+					}
+				}
+				result[x] = sum;
+			}
+		}
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	DispatchResult DispatchComparison<DIMENSIONALITY>::summarize(const double *values, double seconds) const {
+		DispatchResult result;
+		result.seconds = seconds;
+		result.checksum = 0;
+		result.magnitude = 0;
+		result.deviation = 0;
+		double maxInput = 0;
+		// In order, so that all builds sum the same way
+		for (std::size_t i=0; i<numPoints; i++) {
+			result.checksum += values[i];
+			result.magnitude += std::abs(values[i]);
+			result.deviation = std::max(result.deviation, std::abs(values[i] - rawValues[i]));
+			maxInput = std::max(maxInput, std::abs(inputValues[i]));
+		}
+		double sumOfWeights = 0;
+		for (int k=0; k<=ORDER_OF_ACCURACY; k++) {
+			sumOfWeights += std::abs(weights[k]);
+		}
+		result.deviation /= DIMENSIONALITY * sumOfWeights * maxInput;
+		return result;
+	}
+
+	/**
+	 * Apply the operator, and on the build against this tree also the raw
+	 * kernel, and append one CSV row per variant to the stream.
+	 *
+	 * @param elementsPerDim Number of points in each dimension of the block
+	 * @param nThreads Number of OpenMP threads
+	 * @param nApplications Number of applications, of which the best one is reported
+	 * @param out Stream to which the rows are written
+	 */
+	template <std::size_t DIMENSIONALITY>
+	void compareDispatch(std::size_t elementsPerDim, int nThreads, int nApplications, std::ostream& out) {
+		DispatchComparison<DIMENSIONALITY> comparison(elementsPerDim);
+		// The reference of the operator
+		DispatchResult raw = comparison.runRaw(nApplications);
+		DispatchResult results[2] = {comparison.runOperator(nApplications), raw};
+		const char *variants[2] = {VARIANT, "raw"};
+#ifdef HAPARANDA_CRTP
+		int nVariants = 1;
+#else
+		int nVariants = 2;
+#endif
+		for (int v=0; v<nVariants; v++) {
+			out << variants[v] << "," << DIMENSIONALITY << "," << elementsPerDim << "," << nThreads << ","
+					<< results[v].seconds << "," << results[v].checksum << "," << results[v].magnitude << ","
+					<< results[v].deviation << std::endl;
+		}
+		if (!(results[0].deviation <= TOLERANCE)) {
+			std::ostringstream message;
+			message << "The " << VARIANT << " operator deviates by " << results[0].deviation
+					<< " from the raw kernel in " << DIMENSIONALITY << "D with " << elementsPerDim << " points per dimension";
+			throw std::runtime_error(message.str());
+		}
+	}
+
+	/**
+	 * Run the comparison for a dimensionality given at run time.
+	 */
+	void compareDispatch(std::size_t dimensionality, std::size_t elementsPerDim, int nThreads, int nApplications, std::ostream& out) {
+		switch (dimensionality) {
+		case 1:
+			compareDispatch<1>(elementsPerDim, nThreads, nApplications, out);
+			break;
+		case 2:
+			compareDispatch<2>(elementsPerDim, nThreads, nApplications, out);
+			break;
+		case 3:
+			compareDispatch<3>(elementsPerDim, nThreads, nApplications, out);
+			break;
+		case 4:
+			compareDispatch<4>(elementsPerDim, nThreads, nApplications, out);
+			break;
+		case 5:
+			compareDispatch<5>(elementsPerDim, nThreads, nApplications, out);
+			break;
+		case 6:
+			compareDispatch<6>(elementsPerDim, nThreads, nApplications, out);
+			break;
+		default:
+			throw std::runtime_error("Only 1 to 6 dimensions are supported");
+		}
+	}
+
+	/**
+	 * Merge the rows of all variants into one row per (dimensionality, size,
+	 * threads), with the speed-ups relative to the virtual operator and
+	 * whether the results of the variants agree.
+	 *
+	 * @param in Stream of rows written by the builds
+	 * @param out Stream to which the report is written
+	 */
+	void reportDispatch(std::istream& in, std::ostream& out) {
+		const char *variants[3] = {"virtual", "crtp", "raw"};
+		typedef std::map<std::string, DispatchResult> Variants;
+		std::map<std::vector<long>, Variants> problems;
+		std::string line;
+		while (std::getline(in, line)) {
+			std::stringstream stream(line);
+			std::vector<std::string> fields;
+			std::string field;
+			while (std::getline(stream, field, ',')) {
+				fields.push_back(field);
+			}
+			if (8 != fields.size() || "variant" == fields[0]) {
+				continue;
+			}
+			std::vector<long> problem = {atol(fields[1].c_str()), atol(fields[2].c_str()), atol(fields[3].c_str())};
+			DispatchResult& result = problems[problem][fields[0]];
+			result.seconds = atof(fields[4].c_str());
+			result.checksum = atof(fields[5].c_str());
+			result.magnitude = atof(fields[6].c_str());
+			result.deviation = atof(fields[7].c_str());
+		}
+		out << "dimensionality,elementsPerDim,threads,virtualSeconds,crtpSeconds,rawSeconds,crtpSpeedup,rawSpeedup,agree" << std::endl;
+		for (std::map<std::vector<long>, Variants>::const_iterator p=problems.begin(); p!=problems.end(); p++) {
+			const Variants& results = p->second;
+			out << p->first[0] << "," << p->first[1] << "," << p->first[2];
+			for (int v=0; v<3; v++) {
+				out << ",";
+				if (results.count(variants[v])) {
+					out << results.at(variants[v]).seconds;
+				}
+			}
+			for (int v=1; v<3; v++) {
+				out << ",";
+				if (results.count("virtual") && results.count(variants[v])) {
+					out << results.at("virtual").seconds / results.at(variants[v]).seconds;
+				}
+			}
+			// Each build is checked against its raw kernel, and the checksums tie the builds together
+			bool agree = results.count("raw");
+			for (Variants::const_iterator r=results.begin(); agree && r!=results.end(); r++) {
+				const DispatchResult& reference = results.at("raw");
+				agree = r->second.deviation <= TOLERANCE
+						&& std::abs(r->second.checksum - reference.checksum) <= CHECKSUM_TOLERANCE * reference.magnitude;
+			}
+			out << "," << (agree ? "yes" : "no") << std::endl;
+		}
+	}
+
+} /* namespace Haparanda */
+
+/**
+ * Usage: DispatchComparison [-p <problems>] [-t <thread counts>] [-n <applications>] [<output file>]
+ *        DispatchComparison -r <results file> [<report file>]
+ *
+ * Compare the stencil application of this tree (built without
+ * HAPARANDA_CRTP) or of CppStatic (built with HAPARANDA_CRTP and CppStatic on
+ * the include path) to a raw kernel on the same input, on one process. The
+ * problems are a comma separated list of <dimensionality>:<points per
+ * dimension> and the thread counts a comma separated list, by default the
+ * maximum number of threads. A CSV row per variant, problem and thread count
+ * is appended to the output file (or written to stdout), with the best time
+ * of the applications.
+ *
+ * With -r, the rows of both builds are merged into a report with the
+ * speed-ups relative to the virtual operator per (dimensionality, size,
+ * threads), and whether the results of all variants agree.
+ */
+int main(int argc, char *args[]) {
+	const char *usage = "Usage: DispatchComparison [-p <dim>:<size>,...] [-t <threads>,...] [-n <applications>] [<output file>]\n"
+			"       DispatchComparison -r <results file> [<report file>]";
+	std::vector<std::pair<std::size_t, std::size_t> > problems = {{2, 1024}, {3, 128}, {4, 32}};
+	std::vector<int> threadCounts = {OMP_MAX_NUM_THREADS};
+	int nApplications = 10;
+	const char *resultsFileName = NULL;
+	int option;
+	while (-1 != (option = getopt(argc, args, "p:t:n:r:"))) {
+		switch (option) {
+		case 'p': {
+			problems.clear();
+			std::stringstream stream(optarg);
+			std::string item;
+			while (std::getline(stream, item, ',')) {
+				std::size_t colon = item.find(':');
+				if (std::string::npos == colon) {
+					throw std::runtime_error(usage);
+				}
+				problems.push_back(std::make_pair(atol(item.substr(0, colon).c_str()), atol(item.substr(colon + 1).c_str())));
+			}
+			break;
+		}
+		case 't': {
+			threadCounts.clear();
+			std::stringstream stream(optarg);
+			std::string item;
+			while (std::getline(stream, item, ',')) {
+				threadCounts.push_back(atoi(item.c_str()));
+			}
+			break;
+		}
+		case 'n':
+			nApplications = atoi(optarg);
+			break;
+		case 'r':
+			resultsFileName = optarg;
+			break;
+		default:
+			throw std::runtime_error(usage);
+		}
+	}
+	if (argc - optind > 1) {
+		throw std::runtime_error(usage);
+	}
+	std::sort(threadCounts.begin(), threadCounts.end());
+	threadCounts.erase(std::unique(threadCounts.begin(), threadCounts.end()), threadCounts.end());
+	std::ofstream file;
+	if (argc > optind) {
+		// The rows of the builds are collected in one file
+		file.open(args[optind], NULL == resultsFileName ? std::ofstream::app : std::ofstream::trunc);
+		if (!file) {
+			throw std::runtime_error(std::string("Could not open ") + args[optind]);
+		}
+	}
+	std::ostream& out = file.is_open() ? file : std::cout;
+	out << std::setprecision(17);
+	if (NULL != resultsFileName) {
+		std::ifstream results(resultsFileName);
+		if (!results) {
+			throw std::runtime_error(std::string("Could not open ") + resultsFileName);
+		}
+		out << std::setprecision(6);
+		Haparanda::reportDispatch(results, out);
+		return 0;
+	}
+
+	MPI::Init();
+	if (1 != MPI::COMM_WORLD.Get_size()) {
+		throw std::runtime_error("The comparison runs on one process");
+	}
+	for (std::size_t t=0; t<threadCounts.size(); t++) {
+#ifdef _OPENMP
+		omp_set_num_threads(threadCounts[t]);
+#endif
+		for (std::size_t p=0; p<problems.size(); p++) {
+			Haparanda::compareDispatch(problems[p].first, problems[p].second, threadCounts[t], nApplications, out);
+		}
+	}
+	MPI::Finalize();
+	return 0;
+}
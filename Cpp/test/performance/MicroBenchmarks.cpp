@@ -0,0 +1,413 @@
+#include "src/iterators/ComposedFieldBoundaryIterator.hpp"
+#include "src/iterators/ValueFieldBoundaryIterator.hpp"
+#include "src/iterators/ValueFieldIterator.hpp"
+#include "src/utils/MagicNumber.hpp"
+#include "src/utils/Timer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#define MAX_DIM 6
+#define POINTS (1 << 20)	// Approximate number of points of the fields
+#define MIN_TIME 0.01		// Minimum time of one measurement, in seconds
+#define ROUNDS 5			// Number of measurements, of which the best one is reported
+#define EXTENT 4			// Extent of the ghost regions
+
+namespace Haparanda {
+
+	using namespace Iterators;
+	using namespace Utils;
+
+	volatile double doubleSink;			// Keeps the compiler from removing the measured work
+	volatile std::uint64_t indexSink;
+
+	/**
+	 * Micro-benchmarks of the components the stencil application is built
+	 * from, for a field of the specified dimensionality. Each benchmark
+	 * reports the time per element traversed, so that the components can be
+	 * compared across dimensionalities.
+	 *
+	 * @tparam DIMENSIONALITY Dimensionality of the fields
+	 */
+	template <std::size_t DIMENSIONALITY>
+	class MicroBenchmarks
+	{
+	public:
+		MicroBenchmarks();
+
+		virtual ~MicroBenchmarks();
+
+		/**
+		 * Run all benchmarks and write one CSV row per benchmark (and
+		 * boundary, where applicable) to the stream.
+		 *
+		 * @param out Stream to which the rows are written
+		 */
+		void run(std::ostream& out);
+
+	private:
+		std::size_t elementsPerDim;
+		std::array<std::size_t, DIMENSIONALITY> sizes;
+		std::size_t totalSize;
+		std::vector<double> values;
+
+		/**
+		 * Measure the time of the benchmark, repeated until it takes at least
+		 * MIN_TIME, and keep the best of ROUNDS measurements.
+		 *
+		 * @param benchmark Function running the benchmark once and returning the number of elements traversed
+		 * @return The time per element, in nanoseconds
+		 */
+		template <typename Benchmark>
+		double nanosecondsPerElement(Benchmark benchmark);
+
+		/**
+		 * Write a row of results.
+		 *
+		 * @param dim Dimension of the boundary traversed, or -1
+		 * @param side 0 for the lower boundary, 1 for the upper boundary, or -1
+		 */
+		void report(std::ostream& out, const std::string& name, int dim, int side, double nanoseconds) const;
+
+		/**
+		 * @return Number of elements traversed by calling next and isInField only
+		 */
+		std::size_t traverse(FieldIterator<DIMENSIONALITY>& iterator) const;
+
+		/**
+		 * @return Number of elements traversed while reading the index along each dimension
+		 */
+		std::size_t readIndices(FieldIterator<DIMENSIONALITY>& iterator) const;
+
+		/**
+		 * @return Number of elements traversed while reading the lower neighbor along each dimension, where there is one
+		 */
+		std::size_t readNeighbors(FieldIterator<DIMENSIONALITY>& iterator) const;
+
+		/**
+		 * @return Number of elements traversed while reading the neighbor at the offset along the dimension
+		 */
+		std::size_t readBoundaryNeighbors(FieldIterator<DIMENSIONALITY>& iterator, std::size_t dim, int offset) const;
+
+		/**
+		 * Split each linear index of the field into its index along each
+		 * dimension, like FieldSteppingStrategy::currentIndex does.
+		 *
+		 * @tparam Magic MagicNumber or MagicNumber64, or void for native division
+		 * @tparam INDEX Type of the linear indices
+		 * @return Number of linear indices split
+		 */
+		template <typename Magic, typename INDEX>
+		std::size_t splitIndices() const;
+
+		/**
+		 * @return A ghost region iterator for each boundary, to be deleted by the composed iterator
+		 */
+		FieldIterator<DIMENSIONALITY> ***createGhostIterators(std::vector<double>& ghostValues) const;
+	};
+
+	template <std::size_t DIMENSIONALITY>
+	MicroBenchmarks<DIMENSIONALITY>::MicroBenchmarks() {
+		elementsPerDim = std::max(2.0, std::round(std::pow(double(POINTS), 1.0 / DIMENSIONALITY)));
+		sizes.fill(elementsPerDim);
+		totalSize = 1;
+		for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+			totalSize *= elementsPerDim;
+		}
+		values.resize(totalSize);
+		for (std::size_t i=0; i<totalSize; i++) {
+			values[i] = 0.5 * i;
+		}
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	MicroBenchmarks<DIMENSIONALITY>::~MicroBenchmarks() {
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	void MicroBenchmarks<DIMENSIONALITY>::run(std::ostream& out) {
+		ValueFieldIterator<DIMENSIONALITY> iterator(sizes, &values[0]);
+		report(out, "next", -1, -1, nanosecondsPerElement([&]() { return traverse(iterator); }));
+		report(out, "currentIndex", -1, -1, nanosecondsPerElement([&]() { return readIndices(iterator); }));
+		report(out, "currentNeighbor", -1, -1, nanosecondsPerElement([&]() { return readNeighbors(iterator); }));
+
+		ValueFieldBoundaryIterator<DIMENSIONALITY> boundaryIterator(sizes, &values[0]);
+		std::vector<double> ghostValues;
+		ComposedFieldBoundaryIterator<DIMENSIONALITY> composedIterator(sizes, &values[0], createGhostIterators(ghostValues));
+		for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+			for (int side=0; side<2; side++) {
+				BoundaryId boundary(d, 0 == side);
+				boundaryIterator.setBoundaryToIterate(boundary);
+				report(out, "boundaryNext", d, side, nanosecondsPerElement([&]() { return traverse(boundaryIterator); }));
+				// The neighbor inside the field, as the stencil reads it close to the boundary
+				int inward = 0 == side ? 1 : -1;
+				report(out, "boundaryNeighbor", d, side, nanosecondsPerElement([&]() {
+					return readBoundaryNeighbors(boundaryIterator, d, inward);
+				}));
+				// The neighbor in the ghost region
+				composedIterator.setBoundaryToIterate(boundary);
+				report(out, "ghostNeighbor", d, side, nanosecondsPerElement([&]() {
+					return readBoundaryNeighbors(composedIterator, d, -inward);
+				}));
+			}
+		}
+
+		report(out, "nativeDivision32", -1, -1, nanosecondsPerElement([&]() { return splitIndices<void, std::uint32_t>(); }));
+		report(out, "magicDivision32", -1, -1, nanosecondsPerElement([&]() { return splitIndices<MagicNumber, std::uint32_t>(); }));
+		report(out, "nativeDivision64", -1, -1, nanosecondsPerElement([&]() { return splitIndices<void, std::uint64_t>(); }));
+		report(out, "magicDivision64", -1, -1, nanosecondsPerElement([&]() { return splitIndices<MagicNumber64, std::uint64_t>(); }));
+	}
+
+
+	/*** Private methods ***/
+	template <std::size_t DIMENSIONALITY>
+	template <typename Benchmark>
+	double MicroBenchmarks<DIMENSIONALITY>::nanosecondsPerElement(Benchmark benchmark) {
+		double best = std::numeric_limits<double>::max();
+		Timer timer;
+		for (int r=0; r<ROUNDS; r++) {
+			std::size_t elements = 0;
+			timer.start(true);
+			do {
+				elements += benchmark();
+			} while (timer.totalElapsedTime(true) < MIN_TIME);
+			best = std::min(best, 1e9 * timer.stop() / elements);
+		}
+		return best;
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	void MicroBenchmarks<DIMENSIONALITY>::report(std::ostream& out, const std::string& name, int dim, int side,
+			double nanoseconds) const {
+		out << name << "," << DIMENSIONALITY << "," << elementsPerDim << "," << dim << "," << side << ","
+				<< nanoseconds << std::endl;
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	std::size_t MicroBenchmarks<DIMENSIONALITY>::traverse(FieldIterator<DIMENSIONALITY>& iterator) const {
+		std::size_t elements = 0;
+		for (iterator.first(); iterator.isInField(); iterator.next()) {
+			elements++;
+		}
+		indexSink = elements;
+		return elements;
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	std::size_t MicroBenchmarks<DIMENSIONALITY>::readIndices(FieldIterator<DIMENSIONALITY>& iterator) const {
+		std::size_t elements = 0;
+		std::size_t sum = 0;
+		for (iterator.first(); iterator.isInField(); iterator.next()) {
+			for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+				sum += iterator.currentIndex(d);
+			}
+			elements++;
+		}
+		indexSink = sum;
+		return elements;
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	std::size_t MicroBenchmarks<DIMENSIONALITY>::readNeighbors(FieldIterator<DIMENSIONALITY>& iterator) const {
+		std::size_t elements = 0;
+		double sum = 0;
+		for (iterator.first(); iterator.isInField(); iterator.next()) {
+			for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+				if (0 < iterator.currentIndex(d)) {
+					sum += iterator.currentNeighbor(d, -1);
+				}
+			}
+			elements++;
+		}
+		doubleSink = sum;
+		return elements;
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	std::size_t MicroBenchmarks<DIMENSIONALITY>::readBoundaryNeighbors(FieldIterator<DIMENSIONALITY>& iterator,
+			std::size_t dim, int offset) const {
+		std::size_t elements = 0;
+		double sum = 0;
+		for (iterator.first(); iterator.isInField(); iterator.next()) {
+			sum += iterator.currentNeighbor(dim, offset);
+			elements++;
+		}
+		doubleSink = sum;
+		return elements;
+	}
+
+	/**
+	 * Division by a divisor known only at run time, either natively or by
+	 * magic numbers.
+	 */
+	template <typename Magic>
+	struct Divider {
+		Magic magic;
+
+		Divider(std::uint64_t divisor) : magic(Magic::getMagicNumbers(divisor)) {
+		}
+
+		std::uint64_t divide(std::uint64_t x) const {
+			return magic.divide(x);
+		}
+	};
+
+	template <>
+	struct Divider<void> {
+		std::uint64_t divisor;
+
+		Divider(std::uint64_t divisor) : divisor(divisor) {
+		}
+
+		std::uint64_t divide(std::uint64_t x) const {
+			return x / divisor;
+		}
+	};
+
+	template <std::size_t DIMENSIONALITY>
+	template <typename Magic, typename INDEX>
+	std::size_t MicroBenchmarks<DIMENSIONALITY>::splitIndices() const {
+		typedef Divider<typename std::conditional<std::is_void<Magic>::value, void, Magic>::type> IndexDivider;
+		// Divisors read through a volatile, so that they are unknown to the compiler
+		volatile std::uint64_t size = elementsPerDim;
+		std::vector<IndexDivider> strideDividers;
+		std::vector<IndexDivider> sizeDividers;
+		INDEX stride = 1;
+		for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+			strideDividers.push_back(IndexDivider(stride));
+			sizeDividers.push_back(IndexDivider(size));
+			stride *= size;
+		}
+		std::uint64_t sum = 0;
+		for (INDEX i=0; i<totalSize; i++) {
+			for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+				std::uint64_t indexAlongDimension = strideDividers[d].divide(i);
+				sum += indexAlongDimension - size * sizeDividers[d].divide(indexAlongDimension);
+			}
+		}
+		indexSink = sum;
+		return totalSize;
+	}
+
+	template <std::size_t DIMENSIONALITY>
+	FieldIterator<DIMENSIONALITY> ***MicroBenchmarks<DIMENSIONALITY>::createGhostIterators(std::vector<double>& ghostValues) const {
+		std::size_t ghostSize = totalSize / elementsPerDim * EXTENT;
+		ghostValues.assign(2 * DIMENSIONALITY * ghostSize, 1.0);
+		FieldIterator<DIMENSIONALITY> ***ghostIterators = new FieldIterator<DIMENSIONALITY>**[DIMENSIONALITY];
+		for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+			ghostIterators[d] = new FieldIterator<DIMENSIONALITY>*[2];
+			std::array<std::size_t, DIMENSIONALITY> ghostSizes = sizes;
+			ghostSizes[d] = EXTENT;
+			for (std::size_t j=0; j<2; j++) {
+				ghostIterators[d][j] = new ValueFieldBoundaryIterator<DIMENSIONALITY>(ghostSizes,
+						&ghostValues[(2 * d + j) * ghostSize]);
+			}
+		}
+		return ghostIterators;
+	}
+
+} /* namespace Haparanda */
+
+/**
+ * Run the micro-benchmarks for the specified dimensionality.
+ */
+void runMicroBenchmarks(std::size_t dimensionality, std::ostream& out) {
+	switch (dimensionality) {
+	case 1:
+		Haparanda::MicroBenchmarks<1>().run(out);
+		break;
+	case 2:
+		Haparanda::MicroBenchmarks<2>().run(out);
+		break;
+	case 3:
+		Haparanda::MicroBenchmarks<3>().run(out);
+		break;
+	case 4:
+		Haparanda::MicroBenchmarks<4>().run(out);
+		break;
+	case 5:
+		Haparanda::MicroBenchmarks<5>().run(out);
+		break;
+	case 6:
+		Haparanda::MicroBenchmarks<6>().run(out);
+		break;
+	default:
+		throw std::runtime_error("The dimensionality must be 1 to 6");
+	}
+}
+
+/**
+ * Run micro-benchmarks of the iterators, the steppers and the magic number
+ * division, on one thread, and write the results as CSV with the columns
+ * benchmark, dimensionality, elements per dimension, boundary dimension,
+ * boundary side (0 for lower, 1 for upper) and nanoseconds per element.
+ * The boundary columns are -1 for benchmarks of whole fields. The fields
+ * have about 2^20 points, and the best of a few measurements is reported.
+ *
+ * Benchmarks:
+ * next              Traversal of the whole field (next and isInField)
+ * currentIndex      Traversal, reading the index along each dimension
+ * currentNeighbor   Traversal, reading the lower neighbor along each
+ *                   dimension where it is in the field
+ * boundaryNext      Traversal of a boundary
+ * boundaryNeighbor  Traversal of a boundary, reading the neighbor inside
+ * ghostNeighbor     Traversal of a boundary of a composed field, reading
+ *                   the neighbor in the ghost region
+ * nativeDivision32/64, magicDivision32/64
+ *                   Splitting each linear index into the index along each
+ *                   dimension, by native division or by magic numbers
+ *
+ * Options:
+ * -D Comma separated list of dimensionalities. Default is 1 to 6.
+ *
+ * Usage: MicroBenchmarks [-D <dimensionalities>] [<output file>]
+ * The results are written to standard output if no file is given.
+ */
+int main(int argc, char *args[]) {
+	const char *usage = "Usage: MicroBenchmarks [-D <dimensionalities>] [<output file>]";
+	std::vector<std::size_t> dimensionalities;
+	for (std::size_t d=1; d<=MAX_DIM; d++) {
+		dimensionalities.push_back(d);
+	}
+	int option;
+	while (-1 != (option = getopt(argc, args, "D:"))) {
+		switch (option) {
+		case 'D': {
+			dimensionalities.clear();
+			std::stringstream stream(optarg);
+			std::string item;
+			while (std::getline(stream, item, ',')) {
+				dimensionalities.push_back(atoi(item.c_str()));
+			}
+			break;
+		}
+		default:
+			throw std::runtime_error(usage);
+		}
+	}
+	if (argc - optind > 1) {
+		throw std::runtime_error(usage);
+	}
+	std::ofstream file;
+	if (argc > optind) {
+		file.open(args[optind]);
+		if (!file) {
+			throw std::runtime_error(std::string("Could not open ") + args[optind]);
+		}
+	}
+	std::ostream& out = file.is_open() ? file : std::cout;
+	out << "benchmark,dimensionality,elementsPerDim,boundaryDim,boundarySide,nsPerElement" << std::endl;
+	for (std::size_t i=0; i<dimensionalities.size(); i++) {
+		runMicroBenchmarks(dimensionalities[i], out);
+	}
+	return 0;
+}
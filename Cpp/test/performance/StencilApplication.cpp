@@ -1,28 +1,66 @@
 #ifndef STENCILAPPLICATION_HPP_
 #define STENCILAPPLICATION_HPP_
 
+#include "src/grid/AggregatedComposedBlock.hpp"
+#include "src/grid/Checkpoint.hpp"
+#include "src/grid/CollectiveComposedBlock.hpp"
 #include "src/grid/ComputationalPureBlock.hpp"
 #include "src/grid/ComputationalComposedBlock.hpp"
+#include "src/grid/Domain.hpp"
+#include "src/grid/OneSidedComposedBlock.hpp"
+#include "src/grid/SharedMemoryComposedBlock.hpp"
 #include "src/numerics/ConstFD8Stencil.hpp"
+#include "src/utils/EventTrace.hpp"
+#include "src/utils/PerformanceCounters.hpp"
+#include "src/utils/Roofline.hpp"
+#include "src/utils/SnapshotWriter.hpp"
+#include "src/utils/Statistics.hpp"
+#include "src/utils/TuningCache.hpp"
 
+#include <algorithm>
+#include <cstdint>
 #include <fstream>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <vector>
 #include <time.h>
+#include <unistd.h>
 
-#define DIM 2
+#define BALANCE_TOLERANCE 0.1	// Accepted load imbalance in a domain
+#define MAX_DIM 6					// Highest dimensionality which can be chosen at runtime
+#define SNAPSHOT_BUFFERS 2		// Number of snapshots fitting in the memory budget of the snapshot writer
+#define TUNING_WARM_UP_STEPS 1	// Applications before the measurements of each autotuning trial
+#define TUNING_STEPS 3			// Measured applications of each autotuning trial
 
 namespace Haparanda {
 	using namespace Grid;
 	using namespace Numerics;
 
+	/**
+	 * @param exchange How the boundary data is exchanged (see StencilApplication)
+	 * @param blocksPerProcessDim Blocks per process along each dimension, 0 if there is no domain
+	 * @param linkBandwidth Bandwidth in GB/s which the boundary data is compressed for, negative if it is not compressed
+	 * @param checkpoints True if checkpoints or snapshots are read or written
+	 * @return True if the stencil application supports the combination: halo compression is only done with p2p exchange without a domain, and checkpoints and snapshots are not supported in domains
+	 */
+	bool isSupported(const std::string& exchange, std::size_t blocksPerProcessDim, double linkBandwidth, bool checkpoints) {
+		if (0 <= linkBandwidth && ("p2p" != exchange || 0 < blocksPerProcessDim)) {
+			return false;
+		}
+		return !checkpoints || 0 == blocksPerProcessDim;
+	}
+
 	/**
 	 * Class that can be used for testing application of a constant 8:th order
 	 * finite difference stencil.
 	 *
 	 * @tparam DIMENSIONALITY Dimensionality of the area on which the stencil is applied
+	 * @tparam INDEX Type of the linear indices of the iterators over the blocks; std::uint64_t for blocks with 2^32 elements or more
 	 * @author Malin Kallen
 	 * @copyright Malin Kallen 2014, 2017
 	 */
-	template <std::size_t DIMENSIONALITY>
+	template <std::size_t DIMENSIONALITY, typename INDEX = std::uint32_t>
 	class StencilApplication
 	{
 	public:
@@ -35,27 +73,128 @@ namespace Haparanda {
 		 * maximum coordinate value is 1.
 		 *
 		 * @param pointsPerUnit The number of grid points in each dimension of the block on which the stencil will be applied
+		 * @param packedDimensions Bit mask where bit d is set if the boundary data sent along dimension d is to be packed explicitly
+		 * @param exchange How the boundary data is exchanged: "p2p" (one message per neighbor), "collective" (one neighborhood collective operation) , "onesided" (MPI_Put into windows), "aggregated" (one message per pair of nodes) or "shared" (direct access to the values of neighbors on the same node)
+		 * @param decomposition How the processor grid is arranged: "default" (MPI::Compute_dims) or "planned" (DecompositionPlanner, taking the nodes into account)
+		 * @param blocksPerProcessDim If > 0, let each process have this number of blocks of pointsPerUnit^DIMENSIONALITY points along each dimension, in a Domain (and ignore exchange and decomposition)
+		 * @param balanceInterval If > 0, balance the load between the processes of the domain after this number of applications
+		 * @param linkBandwidth If >= 0, compress the boundary data (only with "p2p" exchange) when it pays off on a link of this bandwidth in bytes per second, or always if it is 0
 		 */
-		StencilApplication(std::size_t pointsPerUnit);
+		StencilApplication(std::size_t pointsPerUnit, unsigned int packedDimensions, const std::string& exchange,
+				const std::string& decomposition, std::size_t blocksPerProcessDim, std::size_t balanceInterval,
+				double linkBandwidth);
 
 		virtual ~StencilApplication();
 
 		/**
 		 * Apply the stencil on the input block the specified number of times
-		 * and write the execution times to the specified file.
+		 * (after the warm-up and once per repetition) and write the execution
+		 * times to the specified file, and statistics of them to the file
+		 * with ".json" appended to its name.
 		 *
-		 * @param nSteps Number of times the stencil will be applied
+		 * @param nSteps Number of times the stencil will be applied per repetition
 		 * @param outputFileName Path to the file to which the execution times will be written.
 		 */
 		void run(int nSteps, std::string& outputFileName);
 
+		/**
+		 * Let run apply the stencil a number of times which are not measured
+		 * before it starts measuring, and repeat the measured applications.
+		 *
+		 * @param warmUpSteps Number of applications before the measurements
+		 * @param repetitions Number of times the measured applications are repeated, > 0
+		 */
+		void setRepetitions(std::size_t warmUpSteps, std::size_t repetitions);
+
+		/**
+		 * Apply the stencil a few times as a trial of the configuration,
+		 * without writing any results.
+		 *
+		 * @param warmUpSteps Number of applications before the measurements
+		 * @param nSteps Number of measured applications
+		 * @return The median time of the measured applications (the max over the processes of each), on all processes
+		 */
+		double trial(std::size_t warmUpSteps, int nSteps);
+
+		/**
+		 * Initialize the input values from a checkpoint instead of random
+		 * values, and continue counting the applications from the step at
+		 * which it was written.
+		 *
+		 * @param fileName Path to the checkpoint file
+		 */
+		void restart(const std::string& fileName);
+
+		/**
+		 * Write the input values (i.e. the result of the last application)
+		 * to a checkpoint.
+		 *
+		 * @param fileName Path to the checkpoint file
+		 */
+		void writeCheckpoint(const std::string& fileName);
+
+		/**
+		 * Write snapshots of the input values in the background while the
+		 * stencil is applied. Each process writes its own file per
+		 * snapshot, named <prefix>.<application>.<rank>.snap.
+		 *
+		 * @param interval Number of applications between the snapshots
+		 * @param fileNamePrefix Prefix of the paths to the snapshot files
+		 */
+		void writeSnapshots(std::size_t interval, const std::string& fileNamePrefix);
+
+		/**
+		 * Record a timeline of the measured applications, and export it to
+		 * <output file>.trace.json in the Chrome trace format. Needs a build
+		 * with the profiling regions (make PROFILE=1).
+		 *
+		 * @param capacity Maximum number of events kept per thread
+		 */
+		void traceEvents(std::size_t capacity);
+
+		/**
+		 * Count hardware events of the threads in the interior and boundary
+		 * phases of the measured applications, and add them to the
+		 * statistics. Falls back to the CPU time only if the hardware
+		 * counters cannot be opened.
+		 */
+		void countEvents();
+
+		/**
+		 * Compare the measured performance to the roofline in the statistics.
+		 *
+		 * @param roofline Roofline of this process, measured with the thread configuration of the application
+		 */
+		void setRoofline(const Roofline& roofline);
+
 	private:
 		std::size_t pointsPerUnit;	// Number of points along each dimension (Domain is [0 1]^DIM.)
 		std::size_t numPoints;		// Total number of points
+		unsigned int packedDimensions;	// Bit d is set if the boundary data is packed explicitly along dimension d
+		std::string exchange;		// How the boundary data is exchanged
+		std::string decomposition;	// How the processor grid is arranged
+		std::size_t blocksPerProcessDim;	// Number of blocks per process along each dimension, 0 if there is no domain
+		std::size_t balanceInterval;	// Number of applications between load balancing in the domain, 0 if never
+		double linkBandwidth;		// Link bandwidth given to the halo compressor, < 0 if there is none
+		std::size_t step;			// Number of applications done, including those before a restart
+		std::size_t snapshotInterval;	// Number of applications between snapshots, 0 if there are none
+		std::string snapshotPrefix;	// Prefix of the paths to the snapshot files
+		SnapshotWriter *snapshotWriter;	// NULL if there are no snapshots
+		std::size_t warmUpSteps;	// Number of applications before the measurements
+		std::size_t repetitions;	// Number of times the measured applications are repeated
+		std::vector<double> stepTimes;	// Time of each measured application on this process
+		double warmUpCompTime;		// Computation time during the warm-up
+		double warmUpCommTime;		// Communication time during the warm-up
+		std::vector<double> warmUpThreadTimes;	// Computation time per thread during the warm-up
+		std::size_t traceCapacity;	// Number of events kept per thread in the timeline, 0 if there is none
+		PerformanceCounters *counters;	// NULL if the events are not counted
+		Roofline *roofline;			// NULL if there is no roofline to compare to
+		Domain<DIMENSIONALITY> *domain;	// NULL if each process has one block
 		BlockOperator<DIMENSIONALITY, ORDER_OF_ACCURACY> *stencil;
 		double *inputValues;
 		double *resultValues;
 		CommunicativeBlock<DIMENSIONALITY> *inputBlock;
+		SharedMemoryComposedBlock<DIMENSIONALITY, INDEX> *sharedBlock;	// Same as inputBlock if the values are in shared memory, otherwise NULL
 		ComputationalBlock<DIMENSIONALITY> *resultBlock;
 		Timer *setUpTimer;
 		Timer *totalTimer;
@@ -67,27 +206,73 @@ namespace Haparanda {
 		 * the result of the previous stencil application.
 		 *
 		 * @param nSteps Number of times the stencil will be applied
+		 * @param measure If true, the time of each application is added to stepTimes
 		 */
-		void applyStencil(int nSteps);
+		void applyStencil(int nSteps, bool measure);
+
+		/**
+		 * @return Time spent on communication by this process, in seconds
+		 */
+		double communicationTime() const;
+
+		/**
+		 * Create the input block, which exchanges boundary data in the way
+		 * specified by the exchange member. Set sharedBlock if the block
+		 * stores its values in shared memory.
+		 *
+		 * @return The created block
+		 */
+		ComputationalComposedBlock<DIMENSIONALITY, INDEX> *createInputBlock();
 
 		/**
 		 * Initialize each value in the array with a random value >=0 and <1.
+		 *
+		 * @param values Array of numPoints elements
 		 */
-		void initializeInputRandom();
+		void initializeInputRandom(double *values);
 
 		/**
 		 * Print the configuration of the current application and the total
 		 * execution time, setup time, time spent on computations and time spent
-		 * on communication to the specified file.
+		 * on communication to the specified file. Also print the number of
+		 * bytes per application which are predicted to be sent between nodes,
+		 * and the numbers of bytes per application actually sent between and
+		 * within nodes.
 		 *
 		 * @param nSteps Number of times the stencil will be applied
 		 * @param outputFileName Path to the file to which the execution times will be written.
 		 */
 		void reportResults(int nSteps, std::string& outputFileName);
+
+		/**
+		 * Write statistics of the measured applications to the specified
+		 * file, as one JSON object per line: the minimum, median and 99th
+		 * percentile of the step times (the max over the processes of each
+		 * application), the derived performance at the median, and the times
+		 * per process and per thread.
+		 *
+		 * @param outputFileName Path to the file, to which the object is appended
+		 */
+		void reportStatistics(const std::string& outputFileName);
+
+		/**
+		 * Write the counted events as a member of a JSON object: the totals
+		 * per phase and counter, the instructions per cycle, the last level
+		 * cache misses per point and the floating point operations per cycle.
+		 * Values of counters which are not available are null.
+		 *
+		 * @param out Stream to which the member is written
+		 * @param counts Totals indexed by PerformanceCounters::NUM_COUNTERS * phase + counter
+		 * @param flops Number of floating point operations of the measured applications
+		 * @param points Number of points computed in the measured applications
+		 */
+		void reportCounters(std::ostream& out, const unsigned long long *counts, double flops, double points) const;
 	};
 
-	template <std::size_t DIMENSIONALITY>
-	StencilApplication<DIMENSIONALITY>::StencilApplication(std::size_t pointsPerUnit) {
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	StencilApplication<DIMENSIONALITY, INDEX>::StencilApplication(std::size_t pointsPerUnit, unsigned int packedDimensions, const std::string& exchange,
+			const std::string& decomposition, std::size_t blocksPerProcessDim, std::size_t balanceInterval,
+			double linkBandwidth) {
 		/* Create and start the timers */
 		setUpTimer = new Timer();
 		setUpTimer->start();
@@ -95,20 +280,69 @@ namespace Haparanda {
 		totalTimer->start();
 
 		this->pointsPerUnit = pointsPerUnit;
-		// One unit per block
-		inputBlock = new ComputationalComposedBlock<DIMENSIONALITY>(pointsPerUnit, ORDER_OF_ACCURACY/2);
-
-		/* Create and initialize the blocks. */
+		this->packedDimensions = packedDimensions & ((1u << DIMENSIONALITY) - 1);
+		this->exchange = exchange;
+		this->decomposition = decomposition;
+		if ("planned" != decomposition && "default" != decomposition) {
+			throw std::runtime_error("Unknown decomposition: " + decomposition);
+		}
+		CommunicativeBlock<DIMENSIONALITY>::setPlannedDecomposition("planned" == decomposition);
+		this->blocksPerProcessDim = blocksPerProcessDim;
+		this->balanceInterval = balanceInterval;
+		this->linkBandwidth = linkBandwidth;
+		step = 0;
+		snapshotInterval = 0;
+		snapshotWriter = NULL;
+		traceCapacity = 0;
+		counters = NULL;
+		roofline = NULL;
+		warmUpSteps = 0;
+		repetitions = 1;
+		warmUpCompTime = 0;
+		warmUpCommTime = 0;
+		if (!isSupported(exchange, blocksPerProcessDim, linkBandwidth, false)) {
+			throw std::runtime_error("Halo compression requires p2p exchange without a domain");
+		}
+		numPoints = Math::power(pointsPerUnit, DIMENSIONALITY);
 		std::array<double, DIMENSIONALITY> stepLength;
 		stepLength.fill(1.0/pointsPerUnit);
 
-		numPoints = Math::power(pointsPerUnit, DIMENSIONALITY);
-		inputValues = new double[numPoints];
-		initializeInputRandom();
-		inputBlock->setValues(inputValues);
+		if (0 < blocksPerProcessDim) {
+			/* Create and initialize the domain. The values of its blocks
+			 * are packed as MPI sees fit. */
+			domain = new Domain<DIMENSIONALITY>(pointsPerUnit, ORDER_OF_ACCURACY/2, blocksPerProcessDim);
+			domain->setBalanceInterval(balanceInterval, BALANCE_TOLERANCE);
+			for (std::size_t i=0; i<domain->numLocalBlocks(); i++) {
+				initializeInputRandom(domain->getLocalValues(i));
+			}
+			inputBlock = NULL;
+			resultBlock = NULL;
+			sharedBlock = NULL;
+		} else {
+			domain = NULL;
+			// One unit per block
+			ComputationalComposedBlock<DIMENSIONALITY, INDEX> *composedBlock = createInputBlock();
+			for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+				composedBlock->setExplicitPacking(d, 0 != (this->packedDimensions & (1u << d)));
+			}
+			if (0 <= linkBandwidth) {
+				composedBlock->setHaloCompression(true, linkBandwidth);
+			}
+			inputBlock = composedBlock;
 
-		resultValues = new double[numPoints];
-		resultBlock = new ComputationalPureBlock<DIMENSIONALITY>(pointsPerUnit, resultValues);
+			/* Create and initialize the blocks. */
+			if (NULL != sharedBlock) {
+				inputValues = sharedBlock->getValueArray(0);
+				resultValues = sharedBlock->getValueArray(1);
+			} else {
+				inputValues = new double[numPoints];
+				resultValues = new double[numPoints];
+			}
+			initializeInputRandom(inputValues);
+			inputBlock->setValues(inputValues);
+
+			resultBlock = new ComputationalPureBlock<DIMENSIONALITY, INDEX>(pointsPerUnit, resultValues);
+		}
 
 		/* Create the stencil */
 		stencil = new ConstFD8Stencil<DIMENSIONALITY>(stepLength);
@@ -118,31 +352,185 @@ namespace Haparanda {
 		totalTimer->stop();
 	}
 
-	template <std::size_t DIMENSIONALITY>
-	StencilApplication<DIMENSIONALITY>::~StencilApplication() {
-		delete inputBlock;
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	StencilApplication<DIMENSIONALITY, INDEX>::~StencilApplication() {
+		delete snapshotWriter;
+		delete counters;
+		delete roofline;
+		if (NULL != domain) {
+			delete domain;
+			delete stencil;
+			delete setUpTimer;
+			delete totalTimer;
+			return;
+		}
 		delete resultBlock;
-		delete []inputValues;
-		delete []resultValues;
+		delete inputBlock;	// Frees the values if they are in shared memory
+		if (NULL == sharedBlock) {
+			delete []inputValues;
+			delete []resultValues;
+		}
 		delete stencil;
 		delete setUpTimer;
 		delete totalTimer;
 	}
 
-	template <std::size_t DIMENSIONALITY>
-	void StencilApplication<DIMENSIONALITY>::run(int nSteps, std::string& outputFileName) {
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	void StencilApplication<DIMENSIONALITY, INDEX>::run(int nSteps, std::string& outputFileName) {
+		applyStencil(warmUpSteps, false);
+		warmUpCompTime = stencil->computationTime();
+		warmUpCommTime = communicationTime();
+		warmUpThreadTimes = stencil->threadComputationTimes();
+#ifdef HAPARANDA_PROFILE
+		Utils::Profiler::reset();
+#endif
+		if (0 < traceCapacity) {
+			EventTrace::enable(traceCapacity);
+		}
+		if (NULL != counters) {
+			counters->reset();
+		}
 		totalTimer->start();
-		applyStencil(nSteps);
+		for (std::size_t r=0; r<repetitions; r++) {
+			applyStencil(nSteps, true);
+		}
 		totalTimer->stop();
+		EventTrace::disable();
+		if (NULL != snapshotWriter) {
+			snapshotWriter->flush();
+			if (0 == MPI::COMM_WORLD.Get_rank()) {
+				std::cout << snapshotWriter->getNumWritten() << " snapshots written in " << snapshotWriter->getWriteTime()
+						<< " s, stalled for " << snapshotWriter->getStallTime() << " s" << std::endl;
+			}
+		}
+
+		reportResults(nSteps * repetitions, outputFileName);
+		reportStatistics(outputFileName + ".json");
+#ifdef HAPARANDA_PROFILE
+		// One report per process and configuration
+		std::ostringstream profileFileName;
+		profileFileName << outputFileName << ".profile." << MPI::COMM_WORLD.Get_rank();
+		std::ofstream profileFile(profileFileName.str().c_str(), std::ofstream::app);
+		profileFile << DIMENSIONALITY << "D, " << pointsPerUnit << " points per unit, order " << ORDER_OF_ACCURACY
+				<< ", " << nSteps * repetitions << " steps" << std::endl;
+		Utils::Profiler::report(profileFile);
+#endif
+		if (0 < traceCapacity) {
+			unsigned long overwritten = EventTrace::numOverwritten();
+			unsigned long totalOverwritten;
+			MPI::COMM_WORLD.Reduce(&overwritten, &totalOverwritten, 1, MPI::UNSIGNED_LONG, MPI::SUM, 0);
+			EventTrace::exportChromeTrace(MPI::COMM_WORLD, outputFileName + ".trace.json");
+			if (0 == MPI::COMM_WORLD.Get_rank() && 0 < totalOverwritten) {
+				std::cout << totalOverwritten << " early events were overwritten in the trace" << std::endl;
+			}
+		}
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	void StencilApplication<DIMENSIONALITY, INDEX>::setRepetitions(std::size_t warmUpSteps, std::size_t repetitions) {
+		if (0 == repetitions) {
+			throw std::runtime_error("At least one repetition is needed");
+		}
+		this->warmUpSteps = warmUpSteps;
+		this->repetitions = repetitions;
+	}
 
-		reportResults(nSteps, outputFileName);
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	double StencilApplication<DIMENSIONALITY, INDEX>::trial(std::size_t warmUpSteps, int nSteps) {
+		applyStencil(warmUpSteps, false);
+		stepTimes.clear();
+		applyStencil(nSteps, true);
+		// An application takes as long as on the slowest process
+		std::vector<double> globalStepTimes(stepTimes.size());
+		MPI::COMM_WORLD.Allreduce(&stepTimes[0], &globalStepTimes[0], stepTimes.size(), MPI::DOUBLE, MPI::MAX);
+		stepTimes.clear();
+		Statistics statistics;
+		for (std::size_t i=0; i<globalStepTimes.size(); i++) {
+			statistics.add(globalStepTimes[i]);
+		}
+		return statistics.median();
 	}
 
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	void StencilApplication<DIMENSIONALITY, INDEX>::restart(const std::string& fileName) {
+		if (NULL != domain) {
+			throw std::runtime_error("Checkpoints of domains are not supported");
+		}
+		Timer timer;
+		timer.start();
+		Checkpoint<DIMENSIONALITY> checkpoint(fileName, MPI::COMM_WORLD);
+		checkpoint.restore(*inputBlock, inputValues);
+		step = checkpoint.getStep();
+		timer.stop();
+		if (0 == MPI::COMM_WORLD.Get_rank()) {
+			std::cout << "Restarted at application " << step << " in " << timer.totalElapsedTime() << " s" << std::endl;
+		}
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	void StencilApplication<DIMENSIONALITY, INDEX>::writeCheckpoint(const std::string& fileName) {
+		if (NULL != domain) {
+			throw std::runtime_error("Checkpoints of domains are not supported");
+		}
+		Timer timer;
+		timer.start();
+		Checkpoint<DIMENSIONALITY>::write(fileName, *inputBlock, inputValues, step);
+		timer.stop();
+		if (0 == MPI::COMM_WORLD.Get_rank()) {
+			std::cout << "Checkpoint written in " << timer.totalElapsedTime() << " s" << std::endl;
+		}
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	void StencilApplication<DIMENSIONALITY, INDEX>::traceEvents(std::size_t capacity) {
+#ifndef HAPARANDA_PROFILE
+		throw std::runtime_error("Tracing needs a build with the profiling regions (make PROFILE=1)");
+#endif
+		traceCapacity = capacity;
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	void StencilApplication<DIMENSIONALITY, INDEX>::countEvents() {
+		delete counters;
+		counters = new PerformanceCounters(OMP_MAX_NUM_THREADS);
+		stencil->setPerformanceCounters(counters);
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	void StencilApplication<DIMENSIONALITY, INDEX>::setRoofline(const Roofline& roofline) {
+		delete this->roofline;
+		this->roofline = new Roofline(roofline);
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	void StencilApplication<DIMENSIONALITY, INDEX>::writeSnapshots(std::size_t interval, const std::string& fileNamePrefix) {
+		if (NULL != domain) {
+			throw std::runtime_error("Snapshots of domains are not supported");
+		}
+		snapshotInterval = interval;
+		snapshotPrefix = fileNamePrefix;
+		delete snapshotWriter;
+		// Wait rather than drop snapshots when both buffers are being written
+		snapshotWriter = new SnapshotWriter(SNAPSHOT_BUFFERS * SnapshotWriter::stagingSize(numPoints));
+	}
+
+
 	/*** Private methods ***/
-	template <std::size_t DIMENSIONALITY>
-	void StencilApplication<DIMENSIONALITY>::applyStencil(int nSteps) {
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	void StencilApplication<DIMENSIONALITY, INDEX>::applyStencil(int nSteps, bool measure) {
+		Timer stepTimer;
 		for(int t=0; t<nSteps; t++) {
 			std::cout << "Application " << t << ": " << time(NULL) << std::endl;
+			stepTimer.start(true);
+			if (NULL != domain) {
+				// Swaps the value arrays itself
+				domain->apply(*stencil);
+				step++;
+				if (measure) {
+					stepTimes.push_back(stepTimer.stop());
+				}
+				continue;
+			}
 			// Apply the stencil
 			inputBlock->startCommunication();
 			stencil->apply(*inputBlock, resultBlock);
@@ -153,12 +541,49 @@ namespace Haparanda {
 			inputValues = tmp;
 			inputBlock->setValues(inputValues);
 			resultBlock->setValues(resultValues);
+			step++;
+			if (measure) {
+				stepTimes.push_back(stepTimer.stop());
+			}
+			if (NULL != snapshotWriter && 0 == step % snapshotInterval) {
+				std::ostringstream snapshotFileName;
+				snapshotFileName << snapshotPrefix << "." << step << "." << MPI::COMM_WORLD.Get_rank() << ".snap";
+				snapshotWriter->write(inputValues, numPoints, snapshotFileName.str(), step);
+			}
 		}
 		std::cout << nSteps << " applications done: " << time(NULL) << std::endl;
 	}
 
-	template <std::size_t DIMENSIONALITY>
-	void StencilApplication<DIMENSIONALITY>::initializeInputRandom() {
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	double StencilApplication<DIMENSIONALITY, INDEX>::communicationTime() const {
+		return NULL != domain ? domain->communicationTime() : inputBlock->communicationTime();
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	ComputationalComposedBlock<DIMENSIONALITY, INDEX> *StencilApplication<DIMENSIONALITY, INDEX>::createInputBlock() {
+		sharedBlock = NULL;
+		if ("p2p" == exchange) {
+			return new ComputationalComposedBlock<DIMENSIONALITY, INDEX>(pointsPerUnit, ORDER_OF_ACCURACY/2);
+		}
+		if ("collective" == exchange) {
+			return new CollectiveComposedBlock<DIMENSIONALITY, INDEX>(pointsPerUnit, ORDER_OF_ACCURACY/2);
+		}
+		if ("onesided" == exchange) {
+			return new OneSidedComposedBlock<DIMENSIONALITY, INDEX>(pointsPerUnit, ORDER_OF_ACCURACY/2);
+		}
+		if ("aggregated" == exchange) {
+			return new AggregatedComposedBlock<DIMENSIONALITY, INDEX>(pointsPerUnit, ORDER_OF_ACCURACY/2);
+		}
+		if ("shared" == exchange) {
+			// The input and result values are swapped after each application
+			sharedBlock = new SharedMemoryComposedBlock<DIMENSIONALITY, INDEX>(pointsPerUnit, ORDER_OF_ACCURACY/2, 2);
+			return sharedBlock;
+		}
+		throw std::runtime_error("Unknown exchange mode: " + exchange);
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	void StencilApplication<DIMENSIONALITY, INDEX>::initializeInputRandom(double *values) {
 		unsigned int randState[OMP_MAX_NUM_THREADS];
 		for (int i=0; i<OMP_MAX_NUM_THREADS; i++) {
 			randState[i] = i+1;
@@ -168,17 +593,17 @@ namespace Haparanda {
 			/* The initialization does not scale if we don't copy the array element
 			 * into a local variable before calling rand_r. */
 			unsigned int myState = randState[OMP_THREAD_ID];
-			inputValues[i] = (double)rand_r(&myState)/RAND_MAX;
+			values[i] = (double)rand_r(&myState)/RAND_MAX;
 			randState[OMP_THREAD_ID] = myState;
 		}
 	}
 
-	template <std::size_t DIMENSIONALITY>
-	void StencilApplication<DIMENSIONALITY>::reportResults(int nSteps, std::string& outputFileName) {
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	void StencilApplication<DIMENSIONALITY, INDEX>::reportResults(int nSteps, std::string& outputFileName) {
 		double localTotalTime = totalTimer->totalElapsedTime();
 		double localSetUpTime = setUpTimer->totalElapsedTime();
-		double localCompTime = stencil->computationTime();
-		double localCommTime = inputBlock->communicationTime();
+		double localCompTime = stencil->computationTime() - warmUpCompTime;
+		double localCommTime = communicationTime() - warmUpCommTime;
 		double localCompCommTime = localCompTime + localCommTime;
         double globalTotalTime, globalSetUpTime, globalCompTime, globalCommTime, globalCompCommTime;
         int nProcesses = MPI::COMM_WORLD.Get_size();
@@ -188,24 +613,597 @@ namespace Haparanda {
         MPI::COMM_WORLD.Reduce(&localCompTime, &globalCompTime, 1, MPI::DOUBLE, MPI::MAX, 0);
         MPI::COMM_WORLD.Reduce(&localCommTime, &globalCommTime, 1, MPI::DOUBLE, MPI::MAX, 0);
         MPI::COMM_WORLD.Reduce(&localCompCommTime, &globalCompCommTime, 1, MPI::DOUBLE, MPI::MAX, 0);
+		// In a domain, every process is considered a node of its own
+		unsigned long localBytes[2];
+		std::size_t interNodeFaces;
+		if (NULL != domain) {
+			localBytes[0] = domain->interProcessBytesSent();
+			localBytes[1] = 0;
+			interNodeFaces = domain->interProcessFacesPerStep();
+		} else {
+			localBytes[0] = inputBlock->interNodeBytesSent();
+			localBytes[1] = inputBlock->intraNodeBytesSent();
+			interNodeFaces = inputBlock->interNodeFacesPerStep();
+		}
+		unsigned long globalBytes[2];
+		MPI::COMM_WORLD.Reduce(localBytes, globalBytes, 2, MPI::UNSIGNED_LONG, MPI::SUM, 0);
+		std::size_t faceBytes = Math::power(pointsPerUnit, DIMENSIONALITY-1) * ORDER_OF_ACCURACY/2 * sizeof(double);
+		std::size_t predictedInterNodeBytes = interNodeFaces * faceBytes;
+		// Average over the compressed faces of all processes
+		double compressionRatio = 1;
+		if (0 <= linkBandwidth && NULL == domain) {
+			ComputationalComposedBlock<DIMENSIONALITY, INDEX> *composedBlock
+				= static_cast<ComputationalComposedBlock<DIMENSIONALITY, INDEX> *>(inputBlock);
+			double localRatios[2] = {0, 0}, globalRatios[2];
+			for (std::size_t d=0; d<DIMENSIONALITY; d++) {
+				for (std::size_t j=0; j<2; j++) {
+					const HaloCompressor *compressor = composedBlock->getHaloCompressor(d, j);
+					if (NULL != compressor) {
+						localRatios[0] += compressor->getCompressionRatio();
+						localRatios[1]++;
+					}
+				}
+			}
+			MPI::COMM_WORLD.Reduce(localRatios, globalRatios, 2, MPI::DOUBLE, MPI::SUM, 0);
+			if (0 < globalRatios[1]) {
+				compressionRatio = globalRatios[0] / globalRatios[1];
+			}
+		}
         if (0 == MPI::COMM_WORLD.Get_rank()) {
 			std::ofstream outputFile(outputFileName, std::ofstream::app);
 			outputFile << DIMENSIONALITY << "," << this->pointsPerUnit << "," << ORDER_OF_ACCURACY << "," << \
 						nProcesses << "," << nThreads << "," << nSteps << "," << \
 						globalTotalTime << "," << globalSetUpTime << "," \
-						<< globalCompTime << "," << globalCommTime << "," << globalCompCommTime << "\n";
+						<< globalCompTime << "," << globalCommTime << "," << globalCompCommTime << "," << \
+						this->packedDimensions << "," << this->exchange << "," << this->decomposition << "," << \
+						predictedInterNodeBytes << "," << globalBytes[0]/nSteps << "," << globalBytes[1]/nSteps << "," << \
+						this->blocksPerProcessDim << "," << this->balanceInterval << "," << \
+						this->linkBandwidth << "," << compressionRatio << "\n";
 			outputFile.close();
         }
 	}
 
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	void StencilApplication<DIMENSIONALITY, INDEX>::reportStatistics(const std::string& outputFileName) {
+		if (stepTimes.empty()) {
+			return;
+		}
+		int nProcesses = MPI::COMM_WORLD.Get_size();
+		// An application takes as long as on the slowest process
+		std::vector<double> globalStepTimes(stepTimes.size());
+		MPI::COMM_WORLD.Reduce(&stepTimes[0], &globalStepTimes[0], stepTimes.size(), MPI::DOUBLE, MPI::MAX, 0);
+		unsigned long localPoints = NULL != domain ? domain->numLocalBlocks() * numPoints : numPoints;
+		unsigned long globalPoints;
+		MPI::COMM_WORLD.Reduce(&localPoints, &globalPoints, 1, MPI::UNSIGNED_LONG, MPI::SUM, 0);
+		// Times per process
+		const int NUM_TIMES = 4;
+		double localTimes[NUM_TIMES] = {totalTimer->totalElapsedTime(), setUpTimer->totalElapsedTime(),
+				stencil->computationTime() - warmUpCompTime, communicationTime() - warmUpCommTime};
+		std::vector<double> processTimes(NUM_TIMES * nProcesses);
+		MPI::COMM_WORLD.Gather(localTimes, NUM_TIMES, MPI::DOUBLE, &processTimes[0], NUM_TIMES, MPI::DOUBLE, 0);
+		// Times per thread, padded to the same number of threads on all processes
+		std::vector<double> threadTimes = stencil->threadComputationTimes();
+		for (std::size_t t=0; t<threadTimes.size(); t++) {
+			threadTimes[t] -= warmUpThreadTimes[t];
+		}
+		unsigned long localThreads = threadTimes.size();
+		unsigned long maxThreads;
+		MPI::COMM_WORLD.Allreduce(&localThreads, &maxThreads, 1, MPI::UNSIGNED_LONG, MPI::MAX);
+		threadTimes.resize(maxThreads, 0.0);
+		std::vector<double> processThreadTimes(maxThreads * nProcesses);
+		MPI::COMM_WORLD.Gather(&threadTimes[0], maxThreads, MPI::DOUBLE, &processThreadTimes[0], maxThreads, MPI::DOUBLE, 0);
+		// Events per phase and counter, summed over the processes
+		const int NUM_COUNTS = PerformanceCounters::NUM_PHASES * PerformanceCounters::NUM_COUNTERS;
+		unsigned long long localCounts[NUM_COUNTS] = {0};
+		unsigned long long globalCounts[NUM_COUNTS];
+		if (NULL != counters) {
+			for (int c=0; c<NUM_COUNTS; c++) {
+				localCounts[c] = counters->total(PerformanceCounters::Phase(c / PerformanceCounters::NUM_COUNTERS),
+						PerformanceCounters::Counter(c % PerformanceCounters::NUM_COUNTERS));
+			}
+		}
+		MPI::COMM_WORLD.Reduce(localCounts, globalCounts, NUM_COUNTS, MPI::UNSIGNED_LONG_LONG, MPI::SUM, 0);
+		// The processes share the machine, so their rooflines add up
+		double localRoofline[2] = {0, 0};
+		if (NULL != roofline) {
+			localRoofline[0] = roofline->getBandwidth();
+			localRoofline[1] = roofline->getPeakFlops();
+		}
+		double globalRoofline[2];
+		MPI::COMM_WORLD.Reduce(localRoofline, globalRoofline, 2, MPI::DOUBLE, MPI::SUM, 0);
+		if (0 != MPI::COMM_WORLD.Get_rank()) {
+			return;
+		}
+
+		Statistics statistics;
+		for (std::size_t i=0; i<globalStepTimes.size(); i++) {
+			statistics.add(globalStepTimes[i]);
+		}
+		// One multiplication and one addition per weight, and at least one read and one write per point
+		double pointsPerSecond = globalPoints / statistics.median();
+		double flopsPerPoint = 2.0 * (ORDER_OF_ACCURACY + 1) * DIMENSIONALITY;
+		double bytesPerPoint = 2.0 * sizeof(double);
+		std::ofstream outputFile(outputFileName.c_str(), std::ofstream::app);
+		outputFile << std::setprecision(9) << "{\"dimensionality\":" << DIMENSIONALITY
+				<< ",\"pointsPerUnit\":" << pointsPerUnit << ",\"order\":" << ORDER_OF_ACCURACY
+				<< ",\"processes\":" << nProcesses << ",\"threads\":" << OMP_MAX_NUM_THREADS
+				<< ",\"exchange\":\"" << exchange << "\",\"decomposition\":\"" << decomposition << "\""
+				<< ",\"blocksPerProcessDim\":" << blocksPerProcessDim << ",\"points\":" << globalPoints
+				<< ",\"warmUpSteps\":" << warmUpSteps << ",\"repetitions\":" << repetitions
+				<< ",\"measuredSteps\":" << statistics.count()
+				<< ",\"stepTime\":{\"min\":" << statistics.min() << ",\"median\":" << statistics.median()
+				<< ",\"p99\":" << statistics.percentile(99) << ",\"max\":" << statistics.max()
+				<< ",\"mean\":" << statistics.mean() << ",\"stddev\":" << statistics.standardDeviation() << "}"
+				<< ",\"pointsPerSecond\":" << pointsPerSecond
+				<< ",\"gflops\":" << pointsPerSecond * flopsPerPoint / 1e9
+				<< ",\"effectiveGBPerSecond\":" << pointsPerSecond * bytesPerPoint / 1e9;
+		if (NULL != roofline) {
+			Roofline machine(globalRoofline[0], globalRoofline[1]);
+			double intensity = flopsPerPoint / bytesPerPoint;
+			double attainable = machine.attainableFlops(intensity);
+			outputFile << ",\"roofline\":{\"triadGBPerSecond\":" << machine.getBandwidth() / 1e9
+					<< ",\"peakGflops\":" << machine.getPeakFlops() / 1e9
+					<< ",\"arithmeticIntensity\":" << intensity << ",\"ridgePoint\":" << machine.ridgePoint()
+					<< ",\"attainableGflops\":" << attainable / 1e9
+					<< ",\"percentOfAttainable\":" << 100 * pointsPerSecond * flopsPerPoint / attainable << "}";
+		}
+		if (NULL != counters) {
+			reportCounters(outputFile, globalCounts, globalPoints * statistics.count() * flopsPerPoint,
+					globalPoints * statistics.count());
+		}
+		outputFile << ",\"ranks\":[";
+		for (int p=0; p<nProcesses; p++) {
+			const double *times = &processTimes[NUM_TIMES * p];
+			outputFile << (0 == p ? "" : ",") << "{\"rank\":" << p << ",\"total\":" << times[0]
+					<< ",\"setUp\":" << times[1] << ",\"computation\":" << times[2]
+					<< ",\"communication\":" << times[3] << ",\"threadComputation\":[";
+			for (std::size_t t=0; t<maxThreads; t++) {
+				outputFile << (0 == t ? "" : ",") << processThreadTimes[maxThreads * p + t];
+			}
+			outputFile << "]}";
+		}
+		outputFile << "]}\n";
+		outputFile.close();
+	}
+
+	template <std::size_t DIMENSIONALITY, typename INDEX>
+	void StencilApplication<DIMENSIONALITY, INDEX>::reportCounters(std::ostream& out, const unsigned long long *counts,
+			double flops, double points) const {
+		const int NUM_COUNTERS = PerformanceCounters::NUM_COUNTERS;
+		const char *phaseNames[PerformanceCounters::NUM_PHASES] = {"interior", "boundary"};
+		unsigned long long sums[NUM_COUNTERS] = {0};
+		out << ",\"counters\":{\"hardware\":" << (counters->hasHardwareCounters() ? "true" : "false");
+		for (int p=0; p<PerformanceCounters::NUM_PHASES; p++) {
+			out << ",\"" << phaseNames[p] << "\":{";
+			for (int c=0; c<NUM_COUNTERS; c++) {
+				PerformanceCounters::Counter counter = PerformanceCounters::Counter(c);
+				out << (0 == c ? "" : ",") << "\"" << PerformanceCounters::name(counter) << "\":";
+				if (counters->isAvailable(counter)) {
+					out << counts[NUM_COUNTERS * p + c];
+				} else {
+					out << "null";
+				}
+				sums[c] += counts[NUM_COUNTERS * p + c];
+			}
+			out << "}";
+		}
+		bool hasCycles = counters->isAvailable(PerformanceCounters::CYCLES) && 0 < sums[PerformanceCounters::CYCLES];
+		out << ",\"ipc\":";
+		if (hasCycles && counters->isAvailable(PerformanceCounters::INSTRUCTIONS)) {
+			out << double(sums[PerformanceCounters::INSTRUCTIONS]) / sums[PerformanceCounters::CYCLES];
+		} else {
+			out << "null";
+		}
+		out << ",\"cacheMissesPerPoint\":";
+		if (counters->isAvailable(PerformanceCounters::CACHE_MISSES)) {
+			out << sums[PerformanceCounters::CACHE_MISSES] / points;
+		} else {
+			out << "null";
+		}
+		out << ",\"flopsPerCycle\":";
+		if (hasCycles) {
+			out << flops / sums[PerformanceCounters::CYCLES];
+		} else {
+			out << "null";
+		}
+		out << "}";
+	}
+
 } /* namespace Haparanda */
 
 /**
- * Usage: stencil_application <block size in each dimension> <name of output file> <number of applications of the stencil to the area>
+ * Parse a comma separated list of dimensions, e.g. "0,2", or the word "all".
  *
- * Apply an 8:th order constant multuncial stencil on an NUM_DIMENSIONS
- * dimensional block whose size in each dimension is given by the first
- * argument to the program.
+ * @param list The list to parse
+ * @return Bit mask where bit d is set if d is in the list
+ */
+unsigned int parseDimensionList(const std::string& list) {
+	if ("all" == list) {
+		return ~0u;
+	}
+	unsigned int mask = 0;
+	std::stringstream stream(list);
+	std::string item;
+	while (std::getline(stream, item, ',')) {
+		mask |= 1u << atoi(item.c_str());
+	}
+	return mask;
+}
+
+/**
+ * Parse a comma separated list of numbers, e.g. "3,4,5".
+ *
+ * @param list The list to parse
+ * @return The numbers
+ */
+std::vector<std::size_t> parseList(const std::string& list) {
+	std::vector<std::size_t> numbers;
+	std::stringstream stream(list);
+	std::string item;
+	while (std::getline(stream, item, ',')) {
+		numbers.push_back(atoi(item.c_str()));
+	}
+	return numbers;
+}
+
+/**
+ * Options of one run of the stencil application, i.e. one configuration.
+ */
+struct Options {
+	std::size_t size;
+	unsigned int packedDimensions;
+	std::string exchange;
+	std::string decomposition;
+	int processesPerNode;
+	std::size_t blocksPerProcessDim;
+	std::size_t balanceInterval;
+	double linkBandwidth;
+	std::string restartFileName;
+	std::string checkpointFileName;
+	std::size_t snapshotInterval;
+	std::size_t warmUpSteps;
+	std::size_t repetitions;
+	std::size_t traceCapacity;
+	bool countEvents;
+	Haparanda::Utils::Roofline *roofline;	// NULL if the roofline is not measured
+	std::string fileName;
+	int nSteps;
+};
+
+/**
+ * @param options Options of a run
+ * @return True if the run reads or writes checkpoints or snapshots
+ */
+bool hasCheckpoints(const Options& options) {
+	return !options.restartFileName.empty() || !options.checkpointFileName.empty() || 0 < options.snapshotInterval;
+}
+
+/**
+ * @param dimensionality Dimensionality of the block
+ * @param size Number of elements of the block along each dimension
+ * @return True if the block has too many elements for 32-bit indices
+ */
+bool needs64BitIndices(std::size_t dimensionality, std::size_t size) {
+	std::uint64_t numElements = 1;
+	for (std::size_t d=0; d<dimensionality; d++) {
+		if (0 != size && numElements > std::numeric_limits<std::uint32_t>::max() / size) {
+			return true;
+		}
+		numElements *= size;
+	}
+	return false;
+}
+
+/**
+ * Run the stencil application with the specified options, and append a
+ * row with the results to the output file.
+ *
+ * @tparam DIMENSIONALITY Dimensionality of the block
+ * @tparam INDEX Type of the linear indices of the iterators over the blocks
+ * @param options The options
+ */
+template <std::size_t DIMENSIONALITY, typename INDEX>
+void runApplication(Options& options) {
+	Haparanda::Grid::CommunicativeBlock<DIMENSIONALITY>::setEmulatedProcessesPerNode(options.processesPerNode);
+	Haparanda::StencilApplication<DIMENSIONALITY, INDEX> *application
+	= new Haparanda::StencilApplication<DIMENSIONALITY, INDEX>(options.size, options.packedDimensions, options.exchange,
+			options.decomposition, options.blocksPerProcessDim, options.balanceInterval, options.linkBandwidth);
+	if (!options.restartFileName.empty()) {
+		application->restart(options.restartFileName);
+	}
+	if (0 < options.snapshotInterval) {
+		application->writeSnapshots(options.snapshotInterval, options.fileName);
+	}
+	application->setRepetitions(options.warmUpSteps, options.repetitions);
+	if (0 < options.traceCapacity) {
+		application->traceEvents(options.traceCapacity);
+	}
+	if (options.countEvents) {
+		application->countEvents();
+	}
+	if (NULL != options.roofline) {
+		application->setRoofline(*options.roofline);
+	}
+	application->run(options.nSteps, options.fileName);
+	if (!options.checkpointFileName.empty()) {
+		application->writeCheckpoint(options.checkpointFileName);
+	}
+	delete application;
+	MPI::COMM_WORLD.Barrier();
+}
+
+/**
+ * Run the stencil application with 64-bit indices if the block is too
+ * large for 32-bit ones.
+ *
+ * @tparam DIMENSIONALITY Dimensionality of the block
+ * @param options The options
+ */
+template <std::size_t DIMENSIONALITY>
+void runApplication(Options& options) {
+	if (needs64BitIndices(DIMENSIONALITY, options.size)) {
+		runApplication<DIMENSIONALITY, std::uint64_t>(options);
+	} else {
+		runApplication<DIMENSIONALITY, std::uint32_t>(options);
+	}
+}
+
+/**
+ * Run the stencil application of the specified dimensionality.
+ *
+ * @param dimensionality Dimensionality of the block, 1 to MAX_DIM
+ * @param options The options
+ */
+void runApplication(std::size_t dimensionality, Options& options) {
+	switch (dimensionality) {
+	case 1:
+		runApplication<1>(options);
+		break;
+	case 2:
+		runApplication<2>(options);
+		break;
+	case 3:
+		runApplication<3>(options);
+		break;
+	case 4:
+		runApplication<4>(options);
+		break;
+	case 5:
+		runApplication<5>(options);
+		break;
+	case 6:
+		runApplication<6>(options);
+		break;
+	default:
+		throw std::runtime_error("Unsupported dimensionality");
+	}
+}
+
+/**
+ * Run a short trial of the stencil application with the specified options,
+ * without writing any results.
+ *
+ * @tparam DIMENSIONALITY Dimensionality of the block
+ * @tparam INDEX Type of the linear indices of the iterators over the blocks
+ * @param options The options
+ * @return The median time per application
+ */
+template <std::size_t DIMENSIONALITY, typename INDEX>
+double runTrial(const Options& options) {
+	Haparanda::Grid::CommunicativeBlock<DIMENSIONALITY>::setEmulatedProcessesPerNode(options.processesPerNode);
+	Haparanda::StencilApplication<DIMENSIONALITY, INDEX> *application
+	= new Haparanda::StencilApplication<DIMENSIONALITY, INDEX>(options.size, options.packedDimensions, options.exchange,
+			options.decomposition, options.blocksPerProcessDim, options.balanceInterval, options.linkBandwidth);
+	double time = application->trial(TUNING_WARM_UP_STEPS, TUNING_STEPS);
+	delete application;
+	MPI::COMM_WORLD.Barrier();
+	return time;
+}
+
+/**
+ * Run a short trial with 64-bit indices if the block is too large for
+ * 32-bit ones.
+ *
+ * @tparam DIMENSIONALITY Dimensionality of the block
+ * @param options The options
+ * @return The median time per application
+ */
+template <std::size_t DIMENSIONALITY>
+double runTrial(const Options& options) {
+	if (needs64BitIndices(DIMENSIONALITY, options.size)) {
+		return runTrial<DIMENSIONALITY, std::uint64_t>(options);
+	}
+	return runTrial<DIMENSIONALITY, std::uint32_t>(options);
+}
+
+/**
+ * Run a short trial of the stencil application of the specified
+ * dimensionality.
+ *
+ * @param dimensionality Dimensionality of the block, 1 to MAX_DIM
+ * @param options The options
+ * @return The median time per application
+ */
+double runTrial(std::size_t dimensionality, const Options& options) {
+	switch (dimensionality) {
+	case 1:
+		return runTrial<1>(options);
+	case 2:
+		return runTrial<2>(options);
+	case 3:
+		return runTrial<3>(options);
+	case 4:
+		return runTrial<4>(options);
+	case 5:
+		return runTrial<5>(options);
+	case 6:
+		return runTrial<6>(options);
+	default:
+		throw std::runtime_error("Unsupported dimensionality");
+	}
+}
+
+/**
+ * Let the options use a tuned configuration, and the current OpenMP threads
+ * its number of threads. The blocks of a domain together have as many
+ * points as the block of the problem.
+ *
+ * @param configuration The configuration
+ * @param size Number of points in each dimension of the block of each process
+ * @param options The options
+ */
+void applyConfiguration(const Haparanda::Utils::TuningCache::Configuration& configuration, std::size_t size, Options& options) {
+	options.exchange = configuration.exchange;
+	options.packedDimensions = configuration.packedDimensions;
+	options.blocksPerProcessDim = configuration.blocksPerProcessDim;
+	options.size = 0 < configuration.blocksPerProcessDim ? size / configuration.blocksPerProcessDim : size;
+#ifdef _OPENMP
+	omp_set_num_threads(configuration.threads);
+#endif
+}
+
+/**
+ * Send a configuration from the first process to all others.
+ *
+ * @param configuration The configuration, set on all processes but the first
+ */
+void broadcastConfiguration(Haparanda::Utils::TuningCache::Configuration& configuration) {
+	char exchange[32] = "";
+	configuration.exchange.copy(exchange, sizeof(exchange) - 1);
+	MPI::COMM_WORLD.Bcast(exchange, sizeof(exchange), MPI::CHAR, 0);
+	configuration.exchange = exchange;
+	unsigned long blocks = configuration.blocksPerProcessDim;
+	MPI::COMM_WORLD.Bcast(&blocks, 1, MPI::UNSIGNED_LONG, 0);
+	configuration.blocksPerProcessDim = blocks;
+	MPI::COMM_WORLD.Bcast(&configuration.packedDimensions, 1, MPI::UNSIGNED, 0);
+	MPI::COMM_WORLD.Bcast(&configuration.threads, 1, MPI::INT, 0);
+	MPI::COMM_WORLD.Bcast(&configuration.seconds, 1, MPI::DOUBLE, 0);
+}
+
+/**
+ * Find the fastest configuration of the problem specified by the options,
+ * by a short trial of each candidate: each exchange mode with and without
+ * explicit packing, and domains of 2 and 4 blocks per process and
+ * dimension (where the inner parts of the blocks are computed while the
+ * boundary data is exchanged), on each power of 2 number of threads up to
+ * the number available. The candidates which cannot be applied with the
+ * other options are left out.
+ *
+ * @param dimensionality Dimensionality of the block, 1 to MAX_DIM
+ * @param maxThreads Number of threads available
+ * @param options The options of the problem. Its tunable options are ignored.
+ * @return The fastest configuration
+ */
+Haparanda::Utils::TuningCache::Configuration autotune(std::size_t dimensionality, int maxThreads, Options options) {
+	const char *exchanges[] = {"p2p", "collective", "onesided", "aggregated", "shared"};
+	bool checkpoints = hasCheckpoints(options);
+	std::size_t size = options.size;
+	std::vector<Haparanda::Utils::TuningCache::Configuration> candidates;
+	for (int threads=1; ; threads=std::min(2 * threads, maxThreads)) {
+		Haparanda::Utils::TuningCache::Configuration candidate;
+		candidate.threads = threads;
+		candidate.blocksPerProcessDim = 0;
+		for (int e=0; e<5; e++) {
+			candidate.exchange = exchanges[e];
+			if (Haparanda::isSupported(candidate.exchange, 0, options.linkBandwidth, checkpoints)) {
+				candidate.packedDimensions = 0;
+				candidates.push_back(candidate);
+				candidate.packedDimensions = ~0u;
+				candidates.push_back(candidate);
+			}
+		}
+		for (std::size_t blocks=2; blocks<=4; blocks*=2) {
+			if (0 == size % blocks && ORDER_OF_ACCURACY/2 <= size / blocks
+					&& Haparanda::isSupported("p2p", blocks, options.linkBandwidth, checkpoints)) {
+				candidate.exchange = "p2p";
+				candidate.packedDimensions = 0;
+				candidate.blocksPerProcessDim = blocks;
+				candidates.push_back(candidate);
+			}
+		}
+		if (maxThreads <= threads) {
+			break;
+		}
+	}
+	bool isRoot = 0 == MPI::COMM_WORLD.Get_rank();
+	Haparanda::Utils::TuningCache::Configuration best;
+	best.seconds = std::numeric_limits<double>::max();
+	for (std::size_t c=0; c<candidates.size(); c++) {
+		applyConfiguration(candidates[c], size, options);
+		candidates[c].seconds = runTrial(dimensionality, options);
+		if (isRoot) {
+			std::cout << "Trial " << c + 1 << "/" << candidates.size() << ": exchange " << candidates[c].exchange
+					<< ", packed dimensions " << std::hex << candidates[c].packedDimensions << std::dec
+					<< ", blocks " << candidates[c].blocksPerProcessDim << ", threads " << candidates[c].threads
+					<< ": " << candidates[c].seconds << " s per application" << std::endl;
+		}
+		if (candidates[c].seconds < best.seconds) {
+			best = candidates[c];
+		}
+	}
+	return best;
+}
+
+/**
+ * Let the options use the configuration tuned for the problem they
+ * specify on the current number of threads: the one in the tuning cache if
+ * there is one, otherwise the fastest one found by autotune, which is then
+ * added to the cache. Only the first process reads and writes the cache.
+ *
+ * @param dimensionality Dimensionality of the block, 1 to MAX_DIM
+ * @param cacheFileName Path to the tuning cache
+ * @param options The options
+ */
+void useTunedConfiguration(std::size_t dimensionality, const std::string& cacheFileName, Options& options) {
+	using Haparanda::Utils::TuningCache;
+	bool isRoot = 0 == MPI::COMM_WORLD.Get_rank();
+	TuningCache::Key key;
+	key.host = TuningCache::hostSignature();
+	key.dimensionality = dimensionality;
+	key.size = options.size;
+	key.order = ORDER_OF_ACCURACY;
+	key.processes = MPI::COMM_WORLD.Get_size();
+	key.threads = OMP_MAX_NUM_THREADS;
+	key.decomposition = options.decomposition;
+	key.processesPerNode = options.processesPerNode;
+	key.linkBandwidth = options.linkBandwidth;
+	key.checkpoints = hasCheckpoints(options);
+	TuningCache *cache = NULL;
+	TuningCache::Configuration configuration;
+	int found = 0;
+	if (isRoot) {
+		cache = new TuningCache(cacheFileName);
+		found = cache->find(key, &configuration);
+	}
+	MPI::COMM_WORLD.Bcast(&found, 1, MPI::INT, 0);
+	if (found) {
+		broadcastConfiguration(configuration);
+	} else {
+		configuration = autotune(dimensionality, key.threads, options);
+		if (isRoot) {
+			cache->store(key, configuration);
+		}
+	}
+	delete cache;
+	if (isRoot) {
+		std::cout << (found ? "Cached" : "Tuned") << " configuration: exchange " << configuration.exchange
+				<< ", packed dimensions " << std::hex << configuration.packedDimensions << std::dec
+				<< ", blocks " << configuration.blocksPerProcessDim << ", threads " << configuration.threads << std::endl;
+	}
+	// The roofline is only valid for the number of threads it was measured with
+	if (configuration.threads != key.threads) {
+		options.roofline = NULL;
+	}
+	applyConfiguration(configuration, options.size, options);
+}
+
+/**
+ * Usage: stencil_application [-p <dimensions>] [-e <exchange mode>] [-d <decomposition>] [-n <processes per node>] [-b <blocks per process and dimension>] [-l <applications between load balancing>] [-z <link bandwidth>] [-r <checkpoint to restart from>] [-w <checkpoint to write>] [-s <applications between snapshots>] [-D <dimensionalities>] [-o <orders of accuracy>] [-t <numbers of threads>] [-W <warm-up applications>] [-R <repetitions>] [-P] [-N] [-T <events per thread>] [-A <tuning cache>] <block sizes in each dimension> <name of output file> <number of applications of the stencil to the area>
+ *
+ * Apply an 8:th order constant multuncial stencil on a block whose size in
+ * each dimension is given by the first argument to the program. Blocks of
+ * 2^32 elements or more are iterated with 64-bit indices, and smaller ones
+ * with the faster 32-bit indices.
  *
  * Write the total time, the setup time and the time needed for computations and
  * communication respectively to the file whose name is specified by the second
@@ -214,21 +1212,254 @@ namespace Haparanda {
  * The application is done several times. The number of times can be specified
  * as the third argument to the program. The default is 10.
  *
+ * Options:
+ * -p Comma separated list of the dimensions along which the boundary data is
+ *    packed explicitly by the threads instead of by MPI (e.g. -p 0,1), or
+ *    "all". Default is to let MPI pack the data along all dimensions.
+ * -e How the boundary data is exchanged with the neighbors: "p2p" (default)
+ *    posts one send and one receive per neighbor, "collective" exchanges the
+ *    data with all neighbors in one MPI_Ineighbor_alltoallw and "onesided"
+ *    puts the data into windows exposing the ghost regions. "aggregated"
+ *    lets one process per node send all data destined for another node in
+ *    one message, which pays off when the messages are many and small
+ *    (see also -n). "shared" lets
+ *    neighbors on the same node read the boundary data directly from each
+ *    other's values, which are then allocated in shared memory, and
+ *    exchanges messages with the other neighbors as "p2p". Run the program
+ *    once with each mode and compare the communication times in the output
+ *    file to see which one is faster on a given system.
+ * -d How the processes are arranged in the processor grid: "default" lets
+ *    MPI::Compute_dims decide, and "planned" lets a DecompositionPlanner
+ *    choose the grid and the placement of the ranks in it so that as little
+ *    data as possible is sent between nodes. The output file gets the
+ *    predicted and measured number of bytes sent between nodes per
+ *    application, and the measured number of bytes sent within nodes.
+ *    The nodes are only detected with "planned", -n or -e aggregated;
+ *    otherwise each process is considered a node of its own in the output.
+ * -n Treat each group of the specified number of consecutive ranks as a
+ *    node, instead of detecting which processes share memory.
+ * -b Over-decompose: Let each process have the specified number of blocks
+ *    (of the specified size) along each dimension, in a Domain. The blocks
+ *    of a process exchange boundary data by copying, and the inner parts of
+ *    all blocks are computed while data is exchanged with other processes.
+ *    -e and -d are ignored, and each process is considered a node of its
+ *    own in the output.
+ * -l Together with -b: Balance the load between the processes after each
+ *    specified number of applications, by moving blocks from slow to fast
+ *    processes. Default is to never balance the load.
+ * -z Compress the boundary data sent to other nodes losslessly, when it
+ *    pays off on a link with the specified bandwidth in GB/s (0 to always
+ *    compress). Only together with "p2p" exchange. The output file gets the
+ *    bandwidth and the average compression ratio of the compressed faces.
+ * -r Initialize the values from the specified checkpoint instead of random
+ *    values. The checkpoint may have been written with another number of
+ *    processes, as long as the global grid has the same size.
+ * -w Write the values to the specified checkpoint after the applications.
+ * -s Write a snapshot of the values after each specified number of
+ *    applications. The snapshots are written in the background, to one file
+ *    per process named <output file>.<application>.<rank>.snap, and the
+ *    applications only wait if the previous snapshots are still being
+ *    written.
+ * Checkpoints and snapshots are not supported together with -b.
+ * -D Dimensionality of the block, 1 to 6. Default is 2.
+ * -o Order of accuracy of the stencil. Only the order of the compiled
+ *    stencil (8) is supported, but the order is part of the matrix below.
+ * -t Number of OpenMP threads. Default is to let OpenMP decide.
+ * -W Apply the stencil the specified number of times before the
+ *    measurements start. Default is 0.
+ * -R Repeat the measured applications the specified number of times.
+ *    Default is 1.
+ * -P Count hardware events (cycles, instructions and last level cache
+ *    misses) of each thread in the interior and boundary phases of the
+ *    measured applications, using perf_event_open, and add them to the
+ *    statistics, with the instructions per cycle, misses per point and
+ *    floating point operations per cycle. Only the CPU time is counted if
+ *    the hardware counters are not available.
+ * -N Do not measure the roofline (See below.)
+ * -T Record a timeline of the computation and communication of the
+ *    measured applications, keeping at most the specified number of events
+ *    per thread, and write it to <output file>.trace.json in the Chrome
+ *    trace format (for chrome://tracing or Perfetto). Needs a build with
+ *    PROFILE=1.
+ *
+ * Besides the row in the output file, a JSON object with statistics of the
+ * measured applications is appended to the output file name + ".json": the
+ * min, median and 99th percentile of the time per application, GFLOP/s,
+ * effective GB/s (one read and one write per point) and points/s at the
+ * median, and the times of each process and each of its threads.
+ *
+ * At startup, the STREAM triad bandwidth and the peak floating point
+ * performance of the multiply-add probe are measured by all processes at
+ * once, for each number of threads. The statistics then include this
+ * roofline, the arithmetic intensity of the stencil (its floating point
+ * operations per point over the bytes moved per point), and the percentage
+ * of the performance attainable at that intensity which is achieved.
+ *
+ * -A Autotune: run each configuration with the exchange mode, packing,
+ *    blocks per process and number of threads (at most the number given by
+ *    -t) found fastest for it on this kind of host, instead of those given
+ *    by -e, -p, -b and -t. The fastest ones are looked up in the specified
+ *    tuning cache file, keyed by the host signature (host name, CPU model
+ *    and number of hardware threads), dimensionality, block size, order of
+ *    accuracy, number of processes, number of threads, -d, -n, -z and
+ *    whether checkpoints or snapshots are used. Configurations which are
+ *    not in the cache are found by a short trial of each candidate, and
+ *    then added to it, so that later runs start with them directly. With blocks per process, the blocks together have the
+ *    specified block size. Delete the cache to tune again, e.g. after
+ *    changing the code.
+ *
+ * Sweep mode: -D, -o, -t and the block size may be comma separated lists
+ * (e.g. -D 3,4,5,6 -t 1,2,4 16,32), in which case every combination is
+ * run, and one row per configuration is appended to the output file.
+ * Checkpoints, snapshots and timelines need a single configuration.
+ *
  * Copyright Malin Kallen 2014, 2017
  */
 int main(int argc, char *args[]) {
-	if (argc<3 || argc>4) {
-		throw new std::runtime_error("Usage: stencil_haparanda <block size in each dimension> <name of output file> <number of applications of the stencil to the area>");
+	const char *usage = "Usage: stencil_haparanda [-p <dimensions>] [-e <exchange mode>] [-d <decomposition>] [-n <processes per node>] [-b <blocks per process and dimension>] [-l <applications between load balancing>] [-z <link bandwidth>] [-r <checkpoint to restart from>] [-w <checkpoint to write>] [-s <applications between snapshots>] [-D <dimensionalities>] [-o <orders of accuracy>] [-t <numbers of threads>] [-W <warm-up applications>] [-R <repetitions>] [-P] [-N] [-T <events per thread>] [-A <tuning cache>] <block sizes in each dimension> <name of output file> <number of applications of the stencil to the area>";
+	Options options;
+	options.packedDimensions = 0;
+	options.exchange = "p2p";
+	options.decomposition = "default";
+	options.processesPerNode = 0;
+	options.blocksPerProcessDim = 0;
+	options.balanceInterval = 0;
+	options.linkBandwidth = -1;
+	options.snapshotInterval = 0;
+	options.warmUpSteps = 0;
+	options.repetitions = 1;
+	options.traceCapacity = 0;
+	options.countEvents = false;
+	bool measureRoofline = true;
+	std::vector<std::size_t> dimensionalities(1, 2);
+	std::vector<std::size_t> orders(1, ORDER_OF_ACCURACY);
+	std::vector<std::size_t> threadCounts(1, 0);	// 0: Let OpenMP decide
+	std::string tuningCacheFileName;	// Empty if there is no autotuning
+	int option;
+	while (-1 != (option = getopt(argc, args, "p:e:d:n:b:l:z:r:w:s:D:o:t:W:R:PNT:A:"))) {
+		switch (option) {
+		case 'p':
+			options.packedDimensions = parseDimensionList(optarg);
+			break;
+		case 'e':
+			options.exchange = optarg;
+			break;
+		case 'd':
+			options.decomposition = optarg;
+			break;
+		case 'n':
+			options.processesPerNode = atoi(optarg);
+			break;
+		case 'b':
+			options.blocksPerProcessDim = atoi(optarg);
+			break;
+		case 'l':
+			options.balanceInterval = atoi(optarg);
+			break;
+		case 'z':
+			options.linkBandwidth = atof(optarg) * 1e9;
+			break;
+		case 'r':
+			options.restartFileName = optarg;
+			break;
+		case 'w':
+			options.checkpointFileName = optarg;
+			break;
+		case 's':
+			options.snapshotInterval = atoi(optarg);
+			break;
+		case 'D':
+			dimensionalities = parseList(optarg);
+			break;
+		case 'o':
+			orders = parseList(optarg);
+			break;
+		case 't':
+			threadCounts = parseList(optarg);
+			break;
+		case 'W':
+			options.warmUpSteps = atoi(optarg);
+			break;
+		case 'R':
+			options.repetitions = atoi(optarg);
+			break;
+		case 'P':
+			options.countEvents = true;
+			break;
+		case 'N':
+			measureRoofline = false;
+			break;
+		case 'T':
+			options.traceCapacity = atoi(optarg);
+			break;
+		case 'A':
+			tuningCacheFileName = optarg;
+			break;
+		default:
+			throw new std::runtime_error(usage);
+		}
+	}
+	int nArgs = argc - optind;
+	if (nArgs<2 || nArgs>3) {
+		throw new std::runtime_error(usage);
+	}
+	std::vector<std::size_t> sizes = parseList(args[optind]);
+	options.fileName = args[optind+1];
+	options.nSteps = nArgs > 2 ? atoi(args[optind+2]) : 10;
+	for (std::size_t i=0; i<dimensionalities.size(); i++) {
+		if (1 > dimensionalities[i] || MAX_DIM < dimensionalities[i]) {
+			throw std::runtime_error("The dimensionality must be 1 to 6");
+		}
+	}
+	for (std::size_t i=0; i<orders.size(); i++) {
+		if (ORDER_OF_ACCURACY != orders[i]) {
+			throw std::runtime_error("Only the order of accuracy of the compiled stencil is supported");
+		}
+	}
+	std::size_t numConfigurations = dimensionalities.size() * sizes.size() * orders.size() * threadCounts.size();
+	if (1 < numConfigurations && (!options.restartFileName.empty() || !options.checkpointFileName.empty()
+			|| 0 < options.snapshotInterval || 0 < options.traceCapacity)) {
+		throw std::runtime_error("Checkpoints, snapshots and timelines need a single configuration");
 	}
-	std::size_t size = atoi(args[1]);
-	std::string fileName = args[2];
-	int nSteps = argc > 3 ? atoi(args[3]) : 10;
 
 	MPI::Init();
-	Haparanda::StencilApplication<DIM> *application = new Haparanda::StencilApplication<DIM>(size);
-	application->run(nSteps, fileName);
-	delete application;
-	MPI::COMM_WORLD.Barrier();
+#ifdef _OPENMP
+	// Restored before each configuration, as autotuning changes it
+	int defaultThreads = OMP_MAX_NUM_THREADS;
+#endif
+	// One roofline per number of threads, measured by all processes at once
+	std::vector<Haparanda::Utils::Roofline *> rooflines(threadCounts.size(), NULL);
+	for (std::size_t t=0; t<threadCounts.size() && measureRoofline; t++) {
+#ifdef _OPENMP
+		if (0 < threadCounts[t]) {
+			omp_set_num_threads(threadCounts[t]);
+		}
+#endif
+		MPI::COMM_WORLD.Barrier();
+		rooflines[t] = new Haparanda::Utils::Roofline(Haparanda::Utils::Roofline::measure());
+	}
+	for (std::size_t d=0; d<dimensionalities.size(); d++) {
+		for (std::size_t s=0; s<sizes.size(); s++) {
+			// Only one order for now, so it does not need to be passed on
+			for (std::size_t o=0; o<orders.size(); o++) {
+				for (std::size_t t=0; t<threadCounts.size(); t++) {
+#ifdef _OPENMP
+					omp_set_num_threads(0 < threadCounts[t] ? threadCounts[t] : defaultThreads);
+#endif
+					options.size = sizes[s];
+					options.roofline = rooflines[t];
+					Options configuration = options;
+					if (!tuningCacheFileName.empty()) {
+						useTunedConfiguration(dimensionalities[d], tuningCacheFileName, configuration);
+					}
+					runApplication(dimensionalities[d], configuration);
+				}
+			}
+		}
+	}
+	for (std::size_t t=0; t<rooflines.size(); t++) {
+		delete rooflines[t];
+	}
 	MPI::Finalize();
 	return 0;
 }
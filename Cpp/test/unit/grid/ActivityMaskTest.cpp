@@ -0,0 +1,153 @@
+#include "src/grid/ActivityMask.hpp"
+#include "src/iterators/ValueFieldIterator.hpp"
+#include "test/HaparandaTest.hpp"
+
+#include <array>
+#include <vector>
+
+#define DIM 2
+
+using namespace Haparanda::Grid;
+using namespace Haparanda::Iterators;
+
+/**
+ * Unit test for ActivityMask.
+ */
+class ActivityMaskTest : public HaparandaTest
+{
+protected:
+	// 4 tiles per dimension, where the last one has a single element
+	static const std::size_t SIZE = 10;
+	static const std::size_t TILE_SIZE = 3;
+	static const std::size_t TILES_PER_DIM = 4;
+
+	/**
+	 * @return Values which are zero except at the specified element
+	 */
+	static std::vector<double> pointValues(std::size_t x, std::size_t y, double value) {
+		std::vector<double> values(SIZE*SIZE, 0);
+		values[y*SIZE + x] = value;
+		return values;
+	}
+};
+
+TEST_F(ActivityMaskTest, TestUpdate) {
+	ActivityMask<DIM> mask(SIZE, TILE_SIZE, 0.5);
+	expect_equal(TILES_PER_DIM * TILES_PER_DIM, mask.getNumTiles());
+	std::vector<double> values = pointValues(4, 9, -1.0);
+	mask.update(&values[0]);
+	for (std::size_t t=0; t<mask.getNumTiles(); t++) {
+		EXPECT_EQ(3*TILES_PER_DIM + 1 == t, mask.isSignificant(t));
+	}
+	// Values below the threshold are negligible
+	values = pointValues(4, 9, 0.5);
+	mask.update(&values[0]);
+	for (std::size_t t=0; t<mask.getNumTiles(); t++) {
+		EXPECT_FALSE(mask.isSignificant(t));
+	}
+}
+
+TEST_F(ActivityMaskTest, TestComputeActive) {
+	ActivityMask<DIM> mask(SIZE, TILE_SIZE, 0);
+	std::vector<double> values = pointValues(0, 0, 1.0);
+	mask.update(&values[0]);
+	// A reach of 4 elements covers two tiles, along one dimension at the time
+	mask.computeActive(4);
+	expect_equal(std::size_t(5), mask.numActiveTiles());
+	for (std::size_t y=0; y<TILES_PER_DIM; y++) {
+		for (std::size_t x=0; x<TILES_PER_DIM; x++) {
+			bool expected = (0 == y && x <= 2) || (0 == x && y <= 2);
+			EXPECT_EQ(expected, mask.isActive(y*TILES_PER_DIM + x));
+		}
+	}
+	mask.computeActive(0);
+	expect_equal(std::size_t(1), mask.numActiveTiles());
+}
+
+TEST_F(ActivityMaskTest, TestMaxima) {
+	ActivityMask<DIM> mask(SIZE, TILE_SIZE, 0.1);
+	mask.resetMaxima();
+	std::vector<double> maxima(mask.getNumTiles(), 0.0);
+	maxima[2] = 0.2;
+	maxima[3] = 0.1;
+	mask.mergeMaxima(maxima);
+	for (std::size_t t=0; t<mask.getNumTiles(); t++) {
+		EXPECT_EQ(2 == t, mask.isSignificant(t));
+	}
+	BoundaryId upperX(0, false);
+	EXPECT_FALSE(mask.isSignificantNear(upperX, 1));
+	EXPECT_TRUE(mask.isSignificantNear(upperX, 2));
+	mask.setZero(3, true);
+	mask.markSignificantNear(upperX, 1);
+	EXPECT_TRUE(mask.isSignificant(3));
+	EXPECT_FALSE(mask.isZero(3));
+}
+
+TEST_F(ActivityMaskTest, TestPackAndUnpack) {
+	const std::size_t extent = 2;
+	ActivityMask<DIM> mask(SIZE, TILE_SIZE, 0);
+	std::vector<double> values = pointValues(7, 8, 3.0);
+	values[8*SIZE + 9] = 4.0;
+	std::vector<double> buffer(mask.getMaxPackedCount(0, extent));
+	expect_equal(TILES_PER_DIM + extent*SIZE, buffer.size());
+	// Upper boundary along dimension 0: Only the face tile with y in [6, 8] is significant
+	std::size_t count = mask.packBoundaryData(&values[0], 0, SIZE-extent, extent, &buffer[0]);
+	expect_equal(TILES_PER_DIM + extent*TILE_SIZE, count);
+	std::vector<double> ghost(extent*SIZE, -1.0);
+	mask.unpackBoundaryData(&buffer[0], count, 0, extent, &ghost[0]);
+	for (std::size_t y=0; y<SIZE; y++) {
+		for (std::size_t x=0; x<extent; x++) {
+			expect_equal(values[y*SIZE + SIZE-extent + x], ghost[y*extent + x]);
+		}
+	}
+}
+
+TEST_F(ActivityMaskTest, TestPackAndUnpackAlongY) {
+	const std::size_t extent = 2;
+	ActivityMask<DIM> mask(SIZE, TILE_SIZE, 0);
+	std::vector<double> values = pointValues(1, 8, 3.0);
+	values[9*SIZE + 9] = 4.0;
+	values[9*SIZE + 5] = 5.0;
+	std::vector<double> buffer(mask.getMaxPackedCount(1, extent));
+	// Upper boundary along dimension 1: The face tiles with x in [0, 2], [3, 5] and [9, 9] are significant
+	std::size_t count = mask.packBoundaryData(&values[0], 1, (SIZE-extent)*SIZE, extent, &buffer[0]);
+	expect_equal(TILES_PER_DIM + extent*(2*TILE_SIZE + 1), count);
+	std::vector<double> ghost(extent*SIZE, -1.0);
+	mask.unpackBoundaryData(&buffer[0], count, 1, extent, &ghost[0]);
+	for (std::size_t y=0; y<extent; y++) {
+		for (std::size_t x=0; x<SIZE; x++) {
+			expect_equal(values[(SIZE-extent+y)*SIZE + x], ghost[y*SIZE + x]);
+		}
+	}
+}
+
+TEST_F(ActivityMaskTest, TestAllZeroBoundary) {
+	const std::size_t extent = 2;
+	ActivityMask<DIM> mask(SIZE, TILE_SIZE, 0);
+	std::vector<double> values = pointValues(7, 8, 3.0);
+	std::vector<double> buffer(mask.getMaxPackedCount(1, extent));
+	// Lower boundary along dimension 1 is far from the non-zero value
+	expect_equal(std::size_t(0), mask.packBoundaryData(&values[0], 1, 0, extent, &buffer[0]));
+	std::vector<double> ghost(extent*SIZE, -1.0);
+	mask.unpackBoundaryData(&buffer[0], 0, 1, extent, &ghost[0]);
+	for (std::size_t i=0; i<ghost.size(); i++) {
+		expect_equal(0.0, ghost[i]);
+	}
+}
+
+TEST_F(ActivityMaskTest, TestSignificantAlong) {
+	ActivityMask<DIM> mask(SIZE, TILE_SIZE, 0.5);
+	expect_equal(TILE_SIZE, mask.getTileSize());
+	std::vector<double> values = pointValues(4, 9, 1.0);
+	mask.update(&values[0]);
+	std::array<std::size_t, DIM> sizes = {SIZE, SIZE};
+	ValueFieldIterator<DIM> iterator(sizes, &values[0]);
+	// Move to (4, 5), in the tile below the significant one
+	iterator.advance(5*SIZE + 4);
+	EXPECT_FALSE(mask.isSignificantAlong(iterator, 1, -5, 0));
+	EXPECT_FALSE(mask.isSignificantAlong(iterator, 1, 0, 3));
+	EXPECT_TRUE(mask.isSignificantAlong(iterator, 1, 0, 4));
+	// Offsets outside the array are ignored
+	EXPECT_TRUE(mask.isSignificantAlong(iterator, 1, 4, 20));
+	EXPECT_FALSE(mask.isSignificantAlong(iterator, 0, -4, 5));
+}
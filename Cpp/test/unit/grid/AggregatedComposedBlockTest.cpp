@@ -0,0 +1,73 @@
+#include "src/grid/AggregatedComposedBlock.hpp"
+#include "src/utils/Math.hpp"
+#include "test/HaparandaTest.hpp"
+
+#include <stdexcept>
+
+#define DIM 3  // Dimensionality of the test blocks
+
+using namespace Haparanda::Grid;
+using namespace Haparanda::Math;
+
+/**
+ * Unit test for AggregatedComposedBlocks.
+ */
+class AggregatedComposedBlockTest : public HaparandaTest
+{
+public:
+
+	virtual void SetUp() {
+		elementsPerDim = 7;
+		totalSize = power(elementsPerDim, DIM);
+		extent = 3;
+
+		values = new double[totalSize];
+		for (std::size_t i=0; i<totalSize; i++) {
+			values[i] = 1.7 * i;
+		}
+
+		block = new AggregatedComposedBlock<DIM>(elementsPerDim, extent, values);
+	}
+
+	virtual void TearDown() {
+		delete block;
+		delete []values;
+	}
+
+protected:
+	std::size_t elementsPerDim;
+	std::size_t totalSize;
+	std::size_t extent;
+	AggregatedComposedBlock<DIM> *block;
+
+private:
+	double *values;
+};
+
+
+/**
+ * Verify that receiveDoneAt refuses to wait when all ghost regions have been
+ * handed out, since waiting for another one would never end. (The exchange
+ * itself is tested by ComposedBlockExchangeTest.)
+ */
+TEST_F(AggregatedComposedBlockTest, TestAllHandedOut) {
+	block->startCommunication();
+	BoundaryId boundary;
+	for (int i=0; i<2*DIM; i++) {
+		block->receiveDoneAt(&boundary);
+	}
+	EXPECT_THROW(block->receiveDoneAt(&boundary), std::runtime_error);
+	block->finishCommunication();
+}
+
+/**
+ * Verify that nothing is aggregated when the block is its own neighbor
+ * along every dimension.
+ */
+TEST_F(AggregatedComposedBlockTest, TestNothingAggregated) {
+	for (std::size_t d=0; d<DIM; d++) {
+		EXPECT_FALSE(block->isAggregated(d, 0));
+		EXPECT_FALSE(block->isAggregated(d, 1));
+	}
+	expect_equal(std::size_t(0), block->numAggregatedMessages());
+}
@@ -1,7 +1,14 @@
+#include "src/grid/AggregatedComposedBlock.hpp"
+#include "src/grid/CollectiveComposedBlock.hpp"
 #include "src/grid/ComputationalComposedBlock.hpp"
+#include "src/grid/OneSidedComposedBlock.hpp"
+#include "src/grid/SharedMemoryComposedBlock.hpp"
 #include "src/utils/Math.hpp"
 #include "test/HaparandaTest.hpp"
 
+#include <cstdint>
+#include <vector>
+
 #define DIM 3  // Dimensionality of the test blocks
 
 using namespace Haparanda::Grid;
@@ -175,6 +182,65 @@ protected:
 		block->finishCommunication();
 	}
 
+	/**
+	 * Verify that the ghost regions are initialized correctly when the
+	 * boundary data is packed explicitly along one dimension at the time, and
+	 * along all dimensions at once.
+	 */
+	void testExplicitPacking() {
+		for (std::size_t d=0; d<DIM; d++) {
+			EXPECT_FALSE(block->isPackedExplicitly(d));
+			block->setExplicitPacking(d, true);
+			EXPECT_TRUE(block->isPackedExplicitly(d));
+			block->startCommunication();
+			verifyGhostRegionValues(*block);
+			block->finishCommunication();
+			block->setExplicitPacking(d, false);
+		}
+		for (std::size_t d=0; d<DIM; d++) {
+			block->setExplicitPacking(d, true);
+		}
+		block->startCommunication();
+		verifyGhostRegionValues(*block);
+		block->finishCommunication();
+	}
+
+	/**
+	 * Verify that the block is its own neighbor along every dimension (There
+	 * is only one processor!), and that the ghost regions are initialized
+	 * also when the data is copied without MPI. Do it twice to make sure that
+	 * all boundaries are handed out by receiveDoneAt in each step.
+	 */
+	void testOwnNeighbor() {
+		for (std::size_t d=0; d<DIM; d++) {
+			EXPECT_TRUE(block->isOwnNeighbor(d));
+		}
+		for (int step=0; step<2; step++) {
+			block->startCommunication();
+			verifyGhostRegionValues(*block);
+			block->finishCommunication();
+		}
+	}
+
+	/**
+	 * Verify that a block with 64-bit indices iterates with 64-bit indices
+	 * also over the ghost regions, and gets the same values as one with
+	 * 32-bit indices.
+	 */
+	void testWideIndices() {
+		ComputationalComposedBlock<DIM, std::uint64_t> wideBlock(elementsPerDim, extent, values);
+		BoundaryIterator<DIM> *boundaryIterator = wideBlock.getBoundaryIterator();
+		EXPECT_EQ(typeid(ComposedFieldBoundaryIterator<DIM, std::uint64_t>), typeid(*boundaryIterator));
+		delete boundaryIterator;
+		FieldIterator<DIM> *innerIterator = wideBlock.getInnerIterator();
+		EXPECT_EQ(typeid(ValueFieldIterator<DIM, std::uint64_t>), typeid(*innerIterator));
+		delete innerIterator;
+		wideBlock.startCommunication();
+		verifyInnerValues(wideBlock, values);
+		verifyGhostRegionValues(wideBlock);
+		wideBlock.finishCommunication();
+	}
+
 	/**
 	 * Verify that setValues changes the values stored in a block to the ones in
 	 * the array provided as argument and initializes the ghost regions
@@ -202,7 +268,7 @@ private:
 	 *
 	 * @param block Block for investigation
 	 */
-	void verifyGhostRegionValues(ComputationalComposedBlock<DIM>& block) {
+	void verifyGhostRegionValues(CommunicativeBlock<DIM>& block) {
 		BoundaryIterator<DIM> *boundaryIterator = block.getBoundaryIterator();
 		BoundaryIterator<DIM> *expectedValuesIterator = block.getBoundaryIterator();
 		BoundaryId boundary;
@@ -312,6 +378,20 @@ TEST_F(ComputationalComposedBlockTest, TestCommunication) {
 	testReceiveDoneAt();
 }
 
+/**
+ * Verify the communication when the boundary data is packed explicitly.
+ */
+TEST_F(ComputationalComposedBlockTest, TestExplicitPacking) {
+	testExplicitPacking();
+}
+
+/**
+ * Verify the communication when the block is its own neighbor.
+ */
+TEST_F(ComputationalComposedBlockTest, TestOwnNeighbor) {
+	testOwnNeighbor();
+}
+
 /**
  * Verify the behavior of procGridCoord and procGridSize.
  */
@@ -320,6 +400,13 @@ TEST_F(ComputationalComposedBlockTest, TestProcGrid) {
 	testProcGridSize();
 }
 
+/**
+ * Verify a block with 64-bit indices.
+ */
+TEST_F(ComputationalComposedBlockTest, TestWideIndices) {
+	testWideIndices();
+}
+
 /**
  * Verify the behavior of setValues.
  */
@@ -336,3 +423,135 @@ TEST_F(ComputationalComposedBlockDeathTest, TestBoundaryIterator) {
 	testCurrentBoundaryNeighbor();
 }
 #endif
+
+
+/**
+ * Create a block of the specified type, which exchanges its boundary data
+ * in its own way.
+ *
+ * @tparam BLOCK Type of the block
+ * @param elementsPerDim Block size in each dimension
+ * @param extent Width of the ghost regions
+ * @return The created block, without values
+ */
+template <typename BLOCK>
+BLOCK *createExchangingBlock(std::size_t elementsPerDim, std::size_t extent) {
+	return new BLOCK(elementsPerDim, extent);
+}
+
+template <>
+SharedMemoryComposedBlock<DIM> *createExchangingBlock(std::size_t elementsPerDim, std::size_t extent) {
+	return new SharedMemoryComposedBlock<DIM>(elementsPerDim, extent, 2);
+}
+
+/**
+ * Test of what all the subclasses of ComputationalComposedBlock which
+ * exchange the boundary data in other ways have in common. Each block has
+ * two value arrays, which are of its own if it keeps its values in shared
+ * memory.
+ *
+ * @tparam BLOCK Type of the block
+ */
+template <typename BLOCK>
+class ComposedBlockExchangeTest : public HaparandaTest
+{
+public:
+
+	virtual void SetUp() {
+		elementsPerDim = 7;
+		totalSize = power(elementsPerDim, DIM);
+		extent = 3;
+
+		block = createExchangingBlock<BLOCK>(elementsPerDim, extent);
+		for (std::size_t a=0; a<2; a++) {
+			ownValues[a].resize(totalSize);
+			double *values = valueArray(block, a);
+			for (std::size_t i=0; i<totalSize; i++) {
+				values[i] = 1.7 * i + a;
+			}
+		}
+	}
+
+	virtual void TearDown() {
+		delete block;
+	}
+
+protected:
+	std::size_t elementsPerDim;
+	std::size_t totalSize;
+	std::size_t extent;
+	BLOCK *block;
+
+	/**
+	 * Verify that receiveDoneAt hands out every boundary exactly once after
+	 * startCommunication, and that the ghost region outside that boundary is
+	 * then initialized with values from the opposite boundary (Values are
+	 * the same on all nodes!). Do this for both value arrays, first without
+	 * and then with explicit packing, to make sure that the boundary data is
+	 * taken from the current one.
+	 */
+	void testReceiveDoneAt() {
+		for (std::size_t round=0; round<2; round++) {
+			block->setValues(valueArray(block, round));
+			for (std::size_t d=0; d<DIM; d++) {
+				block->setExplicitPacking(d, 1==round);
+			}
+			block->startCommunication();
+			bool boundaryDone[DIM][2] = {};
+			BoundaryId initialized;
+			for (int i=0; i<2*DIM; i++) {
+				block->receiveDoneAt(&initialized);
+				std::size_t side = initialized.isLowerSide() ? 0 : 1;
+				EXPECT_FALSE(boundaryDone[initialized.getDimension()][side]);
+				boundaryDone[initialized.getDimension()][side] = true;
+				BoundaryIterator<DIM> *initializedIterator = block->getBoundaryIterator();
+				BoundaryIterator<DIM> *oppositeIterator = block->getBoundaryIterator();
+				initializedIterator->setBoundaryToIterate(initialized);
+				BoundaryId *oppositeBoundary = initialized.oppositeSide();
+				oppositeIterator->setBoundaryToIterate(*oppositeBoundary);
+				while (oppositeIterator->isInField()) {
+					for (std::size_t distance=0; distance<extent; distance++) {
+						int dir = initialized.isLowerSide() ? -1 : 1;
+						double expected = oppositeIterator->currentNeighbor(initialized.getDimension(), dir * distance);
+						double actual = initializedIterator->currentNeighbor(initialized.getDimension(), dir * (1+distance));
+						expect_equal(expected, actual);
+					}
+					oppositeIterator->next();
+					initializedIterator->next();
+				}
+				delete oppositeBoundary;
+				delete oppositeIterator;
+				delete initializedIterator;
+			}
+			block->finishCommunication();
+		}
+	}
+
+private:
+	std::vector<double> ownValues[2];	// Not used by blocks with values in shared memory
+
+	/**
+	 * @param block The block
+	 * @param index 0 or 1
+	 * @return The value array with the specified index
+	 */
+	template <typename ANY_BLOCK>
+	double *valueArray(ANY_BLOCK *block, std::size_t index) {
+		return &ownValues[index][0];
+	}
+
+	double *valueArray(SharedMemoryComposedBlock<DIM> *block, std::size_t index) {
+		return block->getValueArray(index);
+	}
+};
+
+typedef ::testing::Types<CollectiveComposedBlock<DIM>, OneSidedComposedBlock<DIM>, SharedMemoryComposedBlock<DIM>,
+		AggregatedComposedBlock<DIM> > ExchangingBlockTypes;
+TYPED_TEST_SUITE(ComposedBlockExchangeTest, ExchangingBlockTypes);
+
+/**
+ * Verify the behavior of receiveDoneAt (and implicitly startCommunication).
+ */
+TYPED_TEST(ComposedBlockExchangeTest, TestCommunication) {
+	this->testReceiveDoneAt();
+}
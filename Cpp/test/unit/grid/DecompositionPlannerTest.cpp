@@ -0,0 +1,114 @@
+#include "src/grid/DecompositionPlanner.hpp"
+#include "test/HaparandaTest.hpp"
+
+#include <vector>
+
+#define DIM 3  // Dimensionality of the processor grids
+
+using namespace Haparanda::Grid;
+
+/**
+ * Unit test for DecompositionPlanner.
+ */
+class DecompositionPlannerTest : public HaparandaTest
+{
+protected:
+	/**
+	 * Count the faces sent between nodes in each time step by placing the
+	 * processes according to the plan and checking the node of each neighbor.
+	 *
+	 * @param planner Planner of the decomposition
+	 * @param numProcesses Total number of processes
+	 * @param processesPerNode Number of processes on each node
+	 * @return Number of faces sent between processes on different nodes
+	 */
+	template <std::size_t D>
+	std::size_t countInterNodeFaces(const DecompositionPlanner<D>& planner, std::size_t numProcesses,
+			std::size_t processesPerNode) const {
+		std::vector<std::size_t> nodeOf(numProcesses);
+		for (std::size_t p=0; p<numProcesses; p++) {
+			nodeOf[planner.cartesianRank(p / processesPerNode, p % processesPerNode)] = p / processesPerNode;
+		}
+		std::size_t faces = 0;
+		for (std::size_t rank=0; rank<numProcesses; rank++) {
+			std::size_t stride = 1;
+			for (std::size_t d=D; d-- > 0; ) {
+				std::size_t size = planner.getProcessorGridSize(d);
+				std::size_t coordinate = rank / stride % size;
+				std::size_t lower = rank - coordinate*stride + (coordinate+size-1) % size * stride;
+				std::size_t upper = rank - coordinate*stride + (coordinate+1) % size * stride;
+				if (1 < size) {
+					faces += nodeOf[lower] != nodeOf[rank];
+					faces += nodeOf[upper] != nodeOf[rank];
+				}
+				stride *= size;
+			}
+		}
+		return faces;
+	}
+
+	/**
+	 * Verify that the plan is consistent: The grids contain all processes,
+	 * each process gets a rank of its own, and the predicted number of faces
+	 * matches the placement of the processes.
+	 */
+	void testConsistency(std::size_t numProcesses, std::size_t processesPerNode) {
+		DecompositionPlanner<DIM> planner(numProcesses, processesPerNode);
+		std::size_t processes = 1;
+		std::size_t processesOnNode = 1;
+		for (std::size_t d=0; d<DIM; d++) {
+			processes *= planner.getProcessorGridSize(d);
+			processesOnNode *= planner.getNodeGridSize(d);
+			expect_equal(std::size_t(0), planner.getProcessorGridSize(d) % planner.getNodeGridSize(d));
+		}
+		expect_equal(numProcesses, processes);
+		expect_equal(processesPerNode, processesOnNode);
+
+		std::vector<bool> taken(numProcesses, false);
+		for (std::size_t p=0; p<numProcesses; p++) {
+			std::size_t rank = planner.cartesianRank(p / processesPerNode, p % processesPerNode);
+			ASSERT_LT(rank, numProcesses);
+			EXPECT_FALSE(taken[rank]);
+			taken[rank] = true;
+		}
+		expect_equal(countInterNodeFaces(planner, numProcesses, processesPerNode), planner.interNodeFaces());
+	}
+};
+
+TEST_F(DecompositionPlannerTest, TestConsistency) {
+	std::size_t numProcesses[] = {1, 2, 4, 6, 8, 12, 16, 24, 36, 64};
+	std::size_t processesPerNode[] = {1, 2, 4, 6};
+	for (std::size_t i=0; i<sizeof(numProcesses)/sizeof(std::size_t); i++) {
+		for (std::size_t j=0; j<sizeof(processesPerNode)/sizeof(std::size_t); j++) {
+			if (0 == numProcesses[i] % processesPerNode[j]) {
+				testConsistency(numProcesses[i], processesPerNode[j]);
+			}
+		}
+	}
+}
+
+TEST_F(DecompositionPlannerTest, TestSingleNode) {
+	DecompositionPlanner<DIM> planner(8, 8);
+	expect_equal(std::size_t(0), planner.interNodeFaces());
+	expect_equal(std::size_t(2*8), planner.intraNodeFaces());
+	// Only the contiguous faces are exchanged
+	expect_equal(std::size_t(8), planner.getProcessorGridSize(DIM-1));
+}
+
+TEST_F(DecompositionPlannerTest, TestOneProcessPerNode) {
+	DecompositionPlanner<DIM> planner(8, 1);
+	expect_equal(std::size_t(2*8), planner.interNodeFaces());
+	expect_equal(std::size_t(0), planner.intraNodeFaces());
+	expect_equal(std::size_t(8), planner.getProcessorGridSize(DIM-1));
+}
+
+TEST_F(DecompositionPlannerTest, TestNodesAlongLastDim) {
+	DecompositionPlanner<2> planner(16, 4);
+	expect_equal(std::size_t(1), planner.getProcessorGridSize(0));
+	expect_equal(std::size_t(16), planner.getProcessorGridSize(1));
+	expect_equal(std::size_t(4), planner.getNodeGridSize(1));
+	// Only the two processes at the ends of each node send to another node
+	expect_equal(std::size_t(8), planner.interNodeFaces());
+	expect_equal(std::size_t(24), planner.intraNodeFaces());
+	expect_equal(std::size_t(5), planner.cartesianRank(1, 1));
+}
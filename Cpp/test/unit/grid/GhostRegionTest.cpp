@@ -144,6 +144,30 @@ protected:
 		delete behindIterator;
 	}
 
+	/**
+	 * Verify that getNumElements returns the total number of elements of the
+	 * ghost region, and that getValues returns the value array.
+	 */
+	void testGetValues() {
+		expect_equal(totalSize, region->getNumElements());
+		EXPECT_EQ(values, region->getValues());
+	}
+
+	/**
+	 * Verify that the ghost region uses an array set by setValues, and that
+	 * it does not delete that array.
+	 */
+	void testSetValues() {
+		double *newValues = new double[totalSize];
+		region->setValues(newValues);
+		EXPECT_EQ(newValues, region->getValues());
+		delete region;
+		region = NULL;
+		// The array must still be valid
+		newValues[totalSize-1] = 1.0;
+		delete []newValues;
+	}
+
 private:
 	double *copyOfValues() {
 		double *result = new double[totalSize];
@@ -184,5 +208,19 @@ TEST_F(GhostRegionTest, TestInnerIterator) {
 	testGetInnerIterator();
 }
 
+/**
+ * Verify the behavior of getNumElements and getValues.
+ */
+TEST_F(GhostRegionTest, TestValues) {
+	testGetValues();
+}
+
+/**
+ * Verify the behavior of setValues.
+ */
+TEST_F(GhostRegionTest, TestSetValues) {
+	testSetValues();
+}
+
 } /* namespace Grid */
 } /* namespace Haparanda */
@@ -0,0 +1,97 @@
+#include "src/grid/GridTransfer.hpp"
+#include "test/HaparandaTest.hpp"
+
+#include <vector>
+
+#define DIM 3
+
+using namespace Haparanda::Grid;
+
+/**
+ * Unit test for GridTransfer.
+ */
+class GridTransferTest : public HaparandaTest
+{
+protected:
+	static const std::size_t SIZE = 8;
+
+	/**
+	 * @return A polynomial of degree 5 in each coordinate, which the interpolation reproduces exactly
+	 */
+	static double polynomial(const double *x) {
+		double value = 0;
+		for (std::size_t d=0; d<DIM; d++) {
+			value += (d+1) * x[d]*x[d]*x[d]*x[d]*x[d] - x[d]*x[d] + 2*x[d];
+		}
+		return value;
+	}
+
+	/**
+	 * Resample the polynomial sampled at the integer points of a box of
+	 * SIZE^DIM points, and verify the result at every target point.
+	 */
+	void testResample(const std::array<double, DIM>& origin, const std::array<double, DIM>& spacing,
+			const std::array<std::size_t, DIM>& targetSize, std::size_t firstDim) {
+		std::vector<double> source(SIZE*SIZE*SIZE);
+		for (std::size_t k=0; k<source.size(); k++) {
+			double x[DIM] = {double(k%SIZE), double(k/SIZE%SIZE), double(k/SIZE/SIZE)};
+			source[k] = polynomial(x);
+		}
+		std::vector<double> target(targetSize[0] * targetSize[1] * targetSize[2]);
+		GridTransfer<DIM>::resample(&source[0], SIZE, origin, spacing, targetSize, firstDim, &target[0]);
+		for (std::size_t k=0; k<target.size(); k++) {
+			std::size_t t[DIM] = {k%targetSize[0], k/targetSize[0]%targetSize[1], k/targetSize[0]/targetSize[1]};
+			double x[DIM];
+			for (std::size_t d=0; d<DIM; d++) {
+				x[d] = origin[d] + t[d]*spacing[d];
+			}
+			expect_near(polynomial(x), target[k], 1e-8 * std::abs(polynomial(x)) + 1e-8);
+		}
+	}
+};
+
+TEST_F(GridTransferTest, TestProlongation) {
+	std::array<double, DIM> origin = {{0, 0, 0}};
+	std::array<double, DIM> spacing = {{0.5, 0.5, 0.5}};
+	std::array<std::size_t, DIM> targetSize = {{2*SIZE, 2*SIZE, 2*SIZE}};
+	testResample(origin, spacing, targetSize, 0);
+}
+
+TEST_F(GridTransferTest, TestRestriction) {
+	std::array<double, DIM> origin = {{0, 1, 0}};
+	std::array<double, DIM> spacing = {{2, 2, 2}};
+	std::array<std::size_t, DIM> targetSize = {{SIZE/2, SIZE/2, SIZE/2}};
+	testResample(origin, spacing, targetSize, 1);
+}
+
+TEST_F(GridTransferTest, TestGhostRegion) {
+	// The ghost region of a finer upper neighbor along dimension 2
+	std::array<double, DIM> origin = {{0, 0, 0}};
+	std::array<double, DIM> spacing = {{0.5, 0.5, 0.5}};
+	std::array<std::size_t, DIM> targetSize = {{2*SIZE, 2*SIZE, 4}};
+	testResample(origin, spacing, targetSize, 2);
+	// The ghost region of a coarser lower neighbor along dimension 1
+	origin[1] = SIZE - 2.0*2;
+	std::array<double, DIM> coarseSpacing = {{2, 2, 2}};
+	std::array<std::size_t, DIM> coarseTargetSize = {{SIZE/2, 2, SIZE/2}};
+	testResample(origin, coarseSpacing, coarseTargetSize, 1);
+}
+
+TEST_F(GridTransferTest, TestInjection) {
+	// Target points at source points get exactly the source values
+	std::vector<double> source(SIZE*SIZE*SIZE);
+	for (std::size_t k=0; k<source.size(); k++) {
+		source[k] = 1.0 / (k+1);
+	}
+	std::array<double, DIM> origin = {{1, 0, 2}};
+	std::array<double, DIM> spacing = {{2, 1, 2}};
+	std::array<std::size_t, DIM> targetSize = {{3, SIZE, 3}};
+	std::vector<double> target(3*SIZE*3);
+	GridTransfer<DIM>::resample(&source[0], SIZE, origin, spacing, targetSize, 0, &target[0]);
+	for (std::size_t k=0; k<target.size(); k++) {
+		std::size_t x = 1 + 2*(k%3);
+		std::size_t y = k/3%SIZE;
+		std::size_t z = 2 + 2*(k/3/SIZE);
+		expect_equal(source[x + SIZE*(y + SIZE*z)], target[k]);
+	}
+}
@@ -0,0 +1,100 @@
+#include "src/grid/HaloCompressor.hpp"
+#include "test/HaparandaTest.hpp"
+
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <vector>
+
+using namespace Haparanda::Grid;
+
+/**
+ * Unit test for HaloCompressor.
+ */
+class HaloCompressorTest : public HaparandaTest
+{
+protected:
+	static const std::size_t NUM_VALUES = 1001;
+
+	/**
+	 * Encode and decode the values, and verify that they are restored
+	 * exactly. Values which are not compressed are decoded as they are.
+	 *
+	 * @return Number of bytes of the message
+	 */
+	std::size_t testRoundTrip(HaloCompressor& compressor, const std::vector<double>& values) {
+		std::vector<unsigned char> message(HaloCompressor::maxMessageSize(values.size()));
+		std::size_t numBytes = compressor.encode(&values[0], values.size(), &message[0]);
+		EXPECT_LE(numBytes, message.size());
+		const unsigned char *sent = &message[0];
+		if (0 == numBytes) {
+			sent = reinterpret_cast<const unsigned char *>(&values[0]);
+			numBytes = values.size() * sizeof(double);
+		} else {
+			// Told apart from uncompressed values by the size
+			EXPECT_NE(std::size_t(0), numBytes % sizeof(double));
+		}
+		std::vector<double> decoded(values.size() + 1, -1.0);
+		expect_equal(values.size(), HaloCompressor::decode(sent, numBytes, &decoded[0], decoded.size()));
+		for (std::size_t i=0; i<values.size(); i++) {
+			expect_equal(values[i], decoded[i]);
+		}
+		return numBytes;
+	}
+};
+
+TEST_F(HaloCompressorTest, TestSmoothValues) {
+	HaloCompressor compressor(0);
+	std::vector<double> values(NUM_VALUES);
+	for (std::size_t i=0; i<values.size(); i++) {
+		values[i] = std::sin(0.001 * i) + 2;
+	}
+	std::size_t numBytes = testRoundTrip(compressor, values);
+	EXPECT_LT(numBytes, values.size() * sizeof(double));
+	EXPECT_LT(1.0, compressor.getCompressionRatio());
+}
+
+TEST_F(HaloCompressorTest, TestZeros) {
+	HaloCompressor compressor(0);
+	std::vector<double> values(NUM_VALUES, 0.0);
+	std::size_t numBytes = testRoundTrip(compressor, values);
+	// Only the number of values and the codes are left
+	expect_equal(sizeof(std::uint64_t) + (NUM_VALUES+1)/2, numBytes);
+	// A message whose size would be a multiple of the size of a double is padded
+	values.resize(15);
+	expect_equal(sizeof(std::uint64_t) + 8 + 1, testRoundTrip(compressor, values));
+}
+
+TEST_F(HaloCompressorTest, TestNoisyValues) {
+	HaloCompressor compressor(0);
+	std::vector<double> values(NUM_VALUES);
+	std::srand(1);
+	for (std::size_t i=0; i<values.size(); i++) {
+		values[i] = (std::rand() % 2 ? -1 : 1) * std::ldexp(std::rand(), std::rand() % 200 - 100);
+	}
+	// Incompressible values are sent as they are
+	expect_equal(NUM_VALUES * sizeof(double), testRoundTrip(compressor, values));
+	std::vector<unsigned char> message(HaloCompressor::maxMessageSize(0));
+	expect_equal(std::size_t(0), compressor.encode(NULL, 0, &message[0]));
+	expect_equal(std::size_t(0), HaloCompressor::decode(&message[0], 0, NULL, 0));
+}
+
+TEST_F(HaloCompressorTest, TestAdaptation) {
+	std::vector<double> values(NUM_VALUES);
+	for (std::size_t i=0; i<values.size(); i++) {
+		values[i] = std::sin(0.001 * i) + 2;
+	}
+	// Compression pays off on a slow link...
+	HaloCompressor slowLink(1.0);
+	testRoundTrip(slowLink, values);
+	EXPECT_TRUE(slowLink.isCompressing());
+	// ...but not on an infinitely fast one, where it is only tried every PROBE_INTERVAL:th time
+	HaloCompressor fastLink(std::numeric_limits<double>::infinity());
+	testRoundTrip(fastLink, values);
+	EXPECT_FALSE(fastLink.isCompressing());
+	for (std::size_t i=1; i<HaloCompressor::PROBE_INTERVAL; i++) {
+		expect_equal(NUM_VALUES * sizeof(double), testRoundTrip(fastLink, values));
+	}
+	EXPECT_LT(testRoundTrip(fastLink, values), NUM_VALUES * sizeof(double));
+	EXPECT_FALSE(fastLink.isCompressing());
+}
@@ -0,0 +1,103 @@
+#include "src/grid/LoadBalancer.hpp"
+#include "test/HaparandaTest.hpp"
+
+#include <vector>
+
+#define DIM 2  // Dimensionality of the grid of blocks
+
+using namespace Haparanda::Grid;
+
+/**
+ * Unit test for LoadBalancer.
+ */
+class LoadBalancerTest : public HaparandaTest
+{
+protected:
+	/**
+	 * @param owner Rank owning each block
+	 * @param numProcesses Number of processes
+	 * @return Number of blocks owned by each process
+	 */
+	std::vector<std::size_t> countBlocks(const std::vector<int>& owner, int numProcesses) const {
+		std::vector<std::size_t> count(numProcesses, 0);
+		for (std::size_t id=0; id<owner.size(); id++) {
+			count[owner[id]]++;
+		}
+		return count;
+	}
+};
+
+TEST_F(LoadBalancerTest, TestCurve) {
+	std::size_t numBlocks[DIM] = {3, 4};
+	LoadBalancer<DIM> balancer(numBlocks, 1);
+	const std::vector<std::size_t>& curve = balancer.getCurve();
+	ASSERT_EQ(std::size_t(12), curve.size());
+	// Each block appears once
+	std::vector<bool> found(12, false);
+	for (std::size_t i=0; i<curve.size(); i++) {
+		ASSERT_LT(curve[i], std::size_t(12));
+		EXPECT_FALSE(found[curve[i]]);
+		found[curve[i]] = true;
+	}
+	// The first 2x2 quadrant comes first, in Z order
+	expect_equal(std::size_t(0), curve[0]);
+	expect_equal(std::size_t(1), curve[1]);
+	expect_equal(std::size_t(4), curve[2]);
+	expect_equal(std::size_t(5), curve[3]);
+}
+
+TEST_F(LoadBalancerTest, TestPartitionEqualSpeeds) {
+	std::size_t numBlocks[DIM] = {4, 4};
+	LoadBalancer<DIM> balancer(numBlocks, 4);
+	std::vector<double> work(16, 1.0);
+	std::vector<int> owner;
+	balancer.partition(work, owner);
+	std::vector<std::size_t> count = countBlocks(owner, 4);
+	for (int rank=0; rank<4; rank++) {
+		expect_equal(std::size_t(4), count[rank]);
+	}
+	// With a power of two grid, each part of the curve is a 2x2 quadrant
+	expect_equal(0, owner[0]);
+	expect_equal(0, owner[5]);
+	expect_equal(3, owner[15]);
+	expect_near(1.0, balancer.imbalance(work, owner), 1e-12);
+}
+
+TEST_F(LoadBalancerTest, TestEstimateAndPartitionDifferentSpeeds) {
+	std::size_t numBlocks[DIM] = {2, 4};
+	LoadBalancer<DIM> balancer(numBlocks, 2);
+	// Rank 0 owns the first half of the blocks, and needs three times as long per block
+	std::vector<int> owner(8);
+	std::vector<double> blockTime(8);
+	for (std::size_t id=0; id<8; id++) {
+		owner[id] = id < 4 ? 0 : 1;
+		blockTime[id] = id < 4 ? 3.0 : 1.0;
+	}
+	std::vector<double> work;
+	balancer.estimate(blockTime, std::vector<double>(8, 1.0), owner, work);
+	for (std::size_t id=0; id<8; id++) {
+		expect_near(1.0, work[id], 1e-12);
+	}
+	expect_near(3.0, balancer.getSpeed(1) / balancer.getSpeed(0), 1e-12);
+	expect_near(12.0 / 8, balancer.imbalance(work, owner), 1e-12);
+
+	std::vector<int> newOwner;
+	balancer.partition(work, newOwner);
+	std::vector<std::size_t> count = countBlocks(newOwner, 2);
+	expect_equal(std::size_t(2), count[0]);
+	expect_equal(std::size_t(6), count[1]);
+	expect_near(1.0, balancer.imbalance(work, newOwner), 1e-12);
+}
+
+TEST_F(LoadBalancerTest, TestEveryProcessGetsBlocks) {
+	std::size_t numBlocks[DIM] = {2, 2};
+	LoadBalancer<DIM> balancer(numBlocks, 4);
+	balancer.setSpeed(0, 100.0);
+	std::vector<double> work(4, 1.0);
+	std::vector<int> owner;
+	balancer.partition(work, owner);
+	std::vector<std::size_t> count = countBlocks(owner, 4);
+	for (int rank=0; rank<4; rank++) {
+		expect_equal(std::size_t(1), count[rank]);
+	}
+}
@@ -0,0 +1,113 @@
+#include "src/grid/MappedBlock.hpp"
+#include "test/HaparandaTest.hpp"
+#include "src/utils/Math.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+
+#define DIM 3  // Dimensionality of the test blocks
+
+using namespace Haparanda::Grid;
+using namespace Haparanda::Math;
+
+/**
+ * Unit test for MappedBlock.
+ */
+class MappedBlockTest : public HaparandaTest
+{
+public:
+	virtual void SetUp() {
+		char pattern[] = "/tmp/MappedBlockTestXXXXXX";
+		ASSERT_TRUE(NULL != mkdtemp(pattern));
+		directory = pattern;
+		inputFileName = directory + "/input";
+		resultFileName = directory + "/result";
+	}
+
+	virtual void TearDown() {
+		std::remove(inputFileName.c_str());
+		std::remove(resultFileName.c_str());
+		rmdir(directory.c_str());
+	}
+
+protected:
+	static const std::size_t ELEMENTS_PER_DIM = 24;
+	static const std::size_t WINDOW_SLABS = 2;
+	std::string directory;
+	std::string inputFileName;
+	std::string resultFileName;
+
+	/**
+	 * Set each value of the block to its linear index, using all threads.
+	 */
+	void initialize(MappedBlock<DIM>& block) {
+#pragma omp parallel
+		{
+			FieldIterator<DIM> *iterator = block.getInnerIterator();
+			while (iterator->isInField()) {
+				std::size_t index = 0;
+				for (std::size_t d=DIM; d-->0; ) {
+					index = index * ELEMENTS_PER_DIM + iterator->currentIndex(d);
+				}
+				iterator->setCurrentValue(index);
+				iterator->next();
+			}
+			delete iterator;
+		}
+	}
+};
+
+TEST_F(MappedBlockTest, TestValuesPersist) {
+	std::size_t totalSize = power(ELEMENTS_PER_DIM, DIM);
+	{
+		MappedBlock<DIM> block(ELEMENTS_PER_DIM, inputFileName, WINDOW_SLABS);
+		initialize(block);
+		block.sync();
+		// Each thread prefetches at least its first slabs, and the slabs are streamed through
+		EXPECT_LE(WINDOW_SLABS + 1, block.getNumPrefetched());
+		EXPECT_LT(std::size_t(0), block.getNumReleased());
+	}
+	MappedBlock<DIM> block(ELEMENTS_PER_DIM, inputFileName, WINDOW_SLABS);
+	for (std::size_t i=0; i<totalSize; i++) {
+		expect_equal(double(i), block.getValues()[i]);
+	}
+	EXPECT_THROW(block.setValues(NULL), std::runtime_error);
+	// The file must match the block size
+	EXPECT_THROW(MappedBlock<DIM>(ELEMENTS_PER_DIM - 1, inputFileName, WINDOW_SLABS), std::runtime_error);
+	EXPECT_THROW(MappedBlock<DIM>(ELEMENTS_PER_DIM, resultFileName, 0), std::runtime_error);
+}
+
+TEST_F(MappedBlockTest, TestStreamedNeighbors) {
+	MappedBlock<DIM> input(ELEMENTS_PER_DIM, inputFileName, WINDOW_SLABS);
+	MappedBlock<DIM> result(ELEMENTS_PER_DIM, resultFileName, WINDOW_SLABS);
+	initialize(input);
+	// Sum of the neighbors along the last dimension, whose slabs are streamed
+	std::size_t slabSize = power(ELEMENTS_PER_DIM, DIM-1);
+#pragma omp parallel
+	{
+		FieldIterator<DIM> *inputIterator = input.getInnerIterator();
+		FieldIterator<DIM> *resultIterator = result.getInnerIterator();
+		while (inputIterator->isInField()) {
+			std::size_t slab = inputIterator->currentIndex(DIM-1);
+			double sum = 0;
+			if (slab > 0) {
+				sum += inputIterator->currentNeighbor(DIM-1, -1);
+			}
+			if (slab+1 < ELEMENTS_PER_DIM) {
+				sum += inputIterator->currentNeighbor(DIM-1, 1);
+			}
+			resultIterator->setCurrentValue(sum);
+			inputIterator->next();
+			resultIterator->next();
+		}
+		delete inputIterator;
+		delete resultIterator;
+	}
+	result.sync();
+	for (std::size_t i=0; i<power(ELEMENTS_PER_DIM, DIM); i++) {
+		std::size_t slab = i / slabSize;
+		double expected = (slab > 0 ? i - slabSize : 0.0) + (slab+1 < ELEMENTS_PER_DIM ? i + slabSize : 0.0);
+		expect_equal(expected, result.getValues()[i]);
+	}
+}
@@ -0,0 +1,79 @@
+#include "src/grid/SharedMemoryComposedBlock.hpp"
+#include "src/utils/Math.hpp"
+#include "test/HaparandaTest.hpp"
+
+#include <stdexcept>
+
+#define DIM 3  // Dimensionality of the test blocks
+
+using namespace Haparanda::Grid;
+using namespace Haparanda::Math;
+
+/**
+ * Unit test for SharedMemoryComposedBlocks.
+ */
+class SharedMemoryComposedBlockTest : public HaparandaTest
+{
+public:
+
+	virtual void SetUp() {
+		elementsPerDim = 7;
+		totalSize = power(elementsPerDim, DIM);
+		extent = 3;
+
+		block = new SharedMemoryComposedBlock<DIM>(elementsPerDim, extent, 2);
+		for (std::size_t a=0; a<2; a++) {
+			double *values = block->getValueArray(a);
+			for (std::size_t i=0; i<totalSize; i++) {
+				values[i] = 1.7 * i + a;
+			}
+		}
+	}
+
+	virtual void TearDown() {
+		delete block;
+	}
+
+protected:
+	std::size_t elementsPerDim;
+	std::size_t totalSize;
+	std::size_t extent;
+	SharedMemoryComposedBlock<DIM> *block;
+
+	/**
+	 * Verify that the value arrays do not overlap, and that no neighbor
+	 * shares memory with this process (The neighbors are the process itself,
+	 * whose ghost regions are copied!)
+	 */
+	void testValueArrays() {
+		EXPECT_TRUE(block->getValueArray(0) + totalSize <= block->getValueArray(1));
+		for (std::size_t d=0; d<DIM; d++) {
+			EXPECT_FALSE(block->sharesMemoryWith(d, 0));
+			EXPECT_FALSE(block->sharesMemoryWith(d, 1));
+		}
+	}
+};
+
+
+/**
+ * Verify the behavior of getValueArray and sharesMemoryWith.
+ */
+TEST_F(SharedMemoryComposedBlockTest, TestValueArrays) {
+	testValueArrays();
+}
+
+/**
+ * Verify that receiveDoneAt refuses to wait when all ghost regions have been
+ * handed out, since waiting for another one would never end. (The exchange
+ * itself is tested by ComposedBlockExchangeTest.)
+ */
+TEST_F(SharedMemoryComposedBlockTest, TestAllHandedOut) {
+	block->setValues(block->getValueArray(0));
+	block->startCommunication();
+	BoundaryId boundary;
+	for (int i=0; i<2*DIM; i++) {
+		block->receiveDoneAt(&boundary);
+	}
+	EXPECT_THROW(block->receiveDoneAt(&boundary), std::runtime_error);
+	block->finishCommunication();
+}
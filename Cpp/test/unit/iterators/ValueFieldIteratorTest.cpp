@@ -81,6 +81,22 @@ namespace Iterators {
 			}
 		}
 
+		/**
+		 * Verify that advance takes the specified number of steps, and stops
+		 * after the last element.
+		 */
+		void testAdvance() {
+			iterator->first();
+			iterator->advance(0);
+			expect_equal(values[0], iterator->currentValue());
+			iterator->advance(5);
+			expect_equal(values[5], iterator->currentValue());
+			iterator->advance(totalSize - 6);
+			expect_equal(values[totalSize-1], iterator->currentValue());
+			iterator->advance(2);
+			EXPECT_FALSE(iterator->isInField());
+		}
+
 		void testFirst() {
 			FieldIteratorTest::testFirst(iterator);
 		}
@@ -325,6 +341,7 @@ namespace Iterators {
 	 */
 	TEST_F(ValueFieldIteratorTest, TestIteration) {
 		testFirst();
+		testAdvance();
 		// next is implicitly tested by the other tests.
 	}
 
@@ -1,6 +1,8 @@
 #include "src/iterators/WholeFieldStepper.hpp"
 #include "test/HaparandaTest.hpp"
 
+#include <stdexcept>
+
 #define ORDER 3
 
 namespace Haparanda {
@@ -165,6 +167,29 @@ namespace Iterators {
 			}
 			delete []timesTouched;
 		}
+
+		/**
+		 * Verify that a field of order 6 with 100^6 elements can be stepped
+		 * through with 64-bit indices, but not with 32-bit ones.
+		 */
+		void testWideIndex() {
+			std::array<std::size_t, 6> wideSize;
+			wideSize.fill(100);
+			EXPECT_THROW(WholeFieldStepper<6> narrowStrategy(wideSize), std::runtime_error);
+			WholeFieldStepper<6, std::uint64_t> wideStrategy(wideSize);
+			std::array<std::size_t, 6> index = {{99, 1, 42, 0, 77, 99}};
+			std::size_t linearIndex = 0;
+			for (std::size_t d=6; d-->0; ) {
+				linearIndex = linearIndex * 100 + index[d];
+			}
+			wideStrategy.index = linearIndex;
+			for (std::size_t d=0; d<6; d++) {
+				EXPECT_EQ(index[d], wideStrategy.currentIndex(d));
+			}
+			EXPECT_EQ(linearIndex - 10000000000ull, wideStrategy.linearNeighborIndex(5, -1));
+			EXPECT_FALSE(wideStrategy.neighborInField(5, 1));
+			EXPECT_TRUE(wideStrategy.neighborInField(4, 22));
+		}
 	};
 
 
@@ -290,6 +315,13 @@ namespace Iterators {
 		testParallelStepping();
 	}
 
+	/**
+	 * Verify stepping through a field too large for 32-bit indices.
+	 */
+	TEST_F(WholeFieldStepperTest, TestWideIndex) {
+		testWideIndex();
+	}
+
 
 #ifndef MPI_LIB
 	/**
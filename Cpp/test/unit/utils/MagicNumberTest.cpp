@@ -0,0 +1,53 @@
+#include "src/utils/MagicNumber.hpp"
+#include "test/HaparandaTest.hpp"
+
+#include <vector>
+
+using namespace Haparanda::Utils;
+
+/**
+ * Unit test for MagicNumber and MagicNumber64.
+ */
+class MagicNumberTest : public HaparandaTest
+{
+protected:
+	/**
+	 * @return Divisors and dividends of interest with at most the specified number of bits
+	 */
+	std::vector<uint64_t> getNumbers(int bits) {
+		uint64_t max = 64 == bits ? std::numeric_limits<uint64_t>::max() : (uint64_t(1) << bits) - 1;
+		std::vector<uint64_t> numbers = {1, 2, 3, 5, 7, 10, 100, 641, 1000, 6700417, max, max-1, max/3, max/7};
+		for (int b=1; b<bits; b++) {
+			uint64_t powerOfTwo = uint64_t(1) << b;
+			numbers.push_back(powerOfTwo - 1);
+			numbers.push_back(powerOfTwo);
+			numbers.push_back(powerOfTwo + 1);
+		}
+		// Strides of large high-dimensional fields
+		for (uint64_t stride=100; stride<=max/100; stride*=100) {
+			numbers.push_back(stride);
+			numbers.push_back(stride * 99 + 98);
+		}
+		return numbers;
+	}
+};
+
+TEST_F(MagicNumberTest, TestDivide32) {
+	std::vector<uint64_t> numbers = getNumbers(32);
+	for (std::size_t i=0; i<numbers.size(); i++) {
+		MagicNumber magic = MagicNumber::getMagicNumbers(numbers[i]);
+		for (std::size_t j=0; j<numbers.size(); j++) {
+			EXPECT_EQ(numbers[j] / numbers[i], magic.divide(numbers[j])) << numbers[j] << "/" << numbers[i];
+		}
+	}
+}
+
+TEST_F(MagicNumberTest, TestDivide64) {
+	std::vector<uint64_t> numbers = getNumbers(64);
+	for (std::size_t i=0; i<numbers.size(); i++) {
+		MagicNumber64 magic = MagicNumber64::getMagicNumbers(numbers[i]);
+		for (std::size_t j=0; j<numbers.size(); j++) {
+			EXPECT_EQ(numbers[j] / numbers[i], magic.divide(numbers[j])) << numbers[j] << "/" << numbers[i];
+		}
+	}
+}
@@ -0,0 +1,59 @@
+#include "src/utils/PerformanceCounters.hpp"
+#include "test/HaparandaTest.hpp"
+
+using namespace Haparanda::Utils;
+
+/**
+ * Unit test for PerformanceCounters. The hardware counters are often not
+ * available where the tests run, so only the CPU time is required.
+ */
+class PerformanceCountersTest : public HaparandaTest
+{
+protected:
+	/**
+	 * @return A value computed in a loop of the specified length
+	 */
+	static double work(std::size_t iterations) {
+		volatile double sum = 0;
+		for (std::size_t i=0; i<iterations; i++) {
+			sum = sum + 0.5 * i;
+		}
+		return sum;
+	}
+};
+
+TEST_F(PerformanceCountersTest, TestPhases) {
+	const std::size_t ITERATIONS = 10000000;
+	PerformanceCounters counters(1);
+	EXPECT_TRUE(counters.isAvailable(PerformanceCounters::CPU_TIME));
+	PerformanceCounters::Reading start = PerformanceCounters::read();
+	work(ITERATIONS);
+	counters.add(PerformanceCounters::INTERIOR, start);
+	start = PerformanceCounters::read();
+	work(ITERATIONS / 100);
+	counters.add(PerformanceCounters::BOUNDARY, start);
+
+	EXPECT_LT(std::uint64_t(0), counters.total(PerformanceCounters::INTERIOR, PerformanceCounters::CPU_TIME));
+	EXPECT_LT(counters.total(PerformanceCounters::BOUNDARY, PerformanceCounters::CPU_TIME),
+			counters.total(PerformanceCounters::INTERIOR, PerformanceCounters::CPU_TIME));
+	if (counters.isAvailable(PerformanceCounters::INSTRUCTIONS)) {
+		EXPECT_LT(std::uint64_t(ITERATIONS), counters.total(PerformanceCounters::INTERIOR, PerformanceCounters::INSTRUCTIONS));
+	} else {
+		expect_equal(std::size_t(0), std::size_t(counters.total(PerformanceCounters::INTERIOR, PerformanceCounters::INSTRUCTIONS)));
+	}
+	counters.reset();
+	expect_equal(std::size_t(0), std::size_t(counters.total(PerformanceCounters::INTERIOR, PerformanceCounters::CPU_TIME)));
+}
+
+TEST_F(PerformanceCountersTest, TestPerThread) {
+	const int NUM_THREADS = 4;
+	PerformanceCounters counters(NUM_THREADS);
+#pragma omp parallel num_threads(NUM_THREADS)
+	{
+		PerformanceCounters::Reading start = PerformanceCounters::read();
+		work(1000000);
+		counters.add(PerformanceCounters::INTERIOR, start);
+	}
+	EXPECT_LT(std::uint64_t(0), counters.total(PerformanceCounters::INTERIOR, PerformanceCounters::CPU_TIME));
+	expect_equal(std::size_t(0), std::size_t(counters.total(PerformanceCounters::BOUNDARY, PerformanceCounters::CPU_TIME)));
+}
@@ -0,0 +1,93 @@
+#define HAPARANDA_PROFILE
+#include "src/utils/Profiler.hpp"
+#include "test/HaparandaTest.hpp"
+
+#include <sstream>
+#include <thread>
+
+using namespace Haparanda::Utils;
+
+/**
+ * Unit test for Profiler.
+ */
+class ProfilerTest : public HaparandaTest
+{
+public:
+	virtual void SetUp() {
+		Profiler::reset();
+	}
+
+protected:
+	/**
+	 * Exchange and compute along all boundaries, like a time step does.
+	 */
+	void step(std::size_t dims) {
+		HAPARANDA_REGION("step");
+		{
+			HAPARANDA_REGION("interior");
+		}
+		for (std::size_t d=0; d<dims; d++) {
+			for (int side=0; side<2; side++) {
+				HAPARANDA_REGION_START(waitStart);
+				HAPARANDA_REGION_ADD("wait", d, side, waitStart);
+				HAPARANDA_REGION_AT("boundary", d, side);
+			}
+		}
+	}
+};
+
+TEST_F(ProfilerTest, TestNesting) {
+	const std::size_t STEPS = 3;
+	const std::size_t DIMS = 2;
+	for (std::size_t i=0; i<STEPS; i++) {
+		step(DIMS);
+	}
+	const Profiler::Region& root = Profiler::ownRegions();
+	const Profiler::Region *stepRegion = root.find("step");
+	ASSERT_TRUE(NULL != stepRegion);
+	expect_equal(STEPS, std::size_t(stepRegion->calls));
+	EXPECT_TRUE(NULL == root.find("interior"));
+	// Interior, and wait and boundary per boundary
+	expect_equal(1 + 2 * 2 * DIMS, stepRegion->children.size());
+	std::uint64_t nestedTime = 0;
+	for (std::size_t i=0; i<stepRegion->children.size(); i++) {
+		expect_equal(STEPS, std::size_t(stepRegion->children[i]->calls));
+		nestedTime += stepRegion->children[i]->nanoseconds;
+	}
+	EXPECT_LE(nestedTime, stepRegion->nanoseconds);
+	const Profiler::Region *boundary = stepRegion->find("boundary", 1, 1);
+	ASSERT_TRUE(NULL != boundary);
+	EXPECT_TRUE(NULL == stepRegion->find("boundary", 2, 0));
+	EXPECT_TRUE(boundary->parent == stepRegion);
+
+	std::ostringstream report;
+	Profiler::report(report);
+	EXPECT_NE(std::string::npos, report.str().find("    boundary[1][upper]"));
+	EXPECT_NE(std::string::npos, report.str().find("    wait[0][lower]"));
+
+	Profiler::reset();
+	EXPECT_TRUE(NULL == Profiler::ownRegions().find("step"));
+}
+
+TEST_F(ProfilerTest, TestPerThread) {
+	const std::size_t NUM_THREADS = 4;
+	const Profiler::Region *threadRegions[NUM_THREADS];
+	std::vector<std::thread> threads;
+	for (std::size_t t=0; t<NUM_THREADS; t++) {
+		threads.push_back(std::thread([t, &threadRegions]() {
+			for (std::size_t i=0; i<=t; i++) {
+				HAPARANDA_REGION("work");
+			}
+			threadRegions[t] = &Profiler::ownRegions();
+		}));
+	}
+	for (std::size_t t=0; t<NUM_THREADS; t++) {
+		threads[t].join();
+	}
+	// The regions are kept after the threads have exited
+	for (std::size_t t=0; t<NUM_THREADS; t++) {
+		const Profiler::Region *work = threadRegions[t]->find("work");
+		ASSERT_TRUE(NULL != work);
+		expect_equal(t + 1, std::size_t(work->calls));
+	}
+}
@@ -0,0 +1,31 @@
+#include "src/utils/Roofline.hpp"
+#include "test/HaparandaTest.hpp"
+
+#include <stdexcept>
+
+using namespace Haparanda::Utils;
+
+/**
+ * Unit test for Roofline.
+ */
+class RooflineTest : public HaparandaTest
+{
+};
+
+TEST_F(RooflineTest, TestAttainable) {
+	Roofline roofline(10e9, 40e9);
+	expect_equal(4.0, roofline.ridgePoint());
+	expect_equal(5e9, roofline.attainableFlops(0.5));
+	expect_equal(40e9, roofline.attainableFlops(4));
+	expect_equal(40e9, roofline.attainableFlops(100));
+	EXPECT_THROW(Roofline(0, 1), std::runtime_error);
+}
+
+TEST_F(RooflineTest, TestProbes) {
+	Roofline roofline = Roofline::measure(1 << 20, 100000);
+	// Loose bounds which any machine running the tests should meet
+	EXPECT_LT(1e8, roofline.getBandwidth());
+	EXPECT_GT(1e14, roofline.getBandwidth());
+	EXPECT_LT(1e8, roofline.getPeakFlops());
+	EXPECT_GT(1e14, roofline.getPeakFlops());
+}
@@ -0,0 +1,143 @@
+#include "src/utils/SnapshotWriter.hpp"
+#include "test/HaparandaTest.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+using namespace Haparanda::Utils;
+
+/**
+ * Unit test for SnapshotWriter.
+ */
+class SnapshotWriterTest : public HaparandaTest
+{
+public:
+	virtual void SetUp() {
+		char pattern[] = "/tmp/SnapshotWriterTestXXXXXX";
+		ASSERT_TRUE(NULL != mkdtemp(pattern));
+		directory = pattern;
+		values.resize(NUM_VALUES);
+		for (std::size_t i=0; i<values.size(); i++) {
+			values[i] = 0.5 * i - 17;
+		}
+	}
+
+	virtual void TearDown() {
+		for (std::size_t i=0; i<fileNames.size(); i++) {
+			std::remove(fileNames[i].c_str());
+		}
+		rmdir(directory.c_str());
+	}
+
+protected:
+	static const std::size_t NUM_VALUES = 3000;	// Not a multiple of the alignment
+	std::string directory;
+	std::vector<std::string> fileNames;
+	std::vector<double> values;
+
+	/**
+	 * @return Name of a file in the test directory, which is removed after the test
+	 */
+	std::string fileName(std::size_t step) {
+		std::ostringstream name;
+		name << directory << "/" << step << ".snap";
+		fileNames.push_back(name.str());
+		return name.str();
+	}
+
+	/**
+	 * Verify that the specified file contains a snapshot of values, offset
+	 * by the step, at the specified step.
+	 */
+	void verifySnapshot(const std::string& fileName, std::size_t step) {
+		std::ifstream file(fileName.c_str(), std::ios::binary);
+		ASSERT_TRUE(file.good());
+		std::uint64_t header[3];
+		file.read(reinterpret_cast<char *>(header), sizeof(header));
+		std::uint64_t magic = SnapshotWriter::MAGIC;
+		EXPECT_EQ(magic, header[0]);
+		expect_equal(step, std::size_t(header[1]));
+		expect_equal(NUM_VALUES, std::size_t(header[2]));
+		std::vector<double> read(NUM_VALUES + 1);
+		file.seekg(SnapshotWriter::HEADER_SIZE);
+		file.read(reinterpret_cast<char *>(&read[0]), read.size() * sizeof(double));
+		// The file ends after the values
+		expect_equal(NUM_VALUES * sizeof(double), std::size_t(file.gcount()));
+		for (std::size_t i=0; i<NUM_VALUES; i++) {
+			expect_equal(values[i] + step, read[i]);
+		}
+	}
+
+	/**
+	 * Write snapshots of values, offset by the step, at the specified number
+	 * of steps.
+	 *
+	 * @return Number of snapshots not dropped
+	 */
+	std::size_t writeSnapshots(SnapshotWriter& writer, std::size_t numSteps) {
+		std::size_t numWritten = 0;
+		std::vector<double> current(values);
+		for (std::size_t step=0; step<numSteps; step++) {
+			if (writer.write(&current[0], current.size(), fileName(step), step)) {
+				numWritten++;
+			}
+			// The snapshot is taken at the call
+			for (std::size_t i=0; i<current.size(); i++) {
+				current[i] += 1;
+			}
+		}
+		return numWritten;
+	}
+};
+
+TEST_F(SnapshotWriterTest, TestBackpressure) {
+	const std::size_t NUM_STEPS = 5;
+	{
+		// Only one buffer, so that each write waits for the previous one
+		SnapshotWriter writer(SnapshotWriter::stagingSize(NUM_VALUES));
+		expect_equal(NUM_STEPS, writeSnapshots(writer, NUM_STEPS));
+		writer.flush();
+		expect_equal(NUM_STEPS, writer.getNumWritten());
+		expect_equal(std::size_t(0), writer.getNumDropped());
+		expect_equal(NUM_STEPS * (SnapshotWriter::HEADER_SIZE + NUM_VALUES * sizeof(double)), writer.getBytesWritten());
+	}
+	for (std::size_t step=0; step<NUM_STEPS; step++) {
+		verifySnapshot(fileNames[step], step);
+	}
+}
+
+TEST_F(SnapshotWriterTest, TestDropWhenFull) {
+	const std::size_t NUM_STEPS = 20;
+	std::size_t numKept;
+	{
+		SnapshotWriter writer(2 * SnapshotWriter::stagingSize(NUM_VALUES), true);
+		numKept = writeSnapshots(writer, NUM_STEPS);
+		// At least the snapshots fitting in the budget are kept
+		EXPECT_LE(std::size_t(2), numKept);
+		writer.flush();
+		expect_equal(numKept, writer.getNumWritten());
+		expect_equal(NUM_STEPS, writer.getNumWritten() + writer.getNumDropped());
+	}
+	std::size_t numFound = 0;
+	for (std::size_t step=0; step<NUM_STEPS; step++) {
+		if (std::ifstream(fileNames[step].c_str()).good()) {
+			verifySnapshot(fileNames[step], step);
+			numFound++;
+		}
+	}
+	expect_equal(numKept, numFound);
+}
+
+TEST_F(SnapshotWriterTest, TestErrors) {
+	SnapshotWriter writer(SnapshotWriter::stagingSize(NUM_VALUES));
+	// Larger than the budget
+	EXPECT_THROW(writer.write(&values[0], NUM_VALUES + 1000, fileName(0), 0), std::runtime_error);
+	// The error of the background thread is reported by the next call
+	EXPECT_TRUE(writer.write(&values[0], NUM_VALUES, directory + "/missing/0.snap", 0));
+	EXPECT_THROW(writer.flush(), std::runtime_error);
+	expect_equal(std::size_t(0), writer.getNumWritten());
+}
@@ -0,0 +1,44 @@
+#include "src/utils/Statistics.hpp"
+#include "test/HaparandaTest.hpp"
+
+#include <cmath>
+#include <stdexcept>
+
+using namespace Haparanda::Utils;
+
+/**
+ * Unit test for Statistics.
+ */
+class StatisticsTest : public HaparandaTest
+{
+};
+
+TEST_F(StatisticsTest, TestSummary) {
+	Statistics statistics;
+	EXPECT_THROW(statistics.median(), std::runtime_error);
+	// 1 to 100, in a scrambled order
+	for (std::size_t i=0; i<100; i++) {
+		statistics.add((i * 37) % 100 + 1);
+	}
+	expect_equal(std::size_t(100), statistics.count());
+	expect_equal(1.0, statistics.min());
+	expect_equal(100.0, statistics.max());
+	expect_equal(50.5, statistics.mean());
+	expect_equal(50.5, statistics.median());
+	expect_equal(99.01, statistics.percentile(99));
+	expect_equal(1.0, statistics.percentile(0));
+	expect_equal(100.0, statistics.percentile(100));
+	expect_equal(std::sqrt(100.0 * 101 / 12), statistics.standardDeviation());
+}
+
+TEST_F(StatisticsTest, TestSingleSample) {
+	Statistics statistics;
+	statistics.add(2.5);
+	expect_equal(2.5, statistics.median());
+	expect_equal(2.5, statistics.percentile(99));
+	expect_equal(0.0, statistics.standardDeviation());
+	// Adding after sorting
+	statistics.add(0.5);
+	expect_equal(0.5, statistics.min());
+	expect_equal(1.5, statistics.median());
+}
@@ -0,0 +1,125 @@
+#include "src/utils/TuningCache.hpp"
+#include "test/HaparandaTest.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+
+using namespace Haparanda::Utils;
+
+/**
+ * Unit test for TuningCache.
+ */
+class TuningCacheTest : public HaparandaTest
+{
+public:
+	virtual void SetUp() {
+		char pattern[] = "/tmp/TuningCacheTestXXXXXX";
+		int file = mkstemp(pattern);
+		ASSERT_NE(-1, file);
+		close(file);
+		std::remove(pattern);
+		fileName = pattern;
+		key.host = "host/model/8";
+		key.dimensionality = 3;
+		key.size = 64;
+		key.order = 8;
+		key.processes = 4;
+		key.threads = 8;
+		key.decomposition = "default";
+		key.processesPerNode = 0;
+		key.linkBandwidth = -1;
+		key.checkpoints = false;
+	}
+
+	virtual void TearDown() {
+		std::remove(fileName.c_str());
+	}
+
+protected:
+	std::string fileName;
+	TuningCache::Key key;
+
+	/**
+	 * @return A configuration with the specified exchange mode and number of threads
+	 */
+	static TuningCache::Configuration configuration(const std::string& exchange, int threads) {
+		TuningCache::Configuration configuration;
+		configuration.exchange = exchange;
+		configuration.packedDimensions = 5;
+		configuration.blocksPerProcessDim = 2;
+		configuration.threads = threads;
+		configuration.seconds = 0.125;
+		return configuration;
+	}
+};
+
+TEST_F(TuningCacheTest, TestMissingFile) {
+	TuningCache cache(fileName);
+	TuningCache::Configuration found;
+	expect_equal(std::size_t(0), cache.size());
+	EXPECT_FALSE(cache.find(key, &found));
+}
+
+TEST_F(TuningCacheTest, TestPersistence) {
+	{
+		TuningCache cache(fileName);
+		cache.store(key, configuration("collective", 4));
+	}
+	TuningCache cache(fileName);
+	TuningCache::Configuration found;
+	ASSERT_TRUE(cache.find(key, &found));
+	EXPECT_EQ("collective", found.exchange);
+	EXPECT_EQ(5u, found.packedDimensions);
+	expect_equal(std::size_t(2), found.blocksPerProcessDim);
+	expect_equal(4, found.threads);
+	expect_equal(0.125, found.seconds);
+}
+
+TEST_F(TuningCacheTest, TestKey) {
+	TuningCache cache(fileName);
+	cache.store(key, configuration("p2p", 8));
+	TuningCache::Configuration found;
+	TuningCache::Key other = key;
+	other.processes = 2;
+	EXPECT_FALSE(cache.find(other, &found));
+	other = key;
+	other.linkBandwidth = 10;
+	EXPECT_FALSE(cache.find(other, &found));
+	other = key;
+	other.checkpoints = true;
+	EXPECT_FALSE(cache.find(other, &found));
+	other = key;
+	other.decomposition = "planned";
+	EXPECT_FALSE(cache.find(other, &found));
+	other = key;
+	other.host = "other/model/8";
+	EXPECT_FALSE(cache.find(other, &found));
+	// A new configuration of the same problem replaces the old one
+	cache.store(key, configuration("onesided", 2));
+	cache.store(other, configuration("shared", 8));
+	TuningCache reread(fileName);
+	expect_equal(std::size_t(2), reread.size());
+	ASSERT_TRUE(reread.find(key, &found));
+	EXPECT_EQ("onesided", found.exchange);
+	expect_equal(2, found.threads);
+	ASSERT_TRUE(reread.find(other, &found));
+	EXPECT_EQ("shared", found.exchange);
+}
+
+TEST_F(TuningCacheTest, TestMalformedFile) {
+	std::ofstream file(fileName.c_str());
+	file << "host\t3\t64" << std::endl;
+	file.close();
+	EXPECT_THROW(TuningCache cache(fileName), std::runtime_error);
+}
+
+TEST_F(TuningCacheTest, TestHostSignature) {
+	std::string signature = TuningCache::hostSignature();
+	EXPECT_FALSE(signature.empty());
+	EXPECT_EQ(std::string::npos, signature.find('\t'));
+	EXPECT_EQ(signature, TuningCache::hostSignature());
+}